@@ -4,7 +4,22 @@
 //
 
 #include <iostream> // cin, cout
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <speechapi_cxx.h>
+#include "mp3_frame_index.h"
 
 using namespace Microsoft::CognitiveServices::Speech;
 using namespace Microsoft::CognitiveServices::Speech::Audio;
@@ -37,51 +52,218 @@ static int ReadCompressedBinaryData(void *stream, uint8_t *ptr, uint32_t bufSize
     }
 }
 
-void recognizeSpeech(const std::string& compressedFileName)
+// A compressed file read by a pull stream, counting the bytes the stream has read from it.
+struct CountingFile
 {
-    std::shared_ptr<SpeechRecognizer> recognizer;
-    std::shared_ptr<PullAudioInputStream> pullAudioStream;
-
-    void *compressedFilePtr = OpenCompressedFile(compressedFileName);
+    FILE* file = NULL;
+    std::atomic<uint64_t> bytesRead{ 0 };
+};
 
-    if (compressedFilePtr == NULL)
-    {
-        std::cout << "Error: Input file doesn't exist" << std::endl;
-        return;
-    }
+static int ReadCountingFile(void* stream, uint8_t* ptr, uint32_t bufSize)
+{
+    auto countingFile = (CountingFile*)stream;
+    auto count = ReadCompressedBinaryData(countingFile->file, ptr, bufSize);
+    countingFile->bytesRead += count;
+    return count;
+}
 
-    // Creates an instance of a speech config with specified subscription key and service region.
-    // Replace with your own subscription key and service region (e.g., "westus").
-    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+static void CloseCountingFile(void* stream)
+{
+    auto countingFile = (CountingFile*)stream;
+    closeStream(countingFile->file);
+    countingFile->file = NULL;
+}
 
-    AudioStreamContainerFormat inputFormat;
+static bool EndsWith(const std::string& value, const std::string& suffix)
+{
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
 
-    if (compressedFileName.find(".mp3") == (compressedFileName.size() - 4))
+// Maps the file extension to the container format of the compressed audio.
+static bool GetContainerFormat(const std::string& compressedFileName, AudioStreamContainerFormat& inputFormat)
+{
+    if (EndsWith(compressedFileName, ".mp3"))
     {
         inputFormat = AudioStreamContainerFormat::MP3;
     }
-    else if (compressedFileName.find(".opus") == (compressedFileName.size() - 5))
+    else if (EndsWith(compressedFileName, ".opus"))
     {
         inputFormat = AudioStreamContainerFormat::OGG_OPUS;
     }
-    else if (compressedFileName.find(".alaw") == (compressedFileName.size() - 5))
+    else if (EndsWith(compressedFileName, ".alaw"))
     {
         inputFormat = AudioStreamContainerFormat::ALAW;
     }
-    else if (compressedFileName.find(".mulaw") == (compressedFileName.size() - 6))
+    else if (EndsWith(compressedFileName, ".mulaw"))
     {
         inputFormat = AudioStreamContainerFormat::MULAW;
     }
-    else if (compressedFileName.find(".flac") == (compressedFileName.size() - 5))
+    else if (EndsWith(compressedFileName, ".flac"))
     {
         inputFormat = AudioStreamContainerFormat::FLAC;
     }
     else
     {
+        return false;
+    }
+    return true;
+}
+
+static size_t ReadAt(FILE* file, uint64_t offset, uint8_t* buffer, size_t size)
+{
+    if (fseeko(file, (off_t)offset, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+    return fread(buffer, 1, size, file);
+}
+
+// Duration of an Ogg Opus file: the granule position of its last page, in 48 kHz samples, less the
+// pre-skip from the OpusHead header. Returns 0 if the file isn't laid out as expected.
+static double OggOpusDurationSeconds(FILE* file, uint64_t fileSize)
+{
+    // The first page: a 27-byte header, up to 255 segment sizes, then the OpusHead packet.
+    uint8_t head[512];
+    auto count = ReadAt(file, 0, head, sizeof(head));
+    if (count < 27 || memcmp(head, "OggS", 4) != 0)
+    {
+        return 0;
+    }
+    size_t packet = 27 + head[26];
+    if (count < packet + 12 || memcmp(head + packet, "OpusHead", 8) != 0)
+    {
+        return 0;
+    }
+    uint64_t preSkip = head[packet + 10] | (head[packet + 11] << 8);
+
+    // A page is at most 65307 bytes, so the last one starts in the last 64 KB.
+    std::vector<uint8_t> tail((size_t)std::min<uint64_t>(fileSize, 65536));
+    count = ReadAt(file, fileSize - tail.size(), tail.data(), tail.size());
+    for (size_t i = count >= 14 ? count - 14 + 1 : 0; i-- > 0;)
+    {
+        if (memcmp(&tail[i], "OggS", 4) != 0)
+        {
+            continue;
+        }
+        uint64_t granulePosition = 0;
+        for (int b = 7; b >= 0; b--)
+        {
+            granulePosition = (granulePosition << 8) | tail[i + 6 + b];
+        }
+        // -1 marks a page on which no packet ends.
+        if (granulePosition != UINT64_MAX)
+        {
+            return granulePosition > preSkip ? (granulePosition - preSkip) / 48000.0 : 0;
+        }
+    }
+    return 0;
+}
+
+// Duration of a FLAC file from its STREAMINFO block. Returns 0 if the file doesn't start with it.
+static double FlacDurationSeconds(FILE* file)
+{
+    // "fLaC", the 4-byte header of the first metadata block, then STREAMINFO.
+    uint8_t head[26];
+    if (ReadAt(file, 0, head, sizeof(head)) != sizeof(head) || memcmp(head, "fLaC", 4) != 0 || (head[4] & 0x7F) != 0)
+    {
+        return 0;
+    }
+    uint32_t sampleRate = (head[18] << 12) | (head[19] << 4) | (head[20] >> 4);
+    uint64_t totalSamples = ((uint64_t)(head[21] & 0x0F) << 32) | ((uint64_t)head[22] << 24) | (head[23] << 16) | (head[24] << 8) | head[25];
+    return sampleRate == 0 ? 0 : (double)totalSamples / sampleRate;
+}
+
+// Duration of the audio in a compressed file, from the stream itself. Returns 0 if it can't be
+// determined. The MP3 frame index is built without the cache, so that batches don't leave an index
+// file per input behind; it may scan the whole file.
+static double CompressedAudioDurationSeconds(const std::string& compressedFileName, AudioStreamContainerFormat inputFormat, uint64_t fileSize)
+{
+    switch (inputFormat)
+    {
+    case AudioStreamContainerFormat::MP3:
+        try
+        {
+            return Mp3FrameIndex::Build(compressedFileName).DurationSeconds();
+        }
+        catch (const std::exception&)
+        {
+            return 0;
+        }
+    case AudioStreamContainerFormat::ALAW:
+    case AudioStreamContainerFormat::MULAW:
+        // G.711: one byte per sample at 8 kHz.
+        return fileSize / 8000.0;
+    default:
+        break;
+    }
+
+    FILE* file = fopen(compressedFileName.c_str(), "rb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    auto durationSeconds = inputFormat == AudioStreamContainerFormat::OGG_OPUS ? OggOpusDurationSeconds(file, fileSize) :
+        inputFormat == AudioStreamContainerFormat::FLAC ? FlacDurationSeconds(file) : 0;
+    fclose(file);
+    return durationSeconds;
+}
+
+void recognizeSpeech(const std::string& compressedFileName, double startSeconds)
+{
+    std::shared_ptr<SpeechRecognizer> recognizer;
+    std::shared_ptr<PullAudioInputStream> pullAudioStream;
+
+    void *compressedFilePtr = OpenCompressedFile(compressedFileName);
+
+    if (compressedFilePtr == NULL)
+    {
+        std::cout << "Error: Input file doesn't exist" << std::endl;
+        return;
+    }
+
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    AudioStreamContainerFormat inputFormat;
+
+    if (!GetContainerFormat(compressedFileName, inputFormat))
+    {
+        closeStream(compressedFilePtr);
         std::cout << "Only Opus and MP3 input files are currently supported" << std::endl;
         return;
     }
 
+    if (startSeconds > 0)
+    {
+        if (inputFormat != AudioStreamContainerFormat::MP3)
+        {
+            closeStream(compressedFilePtr);
+            std::cout << "Starting at a given time is only supported for MP3 files" << std::endl;
+            return;
+        }
+
+        // Compressed streams are read forward only, so the file is positioned at the frame
+        // boundary nearest to the start time before the stream is created.
+        double frameSeconds = 0;
+        try
+        {
+            auto frameIndex = Mp3FrameIndex::LoadOrBuild(compressedFileName);
+            // fseeko takes a 64-bit off_t (see _FILE_OFFSET_BITS in the Makefile), unlike fseek's long.
+            if (fseeko((FILE*)compressedFilePtr, (off_t)frameIndex.FindFrame(startSeconds, &frameSeconds), SEEK_SET) != 0)
+            {
+                throw std::runtime_error("Failed to seek to the start time.");
+            }
+        }
+        catch (const std::exception& e)
+        {
+            closeStream(compressedFilePtr);
+            std::cout << "Error: " << e.what() << std::endl;
+            return;
+        }
+        std::cout << "Starting at " << frameSeconds << " s, recognition offsets are relative to this time." << std::endl;
+    }
+
     pullAudioStream = AudioInputStream::CreatePullStream(
         AudioStreamFormat::GetCompressedFormat(inputFormat),
         compressedFilePtr,
@@ -119,13 +301,294 @@ void recognizeSpeech(const std::string& compressedFileName)
     }
 }
 
+// Outcome of recognizing one file in directory/manifest mode.
+struct FileRecognitionResult
+{
+    std::string fileName;
+    bool succeeded = false;
+    std::string errorDetails;
+    double latencySeconds = 0;  // wall-clock time from creating the stream until the session stopped.
+    double audioSeconds = 0;    // duration of the audio fed to the recognizer.
+};
+
+// Recognizes all utterances in a compressed file with continuous recognition, and writes the
+// recognized text to <outputDirectory>/<file name>.txt, one phrase per line.
+static FileRecognitionResult recognizeFileContinuous(std::shared_ptr<SpeechConfig> config, const std::string& compressedFileName, const std::string& outputDirectory)
+{
+    FileRecognitionResult fileResult;
+    fileResult.fileName = compressedFileName;
+
+    AudioStreamContainerFormat inputFormat;
+    if (!GetContainerFormat(compressedFileName, inputFormat))
+    {
+        fileResult.errorDetails = "unsupported file extension";
+        return fileResult;
+    }
+
+    // Declared before the stream and the recognizer, which read it, so that it outlives them.
+    CountingFile input;
+    input.file = (FILE*)OpenCompressedFile(compressedFileName);
+    struct stat status;
+    if (input.file == NULL || fstat(fileno(input.file), &status) != 0)
+    {
+        closeStream(input.file);
+        fileResult.errorDetails = "input file doesn't exist";
+        return fileResult;
+    }
+    auto fileSize = (uint64_t)status.st_size;
+    // Read before the clock starts, so that the latency is only the recognition's.
+    auto durationSeconds = CompressedAudioDurationSeconds(compressedFileName, inputFormat, fileSize);
+    auto start = std::chrono::steady_clock::now();
+
+    auto baseName = compressedFileName.substr(compressedFileName.find_last_of('/') + 1);
+    auto outputFileName = (outputDirectory.empty() ? compressedFileName : outputDirectory + "/" + baseName) + ".txt";
+    std::ofstream output(outputFileName);
+    if (!output.good())
+    {
+        closeStream(input.file);
+        fileResult.errorDetails = "cannot create " + outputFileName;
+        return fileResult;
+    }
+
+    auto pullAudioStream = AudioInputStream::CreatePullStream(
+        AudioStreamFormat::GetCompressedFormat(inputFormat),
+        &input,
+        ReadCountingFile,
+        CloseCountingFile
+    );
+    auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(pullAudioStream));
+
+    // Recognition ends either with SessionStopped or with a cancellation because of an error;
+    // both may be raised for the same session, so the end is signaled through a flag.
+    std::mutex mutex;
+    std::condition_variable recognitionEnd;
+    bool done = false;
+
+    recognizer->Recognized.Connect([&](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            output << e.Result->Text << "\n";
+        }
+    });
+
+    recognizer->Canceled.Connect([&](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        if (e.Reason == CancellationReason::Error)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fileResult.errorDetails = e.ErrorDetails;
+            done = true;
+            recognitionEnd.notify_one();
+        }
+    });
+
+    recognizer->SessionStopped.Connect([&](const SessionEventArgs& e)
+    {
+        UNUSED(e);
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        recognitionEnd.notify_one();
+    });
+
+    recognizer->StartContinuousRecognitionAsync().get();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        recognitionEnd.wait(lock, [&done] { return done; });
+    }
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    fileResult.succeeded = fileResult.errorDetails.empty();
+    // The share of the file the recognizer read, which is all of it unless recognition was canceled.
+    fileResult.audioSeconds = fileSize == 0 ? 0 : durationSeconds * std::min<uint64_t>(input.bytesRead, fileSize) / fileSize;
+    fileResult.latencySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return fileResult;
+}
+
+// Lists the files with a supported extension in a directory, sorted by name.
+static std::vector<std::string> ListCompressedFiles(const std::string& directoryName)
+{
+    std::vector<std::string> files;
+    DIR* dir = opendir(directoryName.c_str());
+    if (dir == NULL)
+    {
+        return files;
+    }
+
+    AudioStreamContainerFormat inputFormat;
+    while (struct dirent* entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (GetContainerFormat(name, inputFormat))
+        {
+            files.push_back(directoryName + "/" + name);
+        }
+    }
+    closedir(dir);
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Reads a manifest with one file name per line. Empty lines and lines starting with '#' are skipped.
+static std::vector<std::string> ReadManifest(const std::string& manifestFileName)
+{
+    std::vector<std::string> files;
+    std::ifstream manifest(manifestFileName);
+    std::string line;
+    while (std::getline(manifest, line))
+    {
+        if (!line.empty() && line[0] != '#')
+        {
+            files.push_back(line);
+        }
+    }
+    return files;
+}
+
+static double Percentile(const std::vector<double>& sortedValues, double percentile)
+{
+    if (sortedValues.empty())
+    {
+        return 0;
+    }
+    auto index = static_cast<size_t>(percentile / 100 * (sortedValues.size() - 1) + 0.5);
+    return sortedValues[index];
+}
+
+// Recognizes many files with at most 'concurrency' recognizers running at the same time, and
+// prints an aggregate throughput report at the end.
+void recognizeFiles(const std::vector<std::string>& compressedFileNames, size_t concurrency, const std::string& outputDirectory)
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    // The config is shared by all recognizers.
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    std::vector<FileRecognitionResult> results(compressedFileNames.size());
+    std::atomic<size_t> nextFile(0);
+    std::mutex consoleMutex;
+
+    std::cout << "Recognizing " << compressedFileNames.size() << " files with " << concurrency << " concurrent sessions ..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+
+    // Each worker runs one recognition session at a time, which bounds the number of concurrent sessions.
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min(concurrency, compressedFileNames.size()); i++)
+    {
+        workers.emplace_back([&]()
+        {
+            size_t index;
+            while ((index = nextFile++) < compressedFileNames.size())
+            {
+                // An exception, e.g. from creating the recognizer or starting recognition, fails the file only.
+                try
+                {
+                    results[index] = recognizeFileContinuous(config, compressedFileNames[index], outputDirectory);
+                }
+                catch (const std::exception& e)
+                {
+                    results[index].fileName = compressedFileNames[index];
+                    results[index].succeeded = false;
+                    results[index].errorDetails = e.what();
+                }
+
+                std::lock_guard<std::mutex> lock(consoleMutex);
+                const auto& result = results[index];
+                if (result.succeeded)
+                {
+                    std::cout << "DONE: " << result.fileName << " (" << result.latencySeconds << " s)" << std::endl;
+                }
+                else
+                {
+                    std::cout << "FAILED: " << result.fileName << ": " << result.errorDetails << std::endl;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    auto wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t succeeded = 0;
+    double audioSeconds = 0;
+    std::vector<double> latencies;
+    for (const auto& result : results)
+    {
+        if (result.succeeded)
+        {
+            succeeded++;
+            audioSeconds += result.audioSeconds;
+            latencies.push_back(result.latencySeconds);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "\nFiles: " << succeeded << " succeeded, " << (results.size() - succeeded) << " failed" << std::endl;
+    std::cout << "Wall time: " << wallSeconds << " s" << std::endl;
+    std::cout << "Audio recognized: " << audioSeconds / 3600 << " h" << std::endl;
+    std::cout << "Throughput: " << (wallSeconds > 0 ? audioSeconds / wallSeconds : 0) << " audio-hours per wall-hour" << std::endl;
+    std::cout << "Per-file latency: p50=" << Percentile(latencies, 50) << " s, p99=" << Percentile(latencies, 99) << " s" << std::endl;
+}
+
+static void printUsage()
+{
+    std::cout << "Usage: ./compressed-audio-input <filename> [--start <seconds>]" << std::endl;
+    std::cout << "       ./compressed-audio-input --dir <directory> [--concurrency <n>] [--output <directory>]" << std::endl;
+    std::cout << "       ./compressed-audio-input --manifest <file> [--concurrency <n>] [--output <directory>]" << std::endl;
+}
+
 int main(int argc, char **argv) {
-    if (argc != 2)
+    if ((argc == 2 || (argc == 4 && std::string(argv[2]) == "--start")) && argv[1][0] != '-')
+    {
+        setlocale(LC_ALL, "");
+        recognizeSpeech(argv[1], argc == 4 ? atof(argv[3]) : 0);
+        return 0;
+    }
+
+    std::vector<std::string> files;
+    size_t concurrency = 8;
+    std::string outputDirectory;
+    bool hasInput = false;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i];
+        if (option == "--dir")
+        {
+            files = ListCompressedFiles(argv[i + 1]);
+            hasInput = true;
+        }
+        else if (option == "--manifest")
+        {
+            files = ReadManifest(argv[i + 1]);
+            hasInput = true;
+        }
+        else if (option == "--concurrency")
+        {
+            concurrency = std::max(1, atoi(argv[i + 1]));
+        }
+        else if (option == "--output")
+        {
+            outputDirectory = argv[i + 1];
+        }
+        else
+        {
+            hasInput = false;
+            break;
+        }
+    }
+
+    if (!hasInput || argc % 2 == 0)
     {
-        std::cout << "Usage: ./compressed-audio-input <filename>" << std::endl;
+        printUsage();
         return 0;
     }
     setlocale(LC_ALL, "");
-    recognizeSpeech(argv[1]);
+    recognizeFiles(files, concurrency, outputDirectory);
     return 0;
 }
@@ -0,0 +1,549 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Index of MP3 frame boundaries, used to start decoding a compressed stream at a given time.
+// The index is built from the Xing/Info or VBRI header when the file has one, otherwise by
+// scanning all frame headers. It is cached in an index file in a cache directory, named after the
+// path of the MP3 file, and rebuilt when the MP3 file changes.
+class Mp3FrameIndex final
+{
+public:
+    // A frame boundary and the number of samples decoded before it.
+    struct SeekPoint
+    {
+        uint64_t byteOffset;
+        uint64_t sampleOffset;
+    };
+
+    // Identifies the version of an MP3 file an index was built for: its size, its modification
+    // time and a hash of its first bytes, so that an edited file of the same size is detected too.
+    struct FileIdentity
+    {
+        uint64_t size;
+        int64_t modifiedSeconds;
+        int64_t modifiedNanoseconds;
+        uint64_t headHash;
+
+        bool operator==(const FileIdentity& other) const
+        {
+            return size == other.size && modifiedSeconds == other.modifiedSeconds &&
+                modifiedNanoseconds == other.modifiedNanoseconds && headHash == other.headHash;
+        }
+    };
+
+    // Identifies the current version of the MP3 file. Throws std::invalid_argument if it is missing.
+    static FileIdentity Identify(const std::string& fileName)
+    {
+        struct stat status;
+        if (stat(fileName.c_str(), &status) != 0)
+        {
+            throw std::invalid_argument("Failed to open the specified MP3 file.");
+        }
+
+        FileIdentity identity;
+        identity.size = (uint64_t)status.st_size;
+        identity.modifiedSeconds = (int64_t)status.st_mtim.tv_sec;
+        identity.modifiedNanoseconds = (int64_t)status.st_mtim.tv_nsec;
+
+        std::vector<uint8_t> head((size_t)std::min<uint64_t>(identity.size, (uint64_t)identityHashSize));
+        std::ifstream fs(fileName, std::ios_base::binary | std::ios_base::in);
+        fs.read((char*)head.data(), head.size());
+        identity.headHash = Fnv1a(0xcbf29ce484222325ull, head.data(), (size_t)fs.gcount());
+        return identity;
+    }
+
+    // Loads the index from the cache directory, or builds it and writes it there if it is not
+    // cached or was built for a different version of the MP3 file. With an empty cache directory,
+    // the index is built and not written anywhere.
+    static Mp3FrameIndex LoadOrBuild(const std::string& mp3FileName, const std::string& cacheDirectory = DefaultCacheDirectory())
+    {
+        auto identity = Identify(mp3FileName);
+        auto indexFileName = cacheDirectory.empty() ? std::string() : IndexFileName(mp3FileName, cacheDirectory);
+        Mp3FrameIndex index;
+        if (!indexFileName.empty() && index.Load(indexFileName, identity))
+        {
+            return index;
+        }
+
+        index = Build(mp3FileName);
+        index.m_identity = identity;
+        if (!indexFileName.empty() && CreateDirectories(cacheDirectory))
+        {
+            index.Save(indexFileName);
+        }
+        return index;
+    }
+
+    // $XDG_CACHE_HOME/compressed-audio-input, or ~/.cache/compressed-audio-input. Empty if neither
+    // variable is set.
+    static std::string DefaultCacheDirectory()
+    {
+        auto cacheHome = getenv("XDG_CACHE_HOME");
+        if (cacheHome != nullptr && cacheHome[0] == '/')
+        {
+            return std::string(cacheHome) + "/compressed-audio-input";
+        }
+        auto home = getenv("HOME");
+        if (home != nullptr && home[0] != '\0')
+        {
+            return std::string(home) + "/.cache/compressed-audio-input";
+        }
+        return std::string();
+    }
+
+    // The index file of an MP3 file in the cache directory, named after a hash of its absolute path.
+    static std::string IndexFileName(const std::string& mp3FileName, const std::string& cacheDirectory)
+    {
+        char absolutePath[PATH_MAX];
+        auto path = realpath(mp3FileName.c_str(), absolutePath) != nullptr ? std::string(absolutePath) : mp3FileName;
+        auto hash = Fnv1a(0xcbf29ce484222325ull, (const uint8_t*)path.data(), path.size());
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.idx", (unsigned long long)hash);
+        return cacheDirectory + "/" + name;
+    }
+
+    // Builds the index from the MP3 file.
+    static Mp3FrameIndex Build(const std::string& mp3FileName)
+    {
+        FileWindow file(mp3FileName);
+        Mp3FrameIndex index;
+        index.m_identity = Identify(mp3FileName);
+
+        auto position = SkipId3v2Tag(file);
+        FrameHeader header;
+        if (!FindFrame(file, position, header))
+        {
+            throw std::runtime_error("No MP3 frame found.");
+        }
+        index.m_sampleRate = header.sampleRate;
+
+        if (!index.BuildFromXingHeader(file, position, header) && !index.BuildFromVbriHeader(file, position, header))
+        {
+            index.BuildByScanning(file, position);
+        }
+        return index;
+    }
+
+    // Sample rate of the audio.
+    uint32_t SampleRate() const
+    {
+        return m_sampleRate;
+    }
+
+    // Duration of the audio in seconds.
+    double DurationSeconds() const
+    {
+        return m_sampleRate == 0 ? 0 : (double)m_totalSamples / m_sampleRate;
+    }
+
+    // True if the index was built from a Xing/VBRI table of contents. Seek points are frame
+    // boundaries, but their times are interpolated from the table and may be off by a few frames.
+    bool IsApproximate() const
+    {
+        return m_approximate;
+    }
+
+    const std::vector<SeekPoint>& SeekPoints() const
+    {
+        return m_seekPoints;
+    }
+
+    // Finds the last frame boundary at or before the given time, in O(log n).
+    // Returns the byte offset of the frame, and its time in seconds in 'frameSeconds'.
+    uint64_t FindFrame(double seconds, double* frameSeconds = nullptr) const
+    {
+        if (m_seekPoints.empty())
+        {
+            throw std::runtime_error("The MP3 frame index is empty.");
+        }
+
+        auto sample = (uint64_t)(std::max(seconds, 0.0) * m_sampleRate);
+        auto it = std::upper_bound(m_seekPoints.begin(), m_seekPoints.end(), sample,
+            [](uint64_t value, const SeekPoint& point) { return value < point.sampleOffset; });
+        if (it != m_seekPoints.begin())
+        {
+            --it;
+        }
+
+        if (frameSeconds != nullptr)
+        {
+            *frameSeconds = (double)it->sampleOffset / m_sampleRate;
+        }
+        return it->byteOffset;
+    }
+
+    // Writes the index to a file.
+    void Save(const std::string& indexFileName) const
+    {
+        std::ofstream fs(indexFileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!fs.good())
+        {
+            // The index file is only a cache, the index can be rebuilt next time.
+            return;
+        }
+
+        uint32_t version = indexFileVersion;
+        uint32_t flags = m_approximate ? 1 : 0;
+        uint64_t count = m_seekPoints.size();
+        fs.write(indexFileMagic, indexFileMagicSize);
+        fs.write((const char*)&version, sizeof(version));
+        fs.write((const char*)&m_identity, sizeof(m_identity));
+        fs.write((const char*)&m_sampleRate, sizeof(m_sampleRate));
+        fs.write((const char*)&flags, sizeof(flags));
+        fs.write((const char*)&m_totalSamples, sizeof(m_totalSamples));
+        fs.write((const char*)&count, sizeof(count));
+        fs.write((const char*)m_seekPoints.data(), count * sizeof(SeekPoint));
+    }
+
+    // Reads the index from a file. Returns false if the file is missing, invalid, or was built for
+    // a different version of the MP3 file.
+    bool Load(const std::string& indexFileName, const FileIdentity& expectedIdentity)
+    {
+        std::ifstream fs(indexFileName, std::ios_base::binary | std::ios_base::in);
+        char magic[indexFileMagicSize];
+        uint32_t version = 0;
+        uint32_t flags = 0;
+        uint64_t count = 0;
+
+        fs.read(magic, sizeof(magic));
+        fs.read((char*)&version, sizeof(version));
+        fs.read((char*)&m_identity, sizeof(m_identity));
+        fs.read((char*)&m_sampleRate, sizeof(m_sampleRate));
+        fs.read((char*)&flags, sizeof(flags));
+        fs.read((char*)&m_totalSamples, sizeof(m_totalSamples));
+        fs.read((char*)&count, sizeof(count));
+        if (!fs.good() || memcmp(magic, indexFileMagic, indexFileMagicSize) != 0 || version != indexFileVersion ||
+            !(m_identity == expectedIdentity) || count == 0 || count > m_identity.size)
+        {
+            return false;
+        }
+
+        m_approximate = (flags & 1) != 0;
+        m_seekPoints.resize(count);
+        fs.read((char*)m_seekPoints.data(), count * sizeof(SeekPoint));
+        return fs.good();
+    }
+
+private:
+    // Header of the index file: magic, then the version of the layout.
+    static constexpr const char* indexFileMagic = "MP3I";
+    static constexpr uint32_t indexFileMagicSize = 4;
+    static constexpr uint32_t indexFileVersion = 2;
+
+    // Bytes of the start of the MP3 file that are hashed to identify it.
+    static constexpr size_t identityHashSize = 1 << 16;
+
+    // The fields of an MPEG audio frame header that are needed for indexing.
+    struct FrameHeader
+    {
+        int version;            // 1 for MPEG-1, 2 for MPEG-2, 25 for MPEG-2.5.
+        int layer;              // 1, 2 or 3.
+        uint32_t sampleRate;
+        uint32_t frameLength;   // in bytes, including the header.
+        uint32_t samplesPerFrame;
+        bool mono;
+    };
+
+    // Buffered random access to the file, so that scanning does not issue a read per frame.
+    class FileWindow final
+    {
+    public:
+        explicit FileWindow(const std::string& fileName)
+        {
+            m_fs.open(fileName, std::ios_base::binary | std::ios_base::in);
+            if (!m_fs.good())
+            {
+                throw std::invalid_argument("Failed to open the specified MP3 file.");
+            }
+            m_fs.seekg(0, std::ios_base::end);
+            m_size = (uint64_t)m_fs.tellg();
+        }
+
+        uint64_t Size() const
+        {
+            return m_size;
+        }
+
+        // Returns a pointer to 'count' bytes at 'position', or nullptr if the file is too short.
+        const uint8_t* At(uint64_t position, size_t count)
+        {
+            if (position + count > m_size)
+            {
+                return nullptr;
+            }
+            if (position < m_start || position + count > m_start + m_buffer.size())
+            {
+                m_start = position;
+                m_buffer.resize((size_t)std::min<uint64_t>(std::max(count, (size_t)windowSize), m_size - position));
+                m_fs.clear();
+                m_fs.seekg(position);
+                m_fs.read((char*)m_buffer.data(), m_buffer.size());
+            }
+            return m_buffer.data() + (position - m_start);
+        }
+
+    private:
+        static constexpr size_t windowSize = 1 << 16;
+
+        std::ifstream m_fs;
+        uint64_t m_size = 0;
+        uint64_t m_start = 0;
+        std::vector<uint8_t> m_buffer;
+    };
+
+    static uint64_t Fnv1a(uint64_t hash, const uint8_t* data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ data[i]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    // Creates the directory and its parents. Returns false if it could not be created.
+    static bool CreateDirectories(const std::string& directory)
+    {
+        for (auto slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1))
+        {
+            auto parent = directory.substr(0, slash);
+            if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST)
+            {
+                return false;
+            }
+            if (slash == std::string::npos)
+            {
+                return true;
+            }
+        }
+    }
+
+    static uint32_t ReadBigEndian(const uint8_t* data, size_t size)
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            value = (value << 8) | data[i];
+        }
+        return value;
+    }
+
+    // Returns the position after the ID3v2 tag, if the file starts with one.
+    static uint64_t SkipId3v2Tag(FileWindow& file)
+    {
+        auto tag = file.At(0, 10);
+        if (tag == nullptr || memcmp(tag, "ID3", 3) != 0)
+        {
+            return 0;
+        }
+
+        // The tag size is a 28 bit "syncsafe" integer, and excludes the 10 byte header and the optional footer.
+        uint64_t size = ((uint64_t)(tag[6] & 0x7f) << 21) | ((tag[7] & 0x7f) << 14) | ((tag[8] & 0x7f) << 7) | (tag[9] & 0x7f);
+        bool hasFooter = (tag[5] & 0x10) != 0;
+        return 10 + size + (hasFooter ? 10 : 0);
+    }
+
+    static bool ParseFrameHeader(const uint8_t* data, FrameHeader& header)
+    {
+        static const uint16_t bitratesV1[3][16] = {
+            { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },    // layer 1
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },       // layer 2
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 } };      // layer 3
+        static const uint16_t bitratesV2[2][16] = {
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },       // layer 1
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 } };          // layer 2 and 3
+        static const uint32_t sampleRatesV1[3] = { 44100, 48000, 32000 };
+
+        if (data[0] != 0xff || (data[1] & 0xe0) != 0xe0)
+        {
+            return false;
+        }
+
+        auto versionBits = (data[1] >> 3) & 0x03;
+        auto layerBits = (data[1] >> 1) & 0x03;
+        auto bitrateIndex = (data[2] >> 4) & 0x0f;
+        auto sampleRateIndex = (data[2] >> 2) & 0x03;
+        auto padding = (data[2] >> 1) & 0x01;
+        if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3)
+        {
+            // Reserved values, or free format which can't be indexed.
+            return false;
+        }
+
+        header.version = versionBits == 3 ? 1 : (versionBits == 2 ? 2 : 25);
+        header.layer = 4 - layerBits;
+        header.mono = ((data[3] >> 6) & 0x03) == 3;
+        header.sampleRate = sampleRatesV1[sampleRateIndex] / (header.version == 1 ? 1 : (header.version == 2 ? 2 : 4));
+
+        uint32_t bitrate = 1000 * (header.version == 1
+            ? bitratesV1[header.layer - 1][bitrateIndex]
+            : bitratesV2[header.layer == 1 ? 0 : 1][bitrateIndex]);
+
+        if (header.layer == 1)
+        {
+            header.samplesPerFrame = 384;
+            header.frameLength = (12 * bitrate / header.sampleRate + padding) * 4;
+        }
+        else if (header.layer == 2 || header.version == 1)
+        {
+            header.samplesPerFrame = 1152;
+            header.frameLength = 144 * bitrate / header.sampleRate + padding;
+        }
+        else
+        {
+            header.samplesPerFrame = 576;
+            header.frameLength = 72 * bitrate / header.sampleRate + padding;
+        }
+        return header.frameLength > 4;
+    }
+
+    // Finds the next frame at or after 'position' whose successor is also a valid frame header with
+    // the same format, the end of the file or an ID3v1 tag, which rules out false sync words in audio
+    // data. Updates 'position'.
+    static bool FindFrame(FileWindow& file, uint64_t& position, FrameHeader& header)
+    {
+        for (const uint8_t* data; (data = file.At(position, 4)) != nullptr; position++)
+        {
+            if (!ParseFrameHeader(data, header))
+            {
+                continue;
+            }
+
+            FrameHeader next;
+            auto nextData = file.At(position + header.frameLength, 4);
+            if (nextData == nullptr || memcmp(nextData, "TAG", 3) == 0 ||
+                (ParseFrameHeader(nextData, next) && next.version == header.version && next.layer == header.layer && next.sampleRate == header.sampleRate))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Offset of the Xing and VBRI headers within the first frame.
+    static uint32_t SideInfoSize(const FrameHeader& header)
+    {
+        return header.version == 1 ? (header.mono ? 17 : 32) : (header.mono ? 9 : 17);
+    }
+
+    bool BuildFromXingHeader(FileWindow& file, uint64_t frameOffset, const FrameHeader& header)
+    {
+        auto xingOffset = frameOffset + 4 + SideInfoSize(header);
+        auto xing = file.At(xingOffset, 8);
+        if (xing == nullptr || (memcmp(xing, "Xing", 4) != 0 && memcmp(xing, "Info", 4) != 0))
+        {
+            return false;
+        }
+
+        const uint32_t hasFrames = 0x1, hasBytes = 0x2, hasToc = 0x4;
+        auto flags = ReadBigEndian(xing + 4, 4);
+        if ((flags & hasFrames) == 0 || (flags & hasToc) == 0)
+        {
+            return false;
+        }
+
+        auto fields = file.At(xingOffset + 8, 4 + ((flags & hasBytes) ? 4 : 0) + 100);
+        if (fields == nullptr)
+        {
+            return false;
+        }
+
+        uint64_t frames = ReadBigEndian(fields, 4);
+        uint64_t bytes = (flags & hasBytes) ? ReadBigEndian(fields + 4, 4) : file.Size() - frameOffset;
+        auto toc = fields + ((flags & hasBytes) ? 8 : 4);
+
+        // The Xing frame itself carries no audio, the audio starts with the next frame.
+        m_totalSamples = frames * header.samplesPerFrame;
+        m_approximate = true;
+        m_seekPoints.push_back({ frameOffset + header.frameLength, 0 });
+        for (int percent = 1; percent < 100; percent++)
+        {
+            AddApproximateSeekPoint(file, frameOffset + toc[percent] * bytes / 256, m_totalSamples * percent / 100);
+        }
+        return true;
+    }
+
+    bool BuildFromVbriHeader(FileWindow& file, uint64_t frameOffset, const FrameHeader& header)
+    {
+        auto vbriOffset = frameOffset + 4 + 32;
+        auto vbri = file.At(vbriOffset, 26);
+        if (vbri == nullptr || memcmp(vbri, "VBRI", 4) != 0)
+        {
+            return false;
+        }
+
+        uint64_t frames = ReadBigEndian(vbri + 14, 4);
+        auto entryCount = ReadBigEndian(vbri + 18, 2);
+        auto scale = ReadBigEndian(vbri + 20, 2);
+        auto entrySize = ReadBigEndian(vbri + 22, 2);
+        auto framesPerEntry = ReadBigEndian(vbri + 24, 2);
+        auto entries = file.At(vbriOffset + 26, entryCount * entrySize);
+        if (entries == nullptr || entrySize == 0 || entrySize > 4)
+        {
+            return false;
+        }
+
+        // Copies the table, reading the seek points may move the file window.
+        std::vector<uint8_t> table(entries, entries + entryCount * entrySize);
+
+        m_totalSamples = frames * header.samplesPerFrame;
+        m_approximate = true;
+        m_seekPoints.push_back({ frameOffset + header.frameLength, 0 });
+
+        // Each entry is the size in bytes of the next 'framesPerEntry' frames, divided by 'scale'.
+        uint64_t byteOffset = frameOffset;
+        for (uint32_t i = 0; i + 1 < entryCount; i++)
+        {
+            byteOffset += (uint64_t)ReadBigEndian(table.data() + i * entrySize, entrySize) * scale;
+            AddApproximateSeekPoint(file, byteOffset, (uint64_t)(i + 1) * framesPerEntry * header.samplesPerFrame);
+        }
+        return true;
+    }
+
+    // Adds a seek point at the first frame boundary at or after 'byteOffset'.
+    void AddApproximateSeekPoint(FileWindow& file, uint64_t byteOffset, uint64_t sampleOffset)
+    {
+        FrameHeader header;
+        if (byteOffset > m_seekPoints.back().byteOffset && FindFrame(file, byteOffset, header) &&
+            sampleOffset > m_seekPoints.back().sampleOffset)
+        {
+            m_seekPoints.push_back({ byteOffset, sampleOffset });
+        }
+    }
+
+    void BuildByScanning(FileWindow& file, uint64_t position)
+    {
+        FrameHeader header;
+        uint64_t samples = 0;
+        while (FindFrame(file, position, header))
+        {
+            m_seekPoints.push_back({ position, samples });
+            samples += header.samplesPerFrame;
+            position += header.frameLength;
+        }
+        m_totalSamples = samples;
+        m_approximate = false;
+    }
+
+    FileIdentity m_identity = {};
+    uint32_t m_sampleRate = 0;
+    uint64_t m_totalSamples = 0;
+    bool m_approximate = false;
+    std::vector<SeekPoint> m_seekPoints;
+};
+
@@ -0,0 +1,156 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// detailed_result_parser_test.cpp
+//
+// Tests of DetailedResultParser on a detailed result and on malformed JSON. The parser doesn't need the Speech SDK; build and
+// run from this directory with any C++14 compiler, e.g.:
+//
+//   c++ -std=c++14 -I../samples -o detailed_result_parser_test detailed_result_parser_test.cpp
+//   ./detailed_result_parser_test
+//
+
+#include "detailed_result_parser.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+int s_failures = 0;
+
+void Check(bool condition, const std::string& what)
+{
+    std::printf("%s: %s\n", condition ? "PASS" : "FAIL", what.c_str());
+    if (!condition)
+    {
+        s_failures++;
+    }
+}
+
+bool Parses(const std::string& json)
+{
+    DetailedResult result;
+    try
+    {
+        DetailedResultParser::Parse(json, result);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+// A detailed result as the service sends it, with two alternatives with word timings.
+void TestDetailedResultIsParsed()
+{
+    const std::string json = R"({
+  "Id": "0e2c9cb6e4b1434d8e4a6d1c4e6b2f33",
+  "RecognitionStatus": "Success",
+  "Offset": 5500000,
+  "Duration": 17200000,
+  "DisplayText": "What's the weather like?",
+  "NBest": [
+    {
+      "Confidence": 0.9452133,
+      "Lexical": "what's the weather like",
+      "ITN": "what's the weather like",
+      "MaskedITN": "what's the weather like",
+      "Display": "What's the weather like?",
+      "Words": [
+        { "Word": "what's", "Offset": 5500000, "Duration": 3100000 },
+        { "Word": "the", "Offset": 8700000, "Duration": 1100000 },
+        { "Word": "weather", "Offset": 9900000, "Duration": 4200000 },
+        { "Word": "like", "Offset": 14200000, "Duration": 8500000 }
+      ]
+    },
+    {
+      "Confidence": 0.72058,
+      "Lexical": "what is the weather like",
+      "ITN": "what is the weather like",
+      "MaskedITN": "what is the weather like",
+      "Display": "What is the weather like?",
+      "Words": [
+        { "Word": "what", "Offset": 5500000, "Duration": 1500000 },
+        { "Word": "is", "Offset": 7100000, "Duration": 1500000 },
+        { "Word": "the", "Offset": 8700000, "Duration": 1100000 },
+        { "Word": "weather", "Offset": 9900000, "Duration": 4200000 },
+        { "Word": "like", "Offset": 14200000, "Duration": 8500000 }
+      ]
+    }
+  ]
+})";
+
+    DetailedResult result;
+    DetailedResultParser::Parse(json, result);
+    Check(result.recognitionStatus == "Success", "recognition status");
+    Check(result.displayText == "What's the weather like?", "display text");
+    Check(result.offset == 5500000 && result.duration == 17200000, "offset and duration of the result");
+
+    Check(result.AlternativeCount() == 2, "two NBest alternatives");
+    if (result.AlternativeCount() != 2)
+    {
+        return;
+    }
+    Check(result.confidence[0] == 0.9452133 && result.confidence[1] == 0.72058, "NBest confidences");
+    Check(result.lexical[0] == "what's the weather like" && result.lexical[1] == "what is the weather like", "NBest lexical forms");
+    Check(result.itn[0] == "what's the weather like" && result.itn[1] == "what is the weather like", "NBest ITN forms");
+    Check(result.maskedItn[1] == "what is the weather like" && result.display[1] == "What is the weather like?", "NBest masked ITN and display forms");
+
+    Check(result.wordsBegin[0] == 0 && result.wordsEnd[0] == 4 && result.wordsBegin[1] == 4 && result.wordsEnd[1] == 9,
+        "word ranges of the alternatives");
+    if (result.word.size() != 9 || result.wordOffset.size() != 9 || result.wordDuration.size() != 9)
+    {
+        Check(false, "nine words");
+        return;
+    }
+    const char* words[] = { "what's", "the", "weather", "like", "what", "is", "the", "weather", "like" };
+    const uint64_t offsets[] = { 5500000, 8700000, 9900000, 14200000, 5500000, 7100000, 8700000, 9900000, 14200000 };
+    const uint64_t durations[] = { 3100000, 1100000, 4200000, 8500000, 1500000, 1500000, 1100000, 4200000, 8500000 };
+    bool wordsMatch = true;
+    for (size_t i = 0; i < 9; i++)
+    {
+        wordsMatch = wordsMatch && result.word[i] == words[i] && result.wordOffset[i] == offsets[i] && result.wordDuration[i] == durations[i];
+    }
+    Check(wordsMatch, "words with their offsets and durations");
+    Check(result.wordConfidence[0] == 0, "word confidence is 0 when the service doesn't send it");
+
+    // Parsing again into the same result replaces the previous one.
+    const std::string noMatch = R"({"RecognitionStatus":"NoMatch","Offset":100,"Duration":0})";
+    DetailedResultParser::Parse(noMatch, result);
+    Check(result.recognitionStatus == "NoMatch" && result.AlternativeCount() == 0 && result.word.empty(), "a reused result is cleared");
+}
+
+// A field the parser doesn't know is skipped, and its escape sequences have to be valid all the same.
+void TestSkippedStringsAreValidated()
+{
+    Check(!Parses(R"({"a":"\q"})"), R"(invalid escape \q in a skipped value is rejected)");
+    Check(!Parses(R"({"a":["x","\x41"]})"), R"(invalid escape \x in a skipped array is rejected)");
+    Check(!Parses(R"({"a":{"b":"\u12G4"}})"), R"(\u with a non-hex digit in a skipped object is rejected)");
+    Check(!Parses(R"({"a":"\u12"})"), R"(short \u escape in a skipped value is rejected)");
+    Check(!Parses(R"({"a":"\)"), "escape at the end of the text is rejected");
+    Check(Parses(R"({"a":"\"\\\/\b\f\n\r\té😀"})"), "all valid escapes in a skipped value are accepted");
+}
+
+void TestParsedStringsAreValidated()
+{
+    Check(!Parses(R"({"DisplayText":"\q"})"), R"(invalid escape \q in a parsed value is rejected)");
+
+    DetailedResult result;
+    DetailedResultParser::Parse(R"({"DisplayText":"café \"ok\"","a":"\/"})", result);
+    Check(std::string(result.displayText.data, result.displayText.size) == "caf\xC3\xA9 \"ok\"", "escapes in a parsed value are decoded");
+}
+
+} // anonymous namespace
+
+int main()
+{
+    TestDetailedResultIsParsed();
+    TestSkippedStringsAreValidated();
+    TestParsedStringsAreValidated();
+    std::printf("%d failure(s)\n", s_failures);
+    return s_failures == 0 ? 0 : 1;
+}
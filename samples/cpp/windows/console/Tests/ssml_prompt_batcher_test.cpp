@@ -0,0 +1,144 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ssml_prompt_batcher_test.cpp
+//
+// Tests of the request building and audio splitting of SsmlPromptBatcher, with non-ASCII prompts and
+// synthetic audio in place of the Speech service. Build and run from this directory with any C++14
+// compiler, e.g. on Linux:
+//
+//   c++ -std=c++14 -I../samples -I$SPEECHSDK_ROOT/include/cxx_api -I$SPEECHSDK_ROOT/include/c_api -o ssml_prompt_batcher_test ssml_prompt_batcher_test.cpp -pthread
+//   ./ssml_prompt_batcher_test
+//
+
+#include <speechapi_cxx.h>
+#include "ssml_prompt_batcher.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+int s_failures = 0;
+
+void Check(bool condition, const std::string& what)
+{
+    std::printf("%s: %s\n", condition ? "PASS" : "FAIL", what.c_str());
+    if (!condition)
+    {
+        s_failures++;
+    }
+}
+
+// The literals are UTF-8, split where a hex escape would take the next character.
+const std::vector<std::string> s_prompts = {
+    "Gr\xc3\xbc\xc3\x9f" "e aus M\xc3\xbc" "nchen.",                                  // Grüße aus München.
+    "\xe6\x9d\xb1\xe4\xba\xac\xe3\x81\xb8\xe3\x82\x88\xe3\x81\x86\xe3\x81\x93\xe3\x81\x9d\xe3\x80\x82", // 東京へようこそ。
+    "Smile \xf0\x9f\x98\x80 & wave." };                                                  // Smile 😀 & wave.
+
+// The words of each prompt.
+const std::vector<std::vector<std::string>> s_words = {
+    { "Gr\xc3\xbc\xc3\x9f" "e", "aus", "M\xc3\xbc" "nchen" },
+    { "\xe6\x9d\xb1\xe4\xba\xac", "\xe3\x81\xb8\xe3\x82\x88\xe3\x81\x86\xe3\x81\x93\xe3\x81\x9d" },
+    { "Smile", "wave" } };
+
+std::u16string ToUtf16(const std::string& text)
+{
+    std::u16string utf16;
+    for (size_t i = 0; i < text.size();)
+    {
+        auto byte = (uint8_t)text[i];
+        auto length = byte < 0x80 ? 1 : byte < 0xe0 ? 2 : byte < 0xf0 ? 3 : 4;
+        uint32_t codePoint = length == 1 ? byte : byte & (0x3f >> (length - 1));
+        for (int j = 1; j < length; j++)
+        {
+            codePoint = (codePoint << 6) | ((uint8_t)text[i + j] & 0x3f);
+        }
+        if (codePoint >= 0x10000)
+        {
+            utf16 += (char16_t)(0xd800 + ((codePoint - 0x10000) >> 10));
+            utf16 += (char16_t)(0xdc00 + ((codePoint - 0x10000) & 0x3ff));
+        }
+        else
+        {
+            utf16 += (char16_t)codePoint;
+        }
+        i += length;
+    }
+    return utf16;
+}
+
+void TestPromptPositionsAreUtf16()
+{
+    auto request = SsmlPromptBatcher::BuildRequest(s_prompts, SsmlPromptBatcher::Options());
+    auto ssml = ToUtf16(request.ssml);
+    const std::vector<std::string> escaped = { s_prompts[0], s_prompts[1], "Smile \xf0\x9f\x98\x80 &amp; wave." };
+    for (size_t i = 0; i < s_prompts.size(); i++)
+    {
+        auto begin = request.promptBegin[i];
+        auto end = request.promptEnd[i];
+        Check(end <= ssml.size() && ssml.substr(begin, end - begin) == ToUtf16(escaped[i]),
+            "the position of prompt " + std::to_string(i + 1) + " is its text in UTF-16 code units");
+    }
+    Check(request.promptBegin[2] < request.ssml.find("Smile"), "the positions after non-ASCII prompts aren't byte offsets");
+}
+
+// Each prompt is a tone with its own amplitude, followed by the separator's silence. The text offsets
+// of the word boundaries are found in the UTF-16 text of the SSML, as the service reports them.
+void TestNonAsciiPromptsAreSplit()
+{
+    SsmlPromptBatcher::Options options;
+    auto request = SsmlPromptBatcher::BuildRequest(s_prompts, options);
+    auto ssml = ToUtf16(request.ssml);
+    const size_t toneSamples = options.sampleRate * 3 / 10;
+    const size_t silenceSamples = (size_t)(options.separator.count() * options.sampleRate / 1000);
+    const int amplitudes[] = { 3000, 6000, 9000 };
+
+    std::vector<uint8_t> audio;
+    std::vector<SsmlPromptBatcher::WordBoundary> wordBoundaries;
+    for (size_t i = 0; i < s_prompts.size(); i++)
+    {
+        auto toneBegin = audio.size() / 2;
+        for (size_t j = 0; j < toneSamples; j++)
+        {
+            auto sample = (int16_t)(j % 20 < 10 ? amplitudes[i] : -amplitudes[i]);
+            audio.push_back((uint8_t)(sample & 0xff));
+            audio.push_back((uint8_t)((sample >> 8) & 0xff));
+        }
+        audio.resize(audio.size() + 2 * silenceSamples, 0);
+
+        // The words are spread over the tone.
+        for (size_t j = 0; j < s_words[i].size(); j++)
+        {
+            auto sample = toneBegin + toneSamples * j / s_words[i].size();
+            wordBoundaries.push_back({ (uint64_t)sample * 10000000 / options.sampleRate, (uint32_t)ssml.find(ToUtf16(s_words[i][j])) });
+        }
+    }
+
+    auto clips = SsmlPromptBatcher::SplitAudio(request, audio, wordBoundaries, options);
+    for (size_t i = 0; i < s_prompts.size(); i++)
+    {
+        int peak = 0;
+        for (size_t j = 0; j + 1 < clips[i].size(); j += 2)
+        {
+            auto value = (int16_t)(clips[i][j] | (clips[i][j + 1] << 8));
+            peak = std::max(peak, std::abs((int)value));
+        }
+        Check(clips[i].size() >= 2 * toneSamples && peak == amplitudes[i],
+            "the clip of prompt " + std::to_string(i + 1) + " has its whole tone and no other");
+    }
+}
+
+} // anonymous namespace
+
+int main()
+{
+    TestPromptPositionsAreUtf16();
+    TestNonAsciiPromptsAreSplit();
+    std::printf("%d failure(s)\n", s_failures);
+    return s_failures == 0 ? 0 : 1;
+}
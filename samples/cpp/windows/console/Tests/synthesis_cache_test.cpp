@@ -0,0 +1,263 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// synthesis_cache_test.cpp
+//
+// Tests of SynthesisCache, with LocalSynthesizer in place of the Speech service. The cache only uses
+// the Speech SDK headers for the output format; build and run from this directory with any C++14
+// compiler, e.g. on Linux:
+//
+//   c++ -std=c++14 -I../samples -I$SPEECHSDK_ROOT/include/cxx_api -I$SPEECHSDK_ROOT/include/c_api -o synthesis_cache_test synthesis_cache_test.cpp -pthread
+//   ./synthesis_cache_test
+//
+// It creates and removes the directory synthesis_cache_test.dir in the current directory.
+//
+
+#include <speechapi_cxx.h>
+#include "local_synthesizer.h"
+#include "synthesis_cache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char* s_directory = "synthesis_cache_test.dir";
+int s_failures = 0;
+
+void Check(bool condition, const std::string& what)
+{
+    std::printf("%s: %s\n", condition ? "PASS" : "FAIL", what.c_str());
+    if (!condition)
+    {
+        s_failures++;
+    }
+}
+
+// Removes the test directory and the files in it.
+void RemoveDirectory()
+{
+    std::vector<std::string> files;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    auto find = FindFirstFileA((std::string(s_directory) + "/*").c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            files.push_back(data.cFileName);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+    }
+#else
+    if (auto directory = opendir(s_directory))
+    {
+        while (auto entry = readdir(directory))
+        {
+            files.push_back(entry->d_name);
+        }
+        closedir(directory);
+    }
+#endif
+    for (auto& file : files)
+    {
+        std::remove((std::string(s_directory) + "/" + file).c_str());
+    }
+#ifdef _WIN32
+    _rmdir(s_directory);
+#else
+    rmdir(s_directory);
+#endif
+}
+
+SynthesisRequest Request(const std::string& text)
+{
+    SynthesisRequest request;
+    request.text = text;
+    request.voice = "en-US-JessaNeural";
+    return request;
+}
+
+// A synthesizer with little latency, that counts its syntheses.
+struct CountingSynthesizer
+{
+    CountingSynthesizer()
+        : synthesizer(Options())
+    {
+    }
+
+    static LocalSynthesizer::Options Options()
+    {
+        LocalSynthesizer::Options options;
+        options.firstChunkLatency = std::chrono::milliseconds(100);
+        options.chunkInterval = std::chrono::milliseconds(0);
+        return options;
+    }
+
+    SynthesisCache::SynthesizeFunction Function()
+    {
+        return [this](const SynthesisRequest& request)
+        {
+            syntheses++;
+            return synthesizer.SpeakText(request.text);
+        };
+    }
+
+    bool Matches(const std::shared_ptr<CachedAudioDataStream>& stream, const std::string& text) const
+    {
+        auto expected = synthesizer.GenerateAudio(text);
+        return stream != nullptr && stream->GetLength() == expected.size() && std::equal(expected.begin(), expected.end(), stream->Data());
+    }
+
+    LocalSynthesizer synthesizer;
+    std::atomic<int> syntheses{ 0 };
+};
+
+void TestMemoryHit()
+{
+    RemoveDirectory();
+    CountingSynthesizer synthesizer;
+    SynthesisCache cache(1024 * 1024, s_directory);
+    SynthesisCache::Source source;
+    cache.GetOrSynthesize(Request("Hello."), synthesizer.Function(), &source);
+    Check(source == SynthesisCache::Source::Synthesized, "a miss is synthesized");
+
+    auto stream = cache.GetOrSynthesize(Request("Hello."), synthesizer.Function(), &source);
+    Check(source == SynthesisCache::Source::Memory && synthesizer.Matches(stream, "Hello."), "a repeated request is a memory hit with the same audio");
+    Check(synthesizer.syntheses == 1, "a memory hit doesn't synthesize");
+    Check(cache.Get(Request("Goodbye.")) == nullptr, "Get returns nullptr for audio that isn't cached");
+}
+
+void TestDiskHit()
+{
+    RemoveDirectory();
+    CountingSynthesizer synthesizer;
+    {
+        SynthesisCache cache(1024 * 1024, s_directory);
+        cache.GetOrSynthesize(Request("Hello."), synthesizer.Function());
+    }
+
+    // A new cache on the same directory has an empty memory tier.
+    SynthesisCache cache(1024 * 1024, s_directory);
+    SynthesisCache::Source source;
+    auto stream = cache.Get(Request("Hello."), &source);
+    Check(source == SynthesisCache::Source::Disk && synthesizer.Matches(stream, "Hello."), "audio written by another cache is a disk hit");
+    cache.Get(Request("Hello."), &source);
+    Check(source == SynthesisCache::Source::Memory, "a disk hit is kept in memory");
+    Check(cache.Get(Request("hello.")) == nullptr, "requests that differ only in case are different entries");
+}
+
+void TestMemoryEviction()
+{
+    RemoveDirectory();
+    CountingSynthesizer synthesizer;
+    // Room for the audio of three one character texts.
+    auto size = synthesizer.synthesizer.GenerateAudio("a").size();
+    SynthesisCache cache(3 * size, s_directory);
+    for (auto text : { "a", "b", "c" })
+    {
+        cache.GetOrSynthesize(Request(text), synthesizer.Function());
+    }
+    SynthesisCache::Source source;
+    cache.Get(Request("a"), &source);
+    cache.GetOrSynthesize(Request("d"), synthesizer.Function());
+
+    cache.Get(Request("b"), &source);
+    Check(source == SynthesisCache::Source::Disk, "the least recently used entry is evicted from memory");
+    cache.Get(Request("c"), &source);
+    Check(source == SynthesisCache::Source::Disk, "an entry pushed out by the disk hit is read from disk");
+    cache.Get(Request("b"), &source);
+    Check(source == SynthesisCache::Source::Memory, "the entry read from disk is back in memory");
+    Check(synthesizer.syntheses == 4, "evicted entries aren't synthesized again");
+}
+
+void TestDiskEviction()
+{
+    RemoveDirectory();
+    CountingSynthesizer synthesizer;
+    // No memory tier, and room for the files of two one character texts.
+    auto size = synthesizer.synthesizer.GenerateAudio("a").size();
+    SynthesisCache cache(0, s_directory, 2 * size + size / 2);
+    cache.GetOrSynthesize(Request("a"), synthesizer.Function());
+    cache.GetOrSynthesize(Request("b"), synthesizer.Function());
+    cache.Get(Request("a"));
+    cache.GetOrSynthesize(Request("c"), synthesizer.Function());
+
+    Check(cache.GetMetrics().diskEvictions == 1, "one file is evicted over the disk capacity");
+    Check(cache.Get(Request("b")) == nullptr, "the least recently used file is evicted");
+    SynthesisCache::Source source;
+    auto stream = cache.Get(Request("a"), &source);
+    Check(source == SynthesisCache::Source::Disk && synthesizer.Matches(stream, "a"), "a recently used file is kept");
+
+    // A cache opened with a smaller capacity evicts down to it, the oldest files first.
+    SynthesisCache smaller(0, s_directory, size + size / 2);
+    Check(smaller.GetMetrics().diskEvictions == 1, "files over the capacity are evicted at start");
+}
+
+void TestSharedMisses()
+{
+    RemoveDirectory();
+    CountingSynthesizer synthesizer;
+    SynthesisCache cache(1024 * 1024, s_directory);
+    std::atomic<int> matches{ 0 };
+    std::vector<std::thread> callers;
+    for (int i = 0; i < 8; i++)
+    {
+        callers.emplace_back([&]()
+        {
+            auto stream = cache.GetOrSynthesize(Request("Hello."), synthesizer.Function());
+            if (synthesizer.Matches(stream, "Hello."))
+            {
+                matches++;
+            }
+        });
+    }
+    for (auto& caller : callers)
+    {
+        caller.join();
+    }
+
+    auto metrics = cache.GetMetrics();
+    Check(synthesizer.syntheses == 1, "concurrent misses of one request share one synthesis");
+    Check(matches == 8, "all callers get the audio");
+    Check(metrics.misses + metrics.sharedMisses + metrics.memoryHits == 8 && metrics.misses == 1, "one miss is counted, the others are shared misses or hits");
+}
+
+void TestTemporaryFilesAreRemoved()
+{
+    RemoveDirectory();
+    {
+        SynthesisCache cache(1024 * 1024, s_directory);
+    }
+    auto temporary = std::string(s_directory) + "/0123456789abcdef.audio.tmp42";
+    std::ofstream(temporary) << "partial";
+    SynthesisCache cache(1024 * 1024, s_directory);
+    Check(!std::ifstream(temporary).good(), "temporary files left behind are removed at start");
+}
+
+} // anonymous namespace
+
+int main()
+{
+    TestMemoryHit();
+    TestDiskHit();
+    TestMemoryEviction();
+    TestDiskEviction();
+    TestSharedMisses();
+    TestTemporaryFilesAreRemoved();
+    RemoveDirectory();
+    std::printf("%d failure(s)\n", s_failures);
+    return s_failures == 0 ? 0 : 1;
+}
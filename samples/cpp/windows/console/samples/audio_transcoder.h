@@ -0,0 +1,334 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_TRANSCODER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define AUDIO_TRANSCODER_NEON
+#include <arm_neon.h>
+#endif
+
+// Converts synthesized 16 bit mono PCM to a lower sample rate and/or to G.711 mu-law, chunk by
+// chunk, e.g. from Synthesizing events. The sample rate is divided by an integer factor with a low
+// pass FIR filter (windowed sinc, Q15 coefficients). The filter and the mu-law encoder use SSE2 or
+// NEON where available, and plain C++ elsewhere; both give the same output.
+class AudioTranscoder final
+{
+public:
+    enum class Encoding
+    {
+        Pcm16,
+        MuLaw
+    };
+
+    struct Format
+    {
+        uint32_t sampleRate;
+        Encoding encoding;
+    };
+
+    // Throws std::invalid_argument if the input rate isn't a multiple of the output rate.
+    AudioTranscoder(uint32_t inputSampleRate, const Format& output, bool vectorized = true)
+        : m_output(output), m_vectorized(vectorized)
+    {
+        if (output.sampleRate == 0 || inputSampleRate % output.sampleRate != 0)
+        {
+            throw std::invalid_argument("The input sample rate must be a multiple of the output sample rate.");
+        }
+        m_factor = inputSampleRate / output.sampleRate;
+        if (m_factor > 1)
+        {
+            m_taps = DesignLowPass(m_factor);
+            m_samples.assign(m_taps.size() - 1, 0);
+        }
+    }
+
+    const Format& OutputFormat() const
+    {
+        return m_output;
+    }
+
+    // Name of the vector instructions used, if any.
+    static const char* InstructionSet()
+    {
+#if defined(AUDIO_TRANSCODER_SSE2)
+        return "SSE2";
+#elif defined(AUDIO_TRANSCODER_NEON)
+        return "NEON";
+#else
+        return "none";
+#endif
+    }
+
+    // Transcodes a chunk of input, and appends the result to 'output'. Chunks may have any size,
+    // an odd byte is kept for the next one.
+    void Transcode(const uint8_t* data, size_t size, std::vector<uint8_t>& output)
+    {
+        // Appends the input to the samples left from the previous chunk.
+        if (m_hasOddByte && size > 0)
+        {
+            uint8_t bytes[2] = { m_oddByte, data[0] };
+            int16_t sample;
+            memcpy(&sample, bytes, sizeof(sample));
+            m_samples.push_back(sample);
+            data++;
+            size--;
+            m_hasOddByte = false;
+        }
+        auto count = size / 2;
+        m_samples.resize(m_samples.size() + count);
+        memcpy(m_samples.data() + m_samples.size() - count, data, count * 2);
+        if (size % 2 == 1)
+        {
+            m_oddByte = data[size - 1];
+            m_hasOddByte = true;
+        }
+
+        // Filters and decimates, or takes the samples as they are.
+        const int16_t* samples = m_samples.data();
+        size_t sampleCount = m_samples.size();
+        if (m_factor > 1)
+        {
+            m_filtered.clear();
+            auto taps = m_taps.size();
+            for (; m_next + taps <= sampleCount; m_next += m_factor)
+            {
+                m_filtered.push_back(Filter(m_samples.data() + m_next));
+            }
+            samples = m_filtered.data();
+            sampleCount = m_filtered.size();
+        }
+
+        auto outputSize = output.size();
+        if (m_output.encoding == Encoding::Pcm16)
+        {
+            output.resize(outputSize + sampleCount * 2);
+            memcpy(output.data() + outputSize, samples, sampleCount * 2);
+        }
+        else
+        {
+            output.resize(outputSize + sampleCount);
+            EncodeMuLaw(samples, sampleCount, output.data() + outputSize, m_vectorized);
+        }
+
+        // Keeps the samples from the next output on, for the next chunk.
+        auto consumed = m_factor > 1 ? std::min(m_next, m_samples.size()) : m_samples.size();
+        m_samples.erase(m_samples.begin(), m_samples.begin() + consumed);
+        m_next -= consumed;
+    }
+
+    // G.711 mu-law encoding of 16 bit samples.
+    static void EncodeMuLaw(const int16_t* samples, size_t count, uint8_t* output, bool vectorized = true)
+    {
+        size_t i = 0;
+#if defined(AUDIO_TRANSCODER_SSE2)
+        if (vectorized)
+        {
+            for (; i + 8 <= count; i += 8)
+            {
+                auto x = _mm_loadu_si128((const __m128i*)(samples + i));
+                auto sign = _mm_srai_epi16(x, 15);
+                // |x| clipped to 32635, plus the bias. -32768 has no positive counterpart, so it's raised first.
+                x = _mm_max_epi16(x, _mm_set1_epi16(-32767));
+                auto magnitude = _mm_sub_epi16(_mm_xor_si128(x, sign), sign);
+                magnitude = _mm_add_epi16(_mm_min_epi16(magnitude, _mm_set1_epi16(32635)), _mm_set1_epi16(0x84));
+                // The exponent is the number of thresholds reached; each one halves the multiplier that
+                // shifts the mantissa into the high half of the product.
+                auto exponent = _mm_setzero_si128();
+                auto multiplier = _mm_set1_epi16(1 << 13);
+                for (int threshold = 0x100; threshold <= 0x4000; threshold <<= 1)
+                {
+                    auto reached = _mm_cmpgt_epi16(magnitude, _mm_set1_epi16((short)(threshold - 1)));
+                    exponent = _mm_sub_epi16(exponent, reached);
+                    multiplier = _mm_sub_epi16(multiplier, _mm_and_si128(reached, _mm_srli_epi16(multiplier, 1)));
+                }
+                auto mantissa = _mm_and_si128(_mm_mulhi_epu16(magnitude, multiplier), _mm_set1_epi16(0x0f));
+                auto code = _mm_or_si128(_mm_or_si128(_mm_and_si128(sign, _mm_set1_epi16(0x80)), _mm_slli_epi16(exponent, 4)), mantissa);
+                code = _mm_andnot_si128(code, _mm_set1_epi16(0xff));
+                _mm_storel_epi64((__m128i*)(output + i), _mm_packus_epi16(code, code));
+            }
+        }
+#elif defined(AUDIO_TRANSCODER_NEON)
+        if (vectorized)
+        {
+            for (; i + 8 <= count; i += 8)
+            {
+                auto x = vld1q_s16(samples + i);
+                auto sign = vreinterpretq_u16_s16(vshrq_n_s16(x, 15));
+                auto magnitude = vreinterpretq_u16_s16(vqabsq_s16(x));
+                magnitude = vaddq_u16(vminq_u16(magnitude, vdupq_n_u16(32635)), vdupq_n_u16(0x84));
+                // The highest bit is at 15 - leading zeros, and the exponent is its position minus 7.
+                auto exponent = vsubq_u16(vdupq_n_u16(8), vclzq_u16(magnitude));
+                auto mantissa = vandq_u16(vshlq_u16(magnitude, vnegq_s16(vreinterpretq_s16_u16(vaddq_u16(exponent, vdupq_n_u16(3))))), vdupq_n_u16(0x0f));
+                auto code = vorrq_u16(vorrq_u16(vandq_u16(sign, vdupq_n_u16(0x80)), vshlq_n_u16(exponent, 4)), mantissa);
+                vst1_u8(output + i, vmovn_u16(vmvnq_u16(code)));
+            }
+        }
+#else
+        (void)vectorized;
+#endif
+        for (; i < count; i++)
+        {
+            output[i] = EncodeMuLaw(samples[i]);
+        }
+    }
+
+    static uint8_t EncodeMuLaw(int16_t sample)
+    {
+        int value = sample;
+        int sign = value < 0 ? 0x80 : 0;
+        int magnitude = std::min(value < 0 ? -value : value, 32635) + 0x84;
+        int exponent = 0;
+        for (int threshold = 0x100; threshold <= 0x4000 && magnitude >= threshold; threshold <<= 1)
+        {
+            exponent++;
+        }
+        int mantissa = (magnitude >> (exponent + 3)) & 0x0f;
+        return (uint8_t)~(sign | (exponent << 4) | mantissa);
+    }
+
+    static int16_t DecodeMuLaw(uint8_t code)
+    {
+        code = (uint8_t)~code;
+        int exponent = (code >> 4) & 0x07;
+        int magnitude = ((((code & 0x0f) << 3) + 0x84) << exponent) - 0x84;
+        return (int16_t)((code & 0x80) ? -magnitude : magnitude);
+    }
+
+private:
+    // Windowed sinc low pass at 90% of the output Nyquist frequency, 16 taps per decimation step,
+    // padded with zeros to a multiple of 8 for the vector code. The taps are stored reversed, so the
+    // filter is a dot product with the input in order.
+    static std::vector<int16_t> DesignLowPass(uint32_t factor)
+    {
+        const double pi = 3.14159265358979323846;
+        auto length = 16 * factor + 1;
+        auto cutoff = 0.9 / (2.0 * factor);
+        std::vector<double> taps(length);
+        double sum = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            double t = (double)i - (length - 1) / 2.0;
+            double sinc = t == 0 ? 2 * cutoff : std::sin(2 * pi * cutoff * t) / (pi * t);
+            double window = 0.42 - 0.5 * std::cos(2 * pi * i / (length - 1)) + 0.08 * std::cos(4 * pi * i / (length - 1));
+            taps[i] = sinc * window;
+            sum += taps[i];
+        }
+
+        std::vector<int16_t> quantized((length + 7) / 8 * 8, 0);
+        for (size_t i = 0; i < length; i++)
+        {
+            quantized[length - 1 - i] = (int16_t)std::lround(taps[i] / sum * 32768);
+        }
+        return quantized;
+    }
+
+    int16_t Filter(const int16_t* samples) const
+    {
+        auto taps = m_taps.data();
+        auto count = m_taps.size();
+        int32_t sum = 0;
+        size_t i = 0;
+#if defined(AUDIO_TRANSCODER_SSE2)
+        if (m_vectorized)
+        {
+            auto accumulator = _mm_setzero_si128();
+            for (; i < count; i += 8)
+            {
+                auto x = _mm_loadu_si128((const __m128i*)(samples + i));
+                auto h = _mm_loadu_si128((const __m128i*)(taps + i));
+                accumulator = _mm_add_epi32(accumulator, _mm_madd_epi16(x, h));
+            }
+            accumulator = _mm_add_epi32(accumulator, _mm_shuffle_epi32(accumulator, _MM_SHUFFLE(1, 0, 3, 2)));
+            accumulator = _mm_add_epi32(accumulator, _mm_shuffle_epi32(accumulator, _MM_SHUFFLE(2, 3, 0, 1)));
+            sum = _mm_cvtsi128_si32(accumulator);
+        }
+#elif defined(AUDIO_TRANSCODER_NEON)
+        if (m_vectorized)
+        {
+            auto accumulator = vdupq_n_s32(0);
+            for (; i < count; i += 8)
+            {
+                auto x = vld1q_s16(samples + i);
+                auto h = vld1q_s16(taps + i);
+                accumulator = vmlal_s16(accumulator, vget_low_s16(x), vget_low_s16(h));
+                accumulator = vmlal_s16(accumulator, vget_high_s16(x), vget_high_s16(h));
+            }
+            sum = vgetq_lane_s32(accumulator, 0) + vgetq_lane_s32(accumulator, 1) + vgetq_lane_s32(accumulator, 2) + vgetq_lane_s32(accumulator, 3);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            sum += samples[i] * taps[i];
+        }
+        return (int16_t)std::max(-32768, std::min(32767, (sum + (1 << 14)) >> 15));
+    }
+
+    const Format m_output;
+    const bool m_vectorized;
+    uint32_t m_factor = 1;
+    std::vector<int16_t> m_taps;
+
+    // Input samples not consumed yet, and the position of the next output in them.
+    std::vector<int16_t> m_samples;
+    size_t m_next = 0;
+    std::vector<int16_t> m_filtered;
+    uint8_t m_oddByte = 0;
+    bool m_hasOddByte = false;
+};
+
+// Feeds one synthesis output to several sinks, each in its own format.
+class TranscodingFanout final
+{
+public:
+    using Sink = std::function<void(const uint8_t* data, size_t size)>;
+
+    explicit TranscodingFanout(uint32_t inputSampleRate)
+        : m_inputSampleRate(inputSampleRate)
+    {
+    }
+
+    // Throws std::invalid_argument if the format can't be produced from the input.
+    void AddSink(const AudioTranscoder::Format& format, Sink sink)
+    {
+        m_sinks.push_back({ std::make_shared<AudioTranscoder>(m_inputSampleRate, format), sink });
+    }
+
+    // Transcodes a chunk of input for each sink, and passes it on.
+    void Write(const uint8_t* data, size_t size)
+    {
+        for (auto& sink : m_sinks)
+        {
+            m_output.clear();
+            sink.transcoder->Transcode(data, size, m_output);
+            if (!m_output.empty())
+            {
+                sink.sink(m_output.data(), m_output.size());
+            }
+        }
+    }
+
+private:
+    struct Output
+    {
+        std::shared_ptr<AudioTranscoder> transcoder;
+        Sink sink;
+    };
+
+    const uint32_t m_inputSampleRate;
+    std::vector<Output> m_sinks;
+    std::vector<uint8_t> m_output;
+};
@@ -0,0 +1,626 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "synthesis_metrics.h"
+#include "synthesizer_pool.h"
+
+// One prompt of a batch manifest.
+struct BatchPrompt
+{
+    size_t line = 0;
+    std::string text;
+    bool ssml = false;
+    std::string voice;
+    // Output format name as used by the service, e.g. "riff-24khz-16bit-mono-pcm".
+    std::string format;
+    std::string output;
+};
+
+// Reads a JSON lines manifest with one prompt per line, e.g.
+//   {"text": "Hello.", "voice": "en-US-JessaNeural", "format": "riff-24khz-16bit-mono-pcm", "output": "hello.wav"}
+// with "ssml" instead of "text" for SSML prompts. Empty lines are skipped.
+class BatchManifest final
+{
+public:
+    explicit BatchManifest(const std::string& fileName)
+        : m_file(fileName)
+    {
+        if (!m_file.good())
+        {
+            throw std::runtime_error("Failed to open " + fileName);
+        }
+    }
+
+    // Reads the next non-empty line. Returns false at the end of the manifest.
+    bool NextLine(std::string& line, size_t& lineNumber)
+    {
+        while (std::getline(m_file, line))
+        {
+            m_lineNumber++;
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+            {
+                lineNumber = m_lineNumber;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Parses a line. Throws std::invalid_argument if it isn't a flat JSON object with a text or ssml
+    // string and an output string.
+    static BatchPrompt ParseLine(const std::string& line, size_t lineNumber)
+    {
+        std::map<std::string, std::string> fields;
+        size_t position = 0;
+        auto fail = [lineNumber](const std::string& reason)
+        {
+            return std::invalid_argument("Line " + std::to_string(lineNumber) + ": " + reason);
+        };
+
+        if (!Expect(line, position, '{'))
+        {
+            throw fail("expected a JSON object.");
+        }
+        SkipSpaces(line, position);
+        if (position < line.size() && line[position] == '}')
+        {
+            position++;
+        }
+        else
+        {
+            while (true)
+            {
+                std::string key;
+                if (!ParseString(line, position, key))
+                {
+                    throw fail("expected a string key.");
+                }
+                if (!Expect(line, position, ':'))
+                {
+                    throw fail("expected ':'.");
+                }
+                std::string value;
+                SkipSpaces(line, position);
+                if (position < line.size() && line[position] == '"')
+                {
+                    if (!ParseString(line, position, value))
+                    {
+                        throw fail("invalid string value of \"" + key + "\".");
+                    }
+                }
+                else
+                {
+                    // Numbers, true, false and null are kept as they are written.
+                    auto end = line.find_first_of(",} \t\r", position);
+                    value = line.substr(position, end - position);
+                    if (value.empty() || value[0] == '{' || value[0] == '[')
+                    {
+                        throw fail("unsupported value of \"" + key + "\".");
+                    }
+                    position = end;
+                }
+                fields[key] = value;
+
+                SkipSpaces(line, position);
+                if (position < line.size() && line[position] == ',')
+                {
+                    position++;
+                    continue;
+                }
+                if (!Expect(line, position, '}'))
+                {
+                    throw fail("expected ',' or '}'.");
+                }
+                break;
+            }
+        }
+        SkipSpaces(line, position);
+        if (position != line.size())
+        {
+            throw fail("unexpected text after the object.");
+        }
+
+        BatchPrompt prompt;
+        prompt.line = lineNumber;
+        prompt.ssml = fields.count("ssml") > 0;
+        prompt.text = prompt.ssml ? fields["ssml"] : fields["text"];
+        prompt.voice = fields["voice"];
+        prompt.format = fields["format"];
+        prompt.output = fields["output"];
+        if (prompt.text.empty() || prompt.output.empty())
+        {
+            throw fail("\"text\" or \"ssml\", and \"output\" are required.");
+        }
+        return prompt;
+    }
+
+private:
+    static void SkipSpaces(const std::string& line, size_t& position)
+    {
+        while (position < line.size() && (line[position] == ' ' || line[position] == '\t' || line[position] == '\r'))
+        {
+            position++;
+        }
+    }
+
+    static bool Expect(const std::string& line, size_t& position, char c)
+    {
+        SkipSpaces(line, position);
+        if (position < line.size() && line[position] == c)
+        {
+            position++;
+            return true;
+        }
+        return false;
+    }
+
+    // Parses a string with its escapes, \u escapes are converted to UTF-8.
+    static bool ParseString(const std::string& line, size_t& position, std::string& value)
+    {
+        if (!Expect(line, position, '"'))
+        {
+            return false;
+        }
+        while (position < line.size())
+        {
+            auto c = line[position++];
+            if (c == '"')
+            {
+                return true;
+            }
+            if (c != '\\')
+            {
+                value += c;
+                continue;
+            }
+            if (position >= line.size())
+            {
+                return false;
+            }
+            switch (c = line[position++])
+            {
+            case 'n': value += '\n'; break;
+            case 't': value += '\t'; break;
+            case 'r': value += '\r'; break;
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'u':
+            {
+                uint32_t codePoint;
+                if (!ParseHex4(line, position, codePoint))
+                {
+                    return false;
+                }
+                // Surrogate pair.
+                uint32_t low;
+                auto next = position + 2;
+                if (codePoint >= 0xd800 && codePoint < 0xdc00 && line.compare(position, 2, "\\u") == 0 &&
+                    ParseHex4(line, next, low) && low >= 0xdc00 && low < 0xe000)
+                {
+                    codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    position = next;
+                }
+                AppendUtf8(value, codePoint);
+                break;
+            }
+            default: value += c; break;
+            }
+        }
+        return false;
+    }
+
+    static bool ParseHex4(const std::string& line, size_t& position, uint32_t& value)
+    {
+        if (position + 4 > line.size())
+        {
+            return false;
+        }
+        value = 0;
+        for (size_t i = 0; i < 4; i++)
+        {
+            auto c = line[position++];
+            auto digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0)
+            {
+                return false;
+            }
+            value = value * 16 + (uint32_t)digit;
+        }
+        return true;
+    }
+
+    static void AppendUtf8(std::string& value, uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            value += (char)codePoint;
+        }
+        else if (codePoint < 0x800)
+        {
+            value += (char)(0xc0 | (codePoint >> 6));
+            value += (char)(0x80 | (codePoint & 0x3f));
+        }
+        else if (codePoint < 0x10000)
+        {
+            value += (char)(0xe0 | (codePoint >> 12));
+            value += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+            value += (char)(0x80 | (codePoint & 0x3f));
+        }
+        else
+        {
+            value += (char)(0xf0 | (codePoint >> 18));
+            value += (char)(0x80 | ((codePoint >> 12) & 0x3f));
+            value += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+            value += (char)(0x80 | (codePoint & 0x3f));
+        }
+    }
+
+    std::ifstream m_file;
+    size_t m_lineNumber = 0;
+};
+
+// Synthesizes the prompts of a manifest with a fixed number of concurrent requests. Requests
+// canceled for a transient reason (throttling, timeouts, connection failures) are retried with
+// exponential backoff. With a checkpoint file, a hash of each completed prompt (its text or SSML,
+// voice, format and output) is appended to it, and a later run skips the prompts with a hash in the
+// checkpoint, so an interrupted batch can be resumed even if lines of the manifest were added,
+// removed or edited in between; edited prompts are synthesized again. Prompts stopped while waiting
+// for a retry are neither completed nor failed.
+class BatchSynthesizer final
+{
+public:
+    enum class Outcome
+    {
+        Succeeded,
+        TransientFailure,
+        PermanentFailure
+    };
+
+    struct Attempt
+    {
+        Outcome outcome = Outcome::PermanentFailure;
+        std::chrono::microseconds audioDuration{ 0 };
+        std::string error;
+    };
+
+    // Synthesizes a prompt to its output, on the worker with the given index.
+    using SynthesizeFunction = std::function<Attempt(size_t worker, const BatchPrompt& prompt)>;
+
+    struct Options
+    {
+        size_t concurrency = 8;
+        // Attempts per prompt, including the first one.
+        size_t maxAttempts = 4;
+        // Delay before the first retry, doubled for each further one.
+        std::chrono::milliseconds retryDelay{ 500 };
+        // Empty for no checkpoint.
+        std::string checkpointFile;
+    };
+
+    struct Report
+    {
+        size_t succeeded = 0;
+        size_t failed = 0;
+        size_t skipped = 0;   // completed by an earlier run.
+        size_t retries = 0;
+        std::chrono::microseconds elapsed{ 0 };
+        std::chrono::microseconds audioDuration{ 0 };
+        // Latency of the prompts, from the first attempt to the last one, in microseconds.
+        HdrHistogram latency;
+        // Line and error of the failed prompts.
+        std::vector<std::pair<size_t, std::string>> failures;
+
+        double PromptsPerSecond() const
+        {
+            return elapsed.count() > 0 ? succeeded * 1e6 / elapsed.count() : 0;
+        }
+
+        // Seconds of audio synthesized per second.
+        double AudioSecondsPerSecond() const
+        {
+            return elapsed.count() > 0 ? (double)audioDuration.count() / elapsed.count() : 0;
+        }
+    };
+
+    BatchSynthesizer(SynthesizeFunction synthesize, const Options& options)
+        : m_synthesize(synthesize), m_options(options)
+    {
+        if (options.concurrency == 0 || options.maxAttempts == 0)
+        {
+            throw std::invalid_argument("Concurrency and attempts must not be 0.");
+        }
+    }
+
+    // Creates a batch synthesizer whose workers take synthesizers for the voice and format of each
+    // prompt from a pool, and write the audio of the results to the output files.
+    static std::shared_ptr<BatchSynthesizer> FromConfig(SynthesizerPool::ConfigFactory configFactory, const Options& options)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto pool = std::make_shared<SynthesizerPool>(configFactory, SynthesizerPool::Options());
+        auto synthesize = [pool](size_t worker, const BatchPrompt& prompt)
+        {
+            (void)worker;
+            Attempt attempt;
+            SpeechSynthesisOutputFormat format;
+            if (!ParseOutputFormat(prompt.format, format))
+            {
+                attempt.error = "Unknown output format " + prompt.format;
+                return attempt;
+            }
+
+            std::shared_ptr<SpeechSynthesisResult> result;
+            {
+                auto synthesizer = pool->Checkout(prompt.voice, format);
+                result = (prompt.ssml ? synthesizer->SpeakSsmlAsync(prompt.text) : synthesizer->SpeakTextAsync(prompt.text)).get();
+            }
+
+            if (result->Reason == ResultReason::Canceled)
+            {
+                auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+                attempt.outcome = IsTransient(cancellation->ErrorCode) ? Outcome::TransientFailure : Outcome::PermanentFailure;
+                attempt.error = cancellation->ErrorDetails;
+                return attempt;
+            }
+
+            auto audio = result->GetAudioData();
+            std::ofstream file(prompt.output, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+            file.write((const char*)audio->data(), audio->size());
+            if (!file.good())
+            {
+                attempt.error = "Failed to write " + prompt.output;
+                return attempt;
+            }
+
+            // Wave formats start with a 44 byte header.
+            auto bytesPerSecond = SynthesisMetrics::BytesPerSecond(format);
+            auto dataSize = prompt.format.compare(0, 5, "riff-") == 0 && audio->size() > 44 ? audio->size() - 44 : audio->size();
+            attempt.outcome = Outcome::Succeeded;
+            attempt.audioDuration = std::chrono::microseconds(bytesPerSecond > 0 ? (int64_t)(dataSize * 1000000 / bytesPerSecond) : 0);
+            return attempt;
+        };
+        return std::make_shared<BatchSynthesizer>(synthesize, options);
+    }
+
+    // Synthesizes the prompts of the manifest, and returns when all are done or Stop was called. Once
+    // stopped, including before Run, Run returns at once; use a new batch synthesizer to resume.
+    Report Run(const std::string& manifestFile)
+    {
+        BatchManifest manifest(manifestFile);
+        auto completed = ReadCheckpoint();
+        std::ofstream checkpoint;
+        if (!m_options.checkpointFile.empty())
+        {
+            checkpoint.open(m_options.checkpointFile, std::ios_base::out | std::ios_base::app);
+            if (!checkpoint.good())
+            {
+                throw std::runtime_error("Failed to open " + m_options.checkpointFile);
+            }
+        }
+
+        Report report;
+        std::mutex mutex;
+        auto start = std::chrono::steady_clock::now();
+
+        auto runWorker = [&](size_t worker)
+        {
+            while (true)
+            {
+                std::string line;
+                size_t lineNumber;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (IsStopped() || !manifest.NextLine(line, lineNumber))
+                    {
+                        return;
+                    }
+                }
+
+                auto promptStart = std::chrono::steady_clock::now();
+                Attempt attempt;
+                size_t retries = 0;
+                bool interrupted = false;
+                std::string key;
+                try
+                {
+                    auto prompt = BatchManifest::ParseLine(line, lineNumber);
+                    key = CheckpointKey(prompt);
+                    if (completed.count(key) > 0)
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        report.skipped++;
+                        continue;
+                    }
+                    for (size_t i = 0; i < m_options.maxAttempts; i++)
+                    {
+                        if (i > 0 && !WaitForRetry(m_options.retryDelay * (1 << (i - 1))))
+                        {
+                            interrupted = true;
+                            break;
+                        }
+                        retries += i > 0 ? 1 : 0;
+                        try
+                        {
+                            attempt = m_synthesize(worker, prompt);
+                        }
+                        catch (const std::exception& e)
+                        {
+                            attempt = Attempt();
+                            attempt.error = e.what();
+                        }
+                        if (attempt.outcome != Outcome::TransientFailure)
+                        {
+                            break;
+                        }
+                    }
+                }
+                catch (const std::invalid_argument& e)
+                {
+                    attempt = Attempt();
+                    attempt.error = e.what();
+                }
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - promptStart);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                report.retries += retries;
+                if (attempt.outcome == Outcome::Succeeded)
+                {
+                    report.succeeded++;
+                    report.audioDuration += attempt.audioDuration;
+                    report.latency.Record((uint64_t)latency.count());
+                    if (checkpoint.is_open())
+                    {
+                        checkpoint << key << std::endl;
+                    }
+                }
+                else if (!interrupted)
+                {
+                    report.failed++;
+                    report.failures.emplace_back(lineNumber, attempt.error);
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < m_options.concurrency; i++)
+        {
+            workers.emplace_back(runWorker, i);
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        report.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::sort(report.failures.begin(), report.failures.end());
+        return report;
+    }
+
+    // Makes Run return after the prompts in progress. Can be called from any thread.
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_stopChanged.notify_all();
+    }
+
+    // Maps the output format names of the service to the formats of the SDK.
+    static bool ParseOutputFormat(const std::string& name, Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat& format)
+    {
+        using Format = Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat;
+        static const std::map<std::string, Format> formats = {
+            { "raw-8khz-8bit-mono-mulaw", Format::Raw8Khz8BitMonoMULaw },
+            { "riff-16khz-16kbps-mono-siren", Format::Riff16Khz16KbpsMonoSiren },
+            { "audio-16khz-16kbps-mono-siren", Format::Audio16Khz16KbpsMonoSiren },
+            { "audio-16khz-32kbitrate-mono-mp3", Format::Audio16Khz32KBitRateMonoMp3 },
+            { "audio-16khz-128kbitrate-mono-mp3", Format::Audio16Khz128KBitRateMonoMp3 },
+            { "audio-16khz-64kbitrate-mono-mp3", Format::Audio16Khz64KBitRateMonoMp3 },
+            { "audio-24khz-48kbitrate-mono-mp3", Format::Audio24Khz48KBitRateMonoMp3 },
+            { "audio-24khz-96kbitrate-mono-mp3", Format::Audio24Khz96KBitRateMonoMp3 },
+            { "audio-24khz-160kbitrate-mono-mp3", Format::Audio24Khz160KBitRateMonoMp3 },
+            { "raw-16khz-16bit-mono-truesilk", Format::Raw16Khz16BitMonoTrueSilk },
+            { "riff-16khz-16bit-mono-pcm", Format::Riff16Khz16BitMonoPcm },
+            { "riff-8khz-16bit-mono-pcm", Format::Riff8Khz16BitMonoPcm },
+            { "riff-24khz-16bit-mono-pcm", Format::Riff24Khz16BitMonoPcm },
+            { "riff-8khz-8bit-mono-mulaw", Format::Riff8Khz8BitMonoMULaw },
+            { "raw-16khz-16bit-mono-pcm", Format::Raw16Khz16BitMonoPcm },
+            { "raw-24khz-16bit-mono-pcm", Format::Raw24Khz16BitMonoPcm },
+            { "raw-8khz-16bit-mono-pcm", Format::Raw8Khz16BitMonoPcm } };
+
+        auto found = formats.find(name.empty() ? "riff-16khz-16bit-mono-pcm" : name);
+        if (found == formats.end())
+        {
+            return false;
+        }
+        format = found->second;
+        return true;
+    }
+
+    static bool IsTransient(Microsoft::CognitiveServices::Speech::CancellationErrorCode errorCode)
+    {
+        using ErrorCode = Microsoft::CognitiveServices::Speech::CancellationErrorCode;
+        return errorCode == ErrorCode::TooManyRequests || errorCode == ErrorCode::ConnectionFailure ||
+            errorCode == ErrorCode::ServiceTimeout || errorCode == ErrorCode::ServiceError ||
+            errorCode == ErrorCode::ServiceUnavailable;
+    }
+
+private:
+    std::set<std::string> ReadCheckpoint() const
+    {
+        std::set<std::string> completed;
+        if (!m_options.checkpointFile.empty())
+        {
+            std::ifstream checkpoint(m_options.checkpointFile);
+            std::string key;
+            while (checkpoint >> key)
+            {
+                completed.insert(key);
+            }
+        }
+        return completed;
+    }
+
+    // FNV-1a hash of the fields of a prompt that determine its output, each preceded by its length.
+    static std::string CheckpointKey(const BatchPrompt& prompt)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const std::string& field)
+        {
+            auto size = std::to_string(field.size()) + ":";
+            for (auto c : size + field)
+            {
+                hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+            }
+        };
+        add(prompt.ssml ? "ssml" : "text");
+        add(prompt.text);
+        add(prompt.voice);
+        add(prompt.format);
+        add(prompt.output);
+        char key[17];
+        snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+        return key;
+    }
+
+    bool IsStopped()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stopped;
+    }
+
+    // Returns false if stopped while waiting.
+    bool WaitForRetry(std::chrono::milliseconds delay)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return !m_stopChanged.wait_for(lock, delay, [this]() { return m_stopped; });
+    }
+
+    SynthesizeFunction m_synthesize;
+    const Options m_options;
+
+    std::mutex m_mutex;
+    std::condition_variable m_stopChanged;
+    bool m_stopped = false;
+};
@@ -0,0 +1,432 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Minimal HTTP/1.1 server that streams responses with chunked transfer encoding, for serving audio
+// while it's synthesized. Each connection is handled on its own thread and closed after one
+// request; a client has 10 seconds to send the request head. It only parses the request line, and
+// is meant for local tools and samples, not for the internet.
+class ChunkedHttpServer final
+{
+public:
+    struct Request
+    {
+        std::string method;
+        std::string path;
+        // Decoded query parameters.
+        std::map<std::string, std::string> query;
+    };
+
+    // Sends the response of one request.
+    class ResponseWriter final
+    {
+    public:
+        // Sends the status line and the headers. Called implicitly with 200 by the first Write.
+        bool Start(int status, const std::string& contentType)
+        {
+            if (m_started)
+            {
+                return !m_failed;
+            }
+            m_started = true;
+            auto reason = status == 200 ? " OK" : status == 400 ? " Bad Request" : status == 404 ? " Not Found" : " Error";
+            auto header = "HTTP/1.1 " + std::to_string(status) + reason + "\r\n" +
+                "Content-Type: " + contentType + "\r\n" +
+                "Transfer-Encoding: chunked\r\n" +
+                "Cache-Control: no-cache\r\n" +
+                "Connection: close\r\n\r\n";
+            return Send(header.data(), header.size());
+        }
+
+        // Sends a chunk of the body. Returns false once the client disconnected.
+        bool Write(const void* data, size_t size)
+        {
+            if (!Start(200, "application/octet-stream") || size == 0)
+            {
+                return !m_failed;
+            }
+            char sizeLine[20];
+            snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", size);
+            return Send(sizeLine, strlen(sizeLine)) && Send(data, size) && Send("\r\n", 2);
+        }
+
+        // Sets a callback that Stop calls, on its thread, to wake the handler when it waits for
+        // something other than the client, e.g. Subscription::Cancel. Called right away if the
+        // server is stopping already.
+        void OnStop(std::function<void()> callback)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_stop->mutex);
+                if (!m_stop->stopped)
+                {
+                    m_stop->callback = std::move(callback);
+                    return;
+                }
+            }
+            callback();
+        }
+
+    private:
+        friend class ChunkedHttpServer;
+
+        struct StopState
+        {
+            std::mutex mutex;
+            std::function<void()> callback;
+            bool stopped = false;
+        };
+
+        bool Send(const void* data, size_t size)
+        {
+            auto bytes = (const char*)data;
+            while (size > 0 && !m_failed)
+            {
+#if defined(MSG_NOSIGNAL)
+                auto sent = send(m_socket, bytes, (int)size, MSG_NOSIGNAL);
+#else
+                auto sent = send(m_socket, bytes, (int)size, 0);
+#endif
+                if (sent <= 0)
+                {
+                    m_failed = true;
+                    break;
+                }
+                bytes += sent;
+                size -= (size_t)sent;
+            }
+            return !m_failed;
+        }
+
+        // Ends the body.
+        void Finish()
+        {
+            if (!m_started)
+            {
+                Start(404, "text/plain");
+            }
+            Send("0\r\n\r\n", 5);
+        }
+
+#ifdef _WIN32
+        SOCKET m_socket;
+#else
+        int m_socket;
+#endif
+        std::shared_ptr<StopState> m_stop;
+        bool m_started = false;
+        bool m_failed = false;
+    };
+
+    // Called on the connection's thread. The response is ended when it returns; without any Start or
+    // Write, the response is 404.
+    using Handler = std::function<void(const Request& request, ResponseWriter& response)>;
+
+    // Listens on the port of the local host, 0 for any free port.
+    ChunkedHttpServer(uint16_t port, Handler handler)
+        : m_handler(handler)
+    {
+#ifdef _WIN32
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        {
+            throw std::runtime_error("Failed to initialize Winsock.");
+        }
+#endif
+        m_listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        socklen_t addressSize = sizeof(address);
+        if (m_listener == invalidSocket ||
+            bind(m_listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(m_listener, SOMAXCONN) != 0 ||
+            getsockname(m_listener, (sockaddr*)&address, &addressSize) != 0)
+        {
+            CloseSocket(m_listener);
+#ifdef _WIN32
+            WSACleanup();
+#endif
+            throw std::runtime_error("Failed to listen on port " + std::to_string(port));
+        }
+        m_port = ntohs(address.sin_port);
+        m_acceptThread = std::thread([this]() { RunAccept(); });
+    }
+
+    ~ChunkedHttpServer()
+    {
+        Stop();
+        CloseSocket(m_listener);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    ChunkedHttpServer(const ChunkedHttpServer&) = delete;
+    ChunkedHttpServer& operator=(const ChunkedHttpServer&) = delete;
+
+    uint16_t Port() const
+    {
+        return m_port;
+    }
+
+    // Stops accepting connections and ends the open ones: their sockets are shut down, so that reads
+    // and writes fail, their OnStop callbacks are called, and their threads are joined once the
+    // handlers return. Call from one thread.
+    void Stop()
+    {
+        if (m_stopped.exchange(true))
+        {
+            return;
+        }
+        m_acceptThread.join();
+        for (auto& connection : m_connections)
+        {
+#ifdef _WIN32
+            shutdown(connection.socket, SD_BOTH);
+#else
+            shutdown(connection.socket, SHUT_RDWR);
+#endif
+            std::function<void()> callback;
+            {
+                std::lock_guard<std::mutex> lock(connection.stop->mutex);
+                connection.stop->stopped = true;
+                callback = std::move(connection.stop->callback);
+            }
+            if (callback)
+            {
+                callback();
+            }
+        }
+        for (auto& connection : m_connections)
+        {
+            connection.thread.join();
+            CloseSocket(connection.socket);
+        }
+        m_connections.clear();
+    }
+
+private:
+#ifdef _WIN32
+    using Socket = SOCKET;
+    static constexpr Socket invalidSocket = INVALID_SOCKET;
+#else
+    using Socket = int;
+    enum : int { invalidSocket = -1 };
+#endif
+    enum : int { requestHeadTimeoutMs = 10000 };
+
+    // The socket is closed by the owner of the connection after the thread ended, so that Stop never
+    // shuts down a socket number that was reused.
+    struct Connection
+    {
+        Socket socket;
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+        std::shared_ptr<ResponseWriter::StopState> stop;
+    };
+
+    static void CloseSocket(Socket socket)
+    {
+        if (socket != invalidSocket)
+        {
+#ifdef _WIN32
+            closesocket(socket);
+#else
+            close(socket);
+#endif
+        }
+    }
+
+    // Waits for connections with a timeout, so that Stop can stop it, and closes the connections
+    // that finished.
+    void RunAccept()
+    {
+        while (!m_stopped)
+        {
+            for (auto it = m_connections.begin(); it != m_connections.end();)
+            {
+                if (*it->finished)
+                {
+                    it->thread.join();
+                    CloseSocket(it->socket);
+                    it = m_connections.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            if (!WaitReadable(m_listener, 200))
+            {
+                continue;
+            }
+
+            auto client = accept(m_listener, nullptr, nullptr);
+            if (client == invalidSocket)
+            {
+                continue;
+            }
+
+            auto finished = std::make_shared<std::atomic<bool>>(false);
+            auto stop = std::make_shared<ResponseWriter::StopState>();
+            std::thread thread([this, client, finished, stop]()
+            {
+                HandleConnection(client, stop);
+                *finished = true;
+            });
+            m_connections.push_back({ client, std::move(thread), finished, stop });
+        }
+    }
+
+    // Waits until the socket can be read, for up to the timeout. poll has no limit on the socket
+    // numbers, unlike select with its fixed size fd_set.
+    static bool WaitReadable(Socket socket, int timeoutMs)
+    {
+        pollfd descriptor = {};
+        descriptor.fd = socket;
+        descriptor.events = POLLIN;
+#ifdef _WIN32
+        return WSAPoll(&descriptor, 1, timeoutMs) > 0;
+#else
+        return poll(&descriptor, 1, timeoutMs) > 0;
+#endif
+    }
+
+    void HandleConnection(Socket client, const std::shared_ptr<ResponseWriter::StopState>& stop)
+    {
+        // Reads the request head, up to 8 KB, and gives up on a client that doesn't send it in time.
+        std::string head;
+        char buffer[1024];
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(requestHeadTimeoutMs);
+        while (head.find("\r\n\r\n") == std::string::npos && head.size() < 8192)
+        {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (!WaitReadable(client, (int)std::max<int64_t>(0, remaining)))
+            {
+                return;
+            }
+            auto received = recv(client, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+            {
+                return;
+            }
+            head.append(buffer, (size_t)received);
+        }
+
+        ResponseWriter response;
+        response.m_socket = client;
+        response.m_stop = stop;
+        Request request;
+        if (!ParseRequestLine(head.substr(0, head.find("\r\n")), request))
+        {
+            response.Start(400, "text/plain");
+            response.Finish();
+            return;
+        }
+
+        try
+        {
+            m_handler(request, response);
+        }
+        catch (const std::exception&)
+        {
+            if (!response.m_started)
+            {
+                response.Start(500, "text/plain");
+            }
+        }
+        {
+            // Releases what the callback holds.
+            std::lock_guard<std::mutex> lock(stop->mutex);
+            stop->callback = nullptr;
+        }
+        response.Finish();
+    }
+
+    // Parses "METHOD /path?name=value&... HTTP/1.1".
+    static bool ParseRequestLine(const std::string& line, Request& request)
+    {
+        auto methodEnd = line.find(' ');
+        auto targetEnd = methodEnd == std::string::npos ? methodEnd : line.find(' ', methodEnd + 1);
+        if (targetEnd == std::string::npos)
+        {
+            return false;
+        }
+        request.method = line.substr(0, methodEnd);
+        auto target = line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+
+        auto queryStart = target.find('?');
+        request.path = Decode(target.substr(0, queryStart));
+        while (queryStart != std::string::npos)
+        {
+            auto parameterEnd = target.find('&', queryStart + 1);
+            auto parameter = target.substr(queryStart + 1, parameterEnd == std::string::npos ? std::string::npos : parameterEnd - queryStart - 1);
+            auto equals = parameter.find('=');
+            if (equals != std::string::npos)
+            {
+                request.query[Decode(parameter.substr(0, equals))] = Decode(parameter.substr(equals + 1));
+            }
+            queryStart = parameterEnd;
+        }
+        return true;
+    }
+
+    // Decodes %XX escapes and '+'.
+    static std::string Decode(const std::string& text)
+    {
+        std::string decoded;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '%' && i + 2 < text.size() && isxdigit((unsigned char)text[i + 1]) && isxdigit((unsigned char)text[i + 2]))
+            {
+                decoded += (char)std::stoi(text.substr(i + 1, 2), nullptr, 16);
+                i += 2;
+            }
+            else
+            {
+                decoded += text[i] == '+' ? ' ' : text[i];
+            }
+        }
+        return decoded;
+    }
+
+    Handler m_handler;
+    Socket m_listener = invalidSocket;
+    uint16_t m_port = 0;
+    std::atomic<bool> m_stopped{ false };
+    std::thread m_acceptThread;
+    // Only used by the accept thread, and by Stop after it ended.
+    std::list<Connection> m_connections;
+};
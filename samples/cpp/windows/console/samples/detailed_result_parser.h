@@ -0,0 +1,616 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A string of a parsed result. It points into the JSON text when the string has no escape
+// sequences, and into the result's own buffer when it has.
+struct JsonText
+{
+    const char* data = nullptr;
+    size_t size = 0;
+
+    std::string str() const { return std::string(data, size); }
+    bool empty() const { return size == 0; }
+
+    bool operator==(const char* other) const
+    {
+        return std::strlen(other) == size && std::memcmp(data, other, size) == 0;
+    }
+};
+
+// The detailed recognition result (OutputFormat::Detailed, SpeechServiceResponse_JsonResult) as a
+// struct of arrays: one entry per alternative in the NBest arrays, and one entry per word of all
+// alternatives in the word arrays. Reuse one instance for many results: parsing clears the arrays
+// but keeps their capacity, so it doesn't allocate once they are large enough.
+struct DetailedResult
+{
+    JsonText recognitionStatus;
+    JsonText displayText;
+    // In ticks of 100 ns.
+    uint64_t offset = 0;
+    uint64_t duration = 0;
+
+    std::vector<double> confidence;
+    std::vector<JsonText> lexical;
+    std::vector<JsonText> itn;
+    std::vector<JsonText> maskedItn;
+    std::vector<JsonText> display;
+    // The words of alternative i are [wordsBegin[i], wordsEnd[i]) in the word arrays.
+    std::vector<uint32_t> wordsBegin;
+    std::vector<uint32_t> wordsEnd;
+
+    std::vector<JsonText> word;
+    std::vector<uint64_t> wordOffset;
+    std::vector<uint64_t> wordDuration;
+    // 0 when the service doesn't send a confidence for each word.
+    std::vector<double> wordConfidence;
+
+    size_t AlternativeCount() const { return confidence.size(); }
+
+    void Clear()
+    {
+        recognitionStatus = JsonText();
+        displayText = JsonText();
+        offset = 0;
+        duration = 0;
+        confidence.clear();
+        lexical.clear();
+        itn.clear();
+        maskedItn.clear();
+        display.clear();
+        wordsBegin.clear();
+        wordsEnd.clear();
+        word.clear();
+        wordOffset.clear();
+        wordDuration.clear();
+        wordConfidence.clear();
+        unescapedSize = 0;
+    }
+
+    // Strings with escape sequences, decoded. Sized to the JSON text before parsing, so it doesn't
+    // move while strings point into it.
+    std::vector<char> unescaped;
+    size_t unescapedSize = 0;
+};
+
+// Parses the detailed recognition result in one pass, without building a document: the fields
+// that DetailedResult has are stored as they are read, and other fields are skipped. Strings
+// aren't copied unless they have escape sequences. The JSON text must outlive the result.
+// Malformed JSON throws std::runtime_error, in skipped values too.
+class DetailedResultParser final
+{
+public:
+    static void Parse(const std::string& json, DetailedResult& result)
+    {
+        Parse(json.data(), json.size(), result);
+    }
+
+    static void Parse(const char* json, size_t size, DetailedResult& result)
+    {
+        result.Clear();
+        if (result.unescaped.size() < size)
+        {
+            result.unescaped.resize(size);
+        }
+        Reader reader{ json, json + size, json, result, 0 };
+        reader.SkipSpace();
+        reader.ParseObject([&reader](const JsonText& key) { reader.ParseResultField(key); });
+        reader.SkipSpace();
+        if (reader.position != reader.end)
+        {
+            reader.Fail("unexpected text after the result");
+        }
+    }
+
+private:
+    struct Reader
+    {
+        const char* position;
+        const char* end;
+        const char* begin;
+        DetailedResult& result;
+        int depth;
+
+        void ParseResultField(const JsonText& key)
+        {
+            if (key == "RecognitionStatus")
+            {
+                result.recognitionStatus = ParseString();
+            }
+            else if (key == "DisplayText")
+            {
+                result.displayText = ParseString();
+            }
+            else if (key == "Offset")
+            {
+                result.offset = ParseUnsigned();
+            }
+            else if (key == "Duration")
+            {
+                result.duration = ParseUnsigned();
+            }
+            else if (key == "NBest")
+            {
+                ParseArray([this]() { ParseAlternative(); });
+            }
+            else
+            {
+                SkipValue();
+            }
+        }
+
+        void ParseAlternative()
+        {
+            auto words = static_cast<uint32_t>(result.word.size());
+            result.confidence.push_back(0);
+            result.lexical.push_back(JsonText());
+            result.itn.push_back(JsonText());
+            result.maskedItn.push_back(JsonText());
+            result.display.push_back(JsonText());
+            result.wordsBegin.push_back(words);
+            result.wordsEnd.push_back(words);
+            auto index = result.confidence.size() - 1;
+            ParseObject([this, index](const JsonText& key)
+            {
+                if (key == "Confidence")
+                {
+                    result.confidence[index] = ParseNumber();
+                }
+                else if (key == "Lexical")
+                {
+                    result.lexical[index] = ParseString();
+                }
+                else if (key == "ITN")
+                {
+                    result.itn[index] = ParseString();
+                }
+                else if (key == "MaskedITN")
+                {
+                    result.maskedItn[index] = ParseString();
+                }
+                else if (key == "Display")
+                {
+                    result.display[index] = ParseString();
+                }
+                else if (key == "Words")
+                {
+                    result.wordsBegin[index] = static_cast<uint32_t>(result.word.size());
+                    ParseArray([this]() { ParseWord(); });
+                    result.wordsEnd[index] = static_cast<uint32_t>(result.word.size());
+                }
+                else
+                {
+                    SkipValue();
+                }
+            });
+        }
+
+        void ParseWord()
+        {
+            result.word.push_back(JsonText());
+            result.wordOffset.push_back(0);
+            result.wordDuration.push_back(0);
+            result.wordConfidence.push_back(0);
+            auto index = result.word.size() - 1;
+            ParseObject([this, index](const JsonText& key)
+            {
+                if (key == "Word")
+                {
+                    result.word[index] = ParseString();
+                }
+                else if (key == "Offset")
+                {
+                    result.wordOffset[index] = ParseUnsigned();
+                }
+                else if (key == "Duration")
+                {
+                    result.wordDuration[index] = ParseUnsigned();
+                }
+                else if (key == "Confidence")
+                {
+                    result.wordConfidence[index] = ParseNumber();
+                }
+                else
+                {
+                    SkipValue();
+                }
+            });
+        }
+
+        // Calls 'field' for each key, with the position at its value.
+        template<typename Field>
+        void ParseObject(Field&& field)
+        {
+            Expect('{');
+            SkipSpace();
+            if (Peek() == '}')
+            {
+                position++;
+                return;
+            }
+            while (true)
+            {
+                SkipSpace();
+                // Keys are compared as written; the keys of the result have no escape sequences.
+                auto key = ParseString();
+                SkipSpace();
+                Expect(':');
+                SkipSpace();
+                field(key);
+                SkipSpace();
+                if (Peek() == ',')
+                {
+                    position++;
+                    continue;
+                }
+                Expect('}');
+                return;
+            }
+        }
+
+        template<typename Element>
+        void ParseArray(Element&& element)
+        {
+            Expect('[');
+            SkipSpace();
+            if (Peek() == ']')
+            {
+                position++;
+                return;
+            }
+            while (true)
+            {
+                SkipSpace();
+                element();
+                SkipSpace();
+                if (Peek() == ',')
+                {
+                    position++;
+                    continue;
+                }
+                Expect(']');
+                return;
+            }
+        }
+
+        JsonText ParseString()
+        {
+            Expect('"');
+            auto start = position;
+            while (position < end && *position != '"' && *position != '\\')
+            {
+                position++;
+            }
+            if (position == end)
+            {
+                Fail("unterminated string");
+            }
+            if (*position == '"')
+            {
+                JsonText text;
+                text.data = start;
+                text.size = static_cast<size_t>(position - start);
+                position++;
+                return text;
+            }
+
+            // Has escape sequences: decodes it into the buffer of the result.
+            auto out = result.unescaped.data() + result.unescapedSize;
+            JsonText text;
+            text.data = out;
+            std::memcpy(out, start, static_cast<size_t>(position - start));
+            out += position - start;
+            while (true)
+            {
+                if (position == end)
+                {
+                    Fail("unterminated string");
+                }
+                auto c = *position++;
+                if (c == '"')
+                {
+                    break;
+                }
+                if (c != '\\')
+                {
+                    *out++ = c;
+                    continue;
+                }
+                if (position == end)
+                {
+                    Fail("unterminated string");
+                }
+                switch (*position++)
+                {
+                case '"': *out++ = '"'; break;
+                case '\\': *out++ = '\\'; break;
+                case '/': *out++ = '/'; break;
+                case 'b': *out++ = '\b'; break;
+                case 'f': *out++ = '\f'; break;
+                case 'n': *out++ = '\n'; break;
+                case 'r': *out++ = '\r'; break;
+                case 't': *out++ = '\t'; break;
+                case 'u':
+                {
+                    auto code = ParseHex4();
+                    if (code >= 0xD800 && code < 0xDC00 && end - position >= 6 && position[0] == '\\' && position[1] == 'u')
+                    {
+                        position += 2;
+                        auto low = ParseHex4();
+                        if (low < 0xDC00 || low >= 0xE000)
+                        {
+                            Fail("invalid surrogate pair");
+                        }
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    // A \uXXXX sequence is 6 bytes and decodes to at most 3, a pair is 12 and
+                    // decodes to 4, so the text never outgrows the JSON it comes from.
+                    out = AppendUtf8(out, code);
+                    break;
+                }
+                default:
+                    Fail("invalid escape sequence");
+                }
+            }
+            text.size = static_cast<size_t>(out - text.data);
+            result.unescapedSize += text.size;
+            return text;
+        }
+
+        uint32_t ParseHex4()
+        {
+            if (end - position < 4)
+            {
+                Fail("invalid \\u escape sequence");
+            }
+            uint32_t code = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                auto c = *position++;
+                code <<= 4;
+                if (c >= '0' && c <= '9') code |= static_cast<uint32_t>(c - '0');
+                else if (c >= 'a' && c <= 'f') code |= static_cast<uint32_t>(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F') code |= static_cast<uint32_t>(c - 'A' + 10);
+                else Fail("invalid \\u escape sequence");
+            }
+            return code;
+        }
+
+        static char* AppendUtf8(char* out, uint32_t code)
+        {
+            if (code < 0x80)
+            {
+                *out++ = static_cast<char>(code);
+            }
+            else if (code < 0x800)
+            {
+                *out++ = static_cast<char>(0xC0 | (code >> 6));
+                *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000)
+            {
+                *out++ = static_cast<char>(0xE0 | (code >> 12));
+                *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                *out++ = static_cast<char>(0xF0 | (code >> 18));
+                *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            }
+            return out;
+        }
+
+        uint64_t ParseUnsigned()
+        {
+            if (position == end || *position < '0' || *position > '9')
+            {
+                Fail("expected an unsigned integer");
+            }
+            uint64_t value = 0;
+            while (position < end && *position >= '0' && *position <= '9')
+            {
+                value = value * 10 + static_cast<uint64_t>(*position++ - '0');
+            }
+            return value;
+        }
+
+        // Without strtod, which needs a terminated string and depends on the locale. The digits are
+        // collected as an integer and scaled once, which is exact for the up to 15 significant
+        // digits of confidences and scores.
+        double ParseNumber()
+        {
+            static const double powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+            bool negative = position < end && *position == '-';
+            if (negative)
+            {
+                position++;
+            }
+            if (position == end || *position < '0' || *position > '9')
+            {
+                Fail("expected a number");
+            }
+            uint64_t digits = 0;
+            int exponent = 0;
+            auto addDigit = [&digits, &exponent](char c)
+            {
+                // Digits beyond 19 don't change a double; only their magnitude is kept.
+                if (digits < 1000000000000000000ull)
+                {
+                    digits = digits * 10 + static_cast<uint64_t>(c - '0');
+                }
+                else
+                {
+                    exponent++;
+                }
+            };
+            while (position < end && *position >= '0' && *position <= '9')
+            {
+                addDigit(*position++);
+            }
+            if (position < end && *position == '.')
+            {
+                position++;
+                while (position < end && *position >= '0' && *position <= '9')
+                {
+                    addDigit(*position++);
+                    exponent--;
+                }
+            }
+            if (position < end && (*position == 'e' || *position == 'E'))
+            {
+                position++;
+                bool negativeExponent = position < end && *position == '-';
+                if (position < end && (*position == '-' || *position == '+'))
+                {
+                    position++;
+                }
+                int written = 0;
+                while (position < end && *position >= '0' && *position <= '9')
+                {
+                    written = std::min(written * 10 + (*position++ - '0'), 1000);
+                }
+                exponent += negativeExponent ? -written : written;
+            }
+            double value = static_cast<double>(digits);
+            while (exponent > 0)
+            {
+                auto step = std::min(exponent, 22);
+                value *= powersOf10[step];
+                exponent -= step;
+            }
+            while (exponent < 0)
+            {
+                auto step = std::min(-exponent, 22);
+                value /= powersOf10[step];
+                exponent += step;
+            }
+            return negative ? -value : value;
+        }
+
+        void SkipValue()
+        {
+            switch (Peek())
+            {
+            case '{':
+                Nest([this]() { ParseObject([this](const JsonText&) { SkipValue(); }); });
+                break;
+            case '[':
+                Nest([this]() { ParseArray([this]() { SkipValue(); }); });
+                break;
+            case '"':
+                SkipString();
+                break;
+            case 't':
+                ExpectWord("true");
+                break;
+            case 'f':
+                ExpectWord("false");
+                break;
+            case 'n':
+                ExpectWord("null");
+                break;
+            default:
+                ParseNumber();
+                break;
+            }
+        }
+
+        // Bounds the recursion of skipped values.
+        template<typename Value>
+        void Nest(Value&& value)
+        {
+            if (++depth > 64)
+            {
+                Fail("nested too deeply");
+            }
+            value();
+            depth--;
+        }
+
+        // Like ParseString, without decoding; escape sequences are checked the same way.
+        void SkipString()
+        {
+            Expect('"');
+            while (true)
+            {
+                if (position == end)
+                {
+                    Fail("unterminated string");
+                }
+                auto c = *position++;
+                if (c == '"')
+                {
+                    return;
+                }
+                if (c != '\\')
+                {
+                    continue;
+                }
+                if (position == end)
+                {
+                    Fail("unterminated string");
+                }
+                switch (*position++)
+                {
+                case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                    break;
+                case 'u':
+                    ParseHex4();
+                    break;
+                default:
+                    Fail("invalid escape sequence");
+                }
+            }
+        }
+
+        void SkipSpace()
+        {
+            while (position < end && (*position == ' ' || *position == '\n' || *position == '\r' || *position == '\t'))
+            {
+                position++;
+            }
+        }
+
+        char Peek() const
+        {
+            return position < end ? *position : '\0';
+        }
+
+        void Expect(char c)
+        {
+            if (position == end || *position != c)
+            {
+                Fail(std::string("expected '") + c + "'");
+            }
+            position++;
+        }
+
+        void ExpectWord(const char* word)
+        {
+            auto length = std::strlen(word);
+            if (static_cast<size_t>(end - position) < length || std::memcmp(position, word, length) != 0)
+            {
+                Fail(std::string("expected ") + word);
+            }
+            position += length;
+        }
+
+        [[noreturn]] void Fail(const std::string& message) const
+        {
+            throw std::runtime_error("Detailed result JSON, at " + std::to_string(position - begin) + ": " + message);
+        }
+    };
+};
@@ -0,0 +1,467 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hdr_histogram.h"
+
+// Runs event handlers on worker threads instead of the SDK's callback thread, so that a slow
+// handler, such as one that writes to a database, doesn't delay the events that follow. The SDK
+// callback only copies the payload of the event into a lock-free queue. Sessions are spread over
+// the workers by session id, one queue and one thread per worker, so the events of a session are
+// handled in order. Handlers that take too long on a worker, and code that blocks the SDK thread,
+// are reported through the warning handler.
+class EventDispatcher final
+{
+public:
+    struct Options
+    {
+        size_t workerCount = 4;
+        // Time on the SDK thread above which a callback is reported as blocking it.
+        std::chrono::microseconds callbackWarningThreshold{ 1000 };
+        // Time on a worker above which a handler is reported as delaying the sessions of its worker.
+        std::chrono::milliseconds handlerWarningThreshold{ 100 };
+    };
+
+    // Called on the SDK thread or on a worker, at most once per second for each kind of warning.
+    using WarningHandler = std::function<void(const std::string& message)>;
+
+    struct Canceled
+    {
+        Microsoft::CognitiveServices::Speech::CancellationReason reason;
+        Microsoft::CognitiveServices::Speech::CancellationErrorCode errorCode;
+        std::string errorDetails;
+    };
+
+    // Handlers of recognition events, run on the workers. Any of them may be empty.
+    struct RecognitionHandlers
+    {
+        std::function<void(const std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognitionResult>& result)> recognizing;
+        std::function<void(const std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognitionResult>& result)> recognized;
+        std::function<void(const Canceled& canceled)> canceled;
+        std::function<void(const std::string& sessionId)> sessionStarted;
+        std::function<void(const std::string& sessionId)> sessionStopped;
+    };
+
+    struct Stats
+    {
+        uint64_t posted = 0;
+        uint64_t handled = 0;
+        size_t maxQueueLength = 0;
+        uint64_t slowCallbacks = 0;
+        uint64_t slowHandlers = 0;
+        // From Post to the start of the handler.
+        std::chrono::microseconds queueDelayP50{ 0 };
+        std::chrono::microseconds queueDelayP99{ 0 };
+        std::chrono::microseconds queueDelayMax{ 0 };
+        std::chrono::microseconds handlerP50{ 0 };
+        std::chrono::microseconds handlerP99{ 0 };
+        std::chrono::microseconds handlerMax{ 0 };
+        // Time spent on the SDK thread, by the callbacks of Connect and Inline.
+        std::chrono::microseconds callbackP99{ 0 };
+        std::chrono::microseconds callbackMax{ 0 };
+    };
+
+    // Without a warning handler, warnings are written to std::cerr.
+    explicit EventDispatcher(const Options& options, WarningHandler warningHandler = nullptr)
+        : m_options(options), m_warningHandler(warningHandler), m_workers(std::max<size_t>(1, options.workerCount))
+    {
+        if (!m_warningHandler)
+        {
+            m_warningHandler = [](const std::string& message) { std::cerr << "EventDispatcher: " << message << std::endl; };
+        }
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            m_workers[i].thread = std::thread([this, i]() { RunWorker(m_workers[i]); });
+        }
+    }
+
+    // Handles the events already posted, and stops the workers. Disconnect the recognizers, or
+    // destroy them, first.
+    ~EventDispatcher()
+    {
+        for (auto& worker : m_workers)
+        {
+            {
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                worker.stopping = true;
+            }
+            worker.wakeUp.notify_one();
+        }
+        for (auto& worker : m_workers)
+        {
+            worker.thread.join();
+        }
+    }
+
+    EventDispatcher(const EventDispatcher&) = delete;
+    EventDispatcher& operator=(const EventDispatcher&) = delete;
+
+    // Queues a handler after the ones posted before for the same session. Lock-free, callable from
+    // any thread.
+    void Post(const std::string& session, std::function<void()> handler)
+    {
+        auto& worker = m_workers[std::hash<std::string>()(session) % m_workers.size()];
+        auto node = new Node;
+        node->handler = std::move(handler);
+        node->posted = std::chrono::steady_clock::now();
+        auto length = worker.length.fetch_add(1) + 1;
+        worker.queue.Push(node);
+
+        auto maxLength = worker.maxLength.load(std::memory_order_relaxed);
+        while (length > maxLength && !worker.maxLength.compare_exchange_weak(maxLength, length, std::memory_order_relaxed))
+        {
+        }
+        m_posted.fetch_add(1, std::memory_order_relaxed);
+
+        // The worker sets 'sleeping' before it checks the length, so one of the two sees the other.
+        if (worker.sleeping.load())
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.wakeUp.notify_one();
+        }
+    }
+
+    // Connects the handlers to the events of the recognizer. The events are copied on the SDK thread,
+    // and handled on the worker of their session.
+    void Connect(const std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer>& recognizer, const RecognitionHandlers& handlers)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (handlers.recognizing)
+        {
+            auto handler = handlers.recognizing;
+            recognizer->Recognizing += [this, handler](const SpeechRecognitionEventArgs& e)
+            {
+                auto start = std::chrono::steady_clock::now();
+                auto result = e.Result;
+                Post(e.SessionId, [handler, result]() { handler(result); });
+                CallbackDone("Recognizing", start);
+            };
+        }
+        if (handlers.recognized)
+        {
+            auto handler = handlers.recognized;
+            recognizer->Recognized += [this, handler](const SpeechRecognitionEventArgs& e)
+            {
+                auto start = std::chrono::steady_clock::now();
+                auto result = e.Result;
+                Post(e.SessionId, [handler, result]() { handler(result); });
+                CallbackDone("Recognized", start);
+            };
+        }
+        if (handlers.canceled)
+        {
+            auto handler = handlers.canceled;
+            recognizer->Canceled += [this, handler](const SpeechRecognitionCanceledEventArgs& e)
+            {
+                auto start = std::chrono::steady_clock::now();
+                Canceled canceled{ e.Reason, e.ErrorCode, e.ErrorDetails };
+                Post(e.SessionId, [handler, canceled]() { handler(canceled); });
+                CallbackDone("Canceled", start);
+            };
+        }
+        if (handlers.sessionStarted)
+        {
+            auto handler = handlers.sessionStarted;
+            recognizer->SessionStarted += [this, handler](const SessionEventArgs& e)
+            {
+                auto start = std::chrono::steady_clock::now();
+                auto sessionId = e.SessionId;
+                Post(sessionId, [handler, sessionId]() { handler(sessionId); });
+                CallbackDone("SessionStarted", start);
+            };
+        }
+        if (handlers.sessionStopped)
+        {
+            auto handler = handlers.sessionStopped;
+            recognizer->SessionStopped += [this, handler](const SessionEventArgs& e)
+            {
+                auto start = std::chrono::steady_clock::now();
+                auto sessionId = e.SessionId;
+                Post(sessionId, [handler, sessionId]() { handler(sessionId); });
+                CallbackDone("SessionStopped", start);
+            };
+        }
+    }
+
+    // Wraps a handler that has to run on the SDK thread, to measure it and report it if it blocks
+    // the thread for too long.
+    template <class EventArgs>
+    std::function<void(const EventArgs&)> Inline(const std::string& name, std::function<void(const EventArgs&)> handler)
+    {
+        return [this, name, handler](const EventArgs& e)
+        {
+            auto start = std::chrono::steady_clock::now();
+            handler(e);
+            CallbackDone(name.c_str(), start);
+        };
+    }
+
+    // Waits until the handlers posted so far have run.
+    void Flush()
+    {
+        std::vector<std::future<void>> barriers;
+        for (auto& worker : m_workers)
+        {
+            auto barrier = std::make_shared<std::promise<void>>();
+            barriers.push_back(barrier->get_future());
+            PostToWorker(worker, [barrier]() { barrier->set_value(); });
+        }
+        for (auto& barrier : barriers)
+        {
+            barrier.wait();
+        }
+    }
+
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.posted = m_posted.load();
+        stats.slowCallbacks = m_slowCallbacks.load();
+        HdrHistogram queueDelay;
+        HdrHistogram handlerTime;
+        for (auto& worker : m_workers)
+        {
+            std::lock_guard<std::mutex> lock(worker.statsMutex);
+            stats.handled += worker.handled;
+            stats.slowHandlers += worker.slowHandlers;
+            stats.maxQueueLength = std::max(stats.maxQueueLength, worker.maxLength.load());
+            queueDelay.Add(worker.queueDelay);
+            handlerTime.Add(worker.handlerTime);
+        }
+        stats.queueDelayP50 = std::chrono::microseconds(queueDelay.ValueAtPercentile(50));
+        stats.queueDelayP99 = std::chrono::microseconds(queueDelay.ValueAtPercentile(99));
+        stats.queueDelayMax = std::chrono::microseconds(queueDelay.Max());
+        stats.handlerP50 = std::chrono::microseconds(handlerTime.ValueAtPercentile(50));
+        stats.handlerP99 = std::chrono::microseconds(handlerTime.ValueAtPercentile(99));
+        stats.handlerMax = std::chrono::microseconds(handlerTime.Max());
+
+        std::lock_guard<std::mutex> lock(m_callbackMutex);
+        stats.callbackP99 = std::chrono::microseconds(m_callbackTime.ValueAtPercentile(99));
+        stats.callbackMax = std::chrono::microseconds(m_callbackTime.Max());
+        return stats;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next{ nullptr };
+        std::function<void()> handler;
+        std::chrono::steady_clock::time_point posted;
+        bool counted = true;
+    };
+
+    // Intrusive multiple producer, single consumer queue (Vyukov): a push is one atomic exchange
+    // and one store, and never waits for other producers or for the consumer.
+    class MpscQueue final
+    {
+    public:
+        MpscQueue()
+            : m_head(&m_stub), m_tail(&m_stub)
+        {
+        }
+
+        ~MpscQueue()
+        {
+            while (auto node = Pop())
+            {
+                delete node;
+            }
+        }
+
+        void Push(Node* node)
+        {
+            node->next.store(nullptr, std::memory_order_relaxed);
+            auto previous = m_head.exchange(node, std::memory_order_acq_rel);
+            previous->next.store(node, std::memory_order_release);
+        }
+
+        // Returns nullptr if the queue is empty, or if a push is half done; the caller tries again
+        // later then.
+        Node* Pop()
+        {
+            auto tail = m_tail;
+            auto next = tail->next.load(std::memory_order_acquire);
+            if (tail == &m_stub)
+            {
+                if (next == nullptr)
+                {
+                    return nullptr;
+                }
+                m_tail = next;
+                tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if (next != nullptr)
+            {
+                m_tail = next;
+                return tail;
+            }
+            if (tail != m_head.load(std::memory_order_acquire))
+            {
+                return nullptr;
+            }
+            Push(&m_stub);
+            next = tail->next.load(std::memory_order_acquire);
+            if (next != nullptr)
+            {
+                m_tail = next;
+                return tail;
+            }
+            return nullptr;
+        }
+
+    private:
+        std::atomic<Node*> m_head;
+        Node* m_tail;
+        Node m_stub;
+    };
+
+    struct Worker
+    {
+        MpscQueue queue;
+        // Queued nodes, counted before they are pushed.
+        std::atomic<size_t> length{ 0 };
+        std::atomic<size_t> maxLength{ 0 };
+        std::atomic<bool> sleeping{ false };
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        bool stopping = false;
+        std::thread thread;
+
+        mutable std::mutex statsMutex;
+        uint64_t handled = 0;
+        uint64_t slowHandlers = 0;
+        HdrHistogram queueDelay;
+        HdrHistogram handlerTime;
+    };
+
+    void PostToWorker(Worker& worker, std::function<void()> handler)
+    {
+        auto node = new Node;
+        node->handler = std::move(handler);
+        node->posted = std::chrono::steady_clock::now();
+        node->counted = false;
+        worker.length.fetch_add(1);
+        worker.queue.Push(node);
+        if (worker.sleeping.load())
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.wakeUp.notify_one();
+        }
+    }
+
+    void RunWorker(Worker& worker)
+    {
+        while (true)
+        {
+            if (worker.length.load() == 0)
+            {
+                std::unique_lock<std::mutex> lock(worker.mutex);
+                worker.sleeping.store(true);
+                worker.wakeUp.wait(lock, [&worker]() { return worker.length.load() > 0 || worker.stopping; });
+                worker.sleeping.store(false);
+                if (worker.length.load() == 0)
+                {
+                    return;
+                }
+            }
+
+            auto node = worker.queue.Pop();
+            if (node == nullptr)
+            {
+                // A producer is between its exchange and its store.
+                std::this_thread::yield();
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            try
+            {
+                node->handler();
+            }
+            catch (const std::exception& e)
+            {
+                Warn(m_lastHandlerError, std::string("An event handler threw: ") + e.what());
+            }
+            catch (...)
+            {
+                Warn(m_lastHandlerError, "An event handler threw.");
+            }
+            auto end = std::chrono::steady_clock::now();
+            worker.length.fetch_sub(1);
+
+            if (node->counted)
+            {
+                auto handlerTime = end - start;
+                bool slow = handlerTime > m_options.handlerWarningThreshold;
+                {
+                    std::lock_guard<std::mutex> lock(worker.statsMutex);
+                    worker.handled++;
+                    worker.slowHandlers += slow ? 1 : 0;
+                    worker.queueDelay.Record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(start - node->posted).count());
+                    worker.handlerTime.Record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(handlerTime).count());
+                }
+                if (slow)
+                {
+                    Warn(m_lastSlowHandler, "An event handler took " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(handlerTime).count()) +
+                        " ms; the events of the other sessions of its worker waited for it.");
+                }
+            }
+            delete node;
+        }
+    }
+
+    void CallbackDone(const char* name, std::chrono::steady_clock::time_point start)
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        {
+            std::lock_guard<std::mutex> lock(m_callbackMutex);
+            m_callbackTime.Record((uint64_t)elapsed.count());
+        }
+        if (elapsed > m_options.callbackWarningThreshold)
+        {
+            m_slowCallbacks.fetch_add(1);
+            Warn(m_lastSlowCallback, std::string("The ") + name + " callback blocked the SDK thread for " + std::to_string(elapsed.count()) +
+                " us; the events that follow it are delayed.");
+        }
+    }
+
+    // Reports at most one warning of a kind per second.
+    void Warn(std::atomic<int64_t>& last, const std::string& message)
+    {
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        auto previous = last.load();
+        if (now - previous >= 1000 && last.compare_exchange_strong(previous, now))
+        {
+            m_warningHandler(message);
+        }
+    }
+
+    const Options m_options;
+    WarningHandler m_warningHandler;
+    std::vector<Worker> m_workers;
+    std::atomic<uint64_t> m_posted{ 0 };
+    std::atomic<uint64_t> m_slowCallbacks{ 0 };
+    mutable std::mutex m_callbackMutex;
+    HdrHistogram m_callbackTime;
+    std::atomic<int64_t> m_lastSlowCallback{ INT64_MIN / 2 };
+    std::atomic<int64_t> m_lastSlowHandler{ INT64_MIN / 2 };
+    std::atomic<int64_t> m_lastHandlerError{ INT64_MIN / 2 };
+};
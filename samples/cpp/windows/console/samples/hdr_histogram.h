@@ -0,0 +1,129 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Histogram of non-negative integer values with a relative precision of about 1% (HDR style):
+// values below 128 have their own bucket, above that each power of two is split into 64 buckets.
+// Recording is O(1) and the memory is fixed, however many values are recorded.
+class HdrHistogram final
+{
+public:
+    HdrHistogram()
+        : m_counts(BucketIndex(MaxValue()) + 1, 0)
+    {
+    }
+
+    // Records a value, values above 2^40 are recorded as 2^40.
+    void Record(uint64_t value)
+    {
+        value = std::min(value, MaxValue());
+        m_counts[BucketIndex(value)]++;
+        m_count++;
+        m_sum += value;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    // Adds the values recorded by another histogram.
+    void Add(const HdrHistogram& other)
+    {
+        for (size_t i = 0; i < m_counts.size(); i++)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    uint64_t Count() const
+    {
+        return m_count;
+    }
+
+    uint64_t Min() const
+    {
+        return m_count == 0 ? 0 : m_min;
+    }
+
+    uint64_t Max() const
+    {
+        return m_max;
+    }
+
+    double Mean() const
+    {
+        return m_count == 0 ? 0 : (double)m_sum / m_count;
+    }
+
+    // Returns the highest value of the bucket that contains the given percentile, at most the maximum recorded.
+    uint64_t ValueAtPercentile(double percentile) const
+    {
+        if (m_count == 0)
+        {
+            return 0;
+        }
+
+        auto rank = std::max<uint64_t>(1, (uint64_t)(percentile / 100 * m_count + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); i++)
+        {
+            seen += m_counts[i];
+            if (seen >= rank)
+            {
+                return std::min(BucketHighestValue(i), m_max);
+            }
+        }
+        return m_max;
+    }
+
+private:
+    static uint64_t MaxValue()
+    {
+        return 1ull << 40;
+    }
+
+    static int HighestBit(uint64_t value)
+    {
+        int bit = 0;
+        while (value >>= 1)
+        {
+            bit++;
+        }
+        return bit;
+    }
+
+    static size_t BucketIndex(uint64_t value)
+    {
+        if (value < 128)
+        {
+            return (size_t)value;
+        }
+        auto shift = HighestBit(value) - 6;
+        return 128 + (shift - 1) * 64 + (size_t)((value >> shift) - 64);
+    }
+
+    static uint64_t BucketHighestValue(size_t index)
+    {
+        if (index < 128)
+        {
+            return index;
+        }
+        auto shift = (int)(index - 128) / 64 + 1;
+        auto mantissa = (uint64_t)((index - 128) % 64 + 64);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = UINT64_MAX;
+    uint64_t m_max = 0;
+};
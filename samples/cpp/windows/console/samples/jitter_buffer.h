@@ -0,0 +1,266 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Playout buffer between a synthesizer's push output stream and a real time sink, such as an audio
+// device or an RTP leg, for 16 bit PCM. The synthesizer writes chunks whenever they arrive; the sink
+// reads one frame per frame interval. Playback starts, and resumes after an underrun, once the
+// buffer holds the target delay. The target adapts to the arrival pattern: it covers the 95th
+// percentile of recent gaps between chunks. Underruns are concealed with silence, with short fades
+// so that they don't click.
+class JitterBuffer final : public Microsoft::CognitiveServices::Speech::Audio::PushAudioOutputStreamCallback
+{
+public:
+    struct Options
+    {
+        uint32_t bytesPerSecond = 32000;
+        uint16_t channels = 1;
+        std::chrono::milliseconds frameDuration{ 20 };
+        std::chrono::milliseconds initialDelay{ 100 };
+        std::chrono::milliseconds minDelay{ 40 };
+        std::chrono::milliseconds maxDelay{ 1000 };
+        // If false, the target delay stays at the initial delay.
+        bool adaptive = true;
+    };
+
+    struct Stats
+    {
+        uint64_t playedFrames = 0;
+        uint64_t startupFrames = 0;    // silence before the first audio.
+        uint64_t concealedFrames = 0;  // frames with silence inserted after an underrun.
+        uint64_t underruns = 0;
+        std::chrono::milliseconds targetDelay{ 0 };
+        std::chrono::milliseconds maxBuffered{ 0 };
+    };
+
+    explicit JitterBuffer(const Options& options)
+        : m_options(options)
+    {
+        m_frameSize = (size_t)(options.bytesPerSecond * options.frameDuration.count() / 1000);
+        m_frameSize -= m_frameSize % (2 * options.channels);
+        if (m_frameSize == 0 || options.minDelay > options.maxDelay)
+        {
+            throw std::invalid_argument("Invalid jitter buffer options.");
+        }
+        m_targetBytes = BytesOf(std::min(std::max(options.initialDelay, options.minDelay), options.maxDelay));
+    }
+
+    // Size of the frames that ReadFrame returns, in bytes.
+    size_t FrameSize() const
+    {
+        return m_frameSize;
+    }
+
+    // Called by the synthesizer with the synthesized audio.
+    int Write(uint8_t* dataBuffer, uint32_t size) override
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_hasWritten)
+        {
+            m_gaps[m_gapCount++ % gapHistory] = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastWrite);
+            if (m_options.adaptive)
+            {
+                UpdateTarget();
+            }
+        }
+        m_hasWritten = true;
+        m_lastWrite = now;
+
+        m_chunks.emplace_back(dataBuffer, dataBuffer + size);
+        m_buffered += size;
+        m_stats.maxBuffered = std::max(m_stats.maxBuffered, DurationOf(m_buffered));
+        return (int)size;
+    }
+
+    // Called by the synthesizer at the end of the audio.
+    void Close() override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+
+    // Fills 'frame' with FrameSize() bytes: audio, or silence while buffering. Returns false once the
+    // stream was closed and all audio was played.
+    bool ReadFrame(uint8_t* frame)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_playing)
+        {
+            if (m_buffered == 0 && m_closed)
+            {
+                return false;
+            }
+            if (m_buffered < m_targetBytes && !m_closed)
+            {
+                memset(frame, 0, m_frameSize);
+                (m_hasPlayed ? m_stats.concealedFrames : m_stats.startupFrames)++;
+                return true;
+            }
+            m_playing = true;
+            m_fadeIn = m_hasPlayed;
+        }
+
+        auto count = Take(frame, m_frameSize);
+        if (m_fadeIn)
+        {
+            Fade(frame, count, true);
+            m_fadeIn = false;
+        }
+
+        if (count < m_frameSize)
+        {
+            memset(frame + count, 0, m_frameSize - count);
+            if (!m_closed)
+            {
+                // Underrun: fades out what's left and waits for the target delay again.
+                Fade(frame, count, false);
+                m_playing = false;
+                m_stats.underruns++;
+                m_stats.concealedFrames++;
+                if (m_options.adaptive)
+                {
+                    UpdateTarget();
+                }
+                return true;
+            }
+            if (count == 0)
+            {
+                return false;
+            }
+        }
+        m_hasPlayed = true;
+        m_stats.playedFrames++;
+        return true;
+    }
+
+    // Plays the audio in real time: calls 'sink' with a frame every frame duration until the end of
+    // the stream. Returns the stats.
+    Stats Play(const std::function<void(const uint8_t* frame, size_t size)>& sink)
+    {
+        std::vector<uint8_t> frame(m_frameSize);
+        auto next = std::chrono::steady_clock::now();
+        while (ReadFrame(frame.data()))
+        {
+            sink(frame.data(), frame.size());
+            next += m_options.frameDuration;
+            std::this_thread::sleep_until(next);
+        }
+        return GetStats();
+    }
+
+    Stats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto stats = m_stats;
+        stats.targetDelay = DurationOf(m_targetBytes);
+        return stats;
+    }
+
+private:
+    enum : size_t { gapHistory = 256, fadeSamples = 32 };
+
+    size_t BytesOf(std::chrono::milliseconds duration) const
+    {
+        auto bytes = (size_t)(m_options.bytesPerSecond * duration.count() / 1000);
+        return bytes - bytes % (2 * m_options.channels);
+    }
+
+    std::chrono::milliseconds DurationOf(size_t bytes) const
+    {
+        return std::chrono::milliseconds(bytes * 1000 / m_options.bytesPerSecond);
+    }
+
+    // The target covers the 95th percentile of the recent gaps between chunks, plus one frame. The
+    // gaps are selected in a scratch copy of the ring, so that the writer doesn't allocate.
+    void UpdateTarget()
+    {
+        auto count = std::min<size_t>(m_gapCount, gapHistory);
+        if (count == 0)
+        {
+            return;
+        }
+        std::copy(m_gaps, m_gaps + count, m_gapScratch);
+        auto p95 = m_gapScratch + (count - 1) * 95 / 100;
+        std::nth_element(m_gapScratch, p95, m_gapScratch + count);
+        auto target = *p95 + m_options.frameDuration;
+        m_targetBytes = BytesOf(std::min(std::max(target, m_options.minDelay), m_options.maxDelay));
+    }
+
+    size_t Take(uint8_t* buffer, size_t size)
+    {
+        size_t count = 0;
+        while (count < size && !m_chunks.empty())
+        {
+            auto& chunk = m_chunks.front();
+            auto part = std::min(size - count, chunk.size() - m_readOffset);
+            memcpy(buffer + count, chunk.data() + m_readOffset, part);
+            count += part;
+            m_readOffset += part;
+            if (m_readOffset == chunk.size())
+            {
+                m_chunks.pop_front();
+                m_readOffset = 0;
+            }
+        }
+        m_buffered -= count;
+        return count;
+    }
+
+    // Ramps the first (fade in) or the last (fade out) samples of the audio, per channel.
+    void Fade(uint8_t* audio, size_t size, bool fadeIn) const
+    {
+        auto channels = (size_t)m_options.channels;
+        auto frames = size / (2 * channels);
+        auto length = std::min<size_t>(frames, fadeSamples);
+        for (size_t i = 0; i < length; i++)
+        {
+            auto index = fadeIn ? i : frames - length + i;
+            auto gain = fadeIn ? (double)i / length : (double)(length - i) / length;
+            for (size_t channel = 0; channel < channels; channel++)
+            {
+                auto sample = audio + (index * channels + channel) * 2;
+                int16_t value;
+                memcpy(&value, sample, sizeof(value));
+                value = (int16_t)(value * gain);
+                memcpy(sample, &value, sizeof(value));
+            }
+        }
+    }
+
+    const Options m_options;
+    size_t m_frameSize;
+
+    mutable std::mutex m_mutex;
+    std::deque<std::vector<uint8_t>> m_chunks;
+    size_t m_readOffset = 0;
+    size_t m_buffered = 0;
+    size_t m_targetBytes;
+    bool m_closed = false;
+    bool m_playing = false;
+    bool m_hasPlayed = false;
+    bool m_fadeIn = false;
+
+    bool m_hasWritten = false;
+    std::chrono::steady_clock::time_point m_lastWrite;
+    // Ring of the last gaps between chunks.
+    std::chrono::milliseconds m_gaps[gapHistory];
+    std::chrono::milliseconds m_gapScratch[gapHistory];
+    size_t m_gapCount = 0;
+
+    Stats m_stats;
+};
@@ -0,0 +1,104 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local stand-in for SpeechSynthesizer, to test and benchmark code built around synthesis
+// without a connection to the Speech service. It "synthesizes" a tone whose length is
+// proportional to the text, as raw 16 bit mono PCM, and delivers it in chunks with the
+// latency and pacing configured in its options, like the Synthesizing event does.
+// With 'burstSize' set, chunks arrive in bursts of that many, separated by 'burstPause', like
+// audio that is delayed on the network and then delivered at once. The pauses vary randomly between
+// none and twice 'burstPause'.
+class LocalSynthesizer final
+{
+public:
+    struct Options
+    {
+        uint32_t sampleRate = 16000;
+        std::chrono::milliseconds firstChunkLatency{ 100 };
+        std::chrono::milliseconds chunkInterval{ 20 };
+        size_t chunkSize = 3200;
+        std::chrono::milliseconds audioPerCharacter{ 60 };
+        size_t burstSize = 0;
+        std::chrono::milliseconds burstPause{ 0 };
+    };
+
+    using ChunkCallback = std::function<void(const uint8_t* data, size_t size)>;
+
+    LocalSynthesizer()
+    {
+    }
+
+    explicit LocalSynthesizer(const Options& options)
+        : m_options(options)
+    {
+    }
+
+    const Options& GetOptions() const
+    {
+        return m_options;
+    }
+
+    // Synthesizes the text, calls 'onChunk' for each chunk as it is produced, and returns all audio.
+    std::shared_ptr<std::vector<uint8_t>> SpeakText(const std::string& text, const ChunkCallback& onChunk = nullptr) const
+    {
+        auto audio = std::make_shared<std::vector<uint8_t>>(GenerateAudio(text));
+
+        std::minstd_rand random(1);
+        std::uniform_int_distribution<int64_t> pause(0, 2 * m_options.burstPause.count());
+
+        std::this_thread::sleep_for(m_options.firstChunkLatency);
+        for (size_t offset = 0; offset < audio->size(); offset += m_options.chunkSize)
+        {
+            if (offset > 0)
+            {
+                auto chunk = offset / m_options.chunkSize;
+                bool burstEnd = m_options.burstSize > 0 && chunk % m_options.burstSize == 0;
+                std::this_thread::sleep_for(burstEnd ? std::chrono::milliseconds(pause(random)) : m_options.chunkInterval);
+            }
+            if (onChunk)
+            {
+                onChunk(audio->data() + offset, std::min(m_options.chunkSize, audio->size() - offset));
+            }
+        }
+        return audio;
+    }
+
+    // Returns the audio that SpeakText produces for the text, without any delay.
+    std::vector<uint8_t> GenerateAudio(const std::string& text) const
+    {
+        // The pitch depends on the text, so different texts give different audio.
+        uint32_t hash = 2166136261u;
+        for (auto c : text)
+        {
+            hash = (hash ^ (uint8_t)c) * 16777619u;
+        }
+        auto frequency = 200.0 + hash % 600;
+
+        auto samples = (size_t)(text.size() * m_options.audioPerCharacter.count() * m_options.sampleRate / 1000);
+        std::vector<uint8_t> audio(samples * 2);
+        for (size_t i = 0; i < samples; i++)
+        {
+            auto value = (int16_t)(8000 * std::sin(2 * 3.14159265358979 * frequency * i / m_options.sampleRate));
+            audio[2 * i] = (uint8_t)(value & 0xff);
+            audio[2 * i + 1] = (uint8_t)((value >> 8) & 0xff);
+        }
+        return audio;
+    }
+
+private:
+    Options m_options;
+};
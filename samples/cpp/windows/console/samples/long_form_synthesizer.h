@@ -0,0 +1,525 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Synthesizes long documents by splitting them at sentence and paragraph boundaries and
+// synthesizing the segments in parallel on a set of SpeechSynthesizer instances. The audio of
+// the segments is stitched in order into one file, and word boundaries are reported on the
+// timeline of the stitched audio.
+class LongFormSynthesizer final
+{
+public:
+    struct Options
+    {
+        // Number of segments synthesized at the same time, one SpeechSynthesizer each.
+        size_t parallelism = 4;
+        // Segments are built from whole sentences up to this length, in characters of the input.
+        size_t maxSegmentLength = 1000;
+        // Riff8Khz16BitMonoPcm, Riff16Khz16BitMonoPcm, Riff24Khz16BitMonoPcm or one of the MP3 formats.
+        Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat outputFormat =
+            Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat::Riff16Khz16BitMonoPcm;
+    };
+
+    // A piece of the input, synthesized with one request.
+    struct Segment
+    {
+        std::string content;     // text, or SSML with the speak and voice elements of the input.
+        uint32_t sourceOffset;   // offset of the segment's text in the input.
+        uint32_t prefixLength;   // length of the SSML elements added in front of the text.
+    };
+
+    struct WordBoundary
+    {
+        uint64_t audioOffset;    // in ticks (100 nanoseconds) from the start of the stitched audio.
+        uint32_t textOffset;     // in the input text or SSML.
+        uint32_t wordLength;
+    };
+
+    struct Result
+    {
+        std::vector<WordBoundary> wordBoundaries;
+        uint64_t audioDuration = 0; // in ticks.
+        size_t segmentCount = 0;
+    };
+
+    explicit LongFormSynthesizer(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config)
+        : LongFormSynthesizer(config, Options())
+    {
+    }
+
+    // Creates the synthesizers. Note the output format of 'config' is changed to the one used for synthesis.
+    LongFormSynthesizer(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, const Options& options)
+        : m_options(options)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (options.parallelism == 0 || options.maxSegmentLength == 0)
+        {
+            throw std::invalid_argument("Parallelism and maximum segment length must not be 0.");
+        }
+
+        // PCM is synthesized without a header, so that segments can be concatenated.
+        switch (options.outputFormat)
+        {
+        case SpeechSynthesisOutputFormat::Riff8Khz16BitMonoPcm:
+            config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw8Khz16BitMonoPcm);
+            m_sampleRate = 8000;
+            break;
+        case SpeechSynthesisOutputFormat::Riff16Khz16BitMonoPcm:
+            config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw16Khz16BitMonoPcm);
+            m_sampleRate = 16000;
+            break;
+        case SpeechSynthesisOutputFormat::Riff24Khz16BitMonoPcm:
+            config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw24Khz16BitMonoPcm);
+            m_sampleRate = 24000;
+            break;
+        case SpeechSynthesisOutputFormat::Audio16Khz32KBitRateMonoMp3:
+        case SpeechSynthesisOutputFormat::Audio16Khz64KBitRateMonoMp3:
+        case SpeechSynthesisOutputFormat::Audio16Khz128KBitRateMonoMp3:
+        case SpeechSynthesisOutputFormat::Audio24Khz48KBitRateMonoMp3:
+        case SpeechSynthesisOutputFormat::Audio24Khz96KBitRateMonoMp3:
+        case SpeechSynthesisOutputFormat::Audio24Khz160KBitRateMonoMp3:
+            config->SetSpeechSynthesisOutputFormat(options.outputFormat);
+            m_isMp3 = true;
+            break;
+        default:
+            throw std::invalid_argument("Output format is not supported for long form synthesis.");
+        }
+
+        for (size_t i = 0; i < options.parallelism; i++)
+        {
+            auto worker = std::make_shared<Worker>();
+            worker->synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+            // A synthesizer speaks one segment at a time, so its word boundaries belong to the current segment.
+            std::weak_ptr<Worker> weakWorker = worker;
+            worker->synthesizer->WordBoundary += [weakWorker](const SpeechSynthesisWordBoundaryEventArgs& e)
+            {
+                auto worker = weakWorker.lock();
+                if (worker)
+                {
+                    std::lock_guard<std::mutex> lock(worker->mutex);
+                    worker->wordBoundaries.push_back({ e.AudioOffset, e.TextOffset, e.WordLength });
+                }
+            };
+            m_workers.push_back(worker);
+        }
+    }
+
+    // Synthesizes plain text to a WAV or MP3 file. Throws std::runtime_error if a segment fails.
+    Result SynthesizeTextToFile(const std::string& text, const std::string& fileName)
+    {
+        return Synthesize(SplitText(text, m_options.maxSegmentLength), false, fileName);
+    }
+
+    // Synthesizes SSML to a WAV or MP3 file. Throws std::runtime_error if a segment fails.
+    Result SynthesizeSsmlToFile(const std::string& ssml, const std::string& fileName)
+    {
+        return Synthesize(SplitSsml(ssml, m_options.maxSegmentLength), true, fileName);
+    }
+
+    // Splits text at sentence ends, preferably at paragraphs (empty lines). Sentences longer than
+    // 'maxLength' are split between words.
+    static std::vector<Segment> SplitText(const std::string& text, size_t maxLength)
+    {
+        std::vector<Boundary> boundaries;
+        size_t unitStart = 0;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            auto c = text[i];
+            bool sentence = (c == '.' || c == '!' || c == '?') && (i + 1 == text.size() || IsSpace(text[i + 1]));
+            if (!sentence && c != '\n')
+            {
+                continue;
+            }
+
+            // A paragraph ends where the spaces after a line break or a sentence contain an empty line.
+            auto end = SkipSpaces(text, i + 1, text.size());
+            bool paragraph = std::count(text.begin() + i, text.begin() + end, '\n') >= 2;
+            if (!sentence && !paragraph)
+            {
+                continue;
+            }
+
+            if (end - unitStart > maxLength)
+            {
+                AddWordBoundaries(text, unitStart, end, maxLength, boundaries);
+            }
+            boundaries.push_back({ end, paragraph });
+            unitStart = end;
+            i = end - 1;
+        }
+        if (text.size() - unitStart > maxLength)
+        {
+            AddWordBoundaries(text, unitStart, text.size(), maxLength, boundaries);
+        }
+
+        std::vector<Segment> segments;
+        for (auto& range : Pack(text, 0, text.size(), boundaries, maxLength))
+        {
+            segments.push_back({ text.substr(range.first, range.second - range.first), (uint32_t)range.first, 0 });
+        }
+        return segments;
+    }
+
+    // Splits SSML between the top level elements and sentences inside the speak element, or inside
+    // a voice element that contains the whole document. Each segment is wrapped in the same speak
+    // and voice elements. Elements such as paragraphs or prosody are never split.
+    static std::vector<Segment> SplitSsml(const std::string& ssml, size_t maxLength)
+    {
+        size_t contentBegin = 0;
+        size_t contentEnd = ssml.size();
+        std::string prefix;
+        std::string suffix;
+
+        auto speak = ssml.find("<speak");
+        if (speak != std::string::npos)
+        {
+            contentBegin = ssml.find('>', speak);
+            contentEnd = ssml.rfind("</speak>");
+            if (contentBegin == std::string::npos || contentEnd == std::string::npos || contentEnd < contentBegin)
+            {
+                throw std::invalid_argument("Invalid SSML, the speak element is not closed.");
+            }
+            contentBegin++;
+            suffix = "</speak>";
+
+            auto voice = SkipSpaces(ssml, contentBegin, contentEnd);
+            auto voiceEnd = ssml.rfind("</voice>", contentEnd);
+            if (ssml.compare(voice, 6, "<voice") == 0 && voiceEnd != std::string::npos && voiceEnd > voice &&
+                SkipSpaces(ssml, voiceEnd + 8, contentEnd) == contentEnd && ssml.find("<voice", voice + 1) > voiceEnd)
+            {
+                contentBegin = ssml.find('>', voice) + 1;
+                contentEnd = voiceEnd;
+                suffix = "</voice>" + suffix;
+            }
+            prefix = ssml.substr(0, contentBegin);
+        }
+
+        std::vector<Boundary> boundaries;
+        int depth = 0;
+        for (size_t i = contentBegin; i < contentEnd; i++)
+        {
+            if (ssml[i] == '<')
+            {
+                auto tagEnd = ssml.find('>', i);
+                if (tagEnd == std::string::npos || tagEnd >= contentEnd)
+                {
+                    break;
+                }
+
+                bool closing = ssml[i + 1] == '/';
+                bool empty = ssml[tagEnd - 1] == '/';
+                bool comment = ssml[i + 1] == '!' || ssml[i + 1] == '?';
+                depth += comment || empty ? 0 : (closing ? -1 : 1);
+                if (depth == 0 && (closing || empty) && !comment)
+                {
+                    bool paragraph = ssml.compare(i, 4, "</p>") == 0 || ssml.compare(i, 12, "</paragraph>") == 0;
+                    boundaries.push_back({ SkipSpaces(ssml, tagEnd + 1, contentEnd), paragraph });
+                }
+                i = tagEnd;
+            }
+            else if (depth == 0 && (ssml[i] == '.' || ssml[i] == '!' || ssml[i] == '?') && (i + 1 == contentEnd || IsSpace(ssml[i + 1])))
+            {
+                boundaries.push_back({ SkipSpaces(ssml, i + 1, contentEnd), false });
+            }
+        }
+
+        std::vector<Segment> segments;
+        for (auto& range : Pack(ssml, contentBegin, contentEnd, boundaries, maxLength))
+        {
+            segments.push_back({ prefix + ssml.substr(range.first, range.second - range.first) + suffix, (uint32_t)range.first, (uint32_t)prefix.size() });
+        }
+        return segments;
+    }
+
+private:
+    struct Worker
+    {
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> synthesizer;
+        std::mutex mutex;
+        std::vector<WordBoundary> wordBoundaries;
+    };
+
+    struct SegmentResult
+    {
+        bool done = false;
+        std::shared_ptr<std::vector<uint8_t>> audio;
+        std::vector<WordBoundary> wordBoundaries;
+    };
+
+    // A position where a segment may end, and whether it ends a paragraph.
+    struct Boundary
+    {
+        size_t position;
+        bool paragraph;
+    };
+
+    Result Synthesize(const std::vector<Segment>& segments, bool isSsml, const std::string& fileName)
+    {
+        std::ofstream file(fileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to open " + fileName);
+        }
+        if (!m_isMp3)
+        {
+            // Placeholder, the sizes are filled in once all audio is written.
+            WriteWaveHeader(file, 0);
+        }
+
+        std::vector<SegmentResult> results(segments.size());
+        std::atomic<size_t> nextSegment{ 0 };
+        std::mutex mutex;
+        std::condition_variable segmentDone;
+        std::string error;
+
+        std::vector<std::thread> threads;
+        for (auto& worker : m_workers)
+        {
+            threads.emplace_back([&, worker]()
+            {
+                size_t index;
+                while ((index = nextSegment++) < segments.size())
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(worker->mutex);
+                        worker->wordBoundaries.clear();
+                    }
+
+                    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesisResult> result;
+                    std::string segmentError;
+                    try
+                    {
+                        auto& segment = segments[index];
+                        result = isSsml ? worker->synthesizer->SpeakSsmlAsync(segment.content).get() : worker->synthesizer->SpeakTextAsync(segment.content).get();
+                        if (result->Reason != Microsoft::CognitiveServices::Speech::ResultReason::SynthesizingAudioCompleted)
+                        {
+                            auto cancellation = Microsoft::CognitiveServices::Speech::SpeechSynthesisCancellationDetails::FromResult(result);
+                            segmentError = cancellation ? cancellation->ErrorDetails : "unexpected result reason";
+                        }
+                    }
+                    catch (const std::exception& e)
+                    {
+                        segmentError = e.what();
+                    }
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!segmentError.empty())
+                    {
+                        // Stops the other workers, the document can't be completed.
+                        error = "Segment " + std::to_string(index) + " failed: " + segmentError;
+                        nextSegment = segments.size();
+                    }
+                    else
+                    {
+                        std::lock_guard<std::mutex> workerLock(worker->mutex);
+                        results[index].audio = result->GetAudioData();
+                        results[index].wordBoundaries.swap(worker->wordBoundaries);
+                        results[index].done = true;
+                    }
+                    segmentDone.notify_all();
+                }
+            });
+        }
+
+        // Writes the segments in order as they complete, while later segments are still being synthesized.
+        Result stitched;
+        uint64_t dataSize = 0;
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            SegmentResult segmentResult;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                segmentDone.wait(lock, [&]() { return results[i].done || !error.empty(); });
+                if (!results[i].done)
+                {
+                    break;
+                }
+                std::swap(segmentResult, results[i]);
+            }
+
+            for (auto& boundary : segmentResult.wordBoundaries)
+            {
+                stitched.wordBoundaries.push_back({ stitched.audioDuration + boundary.audioOffset,
+                    segments[i].sourceOffset + boundary.textOffset - segments[i].prefixLength, boundary.wordLength });
+            }
+
+            auto& audio = *segmentResult.audio;
+            file.write((const char*)audio.data(), audio.size());
+            dataSize += audio.size();
+            stitched.audioDuration += m_isMp3 ? Mp3DurationTicks(audio) : audio.size() * 10000000ull / (m_sampleRate * 2);
+            stitched.segmentCount++;
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        if (!error.empty())
+        {
+            throw std::runtime_error(error);
+        }
+
+        if (!m_isMp3)
+        {
+            file.seekp(0);
+            WriteWaveHeader(file, (uint32_t)dataSize);
+        }
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write " + fileName);
+        }
+        return stitched;
+    }
+
+    void WriteWaveHeader(std::ofstream& file, uint32_t dataSize) const
+    {
+        uint8_t header[44];
+        auto put16 = [&header](size_t offset, uint16_t value) { header[offset] = (uint8_t)value; header[offset + 1] = (uint8_t)(value >> 8); };
+        auto put32 = [&put16](size_t offset, uint32_t value) { put16(offset, (uint16_t)value); put16(offset + 2, (uint16_t)(value >> 16)); };
+
+        memcpy(header, "RIFF", 4);
+        put32(4, 36 + dataSize);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        put32(16, 16);
+        put16(20, 1);                       // PCM
+        put16(22, 1);                       // mono
+        put32(24, m_sampleRate);
+        put32(28, m_sampleRate * 2);        // bytes per second
+        put16(32, 2);                       // block align
+        put16(34, 16);                      // bits per sample
+        memcpy(header + 36, "data", 4);
+        put32(40, dataSize);
+        file.write((const char*)header, sizeof(header));
+    }
+
+    // Duration of MPEG audio layer III frames, in ticks.
+    static uint64_t Mp3DurationTicks(const std::vector<uint8_t>& audio)
+    {
+        static const int bitrates[2][16] = {
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },  // MPEG 1
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 } };    // MPEG 2 and 2.5
+        static const int sampleRates[3] = { 44100, 48000, 32000 };
+
+        uint64_t samples = 0;
+        uint32_t sampleRate = 0;
+        size_t i = 0;
+        while (i + 4 <= audio.size())
+        {
+            auto version = (audio[i + 1] >> 3) & 3;  // 0: MPEG 2.5, 2: MPEG 2, 3: MPEG 1
+            auto layer = (audio[i + 1] >> 1) & 3;     // 1: layer III
+            auto bitrateIndex = audio[i + 2] >> 4;
+            auto sampleRateIndex = (audio[i + 2] >> 2) & 3;
+            if (audio[i] != 0xff || (audio[i + 1] & 0xe0) != 0xe0 || version == 1 || layer != 1 ||
+                bitrates[0][bitrateIndex] == 0 || sampleRateIndex == 3)
+            {
+                i++;
+                continue;
+            }
+
+            bool mpeg1 = version == 3;
+            sampleRate = sampleRates[sampleRateIndex] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+            auto bitrate = bitrates[mpeg1 ? 0 : 1][bitrateIndex] * 1000;
+            auto padding = (audio[i + 2] >> 1) & 1;
+            i += (mpeg1 ? 144 : 72) * bitrate / sampleRate + padding;
+            samples += mpeg1 ? 1152 : 576;
+        }
+        return sampleRate == 0 ? 0 : samples * 10000000 / sampleRate;
+    }
+
+    static bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static size_t SkipSpaces(const std::string& text, size_t position, size_t end)
+    {
+        while (position < end && IsSpace(text[position]))
+        {
+            position++;
+        }
+        return position;
+    }
+
+    // Adds boundaries between words, for a sentence that is too long for one segment.
+    static void AddWordBoundaries(const std::string& text, size_t begin, size_t end, size_t maxLength, std::vector<Boundary>& boundaries)
+    {
+        while (end - begin > maxLength)
+        {
+            auto split = begin + maxLength;
+            while (split > begin && !IsSpace(text[split - 1]))
+            {
+                split--;
+            }
+            if (split == begin)
+            {
+                split = begin + maxLength;
+            }
+            boundaries.push_back({ split, false });
+            begin = split;
+        }
+    }
+
+    // Groups the units between boundaries into ranges of at most 'maxLength' characters, where
+    // possible. A paragraph ends a range unless the range would be very short.
+    static std::vector<std::pair<size_t, size_t>> Pack(const std::string& text, size_t begin, size_t end, const std::vector<Boundary>& boundaries, size_t maxLength)
+    {
+        std::vector<std::pair<size_t, size_t>> ranges;
+        auto emit = [&](size_t rangeBegin, size_t rangeEnd)
+        {
+            if (SkipSpaces(text, rangeBegin, rangeEnd) < rangeEnd)
+            {
+                ranges.emplace_back(rangeBegin, rangeEnd);
+            }
+        };
+
+        auto rangeBegin = begin;
+        auto lastBoundary = begin;
+        for (auto& boundary : boundaries)
+        {
+            if (boundary.position > end || boundary.position <= rangeBegin)
+            {
+                continue;
+            }
+            if (boundary.position - rangeBegin > maxLength && lastBoundary > rangeBegin)
+            {
+                emit(rangeBegin, lastBoundary);
+                rangeBegin = lastBoundary;
+            }
+            lastBoundary = boundary.position;
+            if (boundary.paragraph && boundary.position - rangeBegin >= maxLength / 4)
+            {
+                emit(rangeBegin, boundary.position);
+                rangeBegin = boundary.position;
+            }
+        }
+        if (end - rangeBegin > maxLength && lastBoundary > rangeBegin && lastBoundary < end)
+        {
+            emit(rangeBegin, lastBoundary);
+            rangeBegin = lastBoundary;
+        }
+        emit(rangeBegin, end);
+        return ranges;
+    }
+
+    const Options m_options;
+    uint32_t m_sampleRate = 0;
+    bool m_isMp3 = false;
+    std::vector<std::shared_ptr<Worker>> m_workers;
+};
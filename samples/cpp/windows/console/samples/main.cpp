@@ -16,6 +16,17 @@ extern void SpeechContinuousRecognitionWithPullStream();
 extern void SpeechContinuousRecognitionWithPushStream();
 extern void KeywordTriggeredSpeechRecognitionWithMicrophone();
 extern void PronunciationAssessmentWithMicrophone();
+extern void SpeechRecognitionWithRecognizerPool();
+extern void SpeechContinuousRecognitionWithCoroutines();
+extern void SpeechCoroutineScalingBenchmark();
+extern void SpeechContinuousRecognitionWithEventDispatcher();
+extern void SpeechEventDispatcherBenchmark();
+extern void SpeechRecognitionWithCaptionCoalescing();
+extern void SpeechCaptionCoalescingBenchmark();
+extern void SpeechContinuousRecognitionWithDetailedResultParser();
+extern void SpeechDetailedResultParsingBenchmark();
+extern void SpeechContinuousRecognitionWithWordTimingStore();
+extern void SpeechWordTimingStoreBenchmark();
 
 extern void IntentRecognitionWithMicrophone();
 extern void IntentRecognitionWithLanguage();
@@ -36,6 +47,23 @@ extern void SpeechSynthesisToAudioDataStream();
 extern void SpeechSynthesisEvents();
 extern void SpeechSynthesisWordBoundaryEvent();
 extern void SpeechSynthesisWithSourceLanguageAutoDetection();
+extern void SpeechSynthesisWithCache();
+extern void SpeechSynthesisLongForm();
+extern void SpeechSynthesisPipelined();
+extern void SpeechSynthesisWithSynthesizerPool();
+extern void SpeechSynthesisToStreamingWavFile();
+extern void SpeechSynthesisToReadableOutputStreams();
+extern void SpeechSynthesisReadableOutputStreamBenchmark();
+extern void SpeechSynthesisWithJitterBuffer();
+extern void SpeechSynthesisJitterBufferBenchmark();
+extern void SpeechSynthesisBroadcastServer();
+extern void SpeechSynthesisBroadcastBenchmark();
+extern void SpeechSynthesisBatch();
+extern void SpeechSynthesisBatchBenchmark();
+extern void SpeechSynthesisPromptBatch();
+extern void SpeechSynthesisPromptArchive();
+extern void SpeechSynthesisToTelephonyFormats();
+extern void SpeechSynthesisTranscodingBenchmark();
 
 extern void ConversationWithPullAudioStream();
 extern void ConversationWithPushAudioStream();
@@ -59,6 +87,17 @@ void SpeechSamples()
         cout << "6.) Speech recognition using push stream input.\n";
         cout << "7.) Speech recognition using microphone with a keyword trigger.\n";
         cout << "8.) Pronunciation assessment using microphone input.\n";
+        cout << "9.) Speech recognition of many concurrent requests with a pool of recognizers.\n";
+        cout << "A.) Speech continuous recognition of several files at once with C++20 coroutines.\n";
+        cout << "B.) Benchmark of thousands of concurrent sessions, with blocked threads and with coroutines.\n";
+        cout << "C.) Speech continuous recognition with event handlers on worker threads.\n";
+        cout << "D.) Benchmark of slow event handlers, inline and on worker threads.\n";
+        cout << "E.) Speech continuous recognition for live captions, with coalesced partial results.\n";
+        cout << "F.) Benchmark of live caption updates, every partial result and coalesced.\n";
+        cout << "G.) Speech continuous recognition with the detailed results parsed into alternatives and words.\n";
+        cout << "H.) Benchmark of parsing detailed results.\n";
+        cout << "I.) Speech continuous recognition that keeps the timings of all words, for subtitles and search.\n";
+        cout << "J.) Benchmark of keeping word timings of a long session.\n";
         cout << "\nChoice (0 for MAIN MENU): ";
         cout.flush();
 
@@ -91,6 +130,49 @@ void SpeechSamples()
         case '8':
             PronunciationAssessmentWithMicrophone();
             break;
+        case '9':
+            SpeechRecognitionWithRecognizerPool();
+            break;
+        case 'A':
+        case 'a':
+            SpeechContinuousRecognitionWithCoroutines();
+            break;
+        case 'B':
+        case 'b':
+            SpeechCoroutineScalingBenchmark();
+            break;
+        case 'C':
+        case 'c':
+            SpeechContinuousRecognitionWithEventDispatcher();
+            break;
+        case 'D':
+        case 'd':
+            SpeechEventDispatcherBenchmark();
+            break;
+        case 'E':
+        case 'e':
+            SpeechRecognitionWithCaptionCoalescing();
+            break;
+        case 'F':
+        case 'f':
+            SpeechCaptionCoalescingBenchmark();
+            break;
+        case 'G':
+        case 'g':
+            SpeechContinuousRecognitionWithDetailedResultParser();
+            break;
+        case 'H':
+        case 'h':
+            SpeechDetailedResultParsingBenchmark();
+            break;
+        case 'I':
+        case 'i':
+            SpeechContinuousRecognitionWithWordTimingStore();
+            break;
+        case 'J':
+        case 'j':
+            SpeechWordTimingStoreBenchmark();
+            break;
         case '0':
             break;
         }
@@ -175,6 +257,23 @@ void SpeechSynthesisSamples()
         cout << "A.) Speech synthesis events.\n";
         cout << "B.) Speech synthesis word boundary event.\n";
         cout << "C.) Speech synthesis with source language auto detection\n";
+        cout << "D.) Speech synthesis with cache.\n";
+        cout << "E.) Speech synthesis of a long text file, with sentences synthesized in parallel.\n";
+        cout << "F.) Speech synthesis of several sentences, synthesized ahead of playback.\n";
+        cout << "G.) Speech synthesis with a pool of pre-connected synthesizers.\n";
+        cout << "H.) Speech synthesis to wave file, written while synthesizing.\n";
+        cout << "I.) Speech synthesis to several output streams, read by one thread.\n";
+        cout << "J.) Benchmark of reading 500 output streams with blocking reads and with one thread.\n";
+        cout << "K.) Speech synthesis played in real time through a jitter buffer.\n";
+        cout << "L.) Benchmark of a fixed and an adaptive jitter buffer with audio arriving in bursts.\n";
+        cout << "M.) HTTP server streaming one synthesis per text to many listeners.\n";
+        cout << "N.) Benchmark of broadcasting 3 texts to 300 listeners.\n";
+        cout << "O.) Speech synthesis of a batch of prompts from a manifest file.\n";
+        cout << "P.) Benchmark of a batch of 400 prompts, with retries and a resumed checkpoint.\n";
+        cout << "Q.) Speech synthesis of many short prompts with a few SSML requests, split into one file per prompt.\n";
+        cout << "R.) Speech synthesis of prompts into an archive file, served from memory.\n";
+        cout << "S.) Speech synthesis transcoded to telephony and web formats at once.\n";
+        cout << "T.) Speech synthesis transcoding benchmark, with and without vector instructions.\n";
         cout << "\nChoice (0 for MAIN MENU): ";
         cout.flush();
 
@@ -222,6 +321,74 @@ void SpeechSynthesisSamples()
         case 'c':
             SpeechSynthesisWithSourceLanguageAutoDetection();
             break;
+        case 'D':
+        case 'd':
+            SpeechSynthesisWithCache();
+            break;
+        case 'E':
+        case 'e':
+            SpeechSynthesisLongForm();
+            break;
+        case 'F':
+        case 'f':
+            SpeechSynthesisPipelined();
+            break;
+        case 'G':
+        case 'g':
+            SpeechSynthesisWithSynthesizerPool();
+            break;
+        case 'H':
+        case 'h':
+            SpeechSynthesisToStreamingWavFile();
+            break;
+        case 'I':
+        case 'i':
+            SpeechSynthesisToReadableOutputStreams();
+            break;
+        case 'J':
+        case 'j':
+            SpeechSynthesisReadableOutputStreamBenchmark();
+            break;
+        case 'K':
+        case 'k':
+            SpeechSynthesisWithJitterBuffer();
+            break;
+        case 'L':
+        case 'l':
+            SpeechSynthesisJitterBufferBenchmark();
+            break;
+        case 'M':
+        case 'm':
+            SpeechSynthesisBroadcastServer();
+            break;
+        case 'N':
+        case 'n':
+            SpeechSynthesisBroadcastBenchmark();
+            break;
+        case 'O':
+        case 'o':
+            SpeechSynthesisBatch();
+            break;
+        case 'P':
+        case 'p':
+            SpeechSynthesisBatchBenchmark();
+            break;
+        case 'Q':
+        case 'q':
+            SpeechSynthesisPromptBatch();
+            break;
+        case 'R':
+        case 'r':
+            SpeechSynthesisPromptArchive();
+            break;
+        case 'S':
+        case 's':
+            SpeechSynthesisToTelephonyFormats();
+            break;
+        case 'T':
+        case 't':
+            SpeechSynthesisTranscodingBenchmark();
+            break;
         case '0':
             break;
         }
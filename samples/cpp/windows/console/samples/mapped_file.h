@@ -0,0 +1,129 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file.
+class MappedFile final
+{
+public:
+    // Maps the file. Throws std::runtime_error if the file can't be opened or mapped.
+    explicit MappedFile(const std::string& fileName)
+    {
+#ifdef _WIN32
+        m_file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size))
+        {
+            Close();
+            throw std::runtime_error("Failed to open " + fileName);
+        }
+        m_size = (size_t)size.QuadPart;
+        if (m_size > 0)
+        {
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            m_data = m_mapping == nullptr ? nullptr : (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+            if (m_data == nullptr)
+            {
+                Close();
+                throw std::runtime_error("Failed to map " + fileName);
+            }
+        }
+#else
+        m_file = open(fileName.c_str(), O_RDONLY);
+        struct stat status;
+        if (m_file < 0 || fstat(m_file, &status) != 0)
+        {
+            Close();
+            throw std::runtime_error("Failed to open " + fileName);
+        }
+        m_size = (size_t)status.st_size;
+        if (m_size > 0)
+        {
+            auto data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_file, 0);
+            if (data == MAP_FAILED)
+            {
+                Close();
+                throw std::runtime_error("Failed to map " + fileName);
+            }
+            m_data = (const uint8_t*)data;
+        }
+#endif
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* Data() const
+    {
+        return m_data;
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+private:
+    void Close()
+    {
+#ifdef _WIN32
+        if (m_data != nullptr)
+        {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data != nullptr)
+        {
+            munmap((void*)m_data, m_size);
+        }
+        if (m_file >= 0)
+        {
+            close(m_file);
+        }
+        m_file = -1;
+#endif
+        m_data = nullptr;
+    }
+
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
@@ -0,0 +1,188 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// An update of the caption of one utterance: the client keeps the first 'keep' bytes of the text it
+// has for the utterance and appends 'append'. The first update of an utterance has 'keep' 0.
+struct CaptionUpdate
+{
+    uint64_t utterance = 0;
+    bool isFinal = false;
+    size_t keep = 0;
+    std::string append;
+};
+
+// Rebuilds the captions from the updates, on the client.
+class CaptionText final
+{
+public:
+    void Apply(const CaptionUpdate& update)
+    {
+        if (update.utterance != m_utterance)
+        {
+            m_utterance = update.utterance;
+            m_text.clear();
+        }
+        m_text.resize(std::min(update.keep, m_text.size()));
+        m_text += update.append;
+        m_isFinal = update.isFinal;
+    }
+
+    const std::string& Text() const { return m_text; }
+    bool IsFinal() const { return m_isFinal; }
+
+private:
+    uint64_t m_utterance = 0;
+    std::string m_text;
+    bool m_isFinal = false;
+};
+
+// Reduces the partial results (Recognizing events) of a session to the updates a caption client
+// needs. Partials are forwarded at most once per interval: the first partial of an utterance goes
+// out at once, later ones are held and only the latest is sent when the interval has passed. Each
+// update only carries the text after the prefix it shares with the previous update, which is the
+// part of the caption that stayed stable. Final results are always sent at once, and replace any
+// partial that is held, so the final text the client ends up with is the recognized text.
+//
+// A held partial goes out with the next event, or from Poll(), which a server with many sessions
+// calls for all of them from one timer. The sink runs under the coalescer's lock, in order; it
+// should only queue the update for sending.
+class PartialResultCoalescer final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Sink = std::function<void(const CaptionUpdate& update)>;
+
+    struct Options
+    {
+        // Minimum time between two partial updates of a session.
+        std::chrono::milliseconds interval{ 250 };
+    };
+
+    struct Stats
+    {
+        uint64_t partialsReceived = 0;
+        uint64_t partialsSent = 0;
+        uint64_t finalsSent = 0;
+        // Text of the results received, which forwarding every event would send.
+        uint64_t bytesReceived = 0;
+        // Text of the updates sent.
+        uint64_t bytesSent = 0;
+    };
+
+    PartialResultCoalescer(const Options& options, Sink sink)
+        : m_options(options), m_sink(std::move(sink))
+    {
+    }
+
+    PartialResultCoalescer(const PartialResultCoalescer&) = delete;
+    PartialResultCoalescer& operator=(const PartialResultCoalescer&) = delete;
+
+    // Call from the Recognizing event, with the text of its result.
+    void OnPartial(const std::string& text, Clock::time_point now = Clock::now())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.partialsReceived++;
+        m_stats.bytesReceived += text.size();
+        if (!m_inUtterance || now - m_lastSent >= m_options.interval)
+        {
+            m_inUtterance = true;
+            m_hasPending = false;
+            Send(text, false, now);
+        }
+        else
+        {
+            m_pending = text;
+            m_hasPending = true;
+        }
+    }
+
+    // Call from the Recognized event, with the text of its result. An empty text (no match) ends
+    // the utterance and clears its caption.
+    void OnFinal(const std::string& text, Clock::time_point now = Clock::now())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.bytesReceived += text.size();
+        m_hasPending = false;
+        if (m_inUtterance || !text.empty())
+        {
+            Send(text, true, now);
+        }
+        m_inUtterance = false;
+        m_sent.clear();
+        m_utterance++;
+    }
+
+    // Sends the held partial if the interval since the last update has passed.
+    void Poll(Clock::time_point now = Clock::now())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_hasPending && now - m_lastSent >= m_options.interval)
+        {
+            m_hasPending = false;
+            Send(m_pending, false, now);
+        }
+    }
+
+    Stats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    // Length of the prefix the two texts share, cut back to the start of a UTF-8 character.
+    static size_t StablePrefix(const std::string& previous, const std::string& text)
+    {
+        auto end = std::min(previous.size(), text.size());
+        size_t length = 0;
+        while (length < end && previous[length] == text[length])
+        {
+            length++;
+        }
+        if (length < text.size())
+        {
+            while (length > 0 && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80)
+            {
+                length--;
+            }
+        }
+        return length;
+    }
+
+private:
+    void Send(const std::string& text, bool isFinal, Clock::time_point now)
+    {
+        CaptionUpdate update;
+        update.utterance = m_utterance;
+        update.isFinal = isFinal;
+        update.keep = StablePrefix(m_sent, text);
+        update.append = text.substr(update.keep);
+        m_sent = text;
+        m_lastSent = now;
+        (isFinal ? m_stats.finalsSent : m_stats.partialsSent)++;
+        m_stats.bytesSent += update.append.size();
+        m_sink(update);
+    }
+
+    const Options m_options;
+    const Sink m_sink;
+
+    mutable std::mutex m_mutex;
+    uint64_t m_utterance = 0;
+    bool m_inUtterance = false;
+    // Text of the last update of the utterance, as the client has it.
+    std::string m_sent;
+    Clock::time_point m_lastSent;
+    std::string m_pending;
+    bool m_hasPending = false;
+    Stats m_stats;
+};
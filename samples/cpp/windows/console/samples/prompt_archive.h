@@ -0,0 +1,256 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+// A fixed set of synthesized prompts packed into one file, served from a memory mapping: a lookup
+// is a binary search in the index, and the audio is returned in place, without opening or copying
+// anything.
+// File layout, in the byte order of the machine:
+//   header:  magic, version, prompt count (32 bits each), offset of the audio (32 bits)
+//   index:   per prompt, sorted by id: id offset, id length, output format, reserved (32 bits each),
+//            audio offset and audio length (64 bits each)
+//   ids:     the ids, one after the other
+//   audio:   the audio of each prompt, aligned to 64 bytes
+class PromptArchive final
+{
+public:
+    // Audio of a prompt, valid as long as the archive is.
+    struct Prompt
+    {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format{};
+    };
+
+    // Reads the audio of a prompt sequentially, like AudioDataStream.
+    class Reader final
+    {
+    public:
+        explicit Reader(const Prompt& prompt)
+            : m_prompt(prompt)
+        {
+        }
+
+        // Copies up to 'size' bytes from the current position. Returns 0 at the end.
+        uint32_t ReadData(uint8_t* buffer, uint32_t size)
+        {
+            auto count = (uint32_t)std::min<size_t>(size, m_prompt.size - m_position);
+            memcpy(buffer, m_prompt.data + m_position, count);
+            m_position += count;
+            return count;
+        }
+
+        uint32_t GetPosition() const
+        {
+            return (uint32_t)m_position;
+        }
+
+        void SetPosition(uint32_t position)
+        {
+            m_position = std::min<size_t>(position, m_prompt.size);
+        }
+
+    private:
+        Prompt m_prompt;
+        size_t m_position = 0;
+    };
+
+    // Maps an archive written by PromptArchiveBuilder. Throws std::runtime_error if the file is
+    // missing or invalid.
+    explicit PromptArchive(const std::string& fileName)
+        : m_file(std::make_shared<MappedFile>(fileName))
+    {
+        auto data = m_file->Data();
+        auto size = m_file->Size();
+        uint32_t header[4];
+        if (size < sizeof(header))
+        {
+            throw std::runtime_error("Invalid prompt archive " + fileName);
+        }
+        memcpy(header, data, sizeof(header));
+        m_count = header[2];
+        if (header[0] != fileMagic || header[1] != fileVersion ||
+            m_count > (size - sizeof(header)) / sizeof(Entry) || header[3] > size)
+        {
+            throw std::runtime_error("Invalid prompt archive " + fileName);
+        }
+
+        // Checks every entry once, so that lookups don't need to.
+        m_entries = (const Entry*)(data + sizeof(header));
+        auto idsBegin = sizeof(header) + m_count * sizeof(Entry);
+        for (size_t i = 0; i < m_count; i++)
+        {
+            auto& entry = m_entries[i];
+            if (entry.idOffset < idsBegin || entry.idOffset > header[3] || entry.idLength > header[3] - entry.idOffset ||
+                entry.audioOffset < header[3] || entry.audioOffset > size || entry.audioLength > size - entry.audioOffset ||
+                (i > 0 && Compare(m_entries[i - 1], Id(entry)) >= 0))
+            {
+                throw std::runtime_error("Invalid prompt archive " + fileName);
+            }
+        }
+    }
+
+    size_t Size() const
+    {
+        return m_count;
+    }
+
+    std::string Id(size_t index) const
+    {
+        return Id(m_entries[index]);
+    }
+
+    // Returns the prompt with the id, or false if there is none.
+    bool Find(const std::string& id, Prompt& prompt) const
+    {
+        auto end = m_entries + m_count;
+        auto entry = std::lower_bound(m_entries, end, id, [this](const Entry& e, const std::string& value) { return Compare(e, value) < 0; });
+        if (entry == end || Compare(*entry, id) != 0)
+        {
+            return false;
+        }
+        prompt.data = m_file->Data() + entry->audioOffset;
+        prompt.size = (size_t)entry->audioLength;
+        prompt.format = (Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat)entry->format;
+        return true;
+    }
+
+private:
+    friend class PromptArchiveBuilder;
+
+    static constexpr uint32_t fileMagic = 0x41585053; // "SPXA"
+    static constexpr uint32_t fileVersion = 1;
+    enum : size_t { audioAlignment = 64 };
+
+    struct Entry
+    {
+        uint32_t idOffset;
+        uint32_t idLength;
+        uint32_t format;
+        uint32_t reserved;
+        uint64_t audioOffset;
+        uint64_t audioLength;
+    };
+
+    std::string Id(const Entry& entry) const
+    {
+        return std::string((const char*)m_file->Data() + entry.idOffset, entry.idLength);
+    }
+
+    int Compare(const Entry& entry, const std::string& id) const
+    {
+        auto length = std::min<size_t>(entry.idLength, id.size());
+        auto result = memcmp(m_file->Data() + entry.idOffset, id.data(), length);
+        return result != 0 ? result : entry.idLength < id.size() ? -1 : entry.idLength > id.size() ? 1 : 0;
+    }
+
+    std::shared_ptr<MappedFile> m_file;
+    const Entry* m_entries = nullptr;
+    size_t m_count = 0;
+};
+
+// Collects synthesized prompts and writes them as a PromptArchive.
+class PromptArchiveBuilder final
+{
+public:
+    // Adds a prompt. Throws std::invalid_argument if the id was already added.
+    void Add(const std::string& id, Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format, std::vector<uint8_t> audio)
+    {
+        if (!m_prompts.emplace(id, Prompt{ format, std::move(audio) }).second)
+        {
+            throw std::invalid_argument("Duplicate prompt id " + id);
+        }
+    }
+
+    size_t Size() const
+    {
+        return m_prompts.size();
+    }
+
+    // Writes the archive. Throws std::runtime_error if the file can't be written.
+    void Write(const std::string& fileName) const
+    {
+        using Entry = PromptArchive::Entry;
+
+        // The map is sorted by id, like the index.
+        std::vector<Entry> entries(m_prompts.size());
+        uint64_t offset = 4 * sizeof(uint32_t) + entries.size() * sizeof(Entry);
+        size_t i = 0;
+        for (auto& prompt : m_prompts)
+        {
+            entries[i].idOffset = (uint32_t)offset;
+            entries[i].idLength = (uint32_t)prompt.first.size();
+            entries[i].format = (uint32_t)prompt.second.format;
+            entries[i].reserved = 0;
+            offset += prompt.first.size();
+            i++;
+        }
+        if (offset > UINT32_MAX)
+        {
+            throw std::runtime_error("The prompt ids are too long.");
+        }
+        auto audioBegin = Align(offset);
+        offset = audioBegin;
+        i = 0;
+        for (auto& prompt : m_prompts)
+        {
+            entries[i].audioOffset = offset;
+            entries[i].audioLength = prompt.second.audio.size();
+            offset = Align(offset + prompt.second.audio.size());
+            i++;
+        }
+
+        std::ofstream file(fileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        uint32_t header[4] = { PromptArchive::fileMagic, PromptArchive::fileVersion, (uint32_t)m_prompts.size(), (uint32_t)audioBegin };
+        file.write((const char*)header, sizeof(header));
+        file.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+        uint64_t written = sizeof(header) + entries.size() * sizeof(Entry);
+        for (auto& prompt : m_prompts)
+        {
+            file.write(prompt.first.data(), prompt.first.size());
+            written += prompt.first.size();
+        }
+
+        const char zeros[PromptArchive::audioAlignment] = {};
+        i = 0;
+        for (auto& prompt : m_prompts)
+        {
+            file.write(zeros, entries[i].audioOffset - written);
+            file.write((const char*)prompt.second.audio.data(), prompt.second.audio.size());
+            written = entries[i].audioOffset + prompt.second.audio.size();
+            i++;
+        }
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write " + fileName);
+        }
+    }
+
+private:
+    struct Prompt
+    {
+        Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format;
+        std::vector<uint8_t> audio;
+    };
+
+    static uint64_t Align(uint64_t offset)
+    {
+        return (offset + PromptArchive::audioAlignment - 1) / PromptArchive::audioAlignment * PromptArchive::audioAlignment;
+    }
+
+    std::map<std::string, Prompt> m_prompts;
+};
@@ -0,0 +1,382 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// Synthesis output stream that can be read without blocking. It receives the audio as the
+// callback of a push output stream, and tells a readiness callback when there is something to
+// read, so one thread can serve many streams instead of one blocked PullAudioOutputStream::Read
+// per stream.
+// The readiness callback is called once when data or the end of the stream becomes available,
+// and again only after Read returned 0, so a reader must read until Read returns 0.
+class ReadableAudioOutputStream final : public Microsoft::CognitiveServices::Speech::Audio::PushAudioOutputStreamCallback
+{
+public:
+    // Called by the synthesizer with the synthesized audio.
+    int Write(uint8_t* dataBuffer, uint32_t size) override
+    {
+        std::function<void()> onReady;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_chunks.emplace_back(dataBuffer, dataBuffer + size);
+            onReady = Signal();
+        }
+        m_dataAvailable.notify_all();
+        if (onReady)
+        {
+            onReady();
+        }
+        return (int)size;
+    }
+
+    // Called by the synthesizer at the end of the audio.
+    void Close() override
+    {
+        std::function<void()> onReady;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            onReady = Signal();
+        }
+        m_dataAvailable.notify_all();
+        if (onReady)
+        {
+            onReady();
+        }
+    }
+
+    // Reads up to 'size' bytes that are available now. Returns 0 if there are none.
+    uint32_t Read(uint8_t* buffer, uint32_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto count = ReadAvailable(buffer, size);
+        if (count == 0)
+        {
+            m_signaled = false;
+        }
+        return count;
+    }
+
+    // Waits until data is available, like PullAudioOutputStream::Read. Returns 0 at the end of the stream.
+    uint32_t ReadBlocking(uint8_t* buffer, uint32_t size)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_dataAvailable.wait(lock, [this]() { return !m_chunks.empty() || m_closed; });
+        return ReadAvailable(buffer, size);
+    }
+
+    // Returns true once the stream was closed and all data was read.
+    bool IsEndOfStream() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_closed && m_chunks.empty();
+    }
+
+    // Sets the callback that is called when the stream becomes readable. It's called on the synthesizer's
+    // thread, so it should only wake up the reader.
+    void SetReadyCallback(std::function<void()> onReady)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_onReady = onReady;
+            m_signaled = false;
+            onReady = (!m_chunks.empty() || m_closed) ? Signal() : nullptr;
+        }
+        if (onReady)
+        {
+            onReady();
+        }
+    }
+
+private:
+    // Returns the callback to call if the reader wasn't told yet, must be called with the lock held.
+    std::function<void()> Signal()
+    {
+        if (m_signaled || !m_onReady)
+        {
+            return nullptr;
+        }
+        m_signaled = true;
+        return m_onReady;
+    }
+
+    uint32_t ReadAvailable(uint8_t* buffer, uint32_t size)
+    {
+        uint32_t count = 0;
+        while (count < size && !m_chunks.empty())
+        {
+            auto& chunk = m_chunks.front();
+            auto part = (uint32_t)std::min<size_t>(size - count, chunk.size() - m_readOffset);
+            memcpy(buffer + count, chunk.data() + m_readOffset, part);
+            count += part;
+            m_readOffset += part;
+            if (m_readOffset == chunk.size())
+            {
+                m_chunks.pop_front();
+                m_readOffset = 0;
+            }
+        }
+        return count;
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_dataAvailable;
+    std::deque<std::vector<uint8_t>> m_chunks;
+    size_t m_readOffset = 0;
+    bool m_closed = false;
+    bool m_signaled = false;
+    std::function<void()> m_onReady;
+};
+
+// Serves many ReadableAudioOutputStreams from the thread that calls Run. On Linux each stream
+// signals an eventfd that is watched with epoll; elsewhere readable streams are put in a queue.
+class AudioOutputReadinessLoop final
+{
+public:
+    // Called on the loop thread when the stream is readable. It must read until Read returns 0.
+    using ReadyCallback = std::function<void(ReadableAudioOutputStream& stream)>;
+
+    AudioOutputReadinessLoop()
+    {
+#ifdef __linux__
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        m_wakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (m_epoll < 0 || m_wakeEvent < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeEvent, &event) != 0)
+        {
+            CloseHandles();
+            throw std::runtime_error("Failed to create the epoll instance.");
+        }
+#endif
+    }
+
+    ~AudioOutputReadinessLoop()
+    {
+        for (auto& entry : m_entries)
+        {
+            RemoveEntry(*entry.second);
+        }
+        CloseHandles();
+    }
+
+    AudioOutputReadinessLoop(const AudioOutputReadinessLoop&) = delete;
+    AudioOutputReadinessLoop& operator=(const AudioOutputReadinessLoop&) = delete;
+
+    // Adds a stream. It's removed after the callback read its end.
+    void Add(std::shared_ptr<ReadableAudioOutputStream> stream, ReadyCallback onReady)
+    {
+        auto entry = std::make_shared<Entry>();
+        entry->stream = stream;
+        entry->onReady = onReady;
+
+#ifdef __linux__
+        // The stream may still call the callback after the entry is removed, so the callback keeps the eventfd open.
+        entry->event = std::make_shared<EventFd>();
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = entry.get();
+        if (entry->event->handle < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, entry->event->handle, &event) != 0)
+        {
+            throw std::runtime_error("Failed to watch the stream.");
+        }
+        auto eventFd = entry->event;
+        auto setReady = [eventFd]()
+        {
+            uint64_t one = 1;
+            auto written = write(eventFd->handle, &one, sizeof(one));
+            (void)written;
+        };
+#else
+        std::weak_ptr<Entry> weakEntry = entry;
+        auto setReady = [this, weakEntry]()
+        {
+            auto readyEntry = weakEntry.lock();
+            if (!readyEntry)
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_ready.push_back(readyEntry);
+            }
+            m_readyChanged.notify_one();
+        };
+#endif
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_entries[entry.get()] = entry;
+        }
+        stream->SetReadyCallback(setReady);
+    }
+
+    // Number of streams that did not end yet.
+    size_t StreamCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+    // Calls the callbacks of readable streams until Stop is called.
+    void Run()
+    {
+        while (true)
+        {
+            std::vector<std::shared_ptr<Entry>> ready;
+#ifdef __linux__
+            epoll_event events[64];
+            auto count = epoll_wait(m_epoll, events, 64, -1);
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (int i = 0; i < count; i++)
+            {
+                uint64_t value;
+                if (events[i].data.ptr == nullptr)
+                {
+                    auto consumed = read(m_wakeEvent, &value, sizeof(value));
+                    (void)consumed;
+                    continue;
+                }
+
+                auto entry = m_entries.find((Entry*)events[i].data.ptr);
+                if (entry != m_entries.end())
+                {
+                    auto consumed = read(entry->second->event->handle, &value, sizeof(value));
+                    (void)consumed;
+                    ready.push_back(entry->second);
+                }
+            }
+#else
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_readyChanged.wait(lock, [this]() { return !m_ready.empty() || m_stopped; });
+            ready.assign(m_ready.begin(), m_ready.end());
+            m_ready.clear();
+#endif
+            if (m_stopped)
+            {
+                return;
+            }
+            lock.unlock();
+
+            for (auto& entry : ready)
+            {
+                if (entry->removed)
+                {
+                    continue;
+                }
+                entry->onReady(*entry->stream);
+                if (entry->stream->IsEndOfStream())
+                {
+                    RemoveEntry(*entry);
+                    std::lock_guard<std::mutex> entriesLock(m_mutex);
+                    m_entries.erase(entry.get());
+                }
+            }
+        }
+    }
+
+    // Makes Run return. Can be called from any thread.
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+#ifdef __linux__
+        uint64_t one = 1;
+        auto written = write(m_wakeEvent, &one, sizeof(one));
+        (void)written;
+#else
+        m_readyChanged.notify_all();
+#endif
+    }
+
+private:
+#ifdef __linux__
+    struct EventFd
+    {
+        EventFd()
+            : handle(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+        {
+        }
+
+        ~EventFd()
+        {
+            if (handle >= 0)
+            {
+                close(handle);
+            }
+        }
+
+        const int handle;
+    };
+#endif
+
+    struct Entry
+    {
+        std::shared_ptr<ReadableAudioOutputStream> stream;
+        ReadyCallback onReady;
+        bool removed = false;
+#ifdef __linux__
+        std::shared_ptr<EventFd> event;
+#endif
+    };
+
+    void RemoveEntry(Entry& entry)
+    {
+        entry.removed = true;
+        entry.stream->SetReadyCallback(nullptr);
+#ifdef __linux__
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, entry.event->handle, nullptr);
+#endif
+    }
+
+    void CloseHandles()
+    {
+#ifdef __linux__
+        if (m_wakeEvent >= 0)
+        {
+            close(m_wakeEvent);
+        }
+        if (m_epoll >= 0)
+        {
+            close(m_epoll);
+        }
+        m_wakeEvent = -1;
+        m_epoll = -1;
+#endif
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<Entry*, std::shared_ptr<Entry>> m_entries;
+    bool m_stopped = false;
+#ifdef __linux__
+    int m_epoll = -1;
+    int m_wakeEvent = -1;
+#else
+    std::condition_variable m_readyChanged;
+    std::deque<std::shared_ptr<Entry>> m_ready;
+#endif
+};
@@ -0,0 +1,540 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hdr_histogram.h"
+
+// Pool of SpeechRecognizer instances for servers that recognize many short utterances, keyed by
+// language, endpoint and audio format. Each instance is created with its own push stream, and its
+// connection is opened ahead of time; a request takes a warm instance and pushes its audio into it.
+// A recognizer reads one stream, and the stream can't be reopened once closed, so an instance
+// serves one session: after SessionStopped it's disposed of, and a background thread replaces it,
+// keeping the creation and connection cost off the requests. The number of sessions in progress
+// is limited per pool, a session counts until SessionStopped.
+class RecognizerPool final
+{
+public:
+    // Creates a new config for the endpoint, or for the default subscription if it's empty. The pool
+    // sets the language.
+    using ConfigFactory = std::function<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig>(const std::string& endpoint)>;
+
+    struct Key
+    {
+        std::string language = "en-US";
+        std::string endpoint;
+        uint32_t samplesPerSecond = 16000;
+        uint8_t bitsPerSample = 16;
+        uint8_t channels = 1;
+    };
+
+    struct Options
+    {
+        // Number of idle instances kept per key.
+        size_t warmInstances = 4;
+        size_t maxActiveSessions = 200;
+        // Acquire gives up after waiting that long for a session to end.
+        std::chrono::milliseconds acquireTimeout{ 1000 };
+        // A session that doesn't stop within that time after its audio ended no longer counts.
+        std::chrono::seconds drainTimeout{ 30 };
+    };
+
+    struct Metrics
+    {
+        uint64_t warmAcquires = 0;    // served by an idle instance.
+        uint64_t coldAcquires = 0;    // an instance had to be created for the request.
+        uint64_t rejectedAcquires = 0; // timed out at the session limit.
+        uint64_t createdInstances = 0;
+        uint64_t recycledInstances = 0;
+        size_t activeSessions = 0;
+        size_t peakActiveSessions = 0;
+        // Average cost of creating an instance, and the total that warm acquires didn't pay.
+        std::chrono::microseconds averageCreationTime{ 0 };
+        std::chrono::microseconds creationTimeSaved{ 0 };
+        std::chrono::microseconds acquireP50{ 0 };
+        std::chrono::microseconds acquireP99{ 0 };
+        std::chrono::microseconds acquireMax{ 0 };
+        // From the end of the audio to SessionStopped, that is until the last result.
+        std::chrono::microseconds finalP50{ 0 };
+        std::chrono::microseconds finalP99{ 0 };
+        std::chrono::microseconds finalMax{ 0 };
+    };
+
+private:
+    struct Instance;
+    struct State;
+
+public:
+    // A recognizer bound to its push stream, for one session. Start recognition through the session,
+    // write the audio and close. The session is given back when this object is released; a start
+    // that is still in flight by then is waited for before the recognizer is disposed of.
+    class Session final
+    {
+    public:
+        ~Session()
+        {
+            Close();
+            Release(m_state, m_instance);
+        }
+
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+
+        const std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer>& Recognizer() const
+        {
+            return m_instance->recognizer;
+        }
+
+        std::shared_future<void> StartContinuousRecognitionAsync()
+        {
+            auto start = m_instance->recognizer->StartContinuousRecognitionAsync().share();
+            if (auto state = m_state.lock())
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                m_instance->started = true;
+                m_instance->start = start;
+            }
+            return start;
+        }
+
+        std::shared_future<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognitionResult>> RecognizeOnceAsync()
+        {
+            auto result = m_instance->recognizer->RecognizeOnceAsync().share();
+            if (auto state = m_state.lock())
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                m_instance->started = true;
+                m_instance->recognizeOnce = result;
+            }
+            return result;
+        }
+
+        void Write(const uint8_t* data, uint32_t size)
+        {
+            m_instance->stream->Write(const_cast<uint8_t*>(data), size);
+        }
+
+        // Ends the audio. Further calls do nothing.
+        void Close()
+        {
+            if (!m_closed)
+            {
+                m_closed = true;
+                auto state = m_state.lock();
+                if (state)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    m_instance->closed = std::chrono::steady_clock::now();
+                }
+                m_instance->stream->Close();
+            }
+        }
+
+    private:
+        friend class RecognizerPool;
+
+        Session(const std::weak_ptr<State>& state, const std::shared_ptr<Instance>& instance)
+            : m_state(state), m_instance(instance)
+        {
+        }
+
+        std::weak_ptr<State> m_state;
+        std::shared_ptr<Instance> m_instance;
+        bool m_closed = false;
+    };
+
+    RecognizerPool(ConfigFactory configFactory, const Options& options)
+        : m_state(std::make_shared<State>())
+    {
+        m_state->configFactory = configFactory;
+        m_state->options = options;
+        m_maintenanceThread = std::thread([this]() { RunMaintenance(); });
+    }
+
+    ~RecognizerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            m_state->stopped = true;
+        }
+        m_state->changed.notify_all();
+        m_maintenanceThread.join();
+    }
+
+    RecognizerPool(const RecognizerPool&) = delete;
+    RecognizerPool& operator=(const RecognizerPool&) = delete;
+
+    // Creates the warm instances for a key, and keeps them warm from now on.
+    void Prewarm(const Key& key)
+    {
+        std::vector<std::shared_ptr<Instance>> created;
+        for (size_t i = 0; i < m_state->options.warmInstances; i++)
+        {
+            created.push_back(CreateInstance(m_state, key));
+        }
+
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        auto& pool = m_state->pools[KeyString(key)];
+        pool.key = key;
+        for (auto& instance : created)
+        {
+            pool.idle.push_back(instance);
+        }
+    }
+
+    // Returns a session for the key, or nullptr if the session limit was reached and no session
+    // ended within the timeout. Throws like SpeechRecognizer::FromConfig if an instance had to be
+    // created and that failed.
+    std::unique_ptr<Session> Acquire(const Key& key)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto keyString = KeyString(key);
+        std::shared_ptr<Instance> instance;
+        {
+            std::unique_lock<std::mutex> lock(m_state->mutex);
+            if (!m_state->changed.wait_for(lock, m_state->options.acquireTimeout, [this]() { return m_state->activeSessions < m_state->options.maxActiveSessions; }))
+            {
+                m_state->rejectedAcquires++;
+                return nullptr;
+            }
+            m_state->activeSessions++;
+            m_state->peakActiveSessions = std::max(m_state->peakActiveSessions, m_state->activeSessions);
+
+            auto& pool = m_state->pools[keyString];
+            pool.key = key;
+            if (!pool.idle.empty())
+            {
+                instance = pool.idle.front();
+                pool.idle.pop_front();
+                instance->leased = true;
+            }
+        }
+        // Tops up the idle instances in the background.
+        m_state->changed.notify_all();
+
+        bool warm = instance != nullptr;
+        if (!warm)
+        {
+            try
+            {
+                instance = CreateInstance(m_state, key);
+            }
+            catch (...)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_state->mutex);
+                    m_state->activeSessions--;
+                }
+                m_state->changed.notify_all();
+                throw;
+            }
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            instance->leased = true;
+            (warm ? m_state->warmAcquires : m_state->coldAcquires)++;
+            m_state->acquireLatency.Record((uint64_t)elapsed.count());
+        }
+        return std::unique_ptr<Session>(new Session(m_state, instance));
+    }
+
+    Metrics GetMetrics() const
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        Metrics metrics;
+        metrics.warmAcquires = m_state->warmAcquires;
+        metrics.coldAcquires = m_state->coldAcquires;
+        metrics.rejectedAcquires = m_state->rejectedAcquires;
+        metrics.createdInstances = m_state->createdInstances;
+        metrics.recycledInstances = m_state->recycledInstances;
+        metrics.activeSessions = m_state->activeSessions;
+        metrics.peakActiveSessions = m_state->peakActiveSessions;
+        if (m_state->createdInstances > 0)
+        {
+            metrics.averageCreationTime = m_state->creationTime / (int64_t)m_state->createdInstances;
+            metrics.creationTimeSaved = metrics.averageCreationTime * (int64_t)m_state->warmAcquires;
+        }
+        auto& acquire = m_state->acquireLatency;
+        metrics.acquireP50 = std::chrono::microseconds(acquire.ValueAtPercentile(50));
+        metrics.acquireP99 = std::chrono::microseconds(acquire.ValueAtPercentile(99));
+        metrics.acquireMax = std::chrono::microseconds(acquire.Max());
+        auto& finalLatency = m_state->finalLatency;
+        metrics.finalP50 = std::chrono::microseconds(finalLatency.ValueAtPercentile(50));
+        metrics.finalP99 = std::chrono::microseconds(finalLatency.ValueAtPercentile(99));
+        metrics.finalMax = std::chrono::microseconds(finalLatency.Max());
+        return metrics;
+    }
+
+private:
+    struct Instance
+    {
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer> recognizer;
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> stream;
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::Connection> connection;
+        // Guarded by the state mutex.
+        bool leased = false;
+        // Set when a start is issued through the session, or by SessionStarted.
+        bool started = false;
+        std::shared_future<void> start;
+        std::shared_future<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognitionResult>> recognizeOnce;
+        bool stopped = false;
+        bool slotFreed = false;
+        std::chrono::steady_clock::time_point closed;
+        std::chrono::steady_clock::time_point released;
+    };
+
+    struct Pool
+    {
+        Key key;
+        std::deque<std::shared_ptr<Instance>> idle;
+        // Instances being created for it by the maintenance thread.
+        size_t pending = 0;
+    };
+
+    struct State
+    {
+        ConfigFactory configFactory;
+        Options options;
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::map<std::string, Pool> pools;
+        // Released instances whose session hasn't stopped yet.
+        std::vector<std::shared_ptr<Instance>> draining;
+        bool stopped = false;
+        size_t activeSessions = 0;
+        size_t peakActiveSessions = 0;
+        uint64_t warmAcquires = 0;
+        uint64_t coldAcquires = 0;
+        uint64_t rejectedAcquires = 0;
+        uint64_t createdInstances = 0;
+        uint64_t recycledInstances = 0;
+        std::chrono::microseconds creationTime{ 0 };
+        HdrHistogram acquireLatency;
+        HdrHistogram finalLatency;
+    };
+
+    static std::string KeyString(const Key& key)
+    {
+        return key.language + "|" + key.endpoint + "|" + std::to_string(key.samplesPerSecond) + "|" +
+            std::to_string(key.bitsPerSample) + "|" + std::to_string(key.channels);
+    }
+
+    static std::shared_ptr<Instance> CreateInstance(const std::shared_ptr<State>& state, const Key& key)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+        auto start = std::chrono::steady_clock::now();
+        auto config = state->configFactory(key.endpoint);
+        config->SetSpeechRecognitionLanguage(key.language);
+
+        auto instance = std::make_shared<Instance>();
+        instance->stream = AudioInputStream::CreatePushStream(AudioStreamFormat::GetWaveFormatPCM(key.samplesPerSecond, key.bitsPerSample, key.channels));
+        instance->recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(instance->stream));
+
+        // The handlers belong to the recognizer, which the instance owns.
+        std::weak_ptr<State> weakState = state;
+        auto rawInstance = instance.get();
+        instance->recognizer->SessionStarted += [weakState, rawInstance](const SessionEventArgs&)
+        {
+            if (auto state = weakState.lock())
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                rawInstance->started = true;
+            }
+        };
+        instance->recognizer->SessionStopped += [weakState, rawInstance](const SessionEventArgs&)
+        {
+            if (auto state = weakState.lock())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    rawInstance->stopped = true;
+                    if (rawInstance->closed.time_since_epoch().count() != 0)
+                    {
+                        auto latency = std::chrono::steady_clock::now() - rawInstance->closed;
+                        state->finalLatency.Record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+                    }
+                    FreeSlot(*state, *rawInstance);
+                }
+                state->changed.notify_all();
+            }
+        };
+
+        // Opens the connection in the background, the session waits for it if it's not ready yet.
+        instance->connection = Connection::FromRecognizer(instance->recognizer);
+        instance->connection->Open(false);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->createdInstances++;
+        state->creationTime += elapsed;
+        return instance;
+    }
+
+    // Frees the session slot of a leased instance, once.
+    static void FreeSlot(State& state, Instance& instance)
+    {
+        if (instance.leased && !instance.slotFreed)
+        {
+            instance.slotFreed = true;
+            state.activeSessions--;
+        }
+    }
+
+    // Whether a start issued through the session hasn't completed yet. A start that failed leaves
+    // the instance as never started, since no session will stop.
+    static bool StartInFlight(Instance& instance)
+    {
+        return InFlight(instance, instance.start) || InFlight(instance, instance.recognizeOnce);
+    }
+
+    template <class T>
+    static bool InFlight(Instance& instance, const std::shared_future<T>& future)
+    {
+        if (!future.valid())
+        {
+            return false;
+        }
+        if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return true;
+        }
+        try
+        {
+            future.get();
+        }
+        catch (...)
+        {
+            instance.started = false;
+        }
+        return false;
+    }
+
+    // The instance is disposed of by the maintenance thread, never from its own event handlers.
+    static void Release(const std::weak_ptr<State>& weakState, const std::shared_ptr<Instance>& instance)
+    {
+        auto state = weakState.lock();
+        if (!state)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            instance->released = std::chrono::steady_clock::now();
+            state->draining.push_back(instance);
+        }
+        state->changed.notify_all();
+    }
+
+    // Disposes of the released instances whose session stopped, or never started, freeing their slot
+    // if SessionStopped didn't, and tops up each key to the warm instance count. Instances are created and
+    // disposed of without holding the lock.
+    void RunMaintenance()
+    {
+        auto& state = *m_state;
+        std::unique_lock<std::mutex> lock(state.mutex);
+        while (!state.stopped)
+        {
+            state.changed.wait_for(lock, std::chrono::seconds(1));
+
+            auto now = std::chrono::steady_clock::now();
+            std::vector<std::shared_ptr<Instance>> recycled;
+            for (auto it = state.draining.begin(); it != state.draining.end();)
+            {
+                auto& instance = **it;
+                // An instance whose start is still connecting keeps its slot, whatever the drain timeout,
+                // and is looked at again once the start completed.
+                if (StartInFlight(instance))
+                {
+                    ++it;
+                }
+                else if (instance.stopped || !instance.started || now - instance.released > state.options.drainTimeout)
+                {
+                    if (!instance.slotFreed)
+                    {
+                        FreeSlot(state, instance);
+                        state.changed.notify_all();
+                    }
+                    recycled.push_back(*it);
+                    it = state.draining.erase(it);
+                    state.recycledInstances++;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            std::vector<Key> refill;
+            for (auto& entry : state.pools)
+            {
+                auto& pool = entry.second;
+                for (auto i = pool.idle.size() + pool.pending; i < state.options.warmInstances; i++)
+                {
+                    refill.push_back(pool.key);
+                    pool.pending++;
+                }
+            }
+            if (recycled.empty() && refill.empty())
+            {
+                continue;
+            }
+
+            lock.unlock();
+            recycled.clear();
+            // In parallel, so that a burst of requests is caught up with quickly.
+            std::vector<std::future<std::shared_ptr<Instance>>> creating;
+            for (auto& key : refill)
+            {
+                creating.push_back(std::async(std::launch::async, [this, key]() -> std::shared_ptr<Instance>
+                {
+                    try
+                    {
+                        return CreateInstance(m_state, key);
+                    }
+                    catch (const std::exception&)
+                    {
+                        return nullptr;
+                    }
+                }));
+            }
+            std::vector<std::shared_ptr<Instance>> created;
+            for (auto& instance : creating)
+            {
+                created.push_back(instance.get());
+            }
+            lock.lock();
+
+            for (size_t i = 0; i < refill.size(); i++)
+            {
+                auto& pool = state.pools[KeyString(refill[i])];
+                pool.pending--;
+                if (created[i])
+                {
+                    pool.idle.push_back(created[i]);
+                }
+            }
+        }
+    }
+
+    std::shared_ptr<State> m_state;
+    std::thread m_maintenanceThread;
+};
@@ -0,0 +1,228 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Pool of fixed-size memory blocks, shared by audio buffers so that blocks released by one
+// buffer are reused by the next one instead of going back to the heap.
+class AudioBlockPool final
+{
+public:
+    AudioBlockPool(size_t blockSize = 64 * 1024, size_t maxFreeBlocks = 256)
+        : m_blockSize(blockSize), m_maxFreeBlocks(maxFreeBlocks)
+    {
+        if (blockSize == 0)
+        {
+            throw std::invalid_argument("Block size must not be 0.");
+        }
+    }
+
+    size_t BlockSize() const
+    {
+        return m_blockSize;
+    }
+
+    std::unique_ptr<uint8_t[]> Acquire()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_freeBlocks.empty())
+        {
+            return std::unique_ptr<uint8_t[]>(new uint8_t[m_blockSize]);
+        }
+        auto block = std::move(m_freeBlocks.back());
+        m_freeBlocks.pop_back();
+        return block;
+    }
+
+    void Release(std::unique_ptr<uint8_t[]> block)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_freeBlocks.size() < m_maxFreeBlocks)
+        {
+            m_freeBlocks.push_back(std::move(block));
+        }
+    }
+
+private:
+    const size_t m_blockSize;
+    const size_t m_maxFreeBlocks;
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<uint8_t[]>> m_freeBlocks;
+};
+
+// Audio buffer that stores appended data in a list of pooled blocks. Appending never moves
+// data already stored, so the cost is linear in the total size, unlike growing a single vector.
+// Once the buffer holds more than 'memoryLimit' bytes in memory, further data is written to a
+// spill file, if one is given.
+class SegmentedAudioBuffer final
+{
+public:
+    SegmentedAudioBuffer(std::shared_ptr<AudioBlockPool> pool = std::make_shared<AudioBlockPool>(),
+        size_t memoryLimit = std::numeric_limits<size_t>::max(), const std::string& spillFileName = "")
+        : m_pool(pool), m_memoryLimit(memoryLimit), m_spillFileName(spillFileName)
+    {
+    }
+
+    ~SegmentedAudioBuffer()
+    {
+        Clear();
+    }
+
+    SegmentedAudioBuffer(const SegmentedAudioBuffer&) = delete;
+    SegmentedAudioBuffer& operator=(const SegmentedAudioBuffer&) = delete;
+
+    // Appends data. Throws std::runtime_error if the memory limit is reached and no spill file is available.
+    void Append(const uint8_t* data, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (size > 0)
+        {
+            if (!m_spill.is_open() && (m_blocks.empty() || m_lastBlockUsed == m_pool->BlockSize()))
+            {
+                if (m_blocks.size() * m_pool->BlockSize() >= m_memoryLimit)
+                {
+                    OpenSpillFile();
+                }
+                else
+                {
+                    m_blocks.push_back(m_pool->Acquire());
+                    m_lastBlockUsed = 0;
+                }
+            }
+
+            if (m_spill.is_open())
+            {
+                // Once spilling started, all remaining data goes to the file to keep the order.
+                m_spill.write((const char*)data, size);
+                if (!m_spill.good())
+                {
+                    throw std::runtime_error("Failed to write to the spill file.");
+                }
+                m_spillSize += size;
+                break;
+            }
+
+            auto count = std::min(size, m_pool->BlockSize() - m_lastBlockUsed);
+            memcpy(m_blocks.back().get() + m_lastBlockUsed, data, count);
+            m_lastBlockUsed += count;
+            data += count;
+            size -= count;
+        }
+    }
+
+    // Total number of bytes appended.
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return MemorySize() + m_spillSize;
+    }
+
+    // Calls 'callback(const uint8_t* data, size_t size)' for each segment of the data, in order.
+    // In-memory segments are passed without copying; spilled data is read back in block-sized pieces.
+    template <class Callback>
+    void ForEachSegment(Callback callback) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_blocks.size(); i++)
+        {
+            auto size = i + 1 < m_blocks.size() ? m_pool->BlockSize() : m_lastBlockUsed;
+            if (size > 0)
+            {
+                callback((const uint8_t*)m_blocks[i].get(), size);
+            }
+        }
+
+        if (m_spillSize > 0)
+        {
+            m_spill.flush();
+            std::ifstream spill(m_spillFileName, std::ios_base::binary | std::ios_base::in);
+            auto scratch = m_pool->Acquire();
+            size_t remaining = m_spillSize;
+            while (remaining > 0 && spill.good())
+            {
+                spill.read((char*)scratch.get(), std::min(remaining, m_pool->BlockSize()));
+                auto count = (size_t)spill.gcount();
+                if (count == 0)
+                {
+                    break;
+                }
+                callback((const uint8_t*)scratch.get(), count);
+                remaining -= count;
+            }
+            m_pool->Release(std::move(scratch));
+        }
+    }
+
+    // Copies all data into one contiguous vector, with a single allocation.
+    std::vector<uint8_t> Flatten() const
+    {
+        std::vector<uint8_t> data;
+        data.reserve(Size());
+        ForEachSegment([&data](const uint8_t* segment, size_t size)
+        {
+            data.insert(data.end(), segment, segment + size);
+        });
+        return data;
+    }
+
+    // Removes all data, returns the blocks to the pool and deletes the spill file.
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& block : m_blocks)
+        {
+            m_pool->Release(std::move(block));
+        }
+        m_blocks.clear();
+        m_lastBlockUsed = 0;
+
+        if (m_spill.is_open())
+        {
+            m_spill.close();
+            std::remove(m_spillFileName.c_str());
+        }
+        m_spillSize = 0;
+    }
+
+private:
+    size_t MemorySize() const
+    {
+        return m_blocks.empty() ? 0 : (m_blocks.size() - 1) * m_pool->BlockSize() + m_lastBlockUsed;
+    }
+
+    void OpenSpillFile()
+    {
+        if (m_spillFileName.empty())
+        {
+            throw std::runtime_error("Audio buffer memory limit reached and no spill file is set.");
+        }
+
+        m_spill.open(m_spillFileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!m_spill.good())
+        {
+            throw std::runtime_error("Failed to open the spill file.");
+        }
+    }
+
+    std::shared_ptr<AudioBlockPool> m_pool;
+    const size_t m_memoryLimit;
+    const std::string m_spillFileName;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<uint8_t[]>> m_blocks;
+    size_t m_lastBlockUsed = 0;
+    mutable std::ofstream m_spill;
+    size_t m_spillSize = 0;
+};
@@ -0,0 +1,571 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+// C++20 coroutine support for the Speech SDK: the recognition events and the results of callbacks
+// can be awaited, so that many sessions run on a few threads instead of one blocked thread each.
+// Available when the compiler has coroutines enabled (the DebugCpp20 and ReleaseCpp20 configurations,
+// or -std=c++20); SPEECH_COROUTINES_AVAILABLE is defined then.
+#if defined(__has_include)
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#define SPEECH_COROUTINES_AVAILABLE
+#endif
+#endif
+
+#ifdef SPEECH_COROUTINES_AVAILABLE
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+class CoroutineExecutor;
+
+// Lazily started coroutine that returns a T. Awaiting it starts it, and resumes the awaiting
+// coroutine when it returns, on the thread it completed on.
+template <class T>
+class CoroutineTask final
+{
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept
+        {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    struct PromiseBase
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception()
+        {
+            exception = std::current_exception();
+        }
+    };
+
+    struct promise_type : PromiseBase
+    {
+        std::optional<T> value;
+
+        CoroutineTask get_return_object()
+        {
+            return CoroutineTask(Handle::from_promise(*this));
+        }
+
+        void return_value(T result)
+        {
+            value = std::move(result);
+        }
+    };
+
+    CoroutineTask(CoroutineTask&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {
+    }
+
+    CoroutineTask(const CoroutineTask&) = delete;
+    CoroutineTask& operator=(const CoroutineTask&) = delete;
+
+    ~CoroutineTask()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+    {
+        m_handle.promise().continuation = continuation;
+        return m_handle;
+    }
+
+    T await_resume()
+    {
+        auto& promise = m_handle.promise();
+        if (promise.exception)
+        {
+            std::rethrow_exception(promise.exception);
+        }
+        return std::move(*promise.value);
+    }
+
+private:
+    explicit CoroutineTask(Handle handle)
+        : m_handle(handle)
+    {
+    }
+
+    Handle m_handle;
+};
+
+template <>
+struct CoroutineTask<void>::promise_type : CoroutineTask<void>::PromiseBase
+{
+    CoroutineTask get_return_object()
+    {
+        return CoroutineTask(Handle::from_promise(*this));
+    }
+
+    void return_void()
+    {
+    }
+};
+
+template <>
+inline void CoroutineTask<void>::await_resume()
+{
+    if (m_handle.promise().exception)
+    {
+        std::rethrow_exception(m_handle.promise().exception);
+    }
+}
+
+// Fixed set of threads that run coroutines. A coroutine that waits for a callback (see Completion
+// and EventChannel) holds none of them; the callback posts it back.
+class CoroutineExecutor final
+{
+public:
+    explicit CoroutineExecutor(size_t threadCount = std::max(2u, std::thread::hardware_concurrency()))
+    {
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            m_threads.emplace_back([this]() { RunWorker(); });
+        }
+    }
+
+    // Waits for the spawned coroutines, and stops the threads.
+    ~CoroutineExecutor()
+    {
+        WaitIdle();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_changed.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    CoroutineExecutor(const CoroutineExecutor&) = delete;
+    CoroutineExecutor& operator=(const CoroutineExecutor&) = delete;
+
+    size_t ThreadCount() const
+    {
+        return m_threads.size();
+    }
+
+    // Resumes the coroutine on one of the threads.
+    void Post(std::coroutine_handle<> handle)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ready.push_back(handle);
+        }
+        m_changed.notify_one();
+    }
+
+    // co_await executor.Schedule() continues on one of the threads.
+    auto Schedule()
+    {
+        struct Awaiter
+        {
+            CoroutineExecutor& executor;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                executor.Post(handle);
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+        return Awaiter{ *this };
+    }
+
+    // Runs a coroutine to completion on the executor, without waiting for it. An exception that
+    // escapes it terminates the program.
+    void Spawn(CoroutineTask<void> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_spawned++;
+        }
+        RunSpawned(*this, std::move(task));
+    }
+
+    // Waits until all spawned coroutines returned.
+    void WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_spawned == 0; });
+    }
+
+private:
+    // Coroutine that starts on its own and destroys itself at the end.
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void() noexcept
+            {
+            }
+
+            void unhandled_exception() noexcept
+            {
+                std::terminate();
+            }
+        };
+    };
+
+    static Detached RunSpawned(CoroutineExecutor& executor, CoroutineTask<void> task)
+    {
+        co_await executor.Schedule();
+        co_await task;
+        {
+            std::lock_guard<std::mutex> lock(executor.m_mutex);
+            if (--executor.m_spawned == 0)
+            {
+                executor.m_idle.notify_all();
+            }
+        }
+    }
+
+    void RunWorker()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_changed.wait(lock, [this]() { return m_stopped || !m_ready.empty(); });
+            if (m_ready.empty())
+            {
+                return;
+            }
+            auto handle = m_ready.front();
+            m_ready.pop_front();
+            lock.unlock();
+            handle.resume();
+            lock.lock();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::condition_variable m_idle;
+    std::deque<std::coroutine_handle<>> m_ready;
+    size_t m_spawned = 0;
+    bool m_stopped = false;
+    std::vector<std::thread> m_threads;
+};
+
+// Result of an operation that completes in a callback, awaited by one coroutine. Copies share the
+// result, so a copy can be captured by the callback; the coroutine is resumed on the executor once
+// SetValue or SetException is called.
+template <class T>
+class Completion final
+{
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+public:
+    explicit Completion(CoroutineExecutor& executor)
+        : m_state(std::make_shared<State>(executor))
+    {
+    }
+
+    void SetValue(Value value = Value())
+    {
+        Set([&](State& state) { state.value = std::move(value); });
+    }
+
+    void SetException(std::exception_ptr exception)
+    {
+        Set([&](State& state) { state.exception = exception; });
+    }
+
+    bool await_ready() const
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        return m_state->done;
+    }
+
+    // Resumes right away if it completed in the meantime.
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (m_state->done)
+        {
+            return false;
+        }
+        m_state->waiting = handle;
+        return true;
+    }
+
+    T await_resume()
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (m_state->exception)
+        {
+            std::rethrow_exception(m_state->exception);
+        }
+        if constexpr (!std::is_void_v<T>)
+        {
+            return std::move(*m_state->value);
+        }
+    }
+
+private:
+    struct State
+    {
+        explicit State(CoroutineExecutor& e)
+            : executor(e)
+        {
+        }
+
+        CoroutineExecutor& executor;
+        std::mutex mutex;
+        std::optional<Value> value;
+        std::exception_ptr exception;
+        std::coroutine_handle<> waiting;
+        bool done = false;
+    };
+
+    template <class Assign>
+    void Set(Assign assign)
+    {
+        std::coroutine_handle<> waiting;
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            if (m_state->done)
+            {
+                return;
+            }
+            assign(*m_state);
+            m_state->done = true;
+            waiting = std::exchange(m_state->waiting, nullptr);
+        }
+        if (waiting)
+        {
+            m_state->executor.Post(waiting);
+        }
+    }
+
+    std::shared_ptr<State> m_state;
+};
+
+// Queue of values produced by callbacks and awaited by one coroutine, which is resumed on the
+// executor. Next returns std::nullopt once the channel is closed and empty.
+template <class T>
+class EventChannel final
+{
+public:
+    explicit EventChannel(CoroutineExecutor& executor)
+        : m_executor(executor)
+    {
+    }
+
+    void Push(T value)
+    {
+        std::coroutine_handle<> waiting;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_values.push_back(std::move(value));
+            waiting = std::exchange(m_waiting, nullptr);
+        }
+        if (waiting)
+        {
+            m_executor.Post(waiting);
+        }
+    }
+
+    void Close()
+    {
+        std::coroutine_handle<> waiting;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            waiting = std::exchange(m_waiting, nullptr);
+        }
+        if (waiting)
+        {
+            m_executor.Post(waiting);
+        }
+    }
+
+    auto Next()
+    {
+        struct Awaiter
+        {
+            EventChannel& channel;
+
+            bool await_ready()
+            {
+                std::lock_guard<std::mutex> lock(channel.m_mutex);
+                return !channel.m_values.empty() || channel.m_closed;
+            }
+
+            // Resumes right away if a value arrived in the meantime.
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                std::lock_guard<std::mutex> lock(channel.m_mutex);
+                if (!channel.m_values.empty() || channel.m_closed)
+                {
+                    return false;
+                }
+                channel.m_waiting = handle;
+                return true;
+            }
+
+            std::optional<T> await_resume()
+            {
+                std::lock_guard<std::mutex> lock(channel.m_mutex);
+                if (channel.m_values.empty())
+                {
+                    return std::nullopt;
+                }
+                auto value = std::move(channel.m_values.front());
+                channel.m_values.pop_front();
+                return value;
+            }
+        };
+        return Awaiter{ *this };
+    }
+
+private:
+    CoroutineExecutor& m_executor;
+    std::mutex m_mutex;
+    std::deque<T> m_values;
+    std::coroutine_handle<> m_waiting;
+    bool m_closed = false;
+};
+
+// The Recognized, Canceled and SessionStopped events of a recognizer, in order.
+struct RecognitionEvent
+{
+    enum class Type
+    {
+        Recognized,
+        Canceled,
+        SessionStopped
+    };
+
+    Type type = Type::Recognized;
+    // For Recognized.
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognitionResult> result;
+    // For Canceled.
+    Microsoft::CognitiveServices::Speech::CancellationReason reason{};
+    Microsoft::CognitiveServices::Speech::CancellationErrorCode errorCode{};
+    std::string errorDetails;
+};
+
+// Connects a channel to the events of the recognizer; it's closed after SessionStopped. The
+// handlers only hold a weak reference to it.
+inline std::shared_ptr<EventChannel<RecognitionEvent>> RecognitionEvents(
+    const std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechRecognizer>& recognizer, CoroutineExecutor& executor)
+{
+    using namespace Microsoft::CognitiveServices::Speech;
+
+    auto channel = std::make_shared<EventChannel<RecognitionEvent>>(executor);
+    std::weak_ptr<EventChannel<RecognitionEvent>> weakChannel = channel;
+    recognizer->Recognized += [weakChannel](const SpeechRecognitionEventArgs& e)
+    {
+        if (auto channel = weakChannel.lock())
+        {
+            RecognitionEvent event;
+            event.result = e.Result;
+            channel->Push(std::move(event));
+        }
+    };
+    recognizer->Canceled += [weakChannel](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        if (auto channel = weakChannel.lock())
+        {
+            RecognitionEvent event;
+            event.type = RecognitionEvent::Type::Canceled;
+            event.reason = e.Reason;
+            event.errorCode = e.ErrorCode;
+            event.errorDetails = e.ErrorDetails;
+            channel->Push(std::move(event));
+        }
+    };
+    recognizer->SessionStopped += [weakChannel](const SessionEventArgs&)
+    {
+        if (auto channel = weakChannel.lock())
+        {
+            RecognitionEvent event;
+            event.type = RecognitionEvent::Type::SessionStopped;
+            channel->Push(std::move(event));
+            channel->Close();
+        }
+    };
+    return channel;
+}
+
+#endif // SPEECH_COROUTINES_AVAILABLE
@@ -8,7 +8,24 @@
 // <toplevel>
 #include <speechapi_cxx.h>
 #include <fstream>
+#include <random>
+#include "detailed_result_parser.h"
+#include "event_dispatcher.h"
+#include "hdr_histogram.h"
+#include "partial_result_coalescer.h"
+#include "recognizer_pool.h"
+#include "speech_coroutines.h"
 #include "wav_file_reader.h"
+#include "word_timing_store.h"
+
+// The detailed result benchmark compares with nlohmann::json, from the nlohmann.json NuGet package in
+// the Visual Studio project, or from the include path elsewhere.
+#if defined(__has_include)
+#if __has_include(<nlohmann/json.hpp>)
+#include <nlohmann/json.hpp>
+#define NLOHMANN_JSON_AVAILABLE
+#endif
+#endif
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -698,3 +715,1234 @@ void PronunciationAssessmentWithMicrophone()
         }
     }
 }
+
+// Recognizes many short utterances concurrently, like a server does, with a new recognizer per
+// request and then with warm recognizers from a pool, and compares the latencies.
+void SpeechRecognitionWithRecognizerPool()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    // For a custom endpoint, use SpeechConfig::FromEndpoint with the endpoint of the key.
+    auto configFactory = [](const std::string& endpoint)
+    {
+        UNUSED(endpoint);
+        return SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+    };
+
+    const size_t clientCount = 8;
+    const size_t requestsPerClient = 10;
+    RecognizerPool::Key key; // en-US, default endpoint, 16 kHz 16 bit mono.
+
+    // All requests send the same utterance.
+    std::vector<uint8_t> audio;
+    {
+        WavFileReader reader("whatstheweatherlike.wav");
+        std::vector<uint8_t> buffer(3200);
+        int size;
+        while ((size = reader.Read(buffer.data(), (uint32_t)buffer.size())) != 0)
+        {
+            audio.insert(audio.end(), buffer.begin(), buffer.begin() + size);
+        }
+    }
+
+    // Starts the recognition, sends the audio of one request and waits for the result. Returns false
+    // if it wasn't recognized.
+    using RecognizeOnce = std::function<std::shared_future<std::shared_ptr<SpeechRecognitionResult>>()>;
+    auto recognize = [&audio](const RecognizeOnce& start, const std::function<void(const uint8_t*, uint32_t)>& write,
+        const std::function<void()>& close)
+    {
+        auto result = start();
+        for (size_t offset = 0; offset < audio.size(); offset += 3200)
+        {
+            write(audio.data() + offset, (uint32_t)std::min<size_t>(3200, audio.size() - offset));
+        }
+        close();
+        return result.get()->Reason == ResultReason::RecognizedSpeech;
+    };
+
+    auto run = [&](RecognizerPool* pool)
+    {
+        std::mutex mutex;
+        HdrHistogram latency; // in microseconds, from the request to its result.
+        HdrHistogram creation;
+        size_t recognized = 0;
+        std::vector<thread> clients;
+        for (size_t client = 0; client < clientCount; client++)
+        {
+            clients.emplace_back([&]()
+            {
+                for (size_t request = 0; request < requestsPerClient; request++)
+                {
+                    auto start = chrono::steady_clock::now();
+                    bool success = false;
+                    if (pool)
+                    {
+                        auto session = pool->Acquire(key);
+                        if (session)
+                        {
+                            success = recognize([&session]() { return session->RecognizeOnceAsync(); },
+                                [&session](const uint8_t* data, uint32_t size) { session->Write(data, size); },
+                                [&session]() { session->Close(); });
+                        }
+                    }
+                    else
+                    {
+                        auto config = configFactory(key.endpoint);
+                        config->SetSpeechRecognitionLanguage(key.language);
+                        auto stream = AudioInputStream::CreatePushStream(AudioStreamFormat::GetWaveFormatPCM(key.samplesPerSecond, key.bitsPerSample, key.channels));
+                        auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromStreamInput(stream));
+                        auto created = chrono::steady_clock::now();
+                        {
+                            lock_guard<std::mutex> lock(mutex);
+                            creation.Record((uint64_t)chrono::duration_cast<chrono::microseconds>(created - start).count());
+                        }
+                        success = recognize([&recognizer]() { return recognizer->RecognizeOnceAsync().share(); },
+                            [&stream](const uint8_t* data, uint32_t size) { stream->Write(const_cast<uint8_t*>(data), size); },
+                            [&stream]() { stream->Close(); });
+                    }
+
+                    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+                    lock_guard<std::mutex> lock(mutex);
+                    latency.Record((uint64_t)elapsed.count());
+                    recognized += success ? 1 : 0;
+                }
+            });
+        }
+        for (auto& client : clients)
+        {
+            client.join();
+        }
+
+        cout << (pool ? "Pooled recognizers: " : "New recognizer per request: ") << recognized << " of " << latency.Count()
+            << " requests recognized, latency p50 " << latency.ValueAtPercentile(50) / 1000 << " ms, p99 "
+            << latency.ValueAtPercentile(99) / 1000 << " ms, max " << latency.Max() / 1000 << " ms" << endl;
+        if (!pool)
+        {
+            cout << "  Recognizer creation p50 " << creation.ValueAtPercentile(50) / 1000 << " ms, p99 "
+                << creation.ValueAtPercentile(99) / 1000 << " ms" << endl;
+        }
+    };
+
+    cout << clientCount << " clients sending " << requestsPerClient << " utterances each." << endl;
+    run(nullptr);
+
+    // A session counts until it stopped, a little after its result: twice the clients leaves room
+    // for the next request of each.
+    RecognizerPool::Options options;
+    options.warmInstances = 2 * clientCount;
+    options.maxActiveSessions = 2 * clientCount;
+    RecognizerPool pool(configFactory, options);
+    pool.Prewarm(key);
+    run(&pool);
+
+    auto metrics = pool.GetMetrics();
+    cout << "  Warm acquires: " << metrics.warmAcquires << ", cold acquires: " << metrics.coldAcquires
+        << ", rejected: " << metrics.rejectedAcquires << ", peak sessions: " << metrics.peakActiveSessions << endl;
+    cout << "  Creation time saved: " << metrics.creationTimeSaved.count() / 1000 << " ms (" << metrics.averageCreationTime.count() / 1000
+        << " ms per recognizer), acquire p99 " << metrics.acquireP99.count() / 1000 << " ms, end of audio to session stop p50 "
+        << metrics.finalP50.count() / 1000 << " ms, p99 " << metrics.finalP99.count() / 1000 << " ms" << endl;
+}
+
+#ifdef SPEECH_COROUTINES_AVAILABLE
+// One continuous recognition session as a coroutine: it holds no thread while it waits. It's driven
+// by the events, which resume it from the SDK's callbacks.
+static CoroutineTask<void> RecognizeFileAsync(CoroutineExecutor& executor, std::shared_ptr<SpeechConfig> config, int session, std::mutex& outputMutex)
+{
+    auto recognizer = SpeechRecognizer::FromConfig(config, AudioConfig::FromWavFileInput("whatstheweatherlike.wav"));
+    auto events = RecognitionEvents(recognizer, executor);
+    auto started = recognizer->StartContinuousRecognitionAsync();
+
+    while (auto event = co_await events->Next())
+    {
+        lock_guard<std::mutex> lock(outputMutex);
+        if (event->type == RecognitionEvent::Type::Recognized && event->result->Reason == ResultReason::RecognizedSpeech)
+        {
+            cout << "Session " << session << " RECOGNIZED: Text=" << event->result->Text << std::endl;
+        }
+        else if (event->type == RecognitionEvent::Type::Canceled && event->reason == CancellationReason::Error)
+        {
+            cout << "Session " << session << " CANCELED: ErrorCode=" << (int)event->errorCode << std::endl;
+            cout << "CANCELED: ErrorDetails=" << event->errorDetails << std::endl;
+            cout << "CANCELED: Did you update the subscription info?" << std::endl;
+        }
+    }
+
+    // The session stopped at the end of the file, so neither of these waits.
+    started.get();
+    recognizer->StopContinuousRecognitionAsync().get();
+}
+#endif
+
+// Continuous recognition of several files at the same time, as coroutines on two threads.
+void SpeechContinuousRecognitionWithCoroutines()
+{
+#ifdef SPEECH_COROUTINES_AVAILABLE
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    const int sessionCount = 10;
+    std::mutex outputMutex;
+    CoroutineExecutor executor(2);
+    for (int session = 0; session < sessionCount; session++)
+    {
+        executor.Spawn(RecognizeFileAsync(executor, config, session, outputMutex));
+    }
+    executor.WaitIdle();
+    cout << sessionCount << " sessions recognized on " << executor.ThreadCount() << " threads." << std::endl;
+#else
+    cout << "This sample needs C++20 coroutines; build the DebugCpp20 or ReleaseCpp20 configuration." << std::endl;
+#endif
+}
+
+#ifdef SPEECH_COROUTINES_AVAILABLE
+// Stand-in for the service in the coroutine benchmark: runs callbacks after a delay, on one thread.
+class DelayedCallbacks final
+{
+public:
+    DelayedCallbacks()
+        : m_thread([this]() { Run(); })
+    {
+    }
+
+    ~DelayedCallbacks()
+    {
+        {
+            lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_changed.notify_one();
+        m_thread.join();
+    }
+
+    void After(chrono::milliseconds delay, std::function<void()> callback)
+    {
+        {
+            lock_guard<std::mutex> lock(m_mutex);
+            m_callbacks.emplace(chrono::steady_clock::now() + delay, std::move(callback));
+        }
+        m_changed.notify_one();
+    }
+
+private:
+    void Run()
+    {
+        unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stopped)
+        {
+            if (m_callbacks.empty())
+            {
+                m_changed.wait(lock);
+                continue;
+            }
+            auto next = m_callbacks.begin();
+            if (next->first > chrono::steady_clock::now())
+            {
+                m_changed.wait_until(lock, next->first);
+                continue;
+            }
+            auto callback = std::move(next->second);
+            m_callbacks.erase(next);
+            lock.unlock();
+            callback();
+            lock.lock();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::multimap<chrono::steady_clock::time_point, std::function<void()>> m_callbacks;
+    bool m_stopped = false;
+    std::thread m_thread;
+};
+
+// Timing of a simulated session: the start completes after 20 ms, then a result arrives every 50 ms,
+// and the stop completes 10 ms after it's requested. Completions are reported by callbacks.
+struct SimulatedSession
+{
+    static constexpr int results = 5;
+
+    static void Start(DelayedCallbacks& service, std::function<void()> done)
+    {
+        service.After(chrono::milliseconds(20), std::move(done));
+    }
+
+    // Calls 'onResult' with the time the result was produced, then with a default time point at the end.
+    static void Results(DelayedCallbacks& service, const std::function<void(chrono::steady_clock::time_point)>& onResult)
+    {
+        for (int i = 1; i <= results; i++)
+        {
+            service.After(chrono::milliseconds(50 * i), [onResult]() { onResult(chrono::steady_clock::now()); });
+        }
+        service.After(chrono::milliseconds(50 * results + 1), [onResult]() { onResult(chrono::steady_clock::time_point()); });
+    }
+
+    static void Stop(DelayedCallbacks& service, std::function<void()> done)
+    {
+        service.After(chrono::milliseconds(10), std::move(done));
+    }
+
+    // Blocks until the start or stop reports completion.
+    static void Wait(const std::function<void(DelayedCallbacks&, std::function<void()>)>& operation, DelayedCallbacks& service)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        operation(service, [promise]() { promise->set_value(); });
+        promise->get_future().get();
+    }
+};
+
+static CoroutineTask<void> SimulatedSessionAsync(CoroutineExecutor& executor, DelayedCallbacks& service, HdrHistogram& delays, std::mutex& mutex)
+{
+    Completion<void> started(executor);
+    SimulatedSession::Start(service, [started]() mutable { started.SetValue(); });
+    co_await started;
+    auto results = std::make_shared<EventChannel<chrono::steady_clock::time_point>>(executor);
+    SimulatedSession::Results(service, [results](chrono::steady_clock::time_point produced)
+    {
+        if (produced == chrono::steady_clock::time_point())
+        {
+            results->Close();
+        }
+        else
+        {
+            results->Push(produced);
+        }
+    });
+    while (auto produced = co_await results->Next())
+    {
+        auto delay = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - *produced);
+        lock_guard<std::mutex> lock(mutex);
+        delays.Record((uint64_t)delay.count());
+    }
+    Completion<void> stopped(executor);
+    SimulatedSession::Stop(service, [stopped]() mutable { stopped.SetValue(); });
+    co_await stopped;
+}
+#endif
+
+// Runs thousands of simulated recognition sessions, each with a blocked thread, and as coroutines
+// on a few threads, and compares the threads used and how late the results are handled. The
+// sessions are simulated locally, so no subscription is needed.
+void SpeechCoroutineScalingBenchmark()
+{
+#ifdef SPEECH_COROUTINES_AVAILABLE
+    // Highest number of threads in the process while 'run' runs, on Linux; 0 elsewhere.
+    auto peakThreadCount = [](const std::function<void()>& run)
+    {
+        std::atomic<bool> done{ false };
+        size_t peak = 0;
+        std::thread monitor([&]()
+        {
+            while (!done)
+            {
+#ifdef __linux__
+                std::ifstream status("/proc/self/status");
+                std::string line;
+                while (getline(status, line))
+                {
+                    if (line.compare(0, 8, "Threads:") == 0)
+                    {
+                        peak = std::max(peak, (size_t)std::stoul(line.substr(8)));
+                    }
+                }
+#endif
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+        });
+        run();
+        done = true;
+        monitor.join();
+        return peak;
+    };
+
+    auto report = [](const char* name, size_t sessions, chrono::steady_clock::time_point start, size_t threads, const HdrHistogram& delays)
+    {
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        cout << "  " << name << ": " << elapsed.count() << " ms, peak threads " << threads << ", results handled "
+            << delays.Count() << " of " << sessions * SimulatedSession::results << ", delay p50 " << delays.ValueAtPercentile(50)
+            << " us, p99 " << delays.ValueAtPercentile(99) << " us" << endl;
+    };
+
+    DelayedCallbacks service;
+    for (size_t sessions : { 100, 1000, 4000 })
+    {
+        cout << sessions << " concurrent sessions:" << endl;
+
+        // A thread per session, blocked on the futures and on the results.
+        {
+            std::mutex mutex;
+            HdrHistogram delays;
+            auto start = chrono::steady_clock::now();
+            auto threads = peakThreadCount([&]()
+            {
+                std::vector<thread> sessionThreads;
+                for (size_t i = 0; i < sessions; i++)
+                {
+                    sessionThreads.emplace_back([&]()
+                    {
+                        SimulatedSession::Wait(SimulatedSession::Start, service);
+                        std::mutex resultMutex;
+                        std::condition_variable resultAvailable;
+                        std::deque<chrono::steady_clock::time_point> results;
+                        SimulatedSession::Results(service, [&](chrono::steady_clock::time_point produced)
+                        {
+                            {
+                                lock_guard<std::mutex> lock(resultMutex);
+                                results.push_back(produced);
+                            }
+                            resultAvailable.notify_one();
+                        });
+                        while (true)
+                        {
+                            unique_lock<std::mutex> lock(resultMutex);
+                            resultAvailable.wait(lock, [&]() { return !results.empty(); });
+                            auto produced = results.front();
+                            results.pop_front();
+                            if (produced == chrono::steady_clock::time_point())
+                            {
+                                break;
+                            }
+                            auto delay = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - produced);
+                            lock_guard<std::mutex> delaysLock(mutex);
+                            delays.Record((uint64_t)delay.count());
+                        }
+                        SimulatedSession::Wait(SimulatedSession::Stop, service);
+                    });
+                }
+                for (auto& sessionThread : sessionThreads)
+                {
+                    sessionThread.join();
+                }
+            });
+            report("Blocking threads", sessions, start, threads, delays);
+        }
+
+        // Coroutines on 4 threads.
+        {
+            std::mutex mutex;
+            HdrHistogram delays;
+            auto start = chrono::steady_clock::now();
+            auto threads = peakThreadCount([&]()
+            {
+                CoroutineExecutor executor(4);
+                for (size_t i = 0; i < sessions; i++)
+                {
+                    executor.Spawn(SimulatedSessionAsync(executor, service, delays, mutex));
+                }
+                executor.WaitIdle();
+            });
+            report("Coroutines", sessions, start, threads, delays);
+        }
+    }
+#else
+    cout << "This sample needs C++20 coroutines; build the DebugCpp20 or ReleaseCpp20 configuration." << std::endl;
+#endif
+}
+
+// Continuous recognition with the event handlers run on worker threads, so that a slow handler
+// (here a simulated database write) doesn't hold up the SDK's callback thread.
+void SpeechContinuousRecognitionWithEventDispatcher()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Creates a speech recognizer using file as audio input.
+    // Replace with your own audio file name.
+    auto audioInput = AudioConfig::FromWavFileInput("whatstheweatherlike.wav");
+    auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+
+    // promise for synchronization of recognition end.
+    promise<void> recognitionEnd;
+
+    EventDispatcher dispatcher(EventDispatcher::Options{});
+    EventDispatcher::RecognitionHandlers handlers;
+    handlers.recognized = [](const std::shared_ptr<SpeechRecognitionResult>& result)
+    {
+        if (result->Reason == ResultReason::RecognizedSpeech)
+        {
+            // Stands for a write to a database.
+            this_thread::sleep_for(chrono::milliseconds(200));
+            cout << "RECOGNIZED (stored): Text=" << result->Text << std::endl;
+        }
+        else if (result->Reason == ResultReason::NoMatch)
+        {
+            cout << "NOMATCH: Speech could not be recognized." << std::endl;
+        }
+    };
+    handlers.canceled = [](const EventDispatcher::Canceled& canceled)
+    {
+        cout << "CANCELED: Reason=" << (int)canceled.reason << std::endl;
+        if (canceled.reason == CancellationReason::Error)
+        {
+            cout << "CANCELED: ErrorCode=" << (int)canceled.errorCode << "\n"
+                 << "CANCELED: ErrorDetails=" << canceled.errorDetails << "\n"
+                 << "CANCELED: Did you update the subscription info?" << std::endl;
+        }
+    };
+    // The events of a session are handled in order, so this one runs after the last result is stored.
+    handlers.sessionStopped = [&recognitionEnd](const std::string& sessionId)
+    {
+        UNUSED(sessionId);
+        cout << "Session stopped." << std::endl;
+        recognitionEnd.set_value(); // Notify to stop recognition.
+    };
+    dispatcher.Connect(recognizer, handlers);
+
+    // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
+    recognizer->StartContinuousRecognitionAsync().get();
+
+    // Waits for recognition end.
+    recognitionEnd.get_future().get();
+
+    // Stops recognition.
+    recognizer->StopContinuousRecognitionAsync().get();
+    recognizer.reset();
+
+    auto stats = dispatcher.GetStats();
+    cout << "Events: " << stats.handled << ", time on the SDK thread p99 " << stats.callbackP99.count() << " us, max "
+         << stats.callbackMax.count() << " us; handler p99 " << stats.handlerP99.count() / 1000 << " ms, queue delay p99 "
+         << stats.queueDelayP99.count() / 1000 << " ms" << std::endl;
+}
+
+// Delivers simulated recognition events of 32 sessions, one per millisecond, to handlers that take
+// 2 ms each: inline on the delivering thread, then through the dispatcher with 4 workers. The events
+// are simulated locally, so no subscription is needed.
+void SpeechEventDispatcherBenchmark()
+{
+    const int eventCount = 2000;
+    const int sessionCount = 32;
+    const auto interval = chrono::milliseconds(1);
+    const auto handlerTime = chrono::milliseconds(2);
+
+    // Calls 'deliver' for each event at its due time, or as soon as possible after it, like the SDK's
+    // callback thread does.
+    auto run = [&](const char* name, const std::function<void(int session, int sequence, chrono::steady_clock::time_point due)>& deliver,
+        const std::function<void()>& finish, HdrHistogram& delays)
+    {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < eventCount; i++)
+        {
+            auto due = start + i * interval;
+            this_thread::sleep_until(due);
+            deliver(i % sessionCount, i / sessionCount, due);
+        }
+        finish();
+        cout << "  " << name << ": handled " << delays.Count() << " events in " << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+            << " ms, delay from due time p50 " << delays.ValueAtPercentile(50) / 1000 << " ms, p99 " << delays.ValueAtPercentile(99) / 1000
+            << " ms, max " << delays.Max() / 1000 << " ms" << endl;
+    };
+
+    cout << eventCount << " events of " << sessionCount << " sessions, one every " << interval.count() << " ms, handlers of "
+        << handlerTime.count() << " ms:" << endl;
+
+    {
+        HdrHistogram delays;
+        run("Inline handlers", [&](int session, int sequence, chrono::steady_clock::time_point due)
+        {
+            UNUSED(session);
+            UNUSED(sequence);
+            delays.Record((uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - due).count());
+            this_thread::sleep_for(handlerTime);
+        }, []() {}, delays);
+    }
+
+    {
+        std::mutex mutex;
+        HdrHistogram delays;
+        std::vector<int> lastSequence(sessionCount, -1);
+        int outOfOrder = 0;
+        EventDispatcher::Options options;
+        options.workerCount = 4;
+        EventDispatcher dispatcher(options, [](const std::string&) {});
+        run("Dispatcher", [&](int session, int sequence, chrono::steady_clock::time_point due)
+        {
+            dispatcher.Post("session" + std::to_string(session), [&, session, sequence, due]()
+            {
+                {
+                    lock_guard<std::mutex> lock(mutex);
+                    delays.Record((uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - due).count());
+                    outOfOrder += sequence < lastSequence[session] ? 1 : 0;
+                    lastSequence[session] = sequence;
+                }
+                this_thread::sleep_for(handlerTime);
+            });
+        }, [&dispatcher]() { dispatcher.Flush(); }, delays);
+
+        auto stats = dispatcher.GetStats();
+        cout << "    events out of order within a session: " << outOfOrder << ", longest queue " << stats.maxQueueLength
+            << ", handler p99 " << stats.handlerP99.count() / 1000 << " ms" << endl;
+    }
+}
+
+// Continuous recognition for live captions: the partial results are coalesced to at most one update
+// every 250 ms, and each update only carries the text that changed since the previous one.
+void SpeechRecognitionWithCaptionCoalescing()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Creates a speech recognizer using file as audio input.
+    // Replace with your own audio file name.
+    auto audioInput = AudioConfig::FromWavFileInput("whatstheweatherlike.wav");
+    auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+
+    // promise for synchronization of recognition end.
+    promise<void> recognitionEnd;
+
+    // Stands for the client: applies the updates it would receive.
+    CaptionText caption;
+    PartialResultCoalescer::Options options;
+    options.interval = chrono::milliseconds(250);
+    PartialResultCoalescer coalescer(options, [&caption](const CaptionUpdate& update)
+    {
+        caption.Apply(update);
+        cout << (update.isFinal ? "FINAL" : "PARTIAL") << ": keep " << update.keep << ", append \"" << update.append
+             << "\" -> " << caption.Text() << std::endl;
+    });
+
+    // Subscribes to events.
+    recognizer->Recognizing.Connect([&coalescer](const SpeechRecognitionEventArgs& e)
+    {
+        coalescer.OnPartial(e.Result->Text);
+    });
+
+    recognizer->Recognized.Connect([&coalescer](const SpeechRecognitionEventArgs& e)
+    {
+        coalescer.OnFinal(e.Result->Reason == ResultReason::RecognizedSpeech ? e.Result->Text : std::string());
+    });
+
+    recognizer->Canceled.Connect([&recognitionEnd](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
+
+        if (e.Reason == CancellationReason::Error)
+        {
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                 << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                 << "CANCELED: Did you update the subscription info?" << std::endl;
+        }
+    });
+
+    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+    {
+        UNUSED(e);
+        cout << "Session stopped." << std::endl;
+        recognitionEnd.set_value(); // Notify to stop recognition.
+    });
+
+    // Sends a held partial when no further event comes within the interval.
+    auto recognitionEndFuture = recognitionEnd.get_future();
+    std::thread poller([&coalescer, &recognitionEndFuture]()
+    {
+        while (recognitionEndFuture.wait_for(chrono::milliseconds(50)) != future_status::ready)
+        {
+            coalescer.Poll();
+        }
+    });
+
+    // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
+    recognizer->StartContinuousRecognitionAsync().get();
+
+    // Waits for recognition end.
+    poller.join();
+
+    // Stops recognition.
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    auto stats = coalescer.GetStats();
+    cout << "Partial results: " << stats.partialsReceived << " received, " << stats.partialsSent << " sent; text: "
+         << stats.bytesReceived << " bytes received, " << stats.bytesSent << " bytes sent." << std::endl;
+}
+
+// Captions of simulated sessions: a partial result every 40 ms that adds a word, and sometimes
+// revises the last one, as the service does. Compares forwarding every result with coalesced delta
+// updates: messages, bytes and client time, and checks that the clients end up with the same text.
+// The results are simulated locally, so no subscription is needed.
+void SpeechCaptionCoalescingBenchmark()
+{
+    const int sessionCount = 200;
+    const int utterancesPerSession = 20;
+    const auto partialInterval = chrono::milliseconds(40);
+    const char* words[] = { "the", "weather", "in", "seattle", "is", "cloudy", "today", "with", "a", "chance", "of",
+        "rain", "later", "this", "afternoon", "and", "temperatures", "around", "twelve", "degrees" };
+    const size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+    // Results of all sessions, one after the other; a final result has 'isFinal' set.
+    struct Result
+    {
+        bool isFinal;
+        std::string text;
+        chrono::steady_clock::time_point time;
+    };
+    std::vector<std::vector<Result>> sessions(sessionCount);
+    std::mt19937 random(42);
+    for (auto& results : sessions)
+    {
+        auto time = chrono::steady_clock::time_point();
+        for (int u = 0; u < utterancesPerSession; u++)
+        {
+            std::string text;
+            auto length = 5 + random() % 20;
+            for (size_t w = 0; w < length; w++)
+            {
+                auto word = std::string(words[random() % wordCount]);
+                auto next = text + (text.empty() ? "" : " ");
+                // A third of the words are first heard as another word.
+                if (random() % 3 == 0)
+                {
+                    time += partialInterval;
+                    results.push_back({ false, next + words[random() % wordCount], time });
+                }
+                text = next + word;
+                time += partialInterval;
+                results.push_back({ false, text, time });
+            }
+            time += partialInterval;
+            results.push_back({ true, text, time });
+        }
+    }
+
+    // The client wraps the caption to lines of 42 characters on every message, like a caption renderer.
+    auto render = [](const std::string& text)
+    {
+        size_t lines = 0;
+        size_t lineStart = 0;
+        size_t lastSpace = std::string::npos;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == ' ')
+            {
+                lastSpace = i;
+            }
+            if (i - lineStart >= 42 && lastSpace != std::string::npos && lastSpace > lineStart)
+            {
+                lineStart = lastSpace + 1;
+                lines++;
+            }
+        }
+        return lines;
+    };
+
+    uint64_t forwardedMessages = 0;
+    uint64_t forwardedBytes = 0;
+    std::vector<std::string> forwardedFinals;
+    size_t forwardedLines = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto& results : sessions)
+    {
+        std::string caption;
+        for (auto& result : results)
+        {
+            forwardedMessages++;
+            forwardedBytes += result.text.size();
+            caption = result.text;
+            forwardedLines += render(caption);
+            if (result.isFinal)
+            {
+                forwardedFinals.push_back(caption);
+            }
+        }
+    }
+    auto forwardedTime = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+    PartialResultCoalescer::Options options;
+    options.interval = chrono::milliseconds(250);
+    uint64_t coalescedMessages = 0;
+    uint64_t coalescedBytes = 0;
+    std::vector<std::string> coalescedFinals;
+    // Coalescing runs on the server; only the client's work is timed.
+    std::vector<std::vector<CaptionUpdate>> updates(sessionCount);
+    for (int s = 0; s < sessionCount; s++)
+    {
+        PartialResultCoalescer coalescer(options, [&updates, s](const CaptionUpdate& update) { updates[s].push_back(update); });
+        for (auto& result : sessions[s])
+        {
+            // Polled from a timer, at the time of each result here.
+            coalescer.Poll(result.time);
+            if (result.isFinal)
+            {
+                coalescer.OnFinal(result.text, result.time);
+            }
+            else
+            {
+                coalescer.OnPartial(result.text, result.time);
+            }
+        }
+        auto stats = coalescer.GetStats();
+        coalescedMessages += stats.partialsSent + stats.finalsSent;
+        coalescedBytes += stats.bytesSent;
+    }
+    size_t coalescedLines = 0;
+    start = chrono::steady_clock::now();
+    for (auto& sessionUpdates : updates)
+    {
+        CaptionText caption;
+        for (auto& update : sessionUpdates)
+        {
+            caption.Apply(update);
+            coalescedLines += render(caption.Text());
+            if (update.isFinal)
+            {
+                coalescedFinals.push_back(caption.Text());
+            }
+        }
+    }
+    auto coalescedTime = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+    cout << sessionCount << " sessions of " << utterancesPerSession << " utterances, a partial result every "
+         << partialInterval.count() << " ms:" << endl;
+    cout << "  Forward every result: " << forwardedMessages << " messages, " << forwardedBytes / 1024 << " KB of text, client time "
+         << forwardedTime.count() / 1000.0 << " ms for " << forwardedLines << " wrapped lines" << endl;
+    cout << "  Coalesced, " << options.interval.count() << " ms: " << coalescedMessages << " messages, " << coalescedBytes / 1024
+         << " KB of text, client time " << coalescedTime.count() / 1000.0 << " ms for " << coalescedLines << " wrapped lines" << endl;
+    cout << "  Final captions identical: " << (forwardedFinals == coalescedFinals ? "yes" : "NO") << " (" << coalescedFinals.size()
+         << " utterances)" << endl;
+}
+
+// Continuous recognition with the detailed output and word-level timestamps: each result's JSON is
+// parsed into the alternatives and their words, reusing one DetailedResult.
+void SpeechContinuousRecognitionWithDetailedResultParser()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Request detailed output format, with the offset and duration of each word.
+    config->SetOutputFormat(OutputFormat::Detailed);
+    config->RequestWordLevelTimestamps();
+
+    // Creates a speech recognizer using file as audio input.
+    // Replace with your own audio file name.
+    auto audioInput = AudioConfig::FromWavFileInput("whatstheweatherlike.wav");
+    auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+
+    // promise for synchronization of recognition end.
+    promise<void> recognitionEnd;
+
+    // Events are raised one at a time, so the handler can reuse one result.
+    DetailedResult detailed;
+    recognizer->Recognized.Connect([&detailed](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason != ResultReason::RecognizedSpeech)
+        {
+            return;
+        }
+        // The parsed result points into the JSON text, which has to be kept while it's used.
+        auto json = e.Result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult);
+        try
+        {
+            DetailedResultParser::Parse(json, detailed);
+        }
+        catch (const std::runtime_error& error)
+        {
+            cout << "Invalid result: " << error.what() << std::endl;
+            return;
+        }
+        cout << "RECOGNIZED: " << detailed.displayText.str() << std::endl;
+        for (size_t i = 0; i < detailed.AlternativeCount(); i++)
+        {
+            cout << "  Alternative " << i << ": Confidence=" << detailed.confidence[i] << ", Lexical=" << detailed.lexical[i].str()
+                 << ", ITN=" << detailed.itn[i].str() << std::endl;
+            for (auto w = detailed.wordsBegin[i]; w < detailed.wordsEnd[i]; w++)
+            {
+                // Offsets and durations are in ticks of 100 ns.
+                cout << "    " << detailed.word[w].str() << " " << detailed.wordOffset[w] / 10000 << " ms, "
+                     << detailed.wordDuration[w] / 10000 << " ms" << std::endl;
+            }
+        }
+    });
+
+    recognizer->Canceled.Connect([](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
+
+        if (e.Reason == CancellationReason::Error)
+        {
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                 << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                 << "CANCELED: Did you update the subscription info?" << std::endl;
+        }
+    });
+
+    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+    {
+        UNUSED(e);
+        cout << "Session stopped." << std::endl;
+        recognitionEnd.set_value(); // Notify to stop recognition.
+    });
+
+    // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
+    recognizer->StartContinuousRecognitionAsync().get();
+
+    // Waits for recognition end.
+    recognitionEnd.get_future().get();
+
+    // Stops recognition.
+    recognizer->StopContinuousRecognitionAsync().get();
+}
+
+// Returns the JSON of a simulated detailed result at the offset, of 5 to 29 words of the vocabulary,
+// 300 ms apart, with word-level timestamps. The alternatives have the same words.
+static std::string SimulatedDetailedResult(std::mt19937& random, const std::vector<std::string>& vocabulary, uint64_t offset, int alternativeCount)
+{
+    auto length = 5 + random() % 25;
+    std::vector<size_t> utterance;
+    for (size_t w = 0; w < length; w++)
+    {
+        utterance.push_back(random() % vocabulary.size());
+    }
+    std::string text;
+    for (auto w : utterance)
+    {
+        text += (text.empty() ? "" : " ") + vocabulary[w];
+    }
+    std::string json = "{\"RecognitionStatus\":\"Success\",\"Offset\":" + std::to_string(offset) + ",\"Duration\":"
+        + std::to_string(length * 3000000) + ",\"DisplayText\":\"" + text + ".\",\"NBest\":[";
+    for (int a = 0; a < alternativeCount; a++)
+    {
+        json += std::string(a == 0 ? "" : ",") + "{\"Confidence\":0." + std::to_string(9000 - a * 1000 - random() % 900)
+            + ",\"Lexical\":\"" + text + "\",\"ITN\":\"" + text + "\",\"MaskedITN\":\"" + text + "\",\"Display\":\"" + text
+            + ".\",\"Words\":[";
+        for (size_t w = 0; w < utterance.size(); w++)
+        {
+            json += std::string(w == 0 ? "" : ",") + "{\"Word\":\"" + vocabulary[utterance[w]] + "\",\"Offset\":"
+                + std::to_string(offset + w * 3000000) + ",\"Duration\":" + std::to_string(2000000 + random() % 1000000) + "}";
+        }
+        json += "]}";
+    }
+    json += "]}";
+    return json;
+}
+
+// Parses simulated detailed results, of 5 alternatives with word-level timestamps, with the
+// DetailedResultParser and, when it's available, with nlohmann::json into the same fields, and
+// checks that both give the same values. The results are simulated locally, so no subscription is
+// needed.
+void SpeechDetailedResultParsingBenchmark()
+{
+    const int resultCount = 1000;
+    const int alternativeCount = 5;
+    const int rounds = 10;
+    const std::vector<std::string> words = { "the", "weather", "in", "seattle", "is", "cloudy", "today", "with", "a", "chance", "of",
+        "rain", "later", "this", "afternoon", "and", "temperatures", "around", "twelve", "degrees", "caf\\u00e9" };
+
+    std::mt19937 random(7);
+    std::vector<std::string> results;
+    size_t totalBytes = 0;
+    for (int r = 0; r < resultCount; r++)
+    {
+        results.push_back(SimulatedDetailedResult(random, words, 10000000ull * (uint64_t)r, alternativeCount));
+        totalBytes += results.back().size();
+    }
+
+    auto report = [&](const char* name, chrono::steady_clock::duration time)
+    {
+        auto seconds = chrono::duration<double>(time).count();
+        cout << "  " << name << ": " << seconds * 1e6 / (resultCount * rounds) << " us per result, "
+             << totalBytes * rounds / seconds / (1024 * 1024) << " MB/s" << endl;
+    };
+
+    cout << resultCount << " detailed results of " << alternativeCount << " alternatives, " << totalBytes / resultCount
+         << " bytes on average, parsed " << rounds << " times:" << endl;
+
+    // One result for all, as a server thread would use it.
+    DetailedResult detailed;
+    uint64_t checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (auto& json : results)
+        {
+            DetailedResultParser::Parse(json, detailed);
+            checksum += detailed.word.size() + detailed.wordOffset.back();
+        }
+    }
+    report("DetailedResultParser", chrono::steady_clock::now() - start);
+
+#ifdef NLOHMANN_JSON_AVAILABLE
+    // The same fields, from the document.
+    struct Word
+    {
+        std::string word;
+        uint64_t offset;
+        uint64_t duration;
+    };
+    struct Alternative
+    {
+        double confidence;
+        std::string lexical, itn, maskedItn, display;
+        std::vector<Word> words;
+    };
+    std::vector<Alternative> alternatives;
+    uint64_t documentChecksum = 0;
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (auto& json : results)
+        {
+            auto document = nlohmann::json::parse(json);
+            alternatives.clear();
+            size_t words = 0;
+            for (auto& nbest : document["NBest"])
+            {
+                Alternative alternative{ nbest["Confidence"].get<double>(), nbest["Lexical"].get<std::string>(), nbest["ITN"].get<std::string>(),
+                    nbest["MaskedITN"].get<std::string>(), nbest["Display"].get<std::string>(), {} };
+                for (auto& word : nbest["Words"])
+                {
+                    alternative.words.push_back({ word["Word"].get<std::string>(), word["Offset"].get<uint64_t>(), word["Duration"].get<uint64_t>() });
+                }
+                words += alternative.words.size();
+                alternatives.push_back(std::move(alternative));
+            }
+            documentChecksum += words + alternatives.back().words.back().offset;
+        }
+    }
+    report("nlohmann::json", chrono::steady_clock::now() - start);
+
+    // Compares all fields of every result.
+    size_t mismatches = 0;
+    for (auto& json : results)
+    {
+        DetailedResultParser::Parse(json, detailed);
+        auto document = nlohmann::json::parse(json);
+        auto& nbest = document["NBest"];
+        mismatches += detailed.AlternativeCount() != nbest.size() || detailed.displayText.str() != document["DisplayText"].get<std::string>()
+            || detailed.offset != document["Offset"].get<uint64_t>() ? 1 : 0;
+        for (size_t i = 0; i < std::min<size_t>(detailed.AlternativeCount(), nbest.size()); i++)
+        {
+            mismatches += detailed.confidence[i] != nbest[i]["Confidence"].get<double>() || detailed.lexical[i].str() != nbest[i]["Lexical"].get<std::string>()
+                || detailed.itn[i].str() != nbest[i]["ITN"].get<std::string>() || detailed.maskedItn[i].str() != nbest[i]["MaskedITN"].get<std::string>()
+                || detailed.display[i].str() != nbest[i]["Display"].get<std::string>()
+                || detailed.wordsEnd[i] - detailed.wordsBegin[i] != nbest[i]["Words"].size() ? 1 : 0;
+            auto w = detailed.wordsBegin[i];
+            for (auto& word : nbest[i]["Words"])
+            {
+                mismatches += w < detailed.wordsEnd[i] && (detailed.word[w].str() != word["Word"].get<std::string>()
+                    || detailed.wordOffset[w] != word["Offset"].get<uint64_t>() || detailed.wordDuration[w] != word["Duration"].get<uint64_t>()) ? 1 : 0;
+                w++;
+            }
+        }
+    }
+    cout << "  Results that differ: " << mismatches << (checksum == documentChecksum ? "" : ", checksums differ") << endl;
+#else
+    UNUSED(checksum);
+    cout << "  nlohmann/json.hpp isn't on the include path; restore the NuGet packages or add it to compare." << endl;
+#endif
+}
+
+// Continuous recognition that keeps the timings of all recognized words, then prints the words
+// spoken in the first five seconds and the time of each occurrence of a word, as subtitles and
+// search would use them.
+void SpeechContinuousRecognitionWithWordTimingStore()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Request detailed output format, with the offset and duration of each word.
+    config->SetOutputFormat(OutputFormat::Detailed);
+    config->RequestWordLevelTimestamps();
+
+    // Creates a speech recognizer using file as audio input.
+    // Replace with your own audio file name.
+    auto audioInput = AudioConfig::FromWavFileInput("whatstheweatherlike.wav");
+    auto recognizer = SpeechRecognizer::FromConfig(config, audioInput);
+
+    // promise for synchronization of recognition end.
+    promise<void> recognitionEnd;
+
+    DetailedResult detailed;
+    WordTimingStore store;
+    recognizer->Recognized.Connect([&detailed, &store](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason != ResultReason::RecognizedSpeech)
+        {
+            return;
+        }
+        auto json = e.Result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult);
+        try
+        {
+            DetailedResultParser::Parse(json, detailed);
+            store.AddUtterance(detailed);
+        }
+        catch (const std::exception& error)
+        {
+            cout << "Result not stored: " << error.what() << std::endl;
+            return;
+        }
+        cout << "RECOGNIZED: " << detailed.displayText.str() << std::endl;
+    });
+
+    recognizer->Canceled.Connect([](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        cout << "CANCELED: Reason=" << (int)e.Reason << std::endl;
+
+        if (e.Reason == CancellationReason::Error)
+        {
+            cout << "CANCELED: ErrorCode=" << (int)e.ErrorCode << "\n"
+                 << "CANCELED: ErrorDetails=" << e.ErrorDetails << "\n"
+                 << "CANCELED: Did you update the subscription info?" << std::endl;
+        }
+    });
+
+    recognizer->SessionStopped.Connect([&recognitionEnd](const SessionEventArgs& e)
+    {
+        UNUSED(e);
+        cout << "Session stopped." << std::endl;
+        recognitionEnd.set_value(); // Notify to stop recognition.
+    });
+
+    // Starts continuous recognition. Uses StopContinuousRecognitionAsync() to stop recognition.
+    recognizer->StartContinuousRecognitionAsync().get();
+
+    // Waits for recognition end.
+    recognitionEnd.get_future().get();
+
+    // Stops recognition.
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    cout << store.WordCount() << " words, " << store.DistinctWordCount() << " distinct, in " << store.UtteranceCount()
+         << " utterances, " << store.MemoryUsage() << " bytes." << std::endl;
+    if (store.WordCount() == 0)
+    {
+        return;
+    }
+
+    // Offsets are in ticks of 100 ns.
+    auto range = store.FindByTimeRange(0, 50000000);
+    cout << "Words in the first 5 seconds:";
+    for (auto w = range.first; w < range.second; w++)
+    {
+        cout << " " << store.Word(w);
+    }
+    cout << std::endl;
+
+    // Each occurrence of the last word, with its utterance.
+    auto last = store.WordCount() - 1;
+    cout << "[" << store.Word(last) << "] is spoken at:";
+    for (size_t w = 0; w < store.WordCount(); w++)
+    {
+        if (store.WordId(w) == store.WordId(last))
+        {
+            cout << " " << store.Offset(w) / 10000 << " ms (utterance " << store.UtteranceOfWord(w) << ")";
+        }
+    }
+    cout << std::endl;
+}
+
+// Keeps the word timings of a simulated 24-hour session, from its detailed results, as objects with
+// a string per word and in a WordTimingStore, and compares the memory used and the time of finding
+// the words of random 10 second windows. The results are simulated locally, so no subscription is
+// needed.
+void SpeechWordTimingStoreBenchmark()
+{
+    const auto sessionLength = 24ull * 3600 * 10000000; // In ticks of 100 ns.
+    const int vocabularySize = 5000;
+    const int queryCount = 100000;
+    const int64_t window = 100000000;
+
+    std::mt19937 random(11);
+    std::vector<std::string> vocabulary;
+    const char* syllables[] = { "ka", "lo", "mi", "ter", "sun", "da", "ri", "on", "be", "st", "al", "que", "for", "mat", "ion", "ly" };
+    for (int i = 0; i < vocabularySize; i++)
+    {
+        std::string word;
+        auto length = 1 + random() % 5;
+        for (size_t s = 0; s < length; s++)
+        {
+            word += syllables[random() % (sizeof(syllables) / sizeof(syllables[0]))];
+        }
+        vocabulary.push_back(word);
+    }
+
+    // How the timings are often kept.
+    struct Word
+    {
+        std::string word;
+        int64_t offset;
+        int64_t duration;
+    };
+    struct Utterance
+    {
+        int64_t offset;
+        int64_t duration;
+        std::vector<Word> words;
+    };
+    std::vector<Utterance> utterances;
+
+    DetailedResult detailed;
+    WordTimingStore store;
+    uint64_t offset = 0;
+    while (offset < sessionLength)
+    {
+        auto json = SimulatedDetailedResult(random, vocabulary, offset, 1);
+        DetailedResultParser::Parse(json, detailed);
+        store.AddUtterance(detailed);
+
+        Utterance utterance{ (int64_t)detailed.offset, (int64_t)detailed.duration, {} };
+        for (auto w = detailed.wordsBegin[0]; w < detailed.wordsEnd[0]; w++)
+        {
+            utterance.words.push_back({ detailed.word[w].str(), (int64_t)detailed.wordOffset[w], (int64_t)detailed.wordDuration[w] });
+        }
+        utterances.push_back(std::move(utterance));
+        // A pause of half a second between utterances.
+        offset = detailed.offset + detailed.duration + 5000000;
+    }
+
+    // Strings up to the capacity of an empty one are kept inside the object, longer ones on the heap.
+    const auto inlineCapacity = std::string().capacity();
+    size_t objectBytes = utterances.capacity() * sizeof(Utterance);
+    for (auto& utterance : utterances)
+    {
+        objectBytes += utterance.words.capacity() * sizeof(Word);
+        for (auto& word : utterance.words)
+        {
+            objectBytes += word.word.capacity() > inlineCapacity ? word.word.capacity() + 1 : 0;
+        }
+    }
+
+    std::vector<int64_t> froms;
+    for (int q = 0; q < queryCount; q++)
+    {
+        froms.push_back((int64_t)(random() % (sessionLength / 10000)) * 10000);
+    }
+
+    // Binary search for the utterances, then a scan of their words.
+    size_t objectMatches = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto from : froms)
+    {
+        auto to = from + window;
+        auto it = std::upper_bound(utterances.begin(), utterances.end(), from,
+            [](int64_t time, const Utterance& utterance) { return time < utterance.offset; });
+        for (it = it == utterances.begin() ? it : it - 1; it != utterances.end() && it->offset < to; ++it)
+        {
+            for (auto& word : it->words)
+            {
+                objectMatches += word.offset < to && word.offset + word.duration > from ? 1 : 0;
+            }
+        }
+    }
+    auto objectTime = chrono::steady_clock::now() - start;
+
+    size_t storeMatches = 0;
+    start = chrono::steady_clock::now();
+    for (auto from : froms)
+    {
+        auto range = store.FindByTimeRange(from, from + window);
+        storeMatches += range.second - range.first;
+    }
+    auto storeTime = chrono::steady_clock::now() - start;
+
+    auto before = store.MemoryUsage();
+    store.ShrinkToFit();
+    cout << "24 hours of speech: " << store.WordCount() << " words, " << store.DistinctWordCount() << " distinct, in "
+         << store.UtteranceCount() << " utterances:" << endl;
+    cout << "  Objects with a string per word: " << objectBytes / 1024 << " KB, not counting the allocator's overhead, "
+         << queryCount << " window queries in " << chrono::duration_cast<chrono::milliseconds>(objectTime).count() << " ms" << endl;
+    cout << "  WordTimingStore: " << store.MemoryUsage() / 1024 << " KB (" << before / 1024 << " KB before ShrinkToFit), "
+         << queryCount << " window queries in " << chrono::duration_cast<chrono::milliseconds>(storeTime).count() << " ms" << endl;
+    cout << "  Words found: " << storeMatches << (storeMatches == objectMatches ? ", the same" : ", DIFFERENT") << endl;
+}
@@ -7,6 +7,23 @@
 
 #include <speechapi_cxx.h>
 #include <fstream>
+#include "audio_transcoder.h"
+#include "batch_synthesizer.h"
+#include "chunked_http_server.h"
+#include "jitter_buffer.h"
+#include "local_synthesizer.h"
+#include "long_form_synthesizer.h"
+#include "prompt_archive.h"
+#include "readable_audio_output_stream.h"
+#include "segmented_audio_buffer.h"
+#include "ssml_prompt_batcher.h"
+#include "streaming_wav_file_writer.h"
+#include "synthesis_broadcaster.h"
+#include "synthesis_cache.h"
+#include "synthesis_metrics.h"
+#include "synthesis_pipeline.h"
+#include "synthesizer_pool.h"
+#include "word_boundary_index.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -325,14 +342,15 @@ void SpeechSynthesisToPushAudioOutputStream()
 {
     // First, defines push audio output stream callback class that implements the
     // PushAudioOutputStreamCallback interface. The sample here illustrates how to define such
-    // a callback that writes audio data to a byte vector.
+    // a callback that collects audio data in a segmented buffer.
     // PushAudioOutputStreamSampleCallback implements PushAudioOutputStreamCallback interface
     class PushAudioOutputStreamSampleCallback : public PushAudioOutputStreamCallback
     {
     public:
+        // The buffer keeps up to 64 MB in memory, and spills the rest of the audio to a file.
         PushAudioOutputStreamSampleCallback()
+            : m_audioData(std::make_shared<AudioBlockPool>(), 64 * 1024 * 1024, "outputaudio.spill")
         {
-            m_audioData = std::make_shared<std::vector<uint8_t>>();
         }
 
         /// <summary>
@@ -343,11 +361,9 @@ void SpeechSynthesisToPushAudioOutputStream()
         /// <returns>Tell synthesizer how many bytes are received.</returns>
         int Write(uint8_t* dataBuffer, uint32_t size) override
         {
-            auto oldSize = m_audioData->size();
-            m_audioData->resize(oldSize + size);
-            memcpy(m_audioData->data() + oldSize, dataBuffer, size);
-
-            cout << size << " bytes received." << endl;
+            // Appending to the segmented buffer never copies the audio received before.
+            m_audioData.Append(dataBuffer, size);
+            m_chunkCount++;
 
             return size;
         }
@@ -357,7 +373,7 @@ void SpeechSynthesisToPushAudioOutputStream()
         /// </summary>
         void Close() override
         {
-            cout << "Push audio output stream closed." << endl;
+            cout << "Push audio output stream closed after " << m_chunkCount << " chunks." << endl;
         }
 
         /// <summary>
@@ -366,7 +382,7 @@ void SpeechSynthesisToPushAudioOutputStream()
         /// <returns>The received audio data size</returns>
         size_t GetAudioSize()
         {
-            return m_audioData->size();
+            return m_audioData.Size();
         }
 
         /// <summary>
@@ -375,11 +391,12 @@ void SpeechSynthesisToPushAudioOutputStream()
         /// <returns>The received audio data in byte vector</returns>
         std::shared_ptr<std::vector<uint8_t>> GetAudioData()
         {
-            return m_audioData;
+            return std::make_shared<std::vector<uint8_t>>(m_audioData.Flatten());
         }
 
     private:
-        std::shared_ptr<std::vector<uint8_t>> m_audioData;
+        SegmentedAudioBuffer m_audioData;
+        size_t m_chunkCount = 0;
     };
 
     // Creates an instance of a speech config with specified subscription key and service region.
@@ -556,10 +573,15 @@ void SpeechSynthesisEvents()
     // Replace with your own subscription key and service region (e.g., "westus").
     auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
 
+    // Records time to first byte, chunk gaps, real-time factor etc. per voice and output format.
+    auto metrics = std::make_shared<SynthesisMetrics>();
+    SynthesisMetricsRecorder recorder(metrics, "default", SpeechSynthesisOutputFormat::Riff16Khz16BitMonoPcm);
+
     // Creates a speech synthesizer with a null output stream.
     // This means the audio output data will not be written to any stream.
     // You can just get the audio from the result.
     auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+    recorder.Attach(synthesizer);
 
     // Subscribes to events
     synthesizer->SynthesisStarted += [](const SpeechSynthesisEventArgs& e)
@@ -591,6 +613,7 @@ void SpeechSynthesisEvents()
             break;
         }
 
+        recorder.RequestStarted();
         auto result = synthesizer->SpeakTextAsync(text).get();
 
         // Checks result.
@@ -613,6 +636,9 @@ void SpeechSynthesisEvents()
             }
         }
     }
+
+    // Exports the metrics as JSON, times in milliseconds.
+    cout << "Synthesis metrics: " << metrics->ToJson();
 }
 
 // Speech synthesis word boundary event.
@@ -627,9 +653,13 @@ void SpeechSynthesisWordBoundaryEvent()
     // You can just get the audio from the result.
     auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
 
+    // Collects the word boundaries into an index, to look up words by time and time by words.
+    WordBoundaryIndexBuilder indexBuilder;
+
     // Subscribes to word boundary event
-    synthesizer->WordBoundary += [](const SpeechSynthesisWordBoundaryEventArgs& e)
+    synthesizer->WordBoundary += [&indexBuilder](const SpeechSynthesisWordBoundaryEventArgs& e)
     {
+        indexBuilder.Add(e.AudioOffset, e.TextOffset, e.WordLength);
         cout << "Word boundary event received. "
             // The unit of e.AudioOffset is tick (1 tick = 100 nanoseconds), divide by 10,000 to convert to milliseconds.
             << "Audio offset: " << (e.AudioOffset + 5000) / 10000 << "ms, "
@@ -658,9 +688,33 @@ void SpeechSynthesisWordBoundaryEvent()
             cout << "Speech synthesized for text [" << text << "]" << std::endl;
             auto audioData = result->GetAudioData();
             cout << audioData->size() << " bytes of audio data received for text [" << text << "]" << endl;
+
+            // Saves the index next to the audio, and maps it back as a player would.
+            AudioDataStream::FromResult(result)->SaveToWavFile("outputaudio_words.wav");
+            indexBuilder.Build().Save("outputaudio_words.wav.words");
+            auto index = WordBoundaryIndex::Load("outputaudio_words.wav.words");
+
+            if (index.Size() > 0)
+            {
+                // The word to highlight one second into the audio.
+                auto word = index.FindByAudioOffset(10000000);
+                if (word != WordBoundaryIndex::npos)
+                {
+                    cout << "Word spoken at 1000ms: [" << text.substr(index.TextOffset(word), index.WordLength(word)) << "]" << endl;
+                }
+
+                // The time to seek to for the last word of the text.
+                word = index.FindByTextOffset((uint32_t)text.size() - 1);
+                if (word != WordBoundaryIndex::npos)
+                {
+                    cout << "Word [" << text.substr(index.TextOffset(word), index.WordLength(word)) << "] is spoken at "
+                        << (index.AudioOffset(word) + 5000) / 10000 << "ms" << endl;
+                }
+            }
         }
         else if (result->Reason == ResultReason::Canceled)
         {
+            indexBuilder.Build();
             auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
             cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
 
@@ -716,3 +770,1302 @@ void SpeechSynthesisWithSourceLanguageAutoDetection()
         }
     }
 }
+
+// Speech synthesis with a cache, so that repeated texts are not synthesized again.
+void SpeechSynthesisWithCache()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // The voice, language and output format are part of the cache key, together with the text.
+    SynthesisRequest request;
+    request.voice = "Microsoft Server Speech Text to Speech Voice (en-US, AriaRUS)";
+    request.language = "en-US";
+    request.outputFormat = SpeechSynthesisOutputFormat::Riff16Khz16BitMonoPcm;
+    config->SetSpeechSynthesisVoiceName(request.voice);
+    config->SetSpeechSynthesisLanguage(request.language);
+    config->SetSpeechSynthesisOutputFormat(request.outputFormat);
+
+    // Creates a speech synthesizer with a null output stream.
+    // This means the audio output data will not be written to any stream.
+    // You can just get the audio from the result.
+    auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+
+    // Keeps up to 16 MB of recently used audio in memory, and up to 256 MB in the "synthesis_cache" directory.
+    SynthesisCache cache(16 * 1024 * 1024, "synthesis_cache", 256 * 1024 * 1024);
+
+    // Synthesizes on a cache miss. Returns nullptr on failure, so that failures are not cached.
+    auto synthesize = [synthesizer](const SynthesisRequest& request) -> std::shared_ptr<std::vector<uint8_t>>
+    {
+        auto result = request.isSsml ? synthesizer->SpeakSsmlAsync(request.text).get() : synthesizer->SpeakTextAsync(request.text).get();
+        if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+            return nullptr;
+        }
+        return result->GetAudioData();
+    };
+
+    while (true)
+    {
+        // Receives a text from console input and synthesize it, or gets it from the cache.
+        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        getline(cin, text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        request.text = text;
+        auto start = chrono::steady_clock::now();
+        SynthesisCache::Source source;
+        auto audioDataStream = cache.GetOrSynthesize(request, synthesize, &source);
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        if (!audioDataStream)
+        {
+            continue;
+        }
+
+        cout << "Audio for text [" << text << "] "
+            << (source == SynthesisCache::Source::Memory ? "served from memory cache" :
+                source == SynthesisCache::Source::Disk ? "served from disk cache" : "synthesized")
+            << " in " << elapsed.count() << " ms" << endl;
+
+        // The cached audio can be read like an audio data stream.
+        uint8_t buffer[16000];
+        uint32_t totalSize = 0;
+        uint32_t filledSize = 0;
+
+        while ((filledSize = audioDataStream->ReadData(buffer, sizeof(buffer))) > 0)
+        {
+            totalSize += filledSize;
+        }
+
+        cout << "Totally " << totalSize << " bytes received for text [" << text << "]" << endl;
+    }
+
+    auto metrics = cache.GetMetrics();
+    auto averageMs = [](chrono::microseconds total, uint64_t count) { return count == 0 ? 0.0 : total.count() / 1000.0 / count; };
+    cout << "Cache hit ratio: " << metrics.HitRatio() * 100 << "%" << endl;
+    cout << "Memory hits: " << metrics.memoryHits << ", average " << averageMs(metrics.memoryHitTime, metrics.memoryHits) << " ms" << endl;
+    cout << "Disk hits: " << metrics.diskHits << ", average " << averageMs(metrics.diskHitTime, metrics.diskHits) << " ms" << endl;
+    cout << "Misses: " << metrics.misses << ", average " << averageMs(metrics.missTime, metrics.misses) << " ms" << endl;
+    cout << "Misses that shared a synthesis: " << metrics.sharedMisses << ", disk evictions: " << metrics.diskEvictions << endl;
+}
+
+// Speech synthesis of a long document, with sentences synthesized in parallel.
+void SpeechSynthesisLongForm()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Synthesizes up to 4 segments of about 1000 characters at the same time, and stitches them into one wave file.
+    LongFormSynthesizer::Options options;
+    options.parallelism = 4;
+    options.maxSegmentLength = 1000;
+    options.outputFormat = SpeechSynthesisOutputFormat::Riff16Khz16BitMonoPcm;
+    LongFormSynthesizer synthesizer(config, options);
+
+    while (true)
+    {
+        // Receives the name of a text file from console input and synthesizes its content.
+        cout << "Enter the name of a text file that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string fileName;
+        getline(cin, fileName);
+        if (fileName.empty())
+        {
+            break;
+        }
+
+        std::ifstream file(fileName);
+        if (!file.good())
+        {
+            cout << "Failed to open " << fileName << endl;
+            continue;
+        }
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        try
+        {
+            auto start = chrono::steady_clock::now();
+            auto result = synthesizer.SynthesizeTextToFile(text, "outputaudio_longform.wav");
+            auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+            // The unit of audio durations and offsets is tick (1 tick = 100 nanoseconds), divide by 10,000 to convert to milliseconds.
+            cout << "Synthesized " << result.segmentCount << " segments, " << result.audioDuration / 10000 << " ms of audio in "
+                << elapsed.count() << " ms, to [outputaudio_longform.wav]" << endl;
+
+            // Word boundaries are on the timeline of the whole file, and refer to positions in the whole text.
+            for (size_t i = 0; i < result.wordBoundaries.size() && i < 10; i++)
+            {
+                auto& boundary = result.wordBoundaries[i];
+                cout << "Word [" << text.substr(boundary.textOffset, boundary.wordLength) << "] at "
+                    << (boundary.audioOffset + 5000) / 10000 << "ms" << endl;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            cout << "Long form synthesis failed: " << e.what() << endl;
+        }
+    }
+}
+
+// Speech synthesis of a response with several sentences, synthesizing the next sentences while the first one is played.
+void SpeechSynthesisPipelined()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Raw PCM, so that the chunks of all sentences form one contiguous stream.
+    config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw16Khz16BitMonoPcm);
+
+    // Compares synthesizing one sentence at a time with synthesizing up to 2 sentences ahead.
+    SynthesisPipeline::Options serialOptions;
+    serialOptions.lookahead = 0;
+    serialOptions.bytesPerSecond = 32000;
+    SynthesisPipeline::Options pipelinedOptions;
+    pipelinedOptions.lookahead = 2;
+    pipelinedOptions.bytesPerSecond = 32000;
+    auto serial = SynthesisPipeline::FromConfig(config, serialOptions);
+    auto pipelined = SynthesisPipeline::FromConfig(config, pipelinedOptions);
+
+    while (true)
+    {
+        // Receives a response of several sentences from console input and synthesizes it.
+        cout << "Enter a response of several sentences that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        getline(cin, text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        auto sentences = SynthesisPipeline::SplitSentences(text);
+        for (auto pipeline : { serial, pipelined })
+        {
+            // The sink gets the audio in order. Replace the file with a player or an audio output stream.
+            std::ofstream audioFile("outputaudio_pipelined.raw", std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+            auto metrics = pipeline->Speak(sentences, [&audioFile](const uint8_t* data, size_t size)
+            {
+                audioFile.write((const char*)data, size);
+            });
+
+            cout << (pipeline == serial ? "One sentence at a time: " : "Synthesized ahead: ")
+                << "time to first audio " << metrics.timeToFirstAudio.count() / 1000 << " ms, "
+                << "mean gap between sentences " << metrics.MeanGap().count() / 1000 << " ms, "
+                << "max gap " << metrics.MaxGap().count() / 1000 << " ms, "
+                << metrics.failedSentences << " of " << sentences.size() << " sentences failed." << endl;
+        }
+    }
+}
+
+// Speech synthesis with a pool of synthesizers, connected before the requests come in.
+void SpeechSynthesisWithSynthesizerPool()
+{
+    // Creates instances of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto configFactory = []() { return SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion"); };
+
+    // Keeps 2 connected synthesizers per voice and format, and replaces the ones that lose their connection.
+    SynthesizerPool::Options options;
+    options.warmInstances = 2;
+    options.healthCheckInterval = chrono::seconds(10);
+    SynthesizerPool pool(configFactory, options);
+
+    const std::string voice = "Microsoft Server Speech Text to Speech Voice (en-US, AriaRUS)";
+    const auto format = SpeechSynthesisOutputFormat::Riff16Khz16BitMonoPcm;
+    pool.Prewarm(voice, format);
+
+    while (true)
+    {
+        // Receives a text from console input and synthesize it with a synthesizer from the pool.
+        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        getline(cin, text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        auto start = chrono::steady_clock::now();
+        auto synthesizer = pool.Checkout(voice, format);
+        auto checkedOut = chrono::steady_clock::now();
+
+        // Measures the time until the first audio arrives, which includes the connection setup for a cold synthesizer.
+        // The pool disconnects the handler when the synthesizer goes back to it.
+        bool firstChunk = true;
+        auto firstAudio = chrono::steady_clock::time_point();
+        synthesizer->Synthesizing += [&firstChunk, &firstAudio](const SpeechSynthesisEventArgs&)
+        {
+            if (firstChunk)
+            {
+                firstAudio = chrono::steady_clock::now();
+                firstChunk = false;
+            }
+        };
+
+        auto result = synthesizer->SpeakTextAsync(text).get();
+        synthesizer = nullptr; // Returns the synthesizer to the pool.
+
+        if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+        {
+            cout << "Speech synthesized for text [" << text << "], checkout took "
+                << chrono::duration_cast<chrono::microseconds>(checkedOut - start).count() << " us, ";
+            if (firstChunk)
+            {
+                cout << "no audio received" << std::endl;
+            }
+            else
+            {
+                cout << "first audio after " << chrono::duration_cast<chrono::milliseconds>(firstAudio - start).count() << " ms" << std::endl;
+            }
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+        }
+    }
+
+    auto metrics = pool.GetMetrics();
+    cout << "Warm checkouts: " << metrics.warmCheckouts << ", cold checkouts: " << metrics.coldCheckouts
+        << ", replaced synthesizers: " << metrics.replacedInstances << ", trimmed: " << metrics.trimmedInstances << std::endl;
+    cout << "Checkout latency p50: " << metrics.checkoutP50.count() << " us, p99: " << metrics.checkoutP99.count()
+        << " us, max: " << metrics.checkoutMax.count() << " us" << std::endl;
+}
+
+// Speech synthesis to a wave file that is written while the audio is synthesized.
+void SpeechSynthesisToStreamingWavFile()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Raw PCM, the writer adds the wave header.
+    config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw16Khz16BitMonoPcm);
+
+    // Creates a speech synthesizer with a null output stream.
+    // This means the audio output data will not be written to any stream.
+    auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+
+    // The writer of the current request. Blocks are shared by all requests.
+    auto pool = std::make_shared<AudioBlockPool>();
+    std::shared_ptr<StreamingWavFileWriter> writer;
+
+    // Hands each audio chunk to the writer as soon as it arrives.
+    synthesizer->Synthesizing += [&writer](const SpeechSynthesisEventArgs& e)
+    {
+        auto audioData = e.Result->GetAudioData();
+        writer->Write(audioData->data(), audioData->size());
+    };
+
+    // Writes the remaining audio and the final sizes in the header.
+    synthesizer->SynthesisCompleted += [&writer](const SpeechSynthesisEventArgs& e)
+    {
+        UNUSED(e);
+        writer->Close();
+    };
+
+    while (true)
+    {
+        // Receives a text from console input and synthesize it to a wave file.
+        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        getline(cin, text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        writer = std::make_shared<StreamingWavFileWriter>("outputaudio_streaming.wav", 16000, 16, 1, pool);
+        auto result = synthesizer->SpeakTextAsync(text).get();
+
+        // Checks result.
+        if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+        {
+            cout << "Speech synthesized for text [" << text << "], " << writer->DataSize()
+                << " bytes of audio written to [outputaudio_streaming.wav]" << std::endl;
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+        }
+
+        // Closes the file, if synthesis was canceled.
+        writer = nullptr;
+    }
+}
+
+// Speech synthesis to several output streams at once, all read by one thread when they have data.
+void SpeechSynthesisToReadableOutputStreams()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    const size_t streamCount = 4;
+
+    while (true)
+    {
+        // Receives a text from console input and synthesizes it on several synthesizers at the same time.
+        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        getline(cin, text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        // One thread serves all streams: it's woken up when a stream has data, and reads what's there.
+        AudioOutputReadinessLoop loop;
+        std::vector<uint32_t> totalSizes(streamCount, 0);
+        size_t endedStreams = 0;
+
+        std::vector<std::shared_ptr<SpeechSynthesizer>> synthesizers;
+        for (size_t i = 0; i < streamCount; i++)
+        {
+            auto stream = std::make_shared<ReadableAudioOutputStream>();
+            loop.Add(stream, [&, i](ReadableAudioOutputStream& readable)
+            {
+                uint8_t buffer[32000];
+                uint32_t filledSize = 0;
+                while ((filledSize = readable.Read(buffer, sizeof(buffer))) > 0)
+                {
+                    totalSizes[i] += filledSize;
+                }
+                if (readable.IsEndOfStream() && ++endedStreams == streamCount)
+                {
+                    loop.Stop();
+                }
+            });
+
+            auto streamConfig = AudioConfig::FromStreamOutput(AudioOutputStream::CreatePushStream(stream));
+            synthesizers.push_back(SpeechSynthesizer::FromConfig(config, streamConfig));
+        }
+
+        std::thread loopThread([&loop]() { loop.Run(); });
+
+        std::vector<std::future<std::shared_ptr<SpeechSynthesisResult>>> futures;
+        for (auto& synthesizer : synthesizers)
+        {
+            futures.push_back(synthesizer->SpeakTextAsync(text));
+        }
+        for (auto& future : futures)
+        {
+            auto result = future.get();
+            if (result->Reason == ResultReason::Canceled)
+            {
+                auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+            }
+        }
+
+        // The output streams are closed when the synthesizers are released.
+        synthesizers.clear();
+        loopThread.join();
+
+        for (size_t i = 0; i < streamCount; i++)
+        {
+            cout << "Stream " << i << ": " << totalSizes[i] << " bytes received." << endl;
+        }
+    }
+}
+
+// Compares reading 500 concurrent synthesis output streams with one blocked thread per stream, and
+// with a single thread woken up by the streams that have data. The audio comes from a local stand-in
+// for the service, paced like real synthesis, so no subscription is needed.
+void SpeechSynthesisReadableOutputStreamBenchmark()
+{
+    const size_t streamCount = 500;
+    const size_t producerThreadCount = 4;
+    LocalSynthesizer::Options synthesisOptions;
+    LocalSynthesizer synthesizer(synthesisOptions);
+    const auto audio = synthesizer.GenerateAudio("This sentence is synthesized by many streams at the same time.");
+    const auto chunkSize = (uint32_t)synthesisOptions.chunkSize;
+
+    // Number of threads in the process, on Linux. Returns 0 elsewhere.
+    auto processThreadCount = []()
+    {
+        size_t count = 0;
+#ifdef __linux__
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (getline(status, line))
+        {
+            if (line.compare(0, 8, "Threads:") == 0)
+            {
+                count = std::stoul(line.substr(8));
+            }
+        }
+#endif
+        return count;
+    };
+
+    auto run = [&](bool readinessLoop)
+    {
+        std::vector<std::shared_ptr<ReadableAudioOutputStream>> streams;
+        for (size_t i = 0; i < streamCount; i++)
+        {
+            streams.push_back(std::make_shared<ReadableAudioOutputStream>());
+        }
+
+        // Each chunk carries the time it was written, so the reader can measure how long it waited.
+        std::mutex latencyMutex;
+        std::vector<int64_t> latencies;
+        auto onChunk = [&latencyMutex, &latencies](const uint8_t* data, uint32_t size)
+        {
+            int64_t written;
+            if (size >= sizeof(written))
+            {
+                memcpy(&written, data, sizeof(written));
+                auto now = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+                std::lock_guard<std::mutex> lock(latencyMutex);
+                latencies.push_back(now - written);
+            }
+        };
+
+        // Readers, either one thread per stream blocked in ReadBlocking, or one readiness loop.
+        std::vector<std::thread> readerThreads;
+        AudioOutputReadinessLoop loop;
+        std::atomic<size_t> endedStreams{ 0 };
+        std::vector<uint8_t> loopBuffer(chunkSize);
+        for (auto& stream : streams)
+        {
+            if (readinessLoop)
+            {
+                loop.Add(stream, [&](ReadableAudioOutputStream& readable)
+                {
+                    uint32_t filledSize = 0;
+                    while ((filledSize = readable.Read(loopBuffer.data(), chunkSize)) > 0)
+                    {
+                        onChunk(loopBuffer.data(), filledSize);
+                    }
+                    if (readable.IsEndOfStream() && ++endedStreams == streamCount)
+                    {
+                        loop.Stop();
+                    }
+                });
+            }
+            else
+            {
+                readerThreads.emplace_back([&, stream]()
+                {
+                    std::vector<uint8_t> buffer(chunkSize);
+                    uint32_t filledSize = 0;
+                    while ((filledSize = stream->ReadBlocking(buffer.data(), chunkSize)) > 0)
+                    {
+                        onChunk(buffer.data(), filledSize);
+                    }
+                });
+            }
+        }
+        if (readinessLoop)
+        {
+            readerThreads.emplace_back([&loop]() { loop.Run(); });
+        }
+
+        // Producers stand in for the synthesizer threads: they write a chunk to each stream at its pace,
+        // starting at staggered times.
+        auto start = chrono::steady_clock::now();
+        std::vector<std::thread> producerThreads;
+        for (size_t producer = 0; producer < producerThreadCount; producer++)
+        {
+            producerThreads.emplace_back([&, producer]()
+            {
+                std::vector<uint8_t> chunk(chunkSize);
+                auto chunkCount = (audio.size() + chunkSize - 1) / chunkSize;
+                for (size_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+                {
+                    for (size_t i = producer; i < streamCount; i += producerThreadCount)
+                    {
+                        auto due = start + synthesisOptions.firstChunkLatency * (1 + i % 4) / 4 + synthesisOptions.chunkInterval * chunkIndex;
+                        std::this_thread::sleep_until(due);
+
+                        auto offset = chunkIndex * chunkSize;
+                        auto size = (uint32_t)std::min<size_t>(chunkSize, audio.size() - offset);
+                        memcpy(chunk.data(), audio.data() + offset, size);
+                        auto now = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+                        memcpy(chunk.data(), &now, std::min<size_t>(sizeof(now), size));
+                        streams[i]->Write(chunk.data(), size);
+                    }
+                }
+                for (size_t i = producer; i < streamCount; i += producerThreadCount)
+                {
+                    streams[i]->Close();
+                }
+            });
+        }
+
+        // Samples the thread count while the streams are being read.
+        std::this_thread::sleep_for(synthesisOptions.firstChunkLatency);
+        auto threads = processThreadCount();
+
+        for (auto& thread : producerThreads)
+        {
+            thread.join();
+        }
+        for (auto& thread : readerThreads)
+        {
+            thread.join();
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        cout << (readinessLoop ? "Readiness loop: " : "Thread per stream: ")
+            << "reader threads: " << readerThreads.size();
+        if (threads > 0)
+        {
+            cout << ", threads in the process: " << threads;
+        }
+        if (!latencies.empty())
+        {
+            cout << ", read latency p50 " << latencies[latencies.size() / 2] << " us, p99 "
+                << latencies[latencies.size() * 99 / 100] << " us, max " << latencies.back() << " us";
+        }
+        cout << ", " << latencies.size() << " chunks." << endl;
+    };
+
+    cout << "Reading " << streamCount << " concurrent synthesis output streams." << endl;
+    run(false);
+    run(true);
+}
+
+// Speech synthesis played in real time through a jitter buffer, which absorbs the irregular arrival
+// of the audio chunks. The played frames are written to a wave file, standing in for an audio device.
+void SpeechSynthesisWithJitterBuffer()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // The jitter buffer plays raw 16 bit PCM.
+    config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw16Khz16BitMonoPcm);
+
+    while (true)
+    {
+        // Receives a text from console input and synthesize it through the jitter buffer.
+        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        getline(cin, text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        // The synthesizer writes to the jitter buffer through a push output stream, while the playback
+        // thread takes a frame out of it every 20 ms.
+        auto jitterBuffer = std::make_shared<JitterBuffer>(JitterBuffer::Options());
+        auto streamConfig = AudioConfig::FromStreamOutput(AudioOutputStream::CreatePushStream(jitterBuffer));
+        auto synthesizer = SpeechSynthesizer::FromConfig(config, streamConfig);
+
+        StreamingWavFileWriter device("outputaudio_playback.wav", 16000, 16, 1);
+        JitterBuffer::Stats stats;
+        std::thread playbackThread([&]()
+        {
+            stats = jitterBuffer->Play([&device](const uint8_t* frame, size_t size) { device.Write(frame, size); });
+        });
+
+        auto result = synthesizer->SpeakTextAsync(text).get();
+
+        // All audio was written, playback ends when the buffer is empty.
+        jitterBuffer->Close();
+        playbackThread.join();
+        device.Close();
+
+        // Checks result.
+        if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+        {
+            cout << "Speech synthesized for text [" << text << "], and played to [outputaudio_playback.wav]." << std::endl;
+            cout << "Played frames: " << stats.playedFrames << ", startup frames: " << stats.startupFrames
+                << ", underruns: " << stats.underruns << ", concealed frames: " << stats.concealedFrames
+                << ", target delay: " << stats.targetDelay.count() << " ms, max buffered: "
+                << stats.maxBuffered.count() << " ms" << std::endl;
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+        }
+    }
+}
+
+// Plays audio that arrives in bursts through a jitter buffer with a fixed short delay, and with an
+// adaptive delay. The audio comes from a local stand-in for the service, so no subscription is needed.
+void SpeechSynthesisJitterBufferBenchmark()
+{
+    // 20 ms chunks, in bursts of 200 ms of audio separated by pauses of 180 ms on average: the audio
+    // arrives as fast as it plays, but irregularly.
+    LocalSynthesizer::Options synthesisOptions;
+    synthesisOptions.chunkSize = 640;
+    synthesisOptions.chunkInterval = chrono::milliseconds(2);
+    synthesisOptions.burstSize = 10;
+    synthesisOptions.burstPause = chrono::milliseconds(180);
+    LocalSynthesizer synthesizer(synthesisOptions);
+    const std::string text = "This sentence is delivered in bursts, with pauses that are sometimes longer than the audio "
+        "that was received before them, and is played in real time.";
+
+    // Returns the stats, and the target delay after each frame in 'targets'.
+    auto run = [&](bool adaptive, std::vector<chrono::milliseconds>& targets)
+    {
+        JitterBuffer::Options options;
+        options.initialDelay = chrono::milliseconds(40);
+        options.adaptive = adaptive;
+        JitterBuffer jitterBuffer(options);
+        targets.reserve(1000);
+
+        std::thread synthesisThread([&]()
+        {
+            synthesizer.SpeakText(text, [&jitterBuffer](const uint8_t* data, size_t size)
+            {
+                jitterBuffer.Write(const_cast<uint8_t*>(data), (uint32_t)size);
+            });
+            jitterBuffer.Close();
+        });
+        auto stats = jitterBuffer.Play([&jitterBuffer, &targets](const uint8_t* frame, size_t size)
+        {
+            UNUSED(frame);
+            UNUSED(size);
+            targets.push_back(jitterBuffer.GetStats().targetDelay);
+        });
+        synthesisThread.join();
+
+        cout << (adaptive ? "Adaptive delay: " : "Fixed delay: ")
+            << "played frames: " << stats.playedFrames << ", underruns: " << stats.underruns
+            << ", concealed frames: " << stats.concealedFrames << ", target delay: " << stats.targetDelay.count()
+            << " ms, max buffered: " << stats.maxBuffered.count() << " ms" << endl;
+        return stats;
+    };
+
+    cout << "Playing bursty synthesis output in real time." << endl;
+    std::vector<chrono::milliseconds> fixedTargets, adaptiveTargets;
+    auto fixed = run(false, fixedTargets);
+    auto adaptive = run(true, adaptiveTargets);
+
+    // The adaptive delay should absorb most pauses: the source has about 45 bursts, and the fixed
+    // 40 ms delay underruns after most of the long pauses.
+    const uint64_t maxUnderruns = 8;
+    auto underrunsOk = adaptive.underruns <= maxUnderruns && adaptive.underruns * 2 <= fixed.underruns;
+    cout << "Adaptive underruns within " << maxUnderruns << " and at most half of the fixed delay's: "
+        << (underrunsOk ? "yes" : "NO") << endl;
+
+    // Once the history of gaps covers enough bursts, the target should settle: over the second half
+    // of the playback it should stay within a few frames.
+    const auto maxSpread = chrono::milliseconds(100);
+    auto settled = std::minmax_element(adaptiveTargets.begin() + adaptiveTargets.size() / 2, adaptiveTargets.end());
+    auto spread = *settled.second - *settled.first;
+    cout << "Adaptive target over the second half: " << settled.first->count() << " to " << settled.second->count()
+        << " ms, converged within " << maxSpread.count() << " ms: " << (spread <= maxSpread ? "yes" : "NO") << endl;
+}
+
+// Streams the audio of GET /speak?text=... from the broadcaster as a wave file of unknown length,
+// 16 bit mono PCM at 16 kHz. Stopping the server cancels the subscription.
+static ChunkedHttpServer::Handler BroadcastHandler(SynthesisBroadcaster& broadcaster)
+{
+    return [&broadcaster](const ChunkedHttpServer::Request& request, ChunkedHttpServer::ResponseWriter& response)
+    {
+        auto text = request.query.find("text");
+        if (request.path != "/speak" || text == request.query.end() || text->second.empty())
+        {
+            return;
+        }
+
+        auto subscription = broadcaster.Subscribe(text->second);
+        response.OnStop([subscription]() { subscription->Cancel(); });
+        const uint8_t waveHeader[44] = {
+            'R', 'I', 'F', 'F', 0xff, 0xff, 0xff, 0xff, 'W', 'A', 'V', 'E',
+            'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0, 0x80, 0x3e, 0, 0, 0, 0x7d, 0, 0, 2, 0, 16, 0,
+            'd', 'a', 't', 'a', 0xff, 0xff, 0xff, 0xff };
+        response.Start(200, "audio/wav");
+        response.Write(waveHeader, sizeof(waveHeader));
+        while (auto chunk = subscription->Next())
+        {
+            if (!response.Write(chunk->data(), chunk->size()))
+            {
+                break;
+            }
+        }
+    };
+}
+
+// Local HTTP server that streams synthesized speech to many listeners, with one synthesis per
+// unique text however many listeners request it.
+void SpeechSynthesisBroadcastServer()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // Raw PCM, the server sends its own wave header.
+    config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw16Khz16BitMonoPcm);
+
+    auto broadcaster = SynthesisBroadcaster::FromConfig(config);
+    ChunkedHttpServer server(8080, BroadcastHandler(*broadcaster));
+    cout << "Listening on http://localhost:" << server.Port() << "/speak?text=..." << std::endl;
+    cout << "For example: curl -o speech.wav \"http://localhost:" << server.Port() << "/speak?text=Hello+world\"" << std::endl;
+    cout << "Press Enter to stop the server." << std::endl;
+    std::string line;
+    getline(cin, line);
+    server.Stop();
+
+    auto stats = broadcaster->GetStats();
+    cout << "Listeners: " << stats.subscriptions << ", syntheses: " << stats.syntheses
+        << ", peak buffered audio: " << stats.peakBufferedBytes << " bytes" << std::endl;
+}
+
+// Minimal HTTP client for the broadcast benchmark: sends GET 'target' to the port of the local host
+// and calls 'onData' with the body of the chunked response as it arrives. Returns false unless the
+// response was 200 and complete.
+static bool HttpGetChunked(uint16_t port, const std::string& target, const std::function<void(const char* data, size_t size)>& onData)
+{
+    auto client = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    auto request = "GET " + target + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    bool complete = false;
+    if (connect(client, (sockaddr*)&address, sizeof(address)) == 0 &&
+        send(client, request.data(), (int)request.size(), 0) == (int)request.size())
+    {
+        // Reads until 'buffer' holds 'size' bytes after 'start'.
+        std::string buffer;
+        auto readUntil = [&](size_t start, size_t size)
+        {
+            char data[4096];
+            while (buffer.size() < start + size)
+            {
+                auto received = recv(client, data, sizeof(data), 0);
+                if (received <= 0)
+                {
+                    return false;
+                }
+                buffer.append(data, (size_t)received);
+            }
+            return true;
+        };
+
+        size_t headEnd;
+        while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos && readUntil(0, buffer.size() + 1))
+        {
+        }
+        if (headEnd != std::string::npos && buffer.compare(0, 12, "HTTP/1.1 200") == 0)
+        {
+            buffer.erase(0, headEnd + 4);
+            while (true)
+            {
+                size_t lineEnd;
+                while ((lineEnd = buffer.find("\r\n")) == std::string::npos && readUntil(0, buffer.size() + 1))
+                {
+                }
+                if (lineEnd == std::string::npos)
+                {
+                    break;
+                }
+                auto size = (size_t)strtoul(buffer.c_str(), nullptr, 16);
+                if (size == 0)
+                {
+                    complete = true;
+                    break;
+                }
+                if (!readUntil(lineEnd + 2, size + 2))
+                {
+                    break;
+                }
+                onData(buffer.data() + lineEnd + 2, size);
+                buffer.erase(0, lineEnd + 2 + size + 2);
+            }
+        }
+    }
+#ifdef _WIN32
+    closesocket(client);
+#else
+    close(client);
+#endif
+    return complete;
+}
+
+// Broadcasts 3 texts to 300 listeners that join one after the other while the audio plays, most of
+// them after the synthesis of their text started. The listeners are HTTP clients of a local
+// broadcast server, and the audio comes from a local stand-in for the service, so no subscription
+// is needed.
+void SpeechSynthesisBroadcastBenchmark()
+{
+    const size_t listenerCount = 300;
+    const std::vector<std::string> texts = {
+        "The store closes in fifteen minutes.",
+        "The train to the airport leaves from platform four.",
+        "Please keep your belongings with you at all times." };
+
+    LocalSynthesizer synthesizer;
+    SynthesisBroadcaster broadcaster([&synthesizer](const std::string& text, const SynthesisBroadcaster::ChunkCallback& onChunk)
+    {
+        synthesizer.SpeakText(text, onChunk);
+        return true;
+    });
+    ChunkedHttpServer server(0, BroadcastHandler(broadcaster));
+
+    std::atomic<size_t> completeListeners{ 0 };
+    size_t audioBytes = 0;
+    std::vector<std::thread> listeners;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < listenerCount; i++)
+    {
+        auto& text = texts[i % texts.size()];
+        audioBytes += synthesizer.GenerateAudio(text).size();
+        std::this_thread::sleep_until(start + chrono::milliseconds(i * 5));
+        listeners.emplace_back([&server, &synthesizer, &completeListeners, &text]()
+        {
+            auto target = "/speak?text=" + text;
+            std::replace(target.begin(), target.end(), ' ', '+');
+            std::string body;
+            auto complete = HttpGetChunked(server.Port(), target, [&body](const char* data, size_t size)
+            {
+                // Plays the data in real time, 16 bit mono PCM at 16 kHz.
+                body.append(data, size);
+                std::this_thread::sleep_for(chrono::microseconds(size * 1000000 / 32000));
+            });
+
+            // The audio follows the 44 byte wave header.
+            auto expected = synthesizer.GenerateAudio(text);
+            if (complete && body.size() == 44 + expected.size() && std::equal(expected.begin(), expected.end(), (const uint8_t*)body.data() + 44))
+            {
+                completeListeners++;
+            }
+        });
+    }
+    for (auto& listener : listeners)
+    {
+        listener.join();
+    }
+    server.Stop();
+
+    auto stats = broadcaster.GetStats();
+    cout << "Listeners: " << stats.subscriptions << " (" << completeListeners << " received all audio over HTTP), syntheses: "
+        << stats.syntheses << std::endl;
+    cout << "Peak buffered audio: " << stats.peakBufferedBytes << " bytes, audio received by all listeners: "
+        << audioBytes << " bytes, buffered after the last listener left: " << stats.bufferedBytes << " bytes" << std::endl;
+}
+
+// Synthesizes the prompts of a JSON lines manifest to files, several at a time. Run it again with
+// the same manifest to resume an interrupted batch.
+void SpeechSynthesisBatch()
+{
+    // Creates a new speech config with specified subscription key and service region for each synthesizer.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto configFactory = []() { return SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion"); };
+
+    cout << "Enter the path of a manifest with one prompt per line, e.g." << std::endl;
+    cout << "{\"text\": \"Hello.\", \"voice\": \"en-US-JessaNeural\", \"format\": \"riff-24khz-16bit-mono-pcm\", \"output\": \"hello.wav\"}" << std::endl;
+    cout << "> ";
+    std::string manifestFile;
+    getline(cin, manifestFile);
+    if (manifestFile.empty())
+    {
+        return;
+    }
+
+    // The hashes of the completed prompts are kept next to the manifest.
+    BatchSynthesizer::Options options;
+    options.concurrency = 8;
+    options.checkpointFile = manifestFile + ".checkpoint";
+    auto batch = BatchSynthesizer::FromConfig(configFactory, options);
+
+    try
+    {
+        auto report = batch->Run(manifestFile);
+        cout << "Succeeded: " << report.succeeded << ", failed: " << report.failed << ", skipped: " << report.skipped
+            << ", retries: " << report.retries << std::endl;
+        cout << report.PromptsPerSecond() << " prompts/s, " << report.AudioSecondsPerSecond() << " audio seconds/s, latency p50: "
+            << report.latency.ValueAtPercentile(50) / 1000 << " ms, p99: " << report.latency.ValueAtPercentile(99) / 1000 << " ms" << std::endl;
+        for (auto& failure : report.failures)
+        {
+            cout << "Line " << failure.first << " failed: " << failure.second << std::endl;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        cout << e.what() << std::endl;
+    }
+}
+
+// Runs a batch of 400 prompts against a local stand-in for the service, which fails some requests
+// with a transient error, with 8 and with 32 concurrent requests. Then interrupts a batch, adds a
+// prompt at the start of the manifest, and resumes the batch from its checkpoint. No subscription is
+// needed.
+void SpeechSynthesisBatchBenchmark()
+{
+    const size_t promptCount = 400;
+    const std::string manifestFile = "batch_benchmark.jsonl";
+    const std::string checkpointFile = "batch_benchmark.jsonl.checkpoint";
+    auto writeManifest = [&](size_t first)
+    {
+        std::ofstream manifest(manifestFile, std::ios_base::out | std::ios_base::trunc);
+        for (size_t i = first; i < promptCount; i++)
+        {
+            manifest << "{\"text\": \"Announcement number " << i << " is ready.\", \"voice\": \"en-US-JessaNeural\", "
+                << "\"format\": \"raw-16khz-16bit-mono-pcm\", \"output\": \"announcement" << i << ".raw\"}" << std::endl;
+        }
+    };
+    writeManifest(0);
+
+    // The stand-in doesn't write the outputs. One request in ten fails with a transient error.
+    LocalSynthesizer::Options synthesisOptions;
+    synthesisOptions.firstChunkLatency = chrono::milliseconds(50);
+    synthesisOptions.chunkInterval = chrono::milliseconds(5);
+    LocalSynthesizer synthesizer(synthesisOptions);
+    std::atomic<uint32_t> requestCount{ 0 };
+    auto synthesize = [&synthesizer, &requestCount](size_t worker, const BatchPrompt& prompt)
+    {
+        UNUSED(worker);
+        BatchSynthesizer::Attempt attempt;
+        if (++requestCount % 10 == 0)
+        {
+            std::this_thread::sleep_for(chrono::milliseconds(20));
+            attempt.outcome = BatchSynthesizer::Outcome::TransientFailure;
+            attempt.error = "Too many requests.";
+            return attempt;
+        }
+        auto audio = synthesizer.SpeakText(prompt.text);
+        attempt.outcome = BatchSynthesizer::Outcome::Succeeded;
+        attempt.audioDuration = chrono::microseconds((int64_t)(audio->size() * 1000000 / 32000));
+        return attempt;
+    };
+
+    auto print = [](const std::string& name, const BatchSynthesizer::Report& report)
+    {
+        cout << name << ": succeeded " << report.succeeded << ", failed " << report.failed << ", skipped "
+            << report.skipped << ", retries " << report.retries << ", " << (int)report.PromptsPerSecond() << " prompts/s, "
+            << (int)report.AudioSecondsPerSecond() << " audio seconds/s, latency p50 " << report.latency.ValueAtPercentile(50) / 1000
+            << " ms, p99 " << report.latency.ValueAtPercentile(99) / 1000 << " ms" << endl;
+    };
+
+    BatchSynthesizer::Options options;
+    options.retryDelay = chrono::milliseconds(50);
+    for (size_t concurrency : { 8, 32 })
+    {
+        options.concurrency = concurrency;
+        BatchSynthesizer batch(synthesize, options);
+        print("Concurrency " + std::to_string(concurrency), batch.Run(manifestFile));
+    }
+
+    // Stops a batch without the first prompt after one second. Then adds the prompt back, which moves
+    // the others to the next line, and runs the batch again to complete it.
+    writeManifest(1);
+    std::remove(checkpointFile.c_str());
+    options.checkpointFile = checkpointFile;
+    BatchSynthesizer batch(synthesize, options);
+    std::thread stopper([&batch]()
+    {
+        std::this_thread::sleep_for(chrono::seconds(1));
+        batch.Stop();
+    });
+    auto interrupted = batch.Run(manifestFile);
+    print("Interrupted", interrupted);
+    stopper.join();
+
+    writeManifest(0);
+    BatchSynthesizer resumedBatch(synthesize, options);
+    auto resumed = resumedBatch.Run(manifestFile);
+    print("Resumed", resumed);
+    auto resumedOk = resumed.skipped == interrupted.succeeded && resumed.succeeded + resumed.skipped == promptCount;
+    cout << "The resumed batch skipped the " << interrupted.succeeded << " completed prompts and completed the others: "
+        << (resumedOk ? "yes" : "NO") << endl;
+}
+
+// Synthesizes many short prompts with a few SSML requests, and splits the audio into one wave file
+// per prompt.
+void SpeechSynthesisPromptBatch()
+{
+    // Creates a speech config with specified subscription key and service region for the batcher.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto configFactory = []() { return SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion"); };
+
+    cout << "Enter the path of a text file with one prompt per line." << std::endl;
+    cout << "> ";
+    std::string promptFile;
+    getline(cin, promptFile);
+    if (promptFile.empty())
+    {
+        return;
+    }
+
+    std::vector<std::string> prompts;
+    std::ifstream file(promptFile);
+    std::string line;
+    while (getline(file, line))
+    {
+        if (!line.empty())
+        {
+            prompts.push_back(line);
+        }
+    }
+
+    // Up to 50 prompts per request, split into 16 kHz clips.
+    SsmlPromptBatcher::Options options;
+    SsmlPromptBatcher batcher(configFactory, options);
+    auto clips = batcher.Synthesize(prompts);
+
+    for (size_t i = 0; i < clips.size(); i++)
+    {
+        if (!clips[i].empty())
+        {
+            StreamingWavFileWriter writer("prompt" + std::to_string(i + 1) + ".wav", options.sampleRate, 16, 1);
+            writer.Write(clips[i].data(), clips[i].size());
+            writer.Close();
+        }
+    }
+
+    auto stats = batcher.GetStats();
+    cout << stats.prompts << " prompts synthesized with " << stats.requests << " requests: " << stats.batchedRequests
+        << " batched requests, and " << stats.separatePrompts << " prompts on their own. " << stats.failedPrompts
+        << " prompts failed." << std::endl;
+    cout << "The audio was written to prompt1.wav to prompt" << clips.size() << ".wav" << std::endl;
+}
+
+// Renders a fixed set of prompts into one archive file, then serves prompts from it by id, straight
+// from its memory mapping.
+void SpeechSynthesisPromptArchive()
+{
+    // Creates a speech config with specified subscription key and service region for the batcher.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto configFactory = []() { return SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion"); };
+    const std::string archiveFile = "prompts.spxa";
+
+    cout << "Enter the path of a text file with one prompt per line, or enter empty text to use the existing " << archiveFile << "." << std::endl;
+    cout << "> ";
+    std::string promptFile;
+    getline(cin, promptFile);
+
+    // Build step: the prompt on line N gets the id "promptN".
+    if (!promptFile.empty())
+    {
+        std::vector<std::string> prompts;
+        std::ifstream file(promptFile);
+        std::string line;
+        while (getline(file, line))
+        {
+            prompts.push_back(line);
+        }
+
+        SsmlPromptBatcher batcher(configFactory, SsmlPromptBatcher::Options());
+        auto clips = batcher.Synthesize(prompts);
+        PromptArchiveBuilder builder;
+        for (size_t i = 0; i < clips.size(); i++)
+        {
+            if (!clips[i].empty())
+            {
+                builder.Add("prompt" + std::to_string(i + 1), SpeechSynthesisOutputFormat::Raw16Khz16BitMonoPcm, std::move(clips[i]));
+            }
+        }
+        builder.Write(archiveFile);
+        cout << builder.Size() << " prompts written to " << archiveFile << "." << std::endl;
+    }
+
+    // Runtime: all prompts are available as soon as the archive is mapped.
+    std::unique_ptr<PromptArchive> archive;
+    try
+    {
+        archive.reset(new PromptArchive(archiveFile));
+    }
+    catch (const std::exception& e)
+    {
+        cout << e.what() << std::endl;
+        return;
+    }
+
+    while (true)
+    {
+        cout << "Enter a prompt id (prompt1 to prompt" << archive->Size() << "), or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string id;
+        getline(cin, id);
+        if (id.empty())
+        {
+            break;
+        }
+
+        auto start = chrono::steady_clock::now();
+        PromptArchive::Prompt prompt;
+        bool found = archive->Find(id, prompt);
+        auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+        if (!found)
+        {
+            cout << "There is no prompt " << id << "." << std::endl;
+            continue;
+        }
+
+        // The writer reads the audio from the mapping.
+        StreamingWavFileWriter writer("outputaudio_prompt.wav", 16000, 16, 1);
+        writer.Write(prompt.data, prompt.size);
+        writer.Close();
+        cout << "Found " << id << " in " << elapsed.count() << " us, " << prompt.size
+            << " bytes of audio written to [outputaudio_prompt.wav]" << std::endl;
+    }
+}
+
+// Synthesizes once and transcodes the audio as it arrives, for a telephony leg (8 kHz mu-law) and a
+// web client (24 kHz PCM) at the same time.
+void SpeechSynthesisToTelephonyFormats()
+{
+    // Creates an instance of a speech config with specified subscription key and service region.
+    // Replace with your own subscription key and service region (e.g., "westus").
+    auto config = SpeechConfig::FromSubscription("YourSubscriptionKey", "YourServiceRegion");
+
+    // The highest rate of the sinks, the others are derived from it.
+    config->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw24Khz16BitMonoPcm);
+
+    // Creates a speech synthesizer with a null output stream: the audio is taken from the events.
+    auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+
+    while (true)
+    {
+        // Receives a text from console input and synthesize it to both formats.
+        cout << "Enter some text that you want to synthesize, or enter empty text to exit." << std::endl;
+        cout << "> ";
+        std::string text;
+        getline(cin, text);
+        if (text.empty())
+        {
+            break;
+        }
+
+        std::ofstream telephony("outputaudio_8khz.ulaw", std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        StreamingWavFileWriter web("outputaudio_24khz.wav", 24000, 16, 1);
+        TranscodingFanout fanout(24000);
+        fanout.AddSink({ 8000, AudioTranscoder::Encoding::MuLaw }, [&telephony](const uint8_t* data, size_t size) { telephony.write((const char*)data, size); });
+        fanout.AddSink({ 24000, AudioTranscoder::Encoding::Pcm16 }, [&web](const uint8_t* data, size_t size) { web.Write(data, size); });
+
+        // Each chunk is transcoded on the event's thread, as soon as it's received.
+        chrono::nanoseconds transcodingTime{ 0 };
+        size_t audioBytes = 0;
+        synthesizer->Synthesizing += [&](const SpeechSynthesisEventArgs& e)
+        {
+            auto audio = e.Result->GetAudioData();
+            auto start = chrono::steady_clock::now();
+            fanout.Write(audio->data(), audio->size());
+            transcodingTime += chrono::steady_clock::now() - start;
+            audioBytes += audio->size();
+        };
+
+        auto result = synthesizer->SpeakTextAsync(text).get();
+        synthesizer->Synthesizing.DisconnectAll();
+        web.Close();
+
+        // Checks result.
+        if (result->Reason == ResultReason::SynthesizingAudioCompleted)
+        {
+            cout << "Speech synthesized for text [" << text << "], and transcoded to [outputaudio_8khz.ulaw] and [outputaudio_24khz.wav]." << std::endl;
+            cout << "Transcoded " << audioBytes / 48 << " ms of audio in " << chrono::duration_cast<chrono::microseconds>(transcodingTime).count()
+                << " us (" << AudioTranscoder::InstructionSet() << ")." << std::endl;
+        }
+        else if (result->Reason == ResultReason::Canceled)
+        {
+            auto cancellation = SpeechSynthesisCancellationDetails::FromResult(result);
+            cout << "CANCELED: Reason=" << (int)cancellation->Reason << std::endl;
+
+            if (cancellation->Reason == CancellationReason::Error)
+            {
+                cout << "CANCELED: ErrorCode=" << (int)cancellation->ErrorCode << std::endl;
+                cout << "CANCELED: ErrorDetails=[" << cancellation->ErrorDetails << "]" << std::endl;
+                cout << "CANCELED: Did you update the subscription info?" << std::endl;
+            }
+        }
+    }
+}
+
+// Measures the cost of transcoding synthesis output, with and without the vector instructions. The
+// audio comes from a local stand-in for the service, so no subscription is needed.
+void SpeechSynthesisTranscodingBenchmark()
+{
+    using Encoding = AudioTranscoder::Encoding;
+    const size_t chunkSize = 4800; // 100 ms at 24 kHz, about the size of a Synthesizing chunk
+    const int seconds = 600;
+
+    LocalSynthesizer::Options synthesisOptions;
+    synthesisOptions.sampleRate = 48000;
+    LocalSynthesizer synthesizer(synthesisOptions);
+    auto sentence = synthesizer.GenerateAudio("This sentence is transcoded for telephony and for the web.");
+
+    cout << "Transcoding " << seconds << " s of synthesized audio in chunks of " << chunkSize << " bytes, with "
+        << AudioTranscoder::InstructionSet() << " and without." << endl;
+    for (uint32_t inputRate : { 16000u, 24000u, 48000u })
+    {
+        // The same audio at each input rate, decimated from 48 kHz.
+        std::vector<uint8_t> audio;
+        AudioTranscoder(48000, { inputRate, Encoding::Pcm16 }).Transcode(sentence.data(), sentence.size(), audio);
+        std::vector<uint8_t> input;
+        while (input.size() < (size_t)seconds * inputRate * 2)
+        {
+            input.insert(input.end(), audio.begin(), audio.end());
+        }
+        input.resize((size_t)seconds * inputRate * 2);
+
+        std::vector<AudioTranscoder::Format> formats = { { 8000, Encoding::MuLaw }, { 8000, Encoding::Pcm16 } };
+        if (inputRate == 48000)
+        {
+            formats.push_back({ 24000, Encoding::Pcm16 });
+        }
+        for (auto& format : formats)
+        {
+            cout << inputRate / 1000 << " kHz to " << format.sampleRate / 1000 << " kHz "
+                << (format.encoding == Encoding::MuLaw ? "mu-law" : "PCM") << ":";
+            std::vector<uint8_t> outputs[2];
+            for (int vectorized = 0; vectorized < 2; vectorized++)
+            {
+                AudioTranscoder transcoder(inputRate, format, vectorized == 1);
+                std::vector<uint8_t> chunkOutput;
+                auto start = chrono::steady_clock::now();
+                for (size_t offset = 0; offset < input.size(); offset += chunkSize)
+                {
+                    chunkOutput.clear();
+                    transcoder.Transcode(input.data() + offset, std::min(chunkSize, input.size() - offset), chunkOutput);
+                    outputs[vectorized].insert(outputs[vectorized].end(), chunkOutput.begin(), chunkOutput.end());
+                }
+                auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                cout << (vectorized ? " vectorized " : " scalar ") << elapsed * 1000 << " ms ("
+                    << (int)(seconds / elapsed) << "x real time)";
+            }
+            cout << (outputs[0] == outputs[1] ? ", same output" : ", DIFFERENT OUTPUT") << endl;
+        }
+    }
+}
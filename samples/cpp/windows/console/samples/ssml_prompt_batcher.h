@@ -0,0 +1,325 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Synthesizes many short prompts with few requests: the prompts are packed into one SSML document
+// per request, as sentences separated by breaks, and the audio is split back into one clip per
+// prompt. Word boundaries tell which part of the audio belongs to which prompt, and each cut is
+// placed in the silence of the break between them, with some padding left on both sides.
+// The audio is 16 bit mono PCM. A prompt without word boundaries, such as one made of punctuation
+// only, can't be located; it's synthesized on its own.
+// The batcher sets the output format and the voice on a config of its own, from 'configFactory'.
+class SsmlPromptBatcher final
+{
+public:
+    using ConfigFactory = std::function<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig>()>;
+
+    struct Options
+    {
+        std::string voice = "Microsoft Server Speech Text to Speech Voice (en-US, AriaRUS)";
+        std::string language = "en-US";
+        uint32_t sampleRate = 16000;
+        size_t maxPromptsPerRequest = 50;
+        // Limit of the prompt text per request, well within the limit of the service.
+        size_t maxTextLength = 3000;
+        std::chrono::milliseconds separator{ 600 };
+        // Silence kept at the end and at the start of a clip, taken from the separator.
+        std::chrono::milliseconds padding{ 50 };
+    };
+
+    // SSML of a request, with the position of the text of each prompt in it, in UTF-16 code units
+    // like the text offsets of word boundaries, not in bytes.
+    struct Request
+    {
+        std::string ssml;
+        std::vector<size_t> promptBegin;
+        std::vector<size_t> promptEnd;
+    };
+
+    struct WordBoundary
+    {
+        uint64_t audioOffset; // in ticks (100 nanoseconds)
+        uint32_t textOffset;
+    };
+
+    struct Stats
+    {
+        size_t prompts = 0;
+        size_t requests = 0;
+        size_t batchedRequests = 0;
+        size_t separatePrompts = 0; // synthesized on their own, because they couldn't be split out.
+        size_t failedPrompts = 0;
+    };
+
+    SsmlPromptBatcher(ConfigFactory configFactory, const Options& options)
+        : m_options(options)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        if (options.sampleRate != 8000 && options.sampleRate != 16000 && options.sampleRate != 24000)
+        {
+            throw std::invalid_argument("The sample rate must be 8000, 16000 or 24000.");
+        }
+        auto config = configFactory();
+        config->SetSpeechSynthesisOutputFormat(options.sampleRate == 8000 ? SpeechSynthesisOutputFormat::Raw8Khz16BitMonoPcm :
+            options.sampleRate == 16000 ? SpeechSynthesisOutputFormat::Raw16Khz16BitMonoPcm : SpeechSynthesisOutputFormat::Raw24Khz16BitMonoPcm);
+        config->SetSpeechSynthesisVoiceName(options.voice);
+        m_synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+        m_synthesizer->WordBoundary += [this](const SpeechSynthesisWordBoundaryEventArgs& e)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wordBoundaries.push_back({ e.AudioOffset, e.TextOffset });
+        };
+    }
+
+    // Synthesizes the prompts, and returns the audio of each, empty for the prompts that failed.
+    std::vector<std::vector<uint8_t>> Synthesize(const std::vector<std::string>& prompts)
+    {
+        std::vector<std::vector<uint8_t>> clips(prompts.size());
+        std::vector<size_t> separate;
+        m_stats.prompts += prompts.size();
+
+        for (size_t first = 0; first < prompts.size();)
+        {
+            // Packs as many prompts as the limits allow.
+            size_t last = first + 1;
+            size_t textLength = prompts[first].size();
+            while (last < prompts.size() && last - first < m_options.maxPromptsPerRequest &&
+                textLength + prompts[last].size() <= m_options.maxTextLength)
+            {
+                textLength += prompts[last++].size();
+            }
+
+            std::vector<std::string> batch(prompts.begin() + first, prompts.begin() + last);
+            if (batch.size() == 1)
+            {
+                separate.push_back(first);
+                first = last;
+                continue;
+            }
+
+            auto request = BuildRequest(batch, m_options);
+            std::vector<WordBoundary> wordBoundaries;
+            auto audio = Speak(request.ssml, wordBoundaries);
+            m_stats.requests++;
+            m_stats.batchedRequests++;
+
+            auto batchClips = audio ? SplitAudio(request, *audio, wordBoundaries, m_options) : std::vector<std::vector<uint8_t>>(batch.size());
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                if (batchClips[i].empty())
+                {
+                    separate.push_back(first + i);
+                }
+                else
+                {
+                    clips[first + i] = std::move(batchClips[i]);
+                }
+            }
+            first = last;
+        }
+
+        for (auto prompt : separate)
+        {
+            std::vector<WordBoundary> wordBoundaries;
+            auto audio = Speak(BuildRequest({ prompts[prompt] }, m_options).ssml, wordBoundaries);
+            m_stats.requests++;
+            m_stats.separatePrompts++;
+            if (audio)
+            {
+                clips[prompt] = std::move(*audio);
+            }
+            else
+            {
+                m_stats.failedPrompts++;
+            }
+        }
+        return clips;
+    }
+
+    Stats GetStats() const
+    {
+        return m_stats;
+    }
+
+    // Builds the SSML of the prompts, each in its own sentence, followed by a break but the last one.
+    static Request BuildRequest(const std::vector<std::string>& prompts, const Options& options)
+    {
+        Request request;
+        request.ssml = "<speak version=\"1.0\" xmlns=\"http://www.w3.org/2001/10/synthesis\" xml:lang=\"" + EscapeXml(options.language) +
+            "\"><voice name=\"" + EscapeXml(options.voice) + "\">";
+        for (size_t i = 0; i < prompts.size(); i++)
+        {
+            if (i > 0)
+            {
+                request.ssml += "<break time=\"" + std::to_string(options.separator.count()) + "ms\"/>";
+            }
+            request.ssml += "<s>";
+            request.promptBegin.push_back(Utf16Length(request.ssml));
+            request.ssml += EscapeXml(prompts[i]);
+            request.promptEnd.push_back(Utf16Length(request.ssml));
+            request.ssml += "</s>";
+        }
+        request.ssml += "</voice></speak>";
+        return request;
+    }
+
+    // Splits the audio of a request into the clips of its prompts. Returns an empty clip for the
+    // prompts whose words were not found in the word boundaries.
+    static std::vector<std::vector<uint8_t>> SplitAudio(const Request& request, const std::vector<uint8_t>& audio,
+        const std::vector<WordBoundary>& wordBoundaries, const Options& options)
+    {
+        auto promptCount = request.promptBegin.size();
+        auto sampleCount = audio.size() / 2;
+        auto ticksToSamples = [&options, sampleCount](uint64_t ticks) { return std::min<size_t>((size_t)(ticks * options.sampleRate / 10000000), sampleCount); };
+
+        // The first and the last word of each prompt, in samples.
+        std::vector<size_t> firstWord(promptCount, SIZE_MAX);
+        std::vector<size_t> lastWord(promptCount, 0);
+        std::vector<bool> found(promptCount, false);
+        for (auto& word : wordBoundaries)
+        {
+            auto prompt = std::upper_bound(request.promptBegin.begin(), request.promptBegin.end(), (size_t)word.textOffset) - request.promptBegin.begin();
+            if (prompt == 0 || word.textOffset >= request.promptEnd[prompt - 1])
+            {
+                continue;
+            }
+            prompt--;
+            auto sample = ticksToSamples(word.audioOffset);
+            firstWord[prompt] = std::min(firstWord[prompt], sample);
+            lastWord[prompt] = std::max(lastWord[prompt], sample);
+            found[prompt] = true;
+        }
+
+        // Cuts between consecutive prompts that were both found, in the longest silence between the
+        // last word of one and the first word of the next.
+        auto padding = (size_t)(options.padding.count() * options.sampleRate / 1000);
+        std::vector<bool> separable(promptCount, false);
+        std::vector<size_t> clipBegin(promptCount, 0);
+        std::vector<size_t> clipEnd(promptCount, sampleCount);
+        for (size_t i = 0; i + 1 < promptCount; i++)
+        {
+            if (found[i] && found[i + 1] && firstWord[i + 1] > lastWord[i])
+            {
+                size_t silenceBegin, silenceEnd;
+                FindLongestSilence(audio, lastWord[i], firstWord[i + 1], options.sampleRate, silenceBegin, silenceEnd);
+                separable[i] = true;
+                clipEnd[i] = std::min(silenceBegin + padding, silenceEnd);
+                clipBegin[i + 1] = silenceEnd > silenceBegin + padding ? silenceEnd - padding : silenceBegin;
+            }
+        }
+
+        std::vector<std::vector<uint8_t>> clips(promptCount);
+        for (size_t i = 0; i < promptCount; i++)
+        {
+            bool valid = found[i] && (i == 0 || separable[i - 1]) && (i + 1 == promptCount || separable[i]);
+            if (valid && clipEnd[i] > clipBegin[i])
+            {
+                clips[i].assign(audio.begin() + clipBegin[i] * 2, audio.begin() + clipEnd[i] * 2);
+            }
+        }
+        return clips;
+    }
+
+private:
+    // Finds the longest run of 10 ms frames whose samples are all quiet in [begin, end). If there is
+    // none, returns an empty run at 'end'.
+    static void FindLongestSilence(const std::vector<uint8_t>& audio, size_t begin, size_t end, uint32_t sampleRate,
+        size_t& silenceBegin, size_t& silenceEnd)
+    {
+        const int threshold = 300;
+        auto frameSize = (size_t)sampleRate / 100;
+        silenceBegin = silenceEnd = end;
+        size_t runBegin = SIZE_MAX;
+        for (auto frame = begin; frame + frameSize <= end; frame += frameSize)
+        {
+            bool quiet = true;
+            for (auto sample = frame; sample < frame + frameSize && quiet; sample++)
+            {
+                auto value = (int16_t)(audio[2 * sample] | (audio[2 * sample + 1] << 8));
+                quiet = std::abs((int)value) < threshold;
+            }
+            if (quiet && runBegin == SIZE_MAX)
+            {
+                runBegin = frame;
+            }
+            auto runEnd = quiet ? frame + frameSize : frame;
+            if (runBegin != SIZE_MAX && runEnd - runBegin > silenceEnd - silenceBegin)
+            {
+                silenceBegin = runBegin;
+                silenceEnd = runEnd;
+            }
+            if (!quiet)
+            {
+                runBegin = SIZE_MAX;
+            }
+        }
+    }
+
+    // Length of UTF-8 text in UTF-16 code units: one per code point, two for those above U+FFFF.
+    static size_t Utf16Length(const std::string& text)
+    {
+        size_t length = 0;
+        for (auto c : text)
+        {
+            auto byte = (uint8_t)c;
+            length += (byte & 0xc0) == 0x80 ? 0 : byte >= 0xf0 ? 2 : 1;
+        }
+        return length;
+    }
+
+    static std::string EscapeXml(const std::string& text)
+    {
+        std::string escaped;
+        for (auto c : text)
+        {
+            switch (c)
+            {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            case '\'': escaped += "&apos;"; break;
+            default: escaped += c; break;
+            }
+        }
+        return escaped;
+    }
+
+    // Returns the audio, or nullptr if the synthesis was canceled.
+    std::shared_ptr<std::vector<uint8_t>> Speak(const std::string& ssml, std::vector<WordBoundary>& wordBoundaries)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wordBoundaries.clear();
+        }
+        auto result = m_synthesizer->SpeakSsmlAsync(ssml).get();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            wordBoundaries.swap(m_wordBoundaries);
+        }
+        return result->Reason == ResultReason::SynthesizingAudioCompleted ? result->GetAudioData() : nullptr;
+    }
+
+    const Options m_options;
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> m_synthesizer;
+    std::mutex m_mutex;
+    std::vector<WordBoundary> m_wordBoundaries;
+    Stats m_stats;
+};
@@ -0,0 +1,253 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "segmented_audio_buffer.h"
+
+// Writes PCM audio to a wave file while it is produced. Data is copied into pooled blocks and
+// written by a background thread, with at most 'maxQueuedBlocks' blocks waiting, so memory use is
+// constant however long the audio is; Write blocks while the queue is full.
+// The header is written with placeholder sizes and patched on Close. Files with more than 4 GB
+// of data are written as RF64: the header reserves room for the ds64 chunk in a JUNK chunk.
+class StreamingWavFileWriter final
+{
+public:
+    StreamingWavFileWriter(const std::string& fileName, uint32_t sampleRate, uint16_t bitsPerSample, uint16_t channels,
+        std::shared_ptr<AudioBlockPool> pool = std::make_shared<AudioBlockPool>(), size_t maxQueuedBlocks = 64)
+        : m_pool(pool), m_maxQueuedBlocks(maxQueuedBlocks), m_sampleRate(sampleRate), m_bitsPerSample(bitsPerSample), m_channels(channels)
+    {
+        if (sampleRate == 0 || bitsPerSample == 0 || bitsPerSample % 8 != 0 || channels == 0 || maxQueuedBlocks == 0)
+        {
+            throw std::invalid_argument("Invalid wave format or queue size.");
+        }
+
+        m_file.open(fileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!m_file.good())
+        {
+            throw std::runtime_error("Failed to open " + fileName);
+        }
+        WriteHeader(0);
+
+        m_writerThread = std::thread([this]() { RunWriter(); });
+    }
+
+    ~StreamingWavFileWriter()
+    {
+        try
+        {
+            Close();
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    StreamingWavFileWriter(const StreamingWavFileWriter&) = delete;
+    StreamingWavFileWriter& operator=(const StreamingWavFileWriter&) = delete;
+
+    // Appends audio. Throws std::runtime_error if writing to the file failed.
+    void Write(const uint8_t* data, size_t size)
+    {
+        std::lock_guard<std::mutex> writeLock(m_writeMutex);
+        if (!m_writerThread.joinable())
+        {
+            throw std::logic_error("The wave file is closed.");
+        }
+
+        while (size > 0)
+        {
+            if (!m_block)
+            {
+                m_block = m_pool->Acquire();
+                m_blockUsed = 0;
+            }
+
+            auto count = std::min(size, m_pool->BlockSize() - m_blockUsed);
+            memcpy(m_block.get() + m_blockUsed, data, count);
+            m_blockUsed += count;
+            data += count;
+            size -= count;
+
+            if (m_blockUsed == m_pool->BlockSize())
+            {
+                Enqueue();
+            }
+        }
+    }
+
+    // Writes the remaining audio, patches the header and closes the file. Further calls do nothing.
+    // Throws std::runtime_error if writing to the file failed.
+    void Close()
+    {
+        std::lock_guard<std::mutex> writeLock(m_writeMutex);
+        if (!m_writerThread.joinable())
+        {
+            return;
+        }
+
+        if (m_block)
+        {
+            Enqueue();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closing = true;
+        }
+        m_changed.notify_all();
+        m_writerThread.join();
+
+        if (m_error.empty())
+        {
+            m_file.seekp(0);
+            WriteHeader(m_dataSize);
+            m_file.close();
+            if (m_file.fail())
+            {
+                m_error = "Failed to write the wave header.";
+            }
+        }
+        if (!m_error.empty())
+        {
+            throw std::runtime_error(m_error);
+        }
+    }
+
+    // Number of audio bytes written so far.
+    uint64_t DataSize() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dataSize;
+    }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    // Space for the ds64 chunk: RIFF size, data size and sample count, 64 bits each, and an empty table.
+    static constexpr uint32_t ds64Size = 28;
+
+    void Enqueue()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() { return m_queue.size() < m_maxQueuedBlocks || !m_error.empty(); });
+        if (!m_error.empty())
+        {
+            m_pool->Release(std::move(m_block));
+            throw std::runtime_error(m_error);
+        }
+        m_queue.push_back({ std::move(m_block), m_blockUsed });
+        m_blockUsed = 0;
+        m_changed.notify_all();
+    }
+
+    void RunWriter()
+    {
+        while (true)
+        {
+            Block block;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [this]() { return !m_queue.empty() || m_closing; });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+                block = std::move(m_queue.front());
+                m_queue.pop_front();
+                m_changed.notify_all();
+            }
+
+            m_file.write((const char*)block.data.get(), block.size);
+            m_pool->Release(std::move(block.data));
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_file.good())
+            {
+                m_error = "Failed to write audio data.";
+                for (auto& queued : m_queue)
+                {
+                    m_pool->Release(std::move(queued.data));
+                }
+                m_queue.clear();
+                m_changed.notify_all();
+                return;
+            }
+            m_dataSize += block.size;
+        }
+    }
+
+    void WriteHeader(uint64_t dataSize)
+    {
+        uint8_t header[80] = {};
+        auto put16 = [&header](size_t offset, uint16_t value) { header[offset] = (uint8_t)value; header[offset + 1] = (uint8_t)(value >> 8); };
+        auto put32 = [&put16](size_t offset, uint32_t value) { put16(offset, (uint16_t)value); put16(offset + 2, (uint16_t)(value >> 16)); };
+        auto put64 = [&put32](size_t offset, uint64_t value) { put32(offset, (uint32_t)value); put32(offset + 4, (uint32_t)(value >> 32)); };
+
+        uint64_t riffSize = sizeof(header) - 8 + dataSize;
+        bool rf64 = riffSize > UINT32_MAX;
+        auto blockAlign = (uint16_t)(m_channels * m_bitsPerSample / 8);
+
+        memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+        put32(4, rf64 ? UINT32_MAX : (uint32_t)riffSize);
+        memcpy(header + 8, "WAVE", 4);
+
+        memcpy(header + 12, rf64 ? "ds64" : "JUNK", 4);
+        put32(16, ds64Size);
+        if (rf64)
+        {
+            put64(20, riffSize);
+            put64(28, dataSize);
+            put64(36, dataSize / blockAlign);
+        }
+
+        memcpy(header + 48, "fmt ", 4);
+        put32(52, 16);
+        put16(56, 1);                       // PCM
+        put16(58, m_channels);
+        put32(60, m_sampleRate);
+        put32(64, m_sampleRate * blockAlign); // bytes per second
+        put16(68, blockAlign);
+        put16(70, m_bitsPerSample);
+
+        memcpy(header + 72, "data", 4);
+        put32(76, rf64 ? UINT32_MAX : (uint32_t)dataSize);
+        m_file.write((const char*)header, sizeof(header));
+    }
+
+    std::shared_ptr<AudioBlockPool> m_pool;
+    const size_t m_maxQueuedBlocks;
+    const uint32_t m_sampleRate;
+    const uint16_t m_bitsPerSample;
+    const uint16_t m_channels;
+
+    std::ofstream m_file;
+    std::thread m_writerThread;
+
+    // Serializes Write and Close, and guards the block being filled.
+    std::mutex m_writeMutex;
+    std::unique_ptr<uint8_t[]> m_block;
+    size_t m_blockUsed = 0;
+
+    // Guards the queue and the writer state.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<Block> m_queue;
+    bool m_closing = false;
+    uint64_t m_dataSize = 0;
+    std::string m_error;
+};
@@ -0,0 +1,269 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Broadcasts synthesized audio to many listeners with one synthesis per unique text. The first
+// subscriber to a text starts its synthesis; everyone subscribed to the same text while it's in
+// progress, or still being listened to, shares it. The chunks are kept once, as reference counted
+// buffers that all subscriptions point to, and late subscribers start from the first chunk.
+// A broadcast is released when it's complete and its last subscription is gone, so memory grows
+// with the number of texts being listened to, not with the number of listeners.
+class SynthesisBroadcaster final
+{
+public:
+    using Chunk = std::shared_ptr<const std::vector<uint8_t>>;
+    using ChunkCallback = std::function<void(const uint8_t* data, size_t size)>;
+    // Synthesizes the text, calls 'onChunk' with the audio as it arrives, and returns true on success.
+    using SynthesizeFunction = std::function<bool(const std::string& text, const ChunkCallback& onChunk)>;
+
+    struct Stats
+    {
+        uint64_t syntheses = 0;
+        uint64_t subscriptions = 0;
+        size_t activeBroadcasts = 0;
+        size_t bufferedBytes = 0;
+        size_t peakBufferedBytes = 0;
+    };
+
+private:
+    struct Counters
+    {
+        std::mutex mutex;
+        size_t bufferedBytes = 0;
+        size_t peakBufferedBytes = 0;
+    };
+
+    struct Broadcast
+    {
+        ~Broadcast()
+        {
+            std::lock_guard<std::mutex> lock(counters->mutex);
+            counters->bufferedBytes -= size;
+        }
+
+        std::shared_ptr<Counters> counters;
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::vector<Chunk> chunks;
+        size_t size = 0;
+        bool done = false;
+        bool succeeded = false;
+    };
+
+public:
+    // One listener's position in a broadcast.
+    class Subscription final
+    {
+    public:
+        explicit Subscription(std::shared_ptr<Broadcast> broadcast)
+            : m_broadcast(broadcast)
+        {
+        }
+
+        // Waits for the next chunk. Returns nullptr at the end of the audio, or once canceled.
+        Chunk Next()
+        {
+            std::unique_lock<std::mutex> lock(m_broadcast->mutex);
+            m_broadcast->changed.wait(lock, [this]() { return m_canceled || m_next < m_broadcast->chunks.size() || m_broadcast->done; });
+            return !m_canceled && m_next < m_broadcast->chunks.size() ? m_broadcast->chunks[m_next++] : nullptr;
+        }
+
+        // Wakes a Next waiting on another thread, and makes it and the following ones return nullptr.
+        // The broadcast goes on for the other subscriptions.
+        void Cancel()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_broadcast->mutex);
+                m_canceled = true;
+            }
+            m_broadcast->changed.notify_all();
+        }
+
+        // True if the synthesis completed successfully and the subscription wasn't canceled. Only
+        // meaningful after Next returned nullptr.
+        bool Succeeded() const
+        {
+            std::lock_guard<std::mutex> lock(m_broadcast->mutex);
+            return m_broadcast->succeeded && !m_canceled;
+        }
+
+    private:
+        std::shared_ptr<Broadcast> m_broadcast;
+        size_t m_next = 0;
+        // Guarded by the mutex of the broadcast.
+        bool m_canceled = false;
+    };
+
+    explicit SynthesisBroadcaster(SynthesizeFunction synthesize)
+        : m_synthesize(synthesize)
+    {
+    }
+
+    // Waits for the syntheses in progress.
+    ~SynthesisBroadcaster()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& synthesis : m_synthesisThreads)
+        {
+            synthesis.thread.join();
+        }
+    }
+
+    SynthesisBroadcaster(const SynthesisBroadcaster&) = delete;
+    SynthesisBroadcaster& operator=(const SynthesisBroadcaster&) = delete;
+
+    // Creates a broadcaster whose syntheses each use a new SpeechSynthesizer with no audio output; the
+    // audio is taken from its Synthesizing events.
+    static std::shared_ptr<SynthesisBroadcaster> FromConfig(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto synthesize = [config](const std::string& text, const ChunkCallback& onChunk)
+        {
+            auto synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+            synthesizer->Synthesizing += [&onChunk](const SpeechSynthesisEventArgs& e)
+            {
+                auto audio = e.Result->GetAudioData();
+                if (audio && !audio->empty())
+                {
+                    onChunk(audio->data(), audio->size());
+                }
+            };
+            auto result = synthesizer->SpeakTextAsync(text).get();
+            return result->Reason == ResultReason::SynthesizingAudioCompleted;
+        };
+        return std::make_shared<SynthesisBroadcaster>(synthesize);
+    }
+
+    // Subscribes to the audio of the text, starting its synthesis if nobody is listening to it yet.
+    std::shared_ptr<Subscription> Subscribe(const std::string& text)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        JoinFinishedThreads();
+        m_subscriptions++;
+
+        auto existing = m_broadcasts.find(text);
+        auto broadcast = existing != m_broadcasts.end() ? existing->second.lock() : nullptr;
+        if (!broadcast)
+        {
+            broadcast = std::make_shared<Broadcast>();
+            broadcast->counters = m_counters;
+            m_broadcasts[text] = broadcast;
+            m_syntheses++;
+
+            auto finished = std::make_shared<std::atomic<bool>>(false);
+            auto counters = m_counters;
+            auto synthesize = m_synthesize;
+            std::thread thread([broadcast, finished, counters, synthesize, text]() mutable
+            {
+                auto onChunk = [&broadcast, &counters](const uint8_t* data, size_t size)
+                {
+                    auto chunk = std::make_shared<const std::vector<uint8_t>>(data, data + size);
+                    {
+                        std::lock_guard<std::mutex> countersLock(counters->mutex);
+                        counters->bufferedBytes += size;
+                        counters->peakBufferedBytes = std::max(counters->peakBufferedBytes, counters->bufferedBytes);
+                    }
+                    {
+                        std::lock_guard<std::mutex> broadcastLock(broadcast->mutex);
+                        broadcast->chunks.push_back(chunk);
+                        broadcast->size += size;
+                    }
+                    broadcast->changed.notify_all();
+                };
+
+                bool succeeded = false;
+                try
+                {
+                    succeeded = synthesize(text, onChunk);
+                }
+                catch (const std::exception&)
+                {
+                }
+                {
+                    std::lock_guard<std::mutex> broadcastLock(broadcast->mutex);
+                    broadcast->done = true;
+                    broadcast->succeeded = succeeded;
+                }
+                broadcast->changed.notify_all();
+
+                // Without subscribers, the broadcast is released here.
+                broadcast = nullptr;
+                *finished = true;
+            });
+            m_synthesisThreads.push_back({ std::move(thread), finished });
+        }
+        return std::make_shared<Subscription>(broadcast);
+    }
+
+    Stats GetStats() const
+    {
+        Stats stats;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            stats.syntheses = m_syntheses;
+            stats.subscriptions = m_subscriptions;
+            for (auto& broadcast : m_broadcasts)
+            {
+                stats.activeBroadcasts += broadcast.second.expired() ? 0 : 1;
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_counters->mutex);
+        stats.bufferedBytes = m_counters->bufferedBytes;
+        stats.peakBufferedBytes = m_counters->peakBufferedBytes;
+        return stats;
+    }
+
+private:
+    struct SynthesisThread
+    {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+
+    // Must be called with the lock held.
+    void JoinFinishedThreads()
+    {
+        for (auto it = m_synthesisThreads.begin(); it != m_synthesisThreads.end();)
+        {
+            if (*it->finished)
+            {
+                it->thread.join();
+                it = m_synthesisThreads.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        for (auto it = m_broadcasts.begin(); it != m_broadcasts.end();)
+        {
+            it = it->second.expired() ? m_broadcasts.erase(it) : std::next(it);
+        }
+    }
+
+    SynthesizeFunction m_synthesize;
+    std::shared_ptr<Counters> m_counters = std::make_shared<Counters>();
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::weak_ptr<Broadcast>> m_broadcasts;
+    std::list<SynthesisThread> m_synthesisThreads;
+    uint64_t m_syntheses = 0;
+    uint64_t m_subscriptions = 0;
+};
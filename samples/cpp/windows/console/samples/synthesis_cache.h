@@ -0,0 +1,619 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// The parameters that determine the synthesized audio.
+struct SynthesisRequest
+{
+    std::string text;   // plain text, or SSML if isSsml is set.
+    bool isSsml = false;
+    std::string voice;
+    std::string language;
+    Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat outputFormat =
+        Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat::Riff16Khz16BitMonoPcm;
+
+    // Canonical form of all parameters, used as the cache key.
+    std::string Key() const
+    {
+        return std::string("v1\n") + (isSsml ? "ssml" : "text") + "\n" + voice + "\n" + language + "\n" +
+            std::to_string((int)outputFormat) + "\n" + text;
+    }
+};
+
+// Reader over cached audio, with the reading methods of AudioDataStream.
+// The audio is not copied: the reader keeps the cache entry or the mapped file alive.
+class CachedAudioDataStream final
+{
+public:
+    CachedAudioDataStream(std::shared_ptr<const void> owner, const uint8_t* data, size_t size)
+        : m_owner(owner), m_data(data), m_size(size)
+    {
+    }
+
+    uint32_t GetLength() const
+    {
+        return (uint32_t)m_size;
+    }
+
+    bool CanReadData(uint32_t bytesRequested) const
+    {
+        return m_size - m_position >= bytesRequested;
+    }
+
+    uint32_t ReadData(uint8_t* buffer, uint32_t bufferSize)
+    {
+        auto count = (uint32_t)std::min<size_t>(bufferSize, m_size - m_position);
+        memcpy(buffer, m_data + m_position, count);
+        m_position += count;
+        return count;
+    }
+
+    uint32_t GetPosition() const
+    {
+        return (uint32_t)m_position;
+    }
+
+    void SetPosition(uint32_t position)
+    {
+        m_position = std::min<size_t>(position, m_size);
+    }
+
+    // Direct access to the audio, e.g. to hand it to playback without a copy.
+    const uint8_t* Data() const
+    {
+        return m_data;
+    }
+
+    // Saves the audio as it was synthesized, i.e. with the header of the output format, if it has one.
+    void SaveToFile(const std::string& fileName) const
+    {
+        std::ofstream fs(fileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        fs.write((const char*)m_data, m_size);
+    }
+
+private:
+    std::shared_ptr<const void> m_owner;
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_position = 0;
+};
+
+// Content-addressed cache of synthesized audio, keyed by the text or SSML, voice, language and
+// output format. Recently used audio is kept in memory up to a byte capacity (LRU); audio is also
+// stored in a directory, one file per key, read back through a memory mapping, up to a second byte
+// capacity (LRU by use in this process, by write time for the files found at start). Concurrent
+// misses of the same request share one synthesis.
+class SynthesisCache final
+{
+public:
+    enum class Source
+    {
+        Memory,
+        Disk,
+        Synthesized
+    };
+
+    struct Metrics
+    {
+        uint64_t memoryHits = 0;
+        uint64_t diskHits = 0;
+        uint64_t misses = 0;
+        // Misses that waited for the synthesis of the same request by another caller.
+        uint64_t sharedMisses = 0;
+        uint64_t diskEvictions = 0;
+        std::chrono::microseconds memoryHitTime{ 0 };
+        std::chrono::microseconds diskHitTime{ 0 };
+        std::chrono::microseconds missTime{ 0 };
+
+        double HitRatio() const
+        {
+            auto total = memoryHits + diskHits + misses + sharedMisses;
+            return total == 0 ? 0 : (double)(memoryHits + diskHits) / total;
+        }
+    };
+
+    // Synthesizes audio for a request. Returns nullptr if synthesis failed, failures are not cached.
+    using SynthesizeFunction = std::function<std::shared_ptr<std::vector<uint8_t>>(const SynthesisRequest&)>;
+
+    SynthesisCache(size_t memoryCapacity, const std::string& directory, uint64_t diskCapacity = 256 * 1024 * 1024)
+        : m_memoryCapacity(memoryCapacity), m_directory(directory), m_diskCapacity(diskCapacity)
+    {
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+        ScanDirectory();
+    }
+
+    // Looks up the request in memory, then on disk. Returns nullptr if the audio is not cached.
+    std::shared_ptr<CachedAudioDataStream> Get(const SynthesisRequest& request, Source* source = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Source found;
+        auto audio = Lookup(request.Key(), found);
+        if (!audio.owner)
+        {
+            return nullptr;
+        }
+        Record(found, start);
+        SetSource(source, found);
+        return audio.Stream();
+    }
+
+    // Adds audio to both tiers.
+    void Put(const SynthesisRequest& request, std::shared_ptr<const std::vector<uint8_t>> audio)
+    {
+        Put(request.Key(), audio);
+    }
+
+    // Returns the cached audio for the request, or synthesizes and caches it on a miss. A miss while
+    // the same request is being synthesized for another caller waits for that synthesis, and gets its
+    // result or exception. Returns nullptr if the audio is not cached and synthesis failed.
+    std::shared_ptr<CachedAudioDataStream> GetOrSynthesize(const SynthesisRequest& request, const SynthesizeFunction& synthesize, Source* source = nullptr)
+    {
+        auto stream = Get(request, source);
+        if (stream)
+        {
+            return stream;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto key = request.Key();
+        std::promise<CachedAudio> promise;
+        std::shared_future<CachedAudio> inFlight;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_inFlight.find(key);
+            if (it != m_inFlight.end())
+            {
+                inFlight = it->second;
+            }
+            else
+            {
+                m_inFlight.emplace(key, promise.get_future().share());
+            }
+        }
+
+        if (inFlight.valid())
+        {
+            auto audio = inFlight.get();
+            if (!audio.owner)
+            {
+                return nullptr;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_metrics.sharedMisses++;
+            }
+            SetSource(source, Source::Synthesized);
+            return audio.Stream();
+        }
+
+        CachedAudio audio;
+        auto found = Source::Synthesized;
+        try
+        {
+            // A synthesis of the request may have completed between the lookup and taking it on.
+            audio = Lookup(key, found);
+            if (!audio.owner)
+            {
+                std::shared_ptr<const std::vector<uint8_t>> synthesized = synthesize(request);
+                if (synthesized)
+                {
+                    Put(key, synthesized);
+                    audio = { synthesized, synthesized->data(), synthesized->size() };
+                }
+            }
+        }
+        catch (...)
+        {
+            EndSynthesis(key);
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+        EndSynthesis(key);
+        promise.set_value(audio);
+
+        if (!audio.owner)
+        {
+            return nullptr;
+        }
+        Record(found, start);
+        SetSource(source, found);
+        return audio.Stream();
+    }
+
+    Metrics GetMetrics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_metrics;
+    }
+
+private:
+    struct CachedAudio
+    {
+        std::shared_ptr<const void> owner;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+
+        std::shared_ptr<CachedAudioDataStream> Stream() const
+        {
+            return std::make_shared<CachedAudioDataStream>(owner, data, size);
+        }
+    };
+
+    struct DiskEntry
+    {
+        std::string fileName;
+        uint64_t size;
+    };
+
+    struct MemoryEntry
+    {
+        std::string key;
+        std::shared_ptr<const void> owner;
+        const uint8_t* data;
+        size_t size;
+    };
+
+    static constexpr uint32_t fileMagic = 0x43585053; // "SPXC"
+
+    // Looks up the key in memory, then on disk. The owner of the result is null if it's not cached.
+    CachedAudio Lookup(const std::string& key, Source& source)
+    {
+        auto audio = GetFromMemory(key);
+        if (audio.owner)
+        {
+            TouchFile(FileName(key));
+            source = Source::Memory;
+            return audio;
+        }
+
+        auto file = ReadFile(key);
+        if (file)
+        {
+            audio = { file, file->Data() + AudioOffset(key), file->Size() - AudioOffset(key) };
+            AddToMemory(key, audio.owner, audio.data, audio.size);
+            source = Source::Disk;
+        }
+        return audio;
+    }
+
+    void Put(const std::string& key, std::shared_ptr<const std::vector<uint8_t>> audio)
+    {
+        WriteFile(key, *audio);
+        AddToMemory(key, audio, audio->data(), audio->size());
+    }
+
+    void EndSynthesis(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inFlight.erase(key);
+    }
+
+    static void SetSource(Source* source, Source value)
+    {
+        if (source != nullptr)
+        {
+            *source = value;
+        }
+    }
+
+    void Record(Source source, std::chrono::steady_clock::time_point start)
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        switch (source)
+        {
+        case Source::Memory:
+            m_metrics.memoryHits++;
+            m_metrics.memoryHitTime += elapsed;
+            break;
+        case Source::Disk:
+            m_metrics.diskHits++;
+            m_metrics.diskHitTime += elapsed;
+            break;
+        case Source::Synthesized:
+            m_metrics.misses++;
+            m_metrics.missTime += elapsed;
+            break;
+        }
+    }
+
+    CachedAudio GetFromMemory(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            return CachedAudio();
+        }
+
+        // Moves the entry to the front, the least recently used entry is at the back.
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        auto& entry = *it->second;
+        return { entry.owner, entry.data, entry.size };
+    }
+
+    void AddToMemory(const std::string& key, std::shared_ptr<const void> owner, const uint8_t* data, size_t size)
+    {
+        if (size > m_memoryCapacity)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_index.find(key) != m_index.end())
+        {
+            return;
+        }
+
+        m_entries.push_front({ key, owner, data, size });
+        m_index[key] = m_entries.begin();
+        m_memorySize += size;
+        while (m_memorySize > m_memoryCapacity)
+        {
+            m_memorySize -= m_entries.back().size;
+            m_index.erase(m_entries.back().key);
+            m_entries.pop_back();
+        }
+    }
+
+    std::string FileName(const std::string& key) const
+    {
+        // FNV-1a hash of the key. Collisions are detected by the key stored in the file.
+        uint64_t hash = 14695981039346656037ull;
+        for (auto c : key)
+        {
+            hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        }
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+        return m_directory + "/" + name + ".audio";
+    }
+
+    static size_t AudioOffset(const std::string& key)
+    {
+        return 2 * sizeof(uint32_t) + key.size();
+    }
+
+    // Adds the cache files found in the directory, the most recently written first, and evicts
+    // down to the capacity. Temporary files left behind by a process that ended while writing are
+    // removed.
+    void ScanDirectory()
+    {
+        struct FoundFile
+        {
+            uint64_t time;
+            std::string fileName;
+            uint64_t size;
+        };
+        std::vector<FoundFile> found;
+        std::vector<std::string> temporary;
+        const std::string extension = ".audio";
+        const std::string temporaryExtension = extension + ".tmp";
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        auto find = FindFirstFileA((m_directory + "/*" + extension + "*").c_str(), &data);
+        if (find != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                std::string name = data.cFileName;
+                if (name.find(temporaryExtension) != std::string::npos)
+                {
+                    temporary.push_back(m_directory + "/" + name);
+                    continue;
+                }
+                if (name.size() <= extension.size() || name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+                {
+                    continue;
+                }
+                auto time = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+                auto size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+                found.push_back({ time, m_directory + "/" + name, size });
+            } while (FindNextFileA(find, &data));
+            FindClose(find);
+        }
+#else
+        if (auto directory = opendir(m_directory.c_str()))
+        {
+            while (auto entry = readdir(directory))
+            {
+                std::string name = entry->d_name;
+                struct stat info;
+                auto fileName = m_directory + "/" + name;
+                if (name.find(temporaryExtension) != std::string::npos)
+                {
+                    temporary.push_back(fileName);
+                }
+                else if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0 &&
+                    stat(fileName.c_str(), &info) == 0)
+                {
+                    found.push_back({ (uint64_t)info.st_mtime, fileName, (uint64_t)info.st_size });
+                }
+            }
+            closedir(directory);
+        }
+#endif
+        RemoveFiles(temporary);
+        std::sort(found.begin(), found.end(), [](const FoundFile& a, const FoundFile& b) { return a.time > b.time; });
+
+        std::vector<std::string> evicted;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto& file : found)
+            {
+                m_files.push_back({ file.fileName, file.size });
+                m_fileIndex[file.fileName] = std::prev(m_files.end());
+                m_diskSize += file.size;
+            }
+            EvictFiles(evicted);
+        }
+        RemoveFiles(evicted);
+    }
+
+    // Marks the file as the most recently used one.
+    void TouchFile(const std::string& fileName)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_fileIndex.find(fileName);
+        if (it != m_fileIndex.end())
+        {
+            m_files.splice(m_files.begin(), m_files, it->second);
+        }
+    }
+
+    // Accounts for a file written to the directory and evicts the least recently used files until
+    // the directory is within its capacity.
+    void AddFile(const std::string& fileName, uint64_t size)
+    {
+        std::vector<std::string> evicted;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_fileIndex.find(fileName);
+            if (it != m_fileIndex.end())
+            {
+                m_files.splice(m_files.begin(), m_files, it->second);
+                return;
+            }
+            m_files.push_front({ fileName, size });
+            m_fileIndex[fileName] = m_files.begin();
+            m_diskSize += size;
+            EvictFiles(evicted);
+        }
+        RemoveFiles(evicted);
+    }
+
+    // Takes the least recently used files off the books, called with the lock held. The files are
+    // removed after the lock is released; the audio of a file that is still mapped stays readable.
+    void EvictFiles(std::vector<std::string>& evicted)
+    {
+        while (m_diskSize > m_diskCapacity && !m_files.empty())
+        {
+            auto& file = m_files.back();
+            m_diskSize -= file.size;
+            evicted.push_back(file.fileName);
+            m_fileIndex.erase(file.fileName);
+            m_files.pop_back();
+            m_metrics.diskEvictions++;
+        }
+    }
+
+    static void RemoveFiles(const std::vector<std::string>& fileNames)
+    {
+        for (auto& fileName : fileNames)
+        {
+            std::remove(fileName.c_str());
+        }
+    }
+
+    // File layout: magic, key size, key, audio.
+    void WriteFile(const std::string& key, const std::vector<uint8_t>& audio)
+    {
+        auto fileName = FileName(key);
+        auto tempFileName = fileName + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            uint32_t magic = fileMagic;
+            uint32_t keySize = (uint32_t)key.size();
+            std::ofstream fs(tempFileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+            fs.write((const char*)&magic, sizeof(magic));
+            fs.write((const char*)&keySize, sizeof(keySize));
+            fs.write(key.data(), key.size());
+            fs.write((const char*)audio.data(), audio.size());
+            if (!fs.good())
+            {
+                fs.close();
+                std::remove(tempFileName.c_str());
+                return;
+            }
+        }
+
+        // Readers only ever see complete files. An existing file is replaced; if it can't be, e.g. while
+        // it's mapped on Windows, it holds the same audio, and the temporary file is dropped.
+#ifdef _WIN32
+        auto moved = MoveFileExA(tempFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        auto moved = std::rename(tempFileName.c_str(), fileName.c_str()) == 0;
+#endif
+        if (!moved)
+        {
+            std::remove(tempFileName.c_str());
+            if (!std::ifstream(fileName).good())
+            {
+                return;
+            }
+        }
+        AddFile(fileName, AudioOffset(key) + audio.size());
+    }
+
+    std::shared_ptr<MappedFile> ReadFile(const std::string& key)
+    {
+        auto fileName = FileName(key);
+        std::shared_ptr<MappedFile> file;
+        try
+        {
+            file = std::make_shared<MappedFile>(fileName);
+        }
+        catch (const std::runtime_error&)
+        {
+            return nullptr;
+        }
+
+        uint32_t magic;
+        uint32_t keySize;
+        if (file->Size() < AudioOffset(key))
+        {
+            return nullptr;
+        }
+        memcpy(&magic, file->Data(), sizeof(magic));
+        memcpy(&keySize, file->Data() + sizeof(magic), sizeof(keySize));
+        if (magic != fileMagic || keySize != key.size() || memcmp(file->Data() + 2 * sizeof(uint32_t), key.data(), key.size()) != 0)
+        {
+            return nullptr;
+        }
+        TouchFile(fileName);
+        return file;
+    }
+
+    const size_t m_memoryCapacity;
+    const std::string m_directory;
+    const uint64_t m_diskCapacity;
+
+    mutable std::mutex m_mutex;
+    std::list<MemoryEntry> m_entries;
+    std::unordered_map<std::string, std::list<MemoryEntry>::iterator> m_index;
+    size_t m_memorySize = 0;
+    std::list<DiskEntry> m_files;
+    std::unordered_map<std::string, std::list<DiskEntry>::iterator> m_fileIndex;
+    uint64_t m_diskSize = 0;
+    std::unordered_map<std::string, std::shared_future<CachedAudio>> m_inFlight;
+    Metrics m_metrics;
+};
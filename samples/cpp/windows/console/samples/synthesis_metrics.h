@@ -0,0 +1,291 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "hdr_histogram.h"
+
+// Synthesis latency and throughput per voice and output format, exported as JSON.
+class SynthesisMetrics final
+{
+public:
+    // One synthesis request, as seen by a recorder.
+    struct Request
+    {
+        std::chrono::microseconds timeToFirstByte{ 0 };
+        std::vector<std::chrono::microseconds> chunkGaps;
+        // How late each word boundary arrived, relative to the playback of its audio started at the first byte.
+        std::vector<std::chrono::microseconds> wordBoundaryDelays;
+        uint64_t bytes = 0;
+        std::chrono::microseconds synthesisTime{ 0 };
+        std::chrono::microseconds audioDuration{ 0 };
+        bool failed = false;
+    };
+
+    void Add(const std::string& key, const Request& request)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& voice = m_voices[key];
+        voice.requests++;
+        if (request.failed)
+        {
+            voice.failures++;
+            return;
+        }
+
+        voice.timeToFirstByte.Record(request.timeToFirstByte.count());
+        for (auto gap : request.chunkGaps)
+        {
+            voice.chunkGap.Record(gap.count());
+        }
+        for (auto delay : request.wordBoundaryDelays)
+        {
+            voice.wordBoundaryDelay.Record(delay.count());
+        }
+        voice.bytes.Record(request.bytes);
+        voice.audioDuration.Record(request.audioDuration.count());
+        if (request.audioDuration.count() > 0)
+        {
+            // In thousandths, the histogram holds integers.
+            voice.realTimeFactor.Record(request.synthesisTime.count() * 1000 / request.audioDuration.count());
+        }
+    }
+
+    // Exports all voices, times in milliseconds.
+    std::string ToJson() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ostringstream json;
+        json << "{";
+        bool firstVoice = true;
+        for (auto& entry : m_voices)
+        {
+            auto& voice = entry.second;
+            json << (firstVoice ? "" : ",") << "\n  \"" << Escape(entry.first) << "\": {"
+                << "\n    \"requests\": " << voice.requests << ","
+                << "\n    \"failures\": " << voice.failures << ","
+                << "\n    \"timeToFirstByteMs\": " << HistogramJson(voice.timeToFirstByte, 1000.0) << ","
+                << "\n    \"chunkGapMs\": " << HistogramJson(voice.chunkGap, 1000.0) << ","
+                << "\n    \"wordBoundaryDelayMs\": " << HistogramJson(voice.wordBoundaryDelay, 1000.0) << ","
+                << "\n    \"bytes\": " << HistogramJson(voice.bytes, 1.0) << ","
+                << "\n    \"audioDurationMs\": " << HistogramJson(voice.audioDuration, 1000.0) << ","
+                << "\n    \"realTimeFactor\": " << HistogramJson(voice.realTimeFactor, 1000.0)
+                << "\n  }";
+            firstVoice = false;
+        }
+        json << "\n}\n";
+        return json.str();
+    }
+
+    static std::string Key(const std::string& voice, Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format)
+    {
+        return voice + "/" + std::to_string((int)format);
+    }
+
+    // Audio bytes per second of the output formats with a constant bit rate, 0 for the others.
+    static uint32_t BytesPerSecond(Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format)
+    {
+        using Format = Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat;
+        switch (format)
+        {
+        case Format::Raw8Khz8BitMonoMULaw:
+        case Format::Riff8Khz8BitMonoMULaw:
+            return 8000;
+        case Format::Raw8Khz16BitMonoPcm:
+        case Format::Riff8Khz16BitMonoPcm:
+            return 16000;
+        case Format::Raw16Khz16BitMonoPcm:
+        case Format::Riff16Khz16BitMonoPcm:
+            return 32000;
+        case Format::Raw24Khz16BitMonoPcm:
+        case Format::Riff24Khz16BitMonoPcm:
+            return 48000;
+        case Format::Riff16Khz16KbpsMonoSiren:
+        case Format::Audio16Khz16KbpsMonoSiren:
+            return 2000;
+        case Format::Audio16Khz32KBitRateMonoMp3:
+            return 4000;
+        case Format::Audio24Khz48KBitRateMonoMp3:
+            return 6000;
+        case Format::Audio16Khz64KBitRateMonoMp3:
+            return 8000;
+        case Format::Audio24Khz96KBitRateMonoMp3:
+            return 12000;
+        case Format::Audio16Khz128KBitRateMonoMp3:
+            return 16000;
+        case Format::Audio24Khz160KBitRateMonoMp3:
+            return 20000;
+        default:
+            return 0;
+        }
+    }
+
+private:
+    struct Voice
+    {
+        uint64_t requests = 0;
+        uint64_t failures = 0;
+        HdrHistogram timeToFirstByte;
+        HdrHistogram chunkGap;
+        HdrHistogram wordBoundaryDelay;
+        HdrHistogram bytes;
+        HdrHistogram audioDuration;
+        HdrHistogram realTimeFactor;
+    };
+
+    static std::string HistogramJson(const HdrHistogram& histogram, double divisor)
+    {
+        std::ostringstream json;
+        json << "{ \"count\": " << histogram.Count()
+            << ", \"min\": " << histogram.Min() / divisor
+            << ", \"mean\": " << histogram.Mean() / divisor
+            << ", \"p50\": " << histogram.ValueAtPercentile(50) / divisor
+            << ", \"p90\": " << histogram.ValueAtPercentile(90) / divisor
+            << ", \"p99\": " << histogram.ValueAtPercentile(99) / divisor
+            << ", \"max\": " << histogram.Max() / divisor << " }";
+        return json.str();
+    }
+
+    static std::string Escape(const std::string& text)
+    {
+        std::string escaped;
+        for (auto c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Voice> m_voices;
+};
+
+// Records the requests of one synthesizer from its events, into SynthesisMetrics. The synthesizer
+// must run one request at a time. Call RequestStarted right before SpeakTextAsync or SpeakSsmlAsync,
+// otherwise times are measured from the SynthesisStarted event.
+class SynthesisMetricsRecorder final
+{
+public:
+    SynthesisMetricsRecorder(std::shared_ptr<SynthesisMetrics> metrics, const std::string& voice,
+        Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format)
+        : m_metrics(metrics), m_key(SynthesisMetrics::Key(voice, format)), m_bytesPerSecond(SynthesisMetrics::BytesPerSecond(format))
+    {
+    }
+
+    // Subscribes to the events of the synthesizer. The recorder must outlive the synthesizer's requests.
+    void Attach(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> synthesizer)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        synthesizer->SynthesisStarted += [this](const SpeechSynthesisEventArgs&)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_requestStarted)
+            {
+                Reset(std::chrono::steady_clock::now());
+            }
+        };
+
+        synthesizer->Synthesizing += [this](const SpeechSynthesisEventArgs& e)
+        {
+            auto now = std::chrono::steady_clock::now();
+            auto size = e.Result->GetAudioData()->size();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_request.bytes == 0)
+            {
+                m_request.timeToFirstByte = Elapsed(m_start, now);
+                m_firstByte = now;
+            }
+            else
+            {
+                m_request.chunkGaps.push_back(Elapsed(m_lastChunk, now));
+            }
+            m_lastChunk = now;
+            m_request.bytes += size;
+        };
+
+        synthesizer->WordBoundary += [this](const SpeechSynthesisWordBoundaryEventArgs& e)
+        {
+            auto now = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_request.bytes > 0)
+            {
+                // The unit of e.AudioOffset is tick (1 tick = 100 nanoseconds).
+                auto played = m_firstByte + std::chrono::microseconds(e.AudioOffset / 10);
+                m_request.wordBoundaryDelays.push_back(now > played ? Elapsed(played, now) : std::chrono::microseconds(0));
+            }
+        };
+
+        synthesizer->SynthesisCompleted += [this](const SpeechSynthesisEventArgs&)
+        {
+            Complete(false);
+        };
+
+        synthesizer->SynthesisCanceled += [this](const SpeechSynthesisEventArgs&)
+        {
+            Complete(true);
+        };
+    }
+
+    void RequestStarted()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Reset(std::chrono::steady_clock::now());
+        m_requestStarted = true;
+    }
+
+private:
+    static std::chrono::microseconds Elapsed(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(to - from);
+    }
+
+    void Reset(std::chrono::steady_clock::time_point start)
+    {
+        m_request = SynthesisMetrics::Request();
+        m_start = start;
+    }
+
+    void Complete(bool failed)
+    {
+        SynthesisMetrics::Request request;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_request.failed = failed;
+            m_request.synthesisTime = Elapsed(m_start, std::chrono::steady_clock::now());
+            if (m_bytesPerSecond > 0)
+            {
+                m_request.audioDuration = std::chrono::microseconds(m_request.bytes * 1000000 / m_bytesPerSecond);
+            }
+            std::swap(request, m_request);
+            m_requestStarted = false;
+        }
+        m_metrics->Add(m_key, request);
+    }
+
+    std::shared_ptr<SynthesisMetrics> m_metrics;
+    const std::string m_key;
+    const uint32_t m_bytesPerSecond;
+
+    std::mutex m_mutex;
+    bool m_requestStarted = false;
+    SynthesisMetrics::Request m_request;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_firstByte;
+    std::chrono::steady_clock::time_point m_lastChunk;
+};
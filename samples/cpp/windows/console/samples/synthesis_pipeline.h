@@ -0,0 +1,314 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Plays a response of several sentences with synthesis ahead of playback: sentence N+1 starts
+// synthesizing as soon as the first audio of sentence N arrives, up to 'lookahead' sentences
+// ahead of the one being played. Audio is handed to the sink in order, so the sink sees one
+// contiguous stream.
+class SynthesisPipeline final
+{
+public:
+    using ChunkCallback = std::function<void(const uint8_t* data, size_t size)>;
+
+    // Synthesizes a sentence on synthesizer 'slot' and calls 'onChunk' for each audio chunk.
+    // Blocks until the sentence is synthesized; returns false if synthesis failed. The pipeline
+    // uses slots 0 to lookahead, and never two sentences on the same slot at the same time.
+    using SynthesizeFunction = std::function<bool(size_t slot, const std::string& text, const ChunkCallback& onChunk)>;
+
+    struct Options
+    {
+        // Number of sentences synthesized ahead of the one being played. 0 means one sentence at a time.
+        size_t lookahead = 2;
+        // Byte rate of the audio, used to measure the gaps of real time playback.
+        uint32_t bytesPerSecond = 32000;
+    };
+
+    // The gaps are measured as if the sink played the audio in real time, starting with the first chunk.
+    struct Metrics
+    {
+        std::chrono::microseconds timeToFirstAudio{ 0 };
+        // Silence before each sentence after the first one, because its audio was not there in time.
+        std::vector<std::chrono::microseconds> gaps;
+        size_t failedSentences = 0;
+
+        std::chrono::microseconds MaxGap() const
+        {
+            return gaps.empty() ? std::chrono::microseconds(0) : *std::max_element(gaps.begin(), gaps.end());
+        }
+
+        std::chrono::microseconds MeanGap() const
+        {
+            std::chrono::microseconds total{ 0 };
+            for (auto gap : gaps)
+            {
+                total += gap;
+            }
+            return gaps.empty() ? total : total / (int64_t)gaps.size();
+        }
+    };
+
+    SynthesisPipeline(SynthesizeFunction synthesize, const Options& options)
+        : m_synthesize(synthesize), m_options(options)
+    {
+        if (options.bytesPerSecond == 0)
+        {
+            throw std::invalid_argument("Bytes per second must not be 0.");
+        }
+    }
+
+    // Creates a pipeline with one SpeechSynthesizer per slot. The synthesizers have no audio output,
+    // the audio is taken from their Synthesizing events.
+    static std::shared_ptr<SynthesisPipeline> FromConfig(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> config, const Options& options)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        struct Slot
+        {
+            std::shared_ptr<SpeechSynthesizer> synthesizer;
+            std::mutex mutex;
+            ChunkCallback onChunk;
+        };
+
+        std::vector<std::shared_ptr<Slot>> slots;
+        for (size_t i = 0; i <= options.lookahead; i++)
+        {
+            auto slot = std::make_shared<Slot>();
+            slot->synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+            Slot* slotPointer = slot.get();
+            slot->synthesizer->Synthesizing += [slotPointer](const SpeechSynthesisEventArgs& e)
+            {
+                std::lock_guard<std::mutex> lock(slotPointer->mutex);
+                auto audio = e.Result->GetAudioData();
+                if (slotPointer->onChunk && audio && !audio->empty())
+                {
+                    slotPointer->onChunk(audio->data(), audio->size());
+                }
+            };
+            slots.push_back(slot);
+        }
+
+        auto synthesize = [slots](size_t slotIndex, const std::string& text, const ChunkCallback& onChunk)
+        {
+            auto& slot = *slots[slotIndex];
+            {
+                std::lock_guard<std::mutex> lock(slot.mutex);
+                slot.onChunk = onChunk;
+            }
+            auto result = slot.synthesizer->SpeakTextAsync(text).get();
+            {
+                std::lock_guard<std::mutex> lock(slot.mutex);
+                slot.onChunk = nullptr;
+            }
+            return result->Reason == ResultReason::SynthesizingAudioCompleted;
+        };
+        return std::make_shared<SynthesisPipeline>(synthesize, options);
+    }
+
+    // Splits a response into sentences, at '.', '!' and '?' followed by a space.
+    static std::vector<std::string> SplitSentences(const std::string& text)
+    {
+        std::vector<std::string> sentences;
+        size_t begin = 0;
+        for (size_t i = 0; i <= text.size(); i++)
+        {
+            bool end = i == text.size() ||
+                ((text[i] == '.' || text[i] == '!' || text[i] == '?') && (i + 1 == text.size() || isspace((unsigned char)text[i + 1])));
+            if (!end)
+            {
+                continue;
+            }
+
+            auto last = std::min(i + 1, text.size());
+            while (begin < last && isspace((unsigned char)text[begin]))
+            {
+                begin++;
+            }
+            if (begin < last)
+            {
+                sentences.push_back(text.substr(begin, last - begin));
+            }
+            begin = last;
+        }
+        return sentences;
+    }
+
+    // Synthesizes the sentences and calls 'sink' with their audio, in order. Returns when all audio
+    // was handed to the sink. Sentences that fail are skipped.
+    Metrics Speak(const std::vector<std::string>& sentences, const ChunkCallback& sink)
+    {
+        auto start = std::chrono::steady_clock::now();
+        State state(sentences.size(), m_options.lookahead + 1);
+
+        std::vector<std::thread> threads;
+        for (size_t slot = 0; slot <= m_options.lookahead; slot++)
+        {
+            threads.emplace_back([this, &state, &sentences, slot]() { RunSlot(state, sentences, slot); });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            StartSentences(state);
+        }
+
+        Metrics metrics;
+        bool firstAudio = true;
+        std::chrono::steady_clock::time_point playbackEnd;
+        for (size_t i = 0; i < sentences.size(); i++)
+        {
+            bool firstChunk = true;
+            while (true)
+            {
+                std::vector<uint8_t> chunk;
+                {
+                    std::unique_lock<std::mutex> lock(state.mutex);
+                    auto& sentence = state.sentences[i];
+                    state.changed.wait(lock, [&sentence]() { return !sentence.chunks.empty() || sentence.done; });
+                    if (sentence.chunks.empty())
+                    {
+                        metrics.failedSentences += sentence.failed ? 1 : 0;
+                        state.playing = i + 1;
+                        StartSentences(state);
+                        break;
+                    }
+                    chunk.swap(sentence.chunks.front());
+                    sentence.chunks.pop_front();
+                }
+
+                auto now = std::chrono::steady_clock::now();
+                if (firstAudio)
+                {
+                    metrics.timeToFirstAudio = std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+                    playbackEnd = now;
+                    firstAudio = false;
+                }
+                else if (firstChunk)
+                {
+                    metrics.gaps.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::max(now - playbackEnd, std::chrono::steady_clock::duration(0))));
+                }
+                firstChunk = false;
+                playbackEnd = std::max(playbackEnd, now) + std::chrono::microseconds(chunk.size() * 1000000ull / m_options.bytesPerSecond);
+                sink(chunk.data(), chunk.size());
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.stopped = true;
+        }
+        state.changed.notify_all();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        return metrics;
+    }
+
+private:
+    enum : size_t { noSentence = (size_t)-1 };
+
+    struct Sentence
+    {
+        std::deque<std::vector<uint8_t>> chunks;
+        bool receiving = false;
+        bool done = false;
+        bool failed = false;
+    };
+
+    struct State
+    {
+        State(size_t sentenceCount, size_t slotCount)
+            : sentences(sentenceCount), slotJobs(slotCount, noSentence)
+        {
+        }
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::vector<Sentence> sentences;
+        std::vector<size_t> slotJobs;
+        size_t nextToStart = 0;
+        size_t playing = 0;
+        bool stopped = false;
+    };
+
+    // Starts the next sentences, as long as they are within the lookahead and the previous sentence
+    // is producing audio. A slot is always free then: the sentences being synthesized are all within
+    // the lookahead, and the one to start is too.
+    void StartSentences(State& state)
+    {
+        while (state.nextToStart < state.sentences.size() &&
+            state.nextToStart <= state.playing + m_options.lookahead &&
+            (state.nextToStart == 0 || state.sentences[state.nextToStart - 1].receiving || state.sentences[state.nextToStart - 1].done))
+        {
+            auto slot = std::find(state.slotJobs.begin(), state.slotJobs.end(), noSentence);
+            *slot = state.nextToStart;
+            state.nextToStart++;
+            state.changed.notify_all();
+        }
+    }
+
+    void RunSlot(State& state, const std::vector<std::string>& sentences, size_t slot)
+    {
+        while (true)
+        {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                state.changed.wait(lock, [&state, slot]() { return state.stopped || state.slotJobs[slot] != noSentence; });
+                if (state.slotJobs[slot] == noSentence)
+                {
+                    return;
+                }
+                index = state.slotJobs[slot];
+            }
+
+            bool succeeded = false;
+            try
+            {
+                succeeded = m_synthesize(slot, sentences[index], [this, &state, index](const uint8_t* data, size_t size)
+                {
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    auto& sentence = state.sentences[index];
+                    sentence.chunks.emplace_back(data, data + size);
+                    if (!sentence.receiving)
+                    {
+                        sentence.receiving = true;
+                        StartSentences(state);
+                    }
+                    state.changed.notify_all();
+                });
+            }
+            catch (const std::exception&)
+            {
+            }
+
+            std::lock_guard<std::mutex> lock(state.mutex);
+            auto& sentence = state.sentences[index];
+            sentence.done = true;
+            sentence.failed = !succeeded;
+            state.slotJobs[slot] = noSentence;
+            StartSentences(state);
+            state.changed.notify_all();
+        }
+    }
+
+    SynthesizeFunction m_synthesize;
+    const Options m_options;
+};
@@ -0,0 +1,329 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <speechapi_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Pool of SpeechSynthesizer instances per voice and output format, with their connections opened
+// ahead of time, so that a request does not pay for connection setup. A background thread replaces
+// idle instances that lost their connection or never established it, and keeps a minimum number
+// of warm instances per voice and format. Healthy instances are kept however long they're idle.
+class SynthesizerPool final
+{
+public:
+    // Creates a new config with the subscription or endpoint. The pool sets voice and output format.
+    using ConfigFactory = std::function<std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig>()>;
+
+    struct Options
+    {
+        // Number of idle instances kept per voice and format.
+        size_t warmInstances = 2;
+        // Instances checked in beyond that many idle ones per voice and format, after a burst of
+        // requests, are closed; the least recently used ones go first. At least warmInstances.
+        size_t maxIdleInstances = 8;
+        std::chrono::seconds healthCheckInterval{ 10 };
+    };
+
+    struct Metrics
+    {
+        uint64_t warmCheckouts = 0;     // served by an idle instance.
+        uint64_t coldCheckouts = 0;     // a new instance had to be created.
+        uint64_t replacedInstances = 0; // closed because disconnected, by the health check or on checkout.
+        uint64_t trimmedInstances = 0;  // closed on check-in, beyond the maximum idle count.
+        std::chrono::microseconds checkoutP50{ 0 };
+        std::chrono::microseconds checkoutP99{ 0 };
+        std::chrono::microseconds checkoutMax{ 0 };
+    };
+
+    SynthesizerPool(ConfigFactory configFactory, const Options& options)
+        : m_state(std::make_shared<State>())
+    {
+        m_state->configFactory = configFactory;
+        m_state->options = options;
+        m_healthCheckThread = std::thread([this]() { RunHealthChecks(); });
+    }
+
+    ~SynthesizerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            m_state->stopped = true;
+        }
+        m_stop.notify_all();
+        m_healthCheckThread.join();
+    }
+
+    SynthesizerPool(const SynthesizerPool&) = delete;
+    SynthesizerPool& operator=(const SynthesizerPool&) = delete;
+
+    // Creates and connects the warm instances for a voice and format, and keeps them warm from now on.
+    void Prewarm(const std::string& voice, Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format)
+    {
+        std::vector<std::shared_ptr<Instance>> created;
+        for (size_t i = 0; i < m_state->options.warmInstances; i++)
+        {
+            created.push_back(CreateInstance(*m_state, voice, format));
+        }
+
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        auto& idle = m_state->idle[Key(voice, format)];
+        for (auto& instance : created)
+        {
+            idle.push_back(instance);
+        }
+    }
+
+    // Returns a synthesizer for the voice and format. It goes back to the pool when the last
+    // reference is released; don't keep it beyond the request.
+    std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> Checkout(const std::string& voice, Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto key = Key(voice, format);
+
+        std::shared_ptr<Instance> instance;
+        std::vector<std::shared_ptr<Instance>> disconnected;
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            auto& idle = m_state->idle[key];
+            // The most recently used instance is the most likely to be still connected.
+            while (!instance && !idle.empty())
+            {
+                instance = idle.back();
+                idle.pop_back();
+                if (!instance->connected->load() && instance->opened)
+                {
+                    m_state->replacedInstances++;
+                    disconnected.push_back(instance);
+                    instance = nullptr;
+                }
+            }
+        }
+        for (auto& dropped : disconnected)
+        {
+            dropped->connection->Close();
+        }
+
+        bool warm = instance != nullptr;
+        if (!warm)
+        {
+            instance = CreateInstance(*m_state, voice, format);
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            (warm ? m_state->warmCheckouts : m_state->coldCheckouts)++;
+            if (m_state->checkoutLatencies.size() >= maxLatencySamples)
+            {
+                m_state->checkoutLatencies.pop_front();
+            }
+            m_state->checkoutLatencies.push_back(elapsed);
+        }
+
+        std::weak_ptr<State> weakState = m_state;
+        return std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer>(instance->synthesizer.get(),
+            [weakState, instance](Microsoft::CognitiveServices::Speech::SpeechSynthesizer*)
+            {
+                Checkin(weakState, instance);
+            });
+    }
+
+    Metrics GetMetrics() const
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        Metrics metrics;
+        metrics.warmCheckouts = m_state->warmCheckouts;
+        metrics.coldCheckouts = m_state->coldCheckouts;
+        metrics.replacedInstances = m_state->replacedInstances;
+        metrics.trimmedInstances = m_state->trimmedInstances;
+
+        std::vector<std::chrono::microseconds> latencies(m_state->checkoutLatencies.begin(), m_state->checkoutLatencies.end());
+        if (!latencies.empty())
+        {
+            std::sort(latencies.begin(), latencies.end());
+            metrics.checkoutP50 = latencies[(latencies.size() - 1) * 50 / 100];
+            metrics.checkoutP99 = latencies[(latencies.size() - 1) * 99 / 100];
+            metrics.checkoutMax = latencies.back();
+        }
+        return metrics;
+    }
+
+private:
+    static constexpr size_t maxLatencySamples = 10000;
+
+    struct Instance
+    {
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechSynthesizer> synthesizer;
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::Connection> connection;
+        std::shared_ptr<std::atomic<bool>> connected = std::make_shared<std::atomic<bool>>(false);
+        // Set once the connection had time to be established, so that a pending connection is not taken for a lost one.
+        bool opened = false;
+        std::string key;
+        std::chrono::steady_clock::time_point created;
+    };
+
+    struct State
+    {
+        ConfigFactory configFactory;
+        Options options;
+        std::mutex mutex;
+        std::map<std::string, std::deque<std::shared_ptr<Instance>>> idle;
+        bool stopped = false;
+        uint64_t warmCheckouts = 0;
+        uint64_t coldCheckouts = 0;
+        uint64_t replacedInstances = 0;
+        uint64_t trimmedInstances = 0;
+        std::deque<std::chrono::microseconds> checkoutLatencies;
+    };
+
+    static std::string Key(const std::string& voice, Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format)
+    {
+        return voice + "|" + std::to_string((int)format);
+    }
+
+    static std::shared_ptr<Instance> CreateInstance(State& state, const std::string& voice, Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat format)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+
+        auto config = state.configFactory();
+        config->SetSpeechSynthesisVoiceName(voice);
+        config->SetSpeechSynthesisOutputFormat(format);
+
+        auto instance = std::make_shared<Instance>();
+        instance->key = Key(voice, format);
+        instance->synthesizer = SpeechSynthesizer::FromConfig(config, nullptr);
+        instance->connection = Connection::FromSynthesizer(instance->synthesizer);
+
+        auto connected = instance->connected;
+        instance->connection->Connected += [connected](const ConnectionEventArgs&) { connected->store(true); };
+        instance->connection->Disconnected += [connected](const ConnectionEventArgs&) { connected->store(false); };
+
+        // Opens the connection in the background, the first request waits for it if it's not ready yet.
+        instance->connection->Open(false);
+        instance->created = std::chrono::steady_clock::now();
+        return instance;
+    }
+
+    static void Checkin(const std::weak_ptr<State>& weakState, const std::shared_ptr<Instance>& instance)
+    {
+        // The next request mustn't get the handlers of this one.
+        auto& synthesizer = *instance->synthesizer;
+        synthesizer.SynthesisStarted.DisconnectAll();
+        synthesizer.Synthesizing.DisconnectAll();
+        synthesizer.SynthesisCompleted.DisconnectAll();
+        synthesizer.SynthesisCanceled.DisconnectAll();
+        synthesizer.WordBoundary.DisconnectAll();
+
+        auto state = weakState.lock();
+        if (!state)
+        {
+            return;
+        }
+
+        // A request opens the connection if it was lost, so the instance is connected again unless it failed.
+        std::vector<std::shared_ptr<Instance>> trimmed;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            instance->opened = true;
+            auto& idle = state->idle[instance->key];
+            idle.push_back(instance);
+            Trim(*state, idle, trimmed);
+        }
+        for (auto& extra : trimmed)
+        {
+            extra->connection->Close();
+        }
+    }
+
+    // Takes the least recently used instances beyond the maximum idle count out of the pool, to be
+    // closed after the lock is released.
+    static void Trim(State& state, std::deque<std::shared_ptr<Instance>>& idle, std::vector<std::shared_ptr<Instance>>& trimmed)
+    {
+        auto maxIdle = std::max(state.options.maxIdleInstances, state.options.warmInstances);
+        while (idle.size() > maxIdle)
+        {
+            trimmed.push_back(idle.front());
+            idle.pop_front();
+            state.trimmedInstances++;
+        }
+    }
+
+    // Closes idle instances that are disconnected, and tops up each voice and format to the warm
+    // instance count. Instances are created without holding the lock.
+    void RunHealthChecks()
+    {
+        // Also holds the instances trimmed when the created ones are added, until the next round.
+        std::vector<std::shared_ptr<Instance>> closed;
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        while (!m_stop.wait_for(lock, m_state->options.healthCheckInterval, [this]() { return m_state->stopped; }))
+        {
+            auto now = std::chrono::steady_clock::now();
+            std::vector<std::string> refill;
+            for (auto& entry : m_state->idle)
+            {
+                auto& idle = entry.second;
+                for (auto it = idle.begin(); it != idle.end();)
+                {
+                    auto& instance = *it;
+                    // A connection that is still not established after a full interval is taken as failed.
+                    instance->opened = instance->opened || now - instance->created >= m_state->options.healthCheckInterval;
+                    if (instance->opened && !instance->connected->load())
+                    {
+                        closed.push_back(instance);
+                        it = idle.erase(it);
+                        m_state->replacedInstances++;
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+                for (auto i = idle.size(); i < m_state->options.warmInstances; i++)
+                {
+                    refill.push_back(entry.first);
+                }
+            }
+
+            lock.unlock();
+            for (auto& instance : closed)
+            {
+                instance->connection->Close();
+            }
+            closed.clear();
+
+            std::vector<std::shared_ptr<Instance>> created;
+            for (auto& key : refill)
+            {
+                auto separator = key.rfind('|');
+                auto format = (Microsoft::CognitiveServices::Speech::SpeechSynthesisOutputFormat)std::stoi(key.substr(separator + 1));
+                created.push_back(CreateInstance(*m_state, key.substr(0, separator), format));
+            }
+            lock.lock();
+
+            for (auto& instance : created)
+            {
+                auto& idle = m_state->idle[instance->key];
+                idle.push_back(instance);
+                Trim(*m_state, idle, closed);
+            }
+        }
+    }
+
+    std::shared_ptr<State> m_state;
+    std::condition_variable m_stop;
+    std::thread m_healthCheckThread;
+};
@@ -0,0 +1,212 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+// Word boundaries of synthesized audio, as parallel arrays of audio offset, text offset and word
+// length, for finding the word spoken at a time and the time a word is spoken in O(log n).
+// The index is either built in memory or loaded from a file through a memory mapping, in which case
+// the arrays are used in place.
+class WordBoundaryIndex final
+{
+public:
+    static constexpr size_t npos = (size_t)-1;
+
+    WordBoundaryIndex()
+    {
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    // In ticks (100 nanoseconds) from the start of the audio.
+    uint64_t AudioOffset(size_t word) const
+    {
+        return m_audioOffsets[word];
+    }
+
+    uint32_t TextOffset(size_t word) const
+    {
+        return m_textOffsets[word];
+    }
+
+    uint32_t WordLength(size_t word) const
+    {
+        return m_wordLengths[word];
+    }
+
+    // Returns the word being spoken at the audio offset, i.e. the last word that starts at or before
+    // it, or npos if the offset is before the first word.
+    size_t FindByAudioOffset(uint64_t audioOffset) const
+    {
+        auto it = std::upper_bound(m_audioOffsets, m_audioOffsets + m_size, audioOffset);
+        return it == m_audioOffsets ? npos : (size_t)(it - m_audioOffsets) - 1;
+    }
+
+    // Returns the word at the text offset, i.e. the last word that starts at or before it, or npos
+    // if the offset is before the first word.
+    size_t FindByTextOffset(uint32_t textOffset) const
+    {
+        auto textOffsets = m_textOffsets;
+        auto it = std::upper_bound(m_textOrder, m_textOrder + m_size, textOffset,
+            [textOffsets](uint32_t offset, uint32_t word) { return offset < textOffsets[word]; });
+        return it == m_textOrder ? npos : m_textOrder[it - m_textOrder - 1];
+    }
+
+    // File layout: magic, version, word count, then the arrays of audio offsets, text offsets, word
+    // lengths and words in text order, in the byte order of the machine.
+    void Save(const std::string& fileName) const
+    {
+        std::ofstream file(fileName, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        uint32_t header[2] = { fileMagic, fileVersion };
+        uint64_t size = m_size;
+        file.write((const char*)header, sizeof(header));
+        file.write((const char*)&size, sizeof(size));
+        file.write((const char*)m_audioOffsets, m_size * sizeof(uint64_t));
+        file.write((const char*)m_textOffsets, m_size * sizeof(uint32_t));
+        file.write((const char*)m_wordLengths, m_size * sizeof(uint32_t));
+        file.write((const char*)m_textOrder, m_size * sizeof(uint32_t));
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write " + fileName);
+        }
+    }
+
+    // Maps an index saved with Save. Throws std::runtime_error if the file is missing or invalid.
+    static WordBoundaryIndex Load(const std::string& fileName)
+    {
+        auto file = std::make_shared<MappedFile>(fileName);
+        uint32_t header[2];
+        uint64_t size;
+        if (file->Size() < headerSize)
+        {
+            throw std::runtime_error("Invalid word boundary index " + fileName);
+        }
+        memcpy(header, file->Data(), sizeof(header));
+        memcpy(&size, file->Data() + sizeof(header), sizeof(size));
+        if (header[0] != fileMagic || header[1] != fileVersion || size > (file->Size() - headerSize) / bytesPerWord ||
+            file->Size() != headerSize + size * bytesPerWord)
+        {
+            throw std::runtime_error("Invalid word boundary index " + fileName);
+        }
+
+        WordBoundaryIndex index;
+        index.m_owner = file;
+        index.m_size = (size_t)size;
+        auto data = file->Data() + headerSize;
+        index.m_audioOffsets = (const uint64_t*)data;
+        index.m_textOffsets = (const uint32_t*)(data + size * sizeof(uint64_t));
+        index.m_wordLengths = index.m_textOffsets + size;
+        index.m_textOrder = index.m_wordLengths + size;
+        // The lookups by text offset index the other arrays with these.
+        for (size_t i = 0; i < index.m_size; i++)
+        {
+            if (index.m_textOrder[i] >= size)
+            {
+                throw std::runtime_error("Invalid word boundary index " + fileName);
+            }
+        }
+        return index;
+    }
+
+private:
+    friend class WordBoundaryIndexBuilder;
+
+    static constexpr uint32_t fileMagic = 0x57585053; // "SPXW"
+    static constexpr uint32_t fileVersion = 1;
+    static constexpr size_t headerSize = 16;
+    static constexpr size_t bytesPerWord = sizeof(uint64_t) + 3 * sizeof(uint32_t);
+
+    struct Arrays
+    {
+        std::vector<uint64_t> audioOffsets;
+        std::vector<uint32_t> textOffsets;
+        std::vector<uint32_t> wordLengths;
+        std::vector<uint32_t> textOrder;
+    };
+
+    explicit WordBoundaryIndex(std::shared_ptr<Arrays> arrays)
+        : m_owner(arrays),
+        m_audioOffsets(arrays->audioOffsets.data()),
+        m_textOffsets(arrays->textOffsets.data()),
+        m_wordLengths(arrays->wordLengths.data()),
+        m_textOrder(arrays->textOrder.data()),
+        m_size(arrays->audioOffsets.size())
+    {
+    }
+
+    // Keeps the arrays alive, either vectors or a mapped file.
+    std::shared_ptr<const void> m_owner;
+    const uint64_t* m_audioOffsets = nullptr;
+    const uint32_t* m_textOffsets = nullptr;
+    const uint32_t* m_wordLengths = nullptr;
+    const uint32_t* m_textOrder = nullptr;
+    size_t m_size = 0;
+};
+
+// Collects word boundary events into a WordBoundaryIndex. Add can be called from the event handler.
+class WordBoundaryIndexBuilder final
+{
+public:
+    void Add(uint64_t audioOffset, uint32_t textOffset, uint32_t wordLength)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_arrays->audioOffsets.push_back(audioOffset);
+        m_arrays->textOffsets.push_back(textOffset);
+        m_arrays->wordLengths.push_back(wordLength);
+    }
+
+    // Builds the index from the words added so far, and starts a new one.
+    WordBoundaryIndex Build()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto arrays = m_arrays;
+        m_arrays = std::make_shared<WordBoundaryIndex::Arrays>();
+
+        // Events arrive in audio order; sorts anyway, so that lookups by audio offset can rely on it.
+        auto size = arrays->audioOffsets.size();
+        if (!std::is_sorted(arrays->audioOffsets.begin(), arrays->audioOffsets.end()))
+        {
+            std::vector<uint32_t> order(size);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&arrays](uint32_t a, uint32_t b) { return arrays->audioOffsets[a] < arrays->audioOffsets[b]; });
+            auto sorted = std::make_shared<WordBoundaryIndex::Arrays>();
+            for (auto word : order)
+            {
+                sorted->audioOffsets.push_back(arrays->audioOffsets[word]);
+                sorted->textOffsets.push_back(arrays->textOffsets[word]);
+                sorted->wordLengths.push_back(arrays->wordLengths[word]);
+            }
+            arrays = sorted;
+        }
+
+        // Text offsets usually increase with the audio offsets too, but not necessarily with SSML.
+        arrays->textOrder.resize(size);
+        std::iota(arrays->textOrder.begin(), arrays->textOrder.end(), 0);
+        if (!std::is_sorted(arrays->textOffsets.begin(), arrays->textOffsets.end()))
+        {
+            auto& textOffsets = arrays->textOffsets;
+            std::stable_sort(arrays->textOrder.begin(), arrays->textOrder.end(), [&textOffsets](uint32_t a, uint32_t b) { return textOffsets[a] < textOffsets[b]; });
+        }
+        return WordBoundaryIndex(arrays);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::shared_ptr<WordBoundaryIndex::Arrays> m_arrays = std::make_shared<WordBoundaryIndex::Arrays>();
+};
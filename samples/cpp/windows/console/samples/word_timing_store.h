@@ -0,0 +1,266 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "detailed_result_parser.h"
+
+// Word timings of the utterances of a session, for subtitles and search. Each distinct word is
+// stored once, in one buffer, and the words of the utterances are parallel arrays of word id, offset
+// and duration, with a table of the range of words of each utterance. Words are found by time in
+// O(log n). Filled from the Recognized event and queried from one thread at a time.
+class WordTimingStore final
+{
+public:
+    static constexpr size_t npos = (size_t)-1;
+
+    WordTimingStore()
+        : m_slots(1024, emptySlot)
+    {
+        m_wordStarts.push_back(0);
+        m_utteranceBegins.push_back(0);
+    }
+
+    // Appends the words of an alternative of the result, the best one by default. The result needs
+    // word-level timestamps (SpeechConfig::RequestWordLevelTimestamps). Results have to be added in
+    // the order they are recognized; throws std::invalid_argument otherwise.
+    void AddUtterance(const DetailedResult& result, size_t alternative = 0)
+    {
+        auto begin = (size_t)0;
+        auto end = (size_t)0;
+        if (alternative < result.AlternativeCount())
+        {
+            begin = result.wordsBegin[alternative];
+            end = result.wordsEnd[alternative];
+        }
+        else if (alternative != 0)
+        {
+            throw std::invalid_argument("The result has no alternative " + std::to_string(alternative));
+        }
+
+        auto lastOffset = m_offsets.empty() ? INT64_MIN : m_offsets.back();
+        for (auto w = begin; w < end; w++)
+        {
+            auto offset = static_cast<int64_t>(result.wordOffset[w]);
+            if (offset < lastOffset)
+            {
+                throw std::invalid_argument("Words have to be added in the order of their offsets");
+            }
+            lastOffset = offset;
+        }
+
+        for (auto w = begin; w < end; w++)
+        {
+            m_wordIds.push_back(Intern(result.word[w].data, result.word[w].size));
+            m_offsets.push_back(static_cast<int64_t>(result.wordOffset[w]));
+            m_durations.push_back(static_cast<int64_t>(result.wordDuration[w]));
+        }
+        m_utteranceOffsets.push_back(static_cast<int64_t>(result.offset));
+        m_utteranceDurations.push_back(static_cast<int64_t>(result.duration));
+        m_utteranceBegins.push_back(static_cast<uint32_t>(m_wordIds.size()));
+    }
+
+    size_t WordCount() const
+    {
+        return m_wordIds.size();
+    }
+
+    size_t DistinctWordCount() const
+    {
+        return m_wordStarts.size() - 1;
+    }
+
+    size_t UtteranceCount() const
+    {
+        return m_utteranceOffsets.size();
+    }
+
+    // The id of the word in the buffer of distinct words; equal words have equal ids.
+    uint32_t WordId(size_t word) const
+    {
+        return m_wordIds[word];
+    }
+
+    // Points into the store, not terminated, and valid until the next AddUtterance.
+    const char* WordData(size_t word) const
+    {
+        return m_text.data() + m_wordStarts[m_wordIds[word]];
+    }
+
+    size_t WordLength(size_t word) const
+    {
+        auto id = m_wordIds[word];
+        return m_wordStarts[id + 1] - m_wordStarts[id];
+    }
+
+    std::string Word(size_t word) const
+    {
+        return std::string(WordData(word), WordLength(word));
+    }
+
+    // In ticks (100 nanoseconds) from the start of the audio.
+    int64_t Offset(size_t word) const
+    {
+        return m_offsets[word];
+    }
+
+    int64_t Duration(size_t word) const
+    {
+        return m_durations[word];
+    }
+
+    // The words of the utterance are [UtteranceBegin, UtteranceEnd).
+    size_t UtteranceBegin(size_t utterance) const
+    {
+        return m_utteranceBegins[utterance];
+    }
+
+    size_t UtteranceEnd(size_t utterance) const
+    {
+        return m_utteranceBegins[utterance + 1];
+    }
+
+    int64_t UtteranceOffset(size_t utterance) const
+    {
+        return m_utteranceOffsets[utterance];
+    }
+
+    int64_t UtteranceDuration(size_t utterance) const
+    {
+        return m_utteranceDurations[utterance];
+    }
+
+    // Returns the utterance of the word.
+    size_t UtteranceOfWord(size_t word) const
+    {
+        auto it = std::upper_bound(m_utteranceBegins.begin(), m_utteranceBegins.end() - 1, static_cast<uint32_t>(word));
+        return (size_t)(it - m_utteranceBegins.begin()) - 1;
+    }
+
+    // Returns the word being spoken at the offset, i.e. the last word that starts at or before it
+    // and hasn't ended, or npos if there is none.
+    size_t FindByOffset(int64_t offset) const
+    {
+        auto it = std::upper_bound(m_offsets.begin(), m_offsets.end(), offset);
+        if (it == m_offsets.begin())
+        {
+            return npos;
+        }
+        auto word = (size_t)(it - m_offsets.begin()) - 1;
+        return offset < m_offsets[word] + m_durations[word] ? word : (size_t)npos;
+    }
+
+    // Returns the words that are spoken in [from, to) as a range [first, second) of words. Words of
+    // recognized speech don't overlap, so only the word before the first one that starts in the
+    // range can reach into it.
+    std::pair<size_t, size_t> FindByTimeRange(int64_t from, int64_t to) const
+    {
+        auto first = (size_t)(std::lower_bound(m_offsets.begin(), m_offsets.end(), from) - m_offsets.begin());
+        auto last = (size_t)(std::lower_bound(m_offsets.begin() + first, m_offsets.end(), to) - m_offsets.begin());
+        if (first > 0 && m_offsets[first - 1] + m_durations[first - 1] > from && m_offsets[first - 1] < to)
+        {
+            first--;
+        }
+        return std::make_pair(first, std::max(first, last));
+    }
+
+    // Bytes allocated by the store.
+    size_t MemoryUsage() const
+    {
+        return m_text.capacity() + m_wordStarts.capacity() * sizeof(uint32_t) + m_slots.capacity() * sizeof(uint32_t) +
+            m_wordIds.capacity() * sizeof(uint32_t) + m_offsets.capacity() * sizeof(int64_t) + m_durations.capacity() * sizeof(int64_t) +
+            m_utteranceBegins.capacity() * sizeof(uint32_t) + m_utteranceOffsets.capacity() * sizeof(int64_t) +
+            m_utteranceDurations.capacity() * sizeof(int64_t);
+    }
+
+    // Releases the spare capacity of the arrays, e.g. when a session has ended.
+    void ShrinkToFit()
+    {
+        m_text.shrink_to_fit();
+        m_wordStarts.shrink_to_fit();
+        m_wordIds.shrink_to_fit();
+        m_offsets.shrink_to_fit();
+        m_durations.shrink_to_fit();
+        m_utteranceBegins.shrink_to_fit();
+        m_utteranceOffsets.shrink_to_fit();
+        m_utteranceDurations.shrink_to_fit();
+    }
+
+private:
+    enum : uint32_t { emptySlot = UINT32_MAX };
+
+    // FNV-1a.
+    static uint32_t Hash(const char* data, size_t size)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    // Returns the id of the word, adding it if it's new. The hash table is open addressing over
+    // the ids, with linear probing, and kept at most half full.
+    uint32_t Intern(const char* data, size_t size)
+    {
+        auto mask = m_slots.size() - 1;
+        for (auto slot = Hash(data, size) & mask;; slot = (slot + 1) & mask)
+        {
+            auto id = m_slots[slot];
+            if (id == emptySlot)
+            {
+                id = static_cast<uint32_t>(m_wordStarts.size() - 1);
+                m_text.append(data, size);
+                m_wordStarts.push_back(static_cast<uint32_t>(m_text.size()));
+                m_slots[slot] = id;
+                if ((id + 1) * 2 > m_slots.size())
+                {
+                    Rehash(m_slots.size() * 2);
+                }
+                return id;
+            }
+            if (m_wordStarts[id + 1] - m_wordStarts[id] == size && std::memcmp(m_text.data() + m_wordStarts[id], data, size) == 0)
+            {
+                return id;
+            }
+        }
+    }
+
+    void Rehash(size_t slotCount)
+    {
+        m_slots.assign(slotCount, emptySlot);
+        auto mask = slotCount - 1;
+        for (uint32_t id = 0; id + 1 < m_wordStarts.size(); id++)
+        {
+            auto slot = Hash(m_text.data() + m_wordStarts[id], m_wordStarts[id + 1] - m_wordStarts[id]) & mask;
+            while (m_slots[slot] != emptySlot)
+            {
+                slot = (slot + 1) & mask;
+            }
+            m_slots[slot] = id;
+        }
+    }
+
+    // The distinct words, one after the other; word id i is [m_wordStarts[i], m_wordStarts[i + 1]).
+    std::string m_text;
+    std::vector<uint32_t> m_wordStarts;
+    std::vector<uint32_t> m_slots;
+
+    std::vector<uint32_t> m_wordIds;
+    std::vector<int64_t> m_offsets;
+    std::vector<int64_t> m_durations;
+
+    // Utterance i has the words [m_utteranceBegins[i], m_utteranceBegins[i + 1]).
+    std::vector<uint32_t> m_utteranceBegins;
+    std::vector<int64_t> m_utteranceOffsets;
+    std::vector<int64_t> m_utteranceDurations;
+};
@@ -7,6 +7,9 @@
 #import <AVFoundation/AVFoundation.h>
 #import <MicrosoftCognitiveServicesSpeech/SPXSpeechApi.h>
 
+// Exported by GStreamerWrapper.framework, see gstreamer_modules.h.
+extern void spx_gst_register_plugins_for_format(int containerFormat);
+extern void spx_gst_compare_plugin_registration(int containerFormat, uint64_t *lazyUs, uint64_t *eagerUs);
 
 @interface ViewController () {
     NSString *speechKey;
@@ -43,6 +46,18 @@
     [self.recognitionResultLabel setText:@"Press a button!"];
 
     [self.view addSubview:self.recognitionResultLabel];
+
+#if defined(SPX_GST_REGISTRATION_BENCHMARK)
+    // Startup benchmark of GStreamer plugin registration: the time lazy registration spends for MP3,
+    // and the time eager registration spends on all formats. Registers all plugins, so it is only
+    // built with SPX_GST_REGISTRATION_BENCHMARK.
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+        uint64_t lazyUs = 0;
+        uint64_t eagerUs = 0;
+        spx_gst_compare_plugin_registration((int)SPXAudioStreamContainerFormat_MP3, &lazyUs, &eagerUs);
+        NSLog(@"GStreamer plugin registration for MP3: lazy %llu us, eager %llu us", lazyUs, eagerUs);
+    });
+#endif
 }
 
 - (IBAction)recognizeFromMP3FileButtonTapped:(UIButton *)sender {
@@ -65,6 +80,9 @@
 
     // <setup-stream>
     SPXAudioStreamContainerFormat compressedStreamFormat = SPXAudioStreamContainerFormat_MP3;
+    // Registers the GStreamer plugins needed for MP3. Only required if GStreamerWrapper was built with
+    // SPX_GST_LAZY_PLUGIN_REGISTRATION, otherwise all plugins are registered when GStreamer is initialized.
+    spx_gst_register_plugins_for_format((int)compressedStreamFormat);
     SPXAudioStreamFormat *audioFormat = [[SPXAudioStreamFormat alloc] initUsingCompressedFormat:compressedStreamFormat];
     SPXPushAudioInputStream* stream = [[SPXPushAudioInputStream alloc] initWithAudioFormat:audioFormat];
 
@@ -0,0 +1,322 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// gstreamer_decoder_pool.cpp
+//
+
+#include "gstreamer_decoder_pool.h"
+#include "gstreamer_modules.h"
+
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Impl {
+
+namespace {
+
+const char* DecoderDescription(int containerFormat)
+{
+    switch (containerFormat)
+    {
+    case SPX_GST_CONTAINER_FORMAT_OGG_OPUS:
+        // oggdemux is linked to opusparse by OnDemuxerPadAdded, not by gst_parse_launch.
+        return "appsrc name=src format=bytes ! oggdemux name=demux  opusparse name=parse ! opusdec";
+    case SPX_GST_CONTAINER_FORMAT_MP3:
+        return "appsrc name=src format=bytes ! mpegaudioparse ! mpg123audiodec";
+    case SPX_GST_CONTAINER_FORMAT_FLAC:
+        return "appsrc name=src format=bytes ! flacparse ! flacdec";
+    case SPX_GST_CONTAINER_FORMAT_ALAW:
+        return "appsrc name=src format=bytes caps=audio/x-alaw,rate=8000,channels=1 ! alawdec";
+    case SPX_GST_CONTAINER_FORMAT_MULAW:
+        return "appsrc name=src format=bytes caps=audio/x-mulaw,rate=8000,channels=1 ! mulawdec";
+    default:
+        return nullptr;
+    }
+}
+
+// Links each source pad oggdemux adds to opusparse. gst_parse_launch links a sometimes-pad only
+// once, but oggdemux removes its pads when the pipeline goes back to READY and adds new ones for
+// the next stream, so a reused pipeline has to link them again. A linked sink pad is left over from
+// the previous stream of a chained file, and is relinked to the new pad.
+void OnDemuxerPadAdded(GstElement* demuxer, GstPad* pad, gpointer data)
+{
+    (void)demuxer;
+    auto parserSink = gst_element_get_static_pad(GST_ELEMENT(data), "sink");
+    auto peer = gst_pad_get_peer(parserSink);
+    if (peer != nullptr)
+    {
+        gst_pad_unlink(peer, parserSink);
+        gst_object_unref(peer);
+    }
+    gst_pad_link(pad, parserSink);
+    gst_object_unref(parserSink);
+}
+
+// How long Read waits for a sample before it checks the bus for an error.
+const GstClockTime PullTimeout = 100 * GST_MSECOND;
+
+} // anonymous namespace
+
+DecoderPipeline::DecoderPipeline(int containerFormat)
+    : m_containerFormat(containerFormat)
+{
+    auto decoder = DecoderDescription(containerFormat);
+    if (decoder == nullptr)
+    {
+        throw std::runtime_error("Unsupported container format.");
+    }
+
+    gst_init(nullptr, nullptr);
+    spx_gst_init();
+    spx_gst_register_plugins_for_format(containerFormat);
+
+    auto description = std::string(decoder) +
+        " ! audioconvert ! audioresample ! audio/x-raw,format=S16LE,rate=16000,channels=1 ! appsink name=sink sync=false";
+
+    GError* error = nullptr;
+    m_pipeline = gst_parse_launch(description.c_str(), &error);
+    if (error != nullptr)
+    {
+        std::string message = error->message;
+        g_error_free(error);
+        if (m_pipeline != nullptr)
+        {
+            gst_object_unref(m_pipeline);
+        }
+        throw std::runtime_error("Failed to build the decode pipeline: " + message);
+    }
+
+    m_source = gst_bin_get_by_name(GST_BIN(m_pipeline), "src");
+    m_sink = gst_bin_get_by_name(GST_BIN(m_pipeline), "sink");
+
+    auto demuxer = gst_bin_get_by_name(GST_BIN(m_pipeline), "demux");
+    if (demuxer != nullptr)
+    {
+        // The parser is owned by the pipeline, like the demuxer, so it outlives the handler.
+        auto parser = gst_bin_get_by_name(GST_BIN(m_pipeline), "parse");
+        g_signal_connect(demuxer, "pad-added", G_CALLBACK(OnDemuxerPadAdded), parser);
+        gst_object_unref(parser);
+        gst_object_unref(demuxer);
+    }
+
+    // Takes the pipeline through its state changes once, so the first stream does not pay for it.
+    if (gst_element_set_state(m_pipeline, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE)
+    {
+        gst_object_unref(m_source);
+        gst_object_unref(m_sink);
+        gst_object_unref(m_pipeline);
+        throw std::runtime_error("Failed to prepare the decode pipeline.");
+    }
+}
+
+DecoderPipeline::~DecoderPipeline()
+{
+    gst_element_set_state(m_pipeline, GST_STATE_NULL);
+    gst_object_unref(m_source);
+    gst_object_unref(m_sink);
+    gst_object_unref(m_pipeline);
+}
+
+bool DecoderPipeline::Start()
+{
+    if (!m_started)
+    {
+        m_started = gst_element_set_state(m_pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+    }
+    return m_started;
+}
+
+bool DecoderPipeline::CheckForError()
+{
+    if (!m_failed)
+    {
+        auto bus = gst_element_get_bus(m_pipeline);
+        auto error = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+        gst_object_unref(bus);
+        if (error != nullptr)
+        {
+            gst_message_unref(error);
+            m_failed = true;
+        }
+    }
+    return m_failed;
+}
+
+bool DecoderPipeline::Write(const uint8_t* data, size_t size)
+{
+    if (m_failed || !Start())
+    {
+        return false;
+    }
+
+    auto buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    gst_buffer_fill(buffer, 0, data, size);
+    // gst_app_src_push_buffer takes ownership of the buffer.
+    return gst_app_src_push_buffer(GST_APP_SRC(m_source), buffer) == GST_FLOW_OK;
+}
+
+void DecoderPipeline::EndOfStream()
+{
+    if (Start())
+    {
+        gst_app_src_end_of_stream(GST_APP_SRC(m_source));
+    }
+}
+
+size_t DecoderPipeline::Read(uint8_t* buffer, size_t size)
+{
+    if (m_pendingOffset == m_pending.size())
+    {
+        if (m_failed || !Start())
+        {
+            return 0;
+        }
+
+        // A failing element only posts an error on the bus and never sends the end of the stream,
+        // so the sink is polled, and the bus checked between polls.
+        GstSample* sample = nullptr;
+        while (sample == nullptr)
+        {
+            sample = gst_app_sink_try_pull_sample(GST_APP_SINK(m_sink), PullTimeout);
+            if (sample == nullptr && (gst_app_sink_is_eos(GST_APP_SINK(m_sink)) || CheckForError()))
+            {
+                return 0;
+            }
+        }
+
+        GstMapInfo map;
+        auto sampleBuffer = gst_sample_get_buffer(sample);
+        if (sampleBuffer != nullptr && gst_buffer_map(sampleBuffer, &map, GST_MAP_READ))
+        {
+            m_pending.assign(map.data, map.data + map.size);
+            gst_buffer_unmap(sampleBuffer, &map);
+        }
+        else
+        {
+            m_pending.clear();
+        }
+        m_pendingOffset = 0;
+        gst_sample_unref(sample);
+    }
+
+    auto count = std::min(size, m_pending.size() - m_pendingOffset);
+    memcpy(buffer, m_pending.data() + m_pendingOffset, count);
+    m_pendingOffset += count;
+    return count;
+}
+
+bool DecoderPipeline::Reset()
+{
+    if (CheckForError())
+    {
+        return false;
+    }
+
+    m_pending.clear();
+    m_pendingOffset = 0;
+    m_started = false;
+
+    // Going back to READY flushes all queued data and clears the end-of-stream state.
+    if (gst_element_set_state(m_pipeline, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE)
+    {
+        return false;
+    }
+
+    // Drops the pipeline if the stream ran into an error while stopping, and clears the other
+    // messages of the stream.
+    if (CheckForError())
+    {
+        return false;
+    }
+    auto bus = gst_element_get_bus(m_pipeline);
+    gst_bus_set_flushing(bus, TRUE);
+    gst_bus_set_flushing(bus, FALSE);
+    gst_object_unref(bus);
+    return true;
+}
+
+DecoderPipelinePool::DecoderPipelinePool(size_t maxIdlePerFormat)
+    : m_state(std::make_shared<State>())
+{
+    m_state->maxIdlePerFormat = maxIdlePerFormat;
+}
+
+void DecoderPipelinePool::Prewarm(int containerFormat, size_t count)
+{
+    count = std::min(count, m_state->maxIdlePerFormat);
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            if (m_state->idle[containerFormat].size() >= count)
+            {
+                return;
+            }
+        }
+
+        // Builds outside of the lock, building a pipeline takes a while.
+        std::unique_ptr<DecoderPipeline> pipeline(new DecoderPipeline(containerFormat));
+
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->idle[containerFormat].push_back(std::move(pipeline));
+    }
+}
+
+std::shared_ptr<DecoderPipeline> DecoderPipelinePool::Acquire(int containerFormat)
+{
+    std::unique_ptr<DecoderPipeline> pipeline;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        auto& idle = m_state->idle[containerFormat];
+        if (!idle.empty())
+        {
+            pipeline = std::move(idle.back());
+            idle.pop_back();
+        }
+    }
+
+    if (pipeline)
+    {
+        m_state->hits++;
+    }
+    else
+    {
+        m_state->misses++;
+        pipeline.reset(new DecoderPipeline(containerFormat));
+    }
+
+    std::weak_ptr<State> weakState = m_state;
+    return std::shared_ptr<DecoderPipeline>(pipeline.release(), [weakState](DecoderPipeline* released)
+    {
+        Release(weakState, released);
+    });
+}
+
+void DecoderPipelinePool::Release(const std::weak_ptr<State>& weakState, DecoderPipeline* pipeline)
+{
+    std::unique_ptr<DecoderPipeline> owned(pipeline);
+    // A pipeline that failed is destroyed instead of going back to the pool.
+    auto state = weakState.lock();
+    if (!state || owned->Failed() || !owned->Reset())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto& idle = state->idle[owned->ContainerFormat()];
+    if (idle.size() < state->maxIdlePerFormat)
+    {
+        idle.push_back(std::move(owned));
+    }
+}
+
+} } } } // Microsoft::CognitiveServices::Speech::Impl
@@ -0,0 +1,105 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// gstreamer_decoder_pool.h
+//
+
+#pragma once
+
+#include <gst/gst.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Microsoft {
+namespace CognitiveServices {
+namespace Speech {
+namespace Impl {
+
+// A decode pipeline for one container format:
+// appsrc -> parser -> decoder -> audioconvert -> audioresample -> appsink,
+// producing 16 kHz, 16 bit, mono PCM.
+class __attribute__((visibility ("default"))) DecoderPipeline final
+{
+public:
+    // Builds the pipeline for one of the SPX_GST_CONTAINER_FORMAT_* values. Throws std::runtime_error on failure.
+    explicit DecoderPipeline(int containerFormat);
+    ~DecoderPipeline();
+
+    DecoderPipeline(const DecoderPipeline&) = delete;
+    DecoderPipeline& operator=(const DecoderPipeline&) = delete;
+
+    int ContainerFormat() const { return m_containerFormat; }
+
+    // Feeds compressed data into the pipeline.
+    bool Write(const uint8_t* data, size_t size);
+
+    // Signals that no more compressed data follows.
+    void EndOfStream();
+
+    // Reads decoded PCM; blocks until data is available. Returns 0 at the end of the stream or on error.
+    size_t Read(uint8_t* buffer, size_t size);
+
+    // True once an element of the pipeline reported an error; the pipeline is not reused then.
+    bool Failed() const { return m_failed; }
+
+    // Brings the pipeline back to its initial state, so it can decode the next stream.
+    // Returns false if the pipeline hit an error and should not be reused.
+    bool Reset();
+
+private:
+    bool Start();
+
+    // Takes an error message off the bus, if there is one, and marks the pipeline as failed.
+    bool CheckForError();
+
+    int m_containerFormat;
+    GstElement* m_pipeline = nullptr;
+    GstElement* m_source = nullptr;
+    GstElement* m_sink = nullptr;
+    bool m_started = false;
+    bool m_failed = false;
+
+    // Decoded data of the last sample not yet returned by Read.
+    std::vector<uint8_t> m_pending;
+    size_t m_pendingOffset = 0;
+};
+
+// Keeps pre-built decode pipelines per container format, and reuses them between streams
+// instead of constructing and tearing down a pipeline for every stream.
+class __attribute__((visibility ("default"))) DecoderPipelinePool final
+{
+public:
+    explicit DecoderPipelinePool(size_t maxIdlePerFormat = 4);
+
+    // Builds pipelines ahead of time, up to 'count' idle pipelines for the format.
+    void Prewarm(int containerFormat, size_t count);
+
+    // Returns a pipeline for the format, ready to accept data. The pipeline goes back to the
+    // pool when the last reference is released.
+    std::shared_ptr<DecoderPipeline> Acquire(int containerFormat);
+
+    // Number of Acquire calls served by an idle pipeline, and by building a new one.
+    uint64_t Hits() const { return m_state->hits; }
+    uint64_t Misses() const { return m_state->misses; }
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        std::map<int, std::vector<std::unique_ptr<DecoderPipeline>>> idle;
+        size_t maxIdlePerFormat;
+        std::atomic<uint64_t> hits{ 0 };
+        std::atomic<uint64_t> misses{ 0 };
+    };
+
+    static void Release(const std::weak_ptr<State>& weakState, DecoderPipeline* pipeline);
+
+    std::shared_ptr<State> m_state;
+};
+
+} } } } // Microsoft::CognitiveServices::Speech::Impl
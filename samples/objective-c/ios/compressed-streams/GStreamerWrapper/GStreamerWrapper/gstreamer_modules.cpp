@@ -7,6 +7,102 @@
 
 #include "gstreamer_modules.h"
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+namespace {
+
+#if defined(TARGET_OS_IPHONE)
+// Static plugins linked into the wrapper. The order matches the plugin table below.
+enum StaticPlugin
+{
+    Coreelements,
+    App,
+    Audioconvert,
+    Audioresample,
+    Audioparsers,
+    Mpg123,
+    Ogg,
+    Opusparse,
+    Opus,
+    Wavparse,
+    Alaw,
+    Mulaw,
+    Flac,
+    StaticPluginCount
+};
+
+using RegisterFunction = void (*)();
+
+const RegisterFunction s_registerFunctions[StaticPluginCount] = {
+    [] { GST_PLUGIN_STATIC_REGISTER(coreelements); },
+    [] { GST_PLUGIN_STATIC_REGISTER(app); },
+    [] { GST_PLUGIN_STATIC_REGISTER(audioconvert); },
+    [] { GST_PLUGIN_STATIC_REGISTER(audioresample); },
+    [] { GST_PLUGIN_STATIC_REGISTER(audioparsers); },
+    [] { GST_PLUGIN_STATIC_REGISTER(mpg123); },
+    [] { GST_PLUGIN_STATIC_REGISTER(ogg); },
+    [] { GST_PLUGIN_STATIC_REGISTER(opusparse); },
+    [] { GST_PLUGIN_STATIC_REGISTER(opus); },
+    [] { GST_PLUGIN_STATIC_REGISTER(wavparse); },
+    [] { GST_PLUGIN_STATIC_REGISTER(alaw); },
+    [] { GST_PLUGIN_STATIC_REGISTER(mulaw); },
+    [] { GST_PLUGIN_STATIC_REGISTER(flac); },
+};
+
+// Plugins every decode pipeline needs: appsrc, queue, audioconvert and audioresample.
+const StaticPlugin s_corePlugins[] = { Coreelements, App, Audioconvert, Audioresample };
+
+const StaticPlugin s_mp3Plugins[] = { Audioparsers, Mpg123 };
+const StaticPlugin s_opusPlugins[] = { Ogg, Opusparse, Opus };
+const StaticPlugin s_flacPlugins[] = { Audioparsers, Flac };
+const StaticPlugin s_alawPlugins[] = { Wavparse, Alaw };
+const StaticPlugin s_mulawPlugins[] = { Wavparse, Mulaw };
+
+std::mutex s_registrationMutex;
+bool s_registered[StaticPluginCount] = {};
+// Time each plugin took to register, for comparing lazy and eager registration.
+uint64_t s_pluginTimeUs[StaticPluginCount] = {};
+uint64_t s_registrationTimeUs = 0;
+
+// Registers the given plugins unless already registered. Must be called with s_registrationMutex held.
+void RegisterPlugins(const StaticPlugin* plugins, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        auto plugin = plugins[i];
+        if (!s_registered[plugin])
+        {
+            auto start = std::chrono::steady_clock::now();
+            s_registerFunctions[plugin]();
+            s_registered[plugin] = true;
+            s_pluginTimeUs[plugin] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            s_registrationTimeUs += s_pluginTimeUs[plugin];
+        }
+    }
+}
+
+template <size_t N>
+void RegisterPlugins(const StaticPlugin (&plugins)[N])
+{
+    RegisterPlugins(plugins, N);
+}
+
+// Registers every plugin, as spx_gst_init does without SPX_GST_LAZY_PLUGIN_REGISTRATION.
+void RegisterAllPlugins()
+{
+    RegisterPlugins(s_corePlugins);
+    RegisterPlugins(s_mp3Plugins);
+    RegisterPlugins(s_opusPlugins);
+    RegisterPlugins(s_flacPlugins);
+    RegisterPlugins(s_alawPlugins);
+    RegisterPlugins(s_mulawPlugins);
+}
+#endif
+
+} // anonymous namespace
+
 namespace Microsoft {
 namespace CognitiveServices {
 namespace Speech {
@@ -14,20 +110,104 @@ namespace Impl {
 
 void spx_gst_init() {
 #if defined(TARGET_OS_IPHONE)
-    GST_PLUGIN_STATIC_REGISTER(coreelements);
-    GST_PLUGIN_STATIC_REGISTER(app);
-    GST_PLUGIN_STATIC_REGISTER(audioconvert);
-    GST_PLUGIN_STATIC_REGISTER(mpg123);
-    GST_PLUGIN_STATIC_REGISTER(audioresample);
-    GST_PLUGIN_STATIC_REGISTER(audioparsers);
-    GST_PLUGIN_STATIC_REGISTER(ogg);
-    GST_PLUGIN_STATIC_REGISTER(opusparse);
-    GST_PLUGIN_STATIC_REGISTER(opus);
-    GST_PLUGIN_STATIC_REGISTER(wavparse);
-    GST_PLUGIN_STATIC_REGISTER(alaw);
-    GST_PLUGIN_STATIC_REGISTER(mulaw);
-    GST_PLUGIN_STATIC_REGISTER(flac);
+    std::lock_guard<std::mutex> lock(s_registrationMutex);
+#if defined(SPX_GST_LAZY_PLUGIN_REGISTRATION)
+    RegisterPlugins(s_corePlugins);
+#else
+    RegisterAllPlugins();
+#endif
 #endif
 }
 
 } } } } // Microsoft::CognitiveServices::Speech::Impl
+
+void spx_gst_register_plugins_for_format(int containerFormat) {
+#if defined(TARGET_OS_IPHONE)
+    std::lock_guard<std::mutex> lock(s_registrationMutex);
+    RegisterPlugins(s_corePlugins);
+    switch (containerFormat)
+    {
+    case SPX_GST_CONTAINER_FORMAT_OGG_OPUS:
+        RegisterPlugins(s_opusPlugins);
+        break;
+    case SPX_GST_CONTAINER_FORMAT_MP3:
+        RegisterPlugins(s_mp3Plugins);
+        break;
+    case SPX_GST_CONTAINER_FORMAT_FLAC:
+        RegisterPlugins(s_flacPlugins);
+        break;
+    case SPX_GST_CONTAINER_FORMAT_ALAW:
+        RegisterPlugins(s_alawPlugins);
+        break;
+    case SPX_GST_CONTAINER_FORMAT_MULAW:
+        RegisterPlugins(s_mulawPlugins);
+        break;
+    default:
+        // Unknown formats may need any decoder.
+        RegisterAllPlugins();
+        break;
+    }
+#else
+    (void)containerFormat;
+#endif
+}
+
+void spx_gst_compare_plugin_registration(int containerFormat, uint64_t* lazyUs, uint64_t* eagerUs) {
+    *lazyUs = 0;
+    *eagerUs = 0;
+#if defined(TARGET_OS_IPHONE)
+    // Registration can't be undone, so both numbers come from the time each plugin took when it was
+    // first registered: the plugins lazy registration needs for the format, and all of them.
+    spx_gst_register_plugins_for_format(containerFormat);
+    std::lock_guard<std::mutex> lock(s_registrationMutex);
+    RegisterAllPlugins();
+
+    bool needed[StaticPluginCount] = {};
+    auto mark = [&needed](const StaticPlugin* plugins, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            needed[plugins[i]] = true;
+        }
+    };
+    mark(s_corePlugins, sizeof(s_corePlugins) / sizeof(s_corePlugins[0]));
+    switch (containerFormat)
+    {
+    case SPX_GST_CONTAINER_FORMAT_OGG_OPUS:
+        mark(s_opusPlugins, sizeof(s_opusPlugins) / sizeof(s_opusPlugins[0]));
+        break;
+    case SPX_GST_CONTAINER_FORMAT_MP3:
+        mark(s_mp3Plugins, sizeof(s_mp3Plugins) / sizeof(s_mp3Plugins[0]));
+        break;
+    case SPX_GST_CONTAINER_FORMAT_FLAC:
+        mark(s_flacPlugins, sizeof(s_flacPlugins) / sizeof(s_flacPlugins[0]));
+        break;
+    case SPX_GST_CONTAINER_FORMAT_ALAW:
+        mark(s_alawPlugins, sizeof(s_alawPlugins) / sizeof(s_alawPlugins[0]));
+        break;
+    case SPX_GST_CONTAINER_FORMAT_MULAW:
+        mark(s_mulawPlugins, sizeof(s_mulawPlugins) / sizeof(s_mulawPlugins[0]));
+        break;
+    default:
+        std::fill(needed, needed + StaticPluginCount, true);
+        break;
+    }
+
+    for (int plugin = 0; plugin < StaticPluginCount; plugin++)
+    {
+        *eagerUs += s_pluginTimeUs[plugin];
+        *lazyUs += needed[plugin] ? s_pluginTimeUs[plugin] : 0;
+    }
+#else
+    (void)containerFormat;
+#endif
+}
+
+uint64_t spx_gst_plugin_registration_time_us() {
+#if defined(TARGET_OS_IPHONE)
+    std::lock_guard<std::mutex> lock(s_registrationMutex);
+    return s_registrationTimeUs;
+#else
+    return 0;
+#endif
+}
@@ -38,6 +38,30 @@ extern "C"
 }
 #endif
 
+// Values of the compressed container formats, matching SPXAudioStreamContainerFormat.
+#define SPX_GST_CONTAINER_FORMAT_OGG_OPUS 0x101
+#define SPX_GST_CONTAINER_FORMAT_MP3 0x102
+#define SPX_GST_CONTAINER_FORMAT_FLAC 0x103
+#define SPX_GST_CONTAINER_FORMAT_ALAW 0x104
+#define SPX_GST_CONTAINER_FORMAT_MULAW 0x105
+#define SPX_GST_CONTAINER_FORMAT_ANY 0x108
+
+extern "C"
+{
+    // Registers the plugins needed to decode the given container format, if not yet registered.
+    // When built with SPX_GST_LAZY_PLUGIN_REGISTRATION, spx_gst_init only registers the plugins shared
+    // by all formats, and applications call this before creating a compressed stream of that format.
+    __attribute__((visibility ("default"))) void spx_gst_register_plugins_for_format(int containerFormat);
+
+    // Total time spent registering plugins so far, in microseconds.
+    __attribute__((visibility ("default"))) uint64_t spx_gst_plugin_registration_time_us();
+
+    // Startup benchmark: registers all plugins, then returns the registration time lazy registration
+    // spends for the format (the shared plugins and the format's own) and the time eager registration
+    // spends (all plugins), in microseconds. Registers every plugin, so call it from benchmarks only.
+    __attribute__((visibility ("default"))) void spx_gst_compare_plugin_registration(int containerFormat, uint64_t* lazyUs, uint64_t* eagerUs);
+}
+
 namespace Microsoft {
 namespace CognitiveServices {
 namespace Speech {
@@ -0,0 +1,145 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// decoder_pool_test.cpp
+//
+// Tests of DecoderPipelinePool against the GStreamer plugins installed on a desktop machine. Build and
+// run from this directory, as one command, on Linux with the GStreamer development packages and the base plugins:
+//
+//   c++ -std=c++14 -I../GStreamerWrapper -o decoder_pool_test decoder_pool_test.cpp
+//       ../GStreamerWrapper/gstreamer_decoder_pool.cpp ../GStreamerWrapper/gstreamer_modules.cpp
+//       $(pkg-config --cflags --libs gstreamer-app-1.0)
+//   ./decoder_pool_test
+//
+
+#include "gstreamer_decoder_pool.h"
+#include "gstreamer_modules.h"
+
+#include <gst/app/gstappsink.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::CognitiveServices::Speech::Impl;
+
+namespace {
+
+int s_failures = 0;
+
+void Check(bool condition, const char* what)
+{
+    std::printf("%s: %s\n", condition ? "PASS" : "FAIL", what);
+    if (!condition)
+    {
+        s_failures++;
+    }
+}
+
+// Encodes a second of a sine tone as Ogg Opus with the installed encoder.
+std::vector<uint8_t> EncodeOggOpus(int frequency)
+{
+    auto description = "audiotestsrc num-buffers=50 samplesperbuffer=960 freq=" + std::to_string(frequency) +
+        " ! audio/x-raw,rate=48000,channels=1 ! opusenc ! oggmux ! appsink name=sink sync=false";
+    auto pipeline = gst_parse_launch(description.c_str(), nullptr);
+    auto sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    std::vector<uint8_t> encoded;
+    while (auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink)))
+    {
+        GstMapInfo map;
+        auto buffer = gst_sample_get_buffer(sample);
+        if (gst_buffer_map(buffer, &map, GST_MAP_READ))
+        {
+            encoded.insert(encoded.end(), map.data, map.data + map.size);
+            gst_buffer_unmap(buffer, &map);
+        }
+        gst_sample_unref(sample);
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return encoded;
+}
+
+// Writes the stream to the pipeline and returns the number of bytes of PCM that come out.
+size_t Decode(DecoderPipeline& pipeline, const std::vector<uint8_t>& stream)
+{
+    pipeline.Write(stream.data(), stream.size());
+    pipeline.EndOfStream();
+
+    size_t decoded = 0;
+    uint8_t buffer[4096];
+    while (auto count = pipeline.Read(buffer, sizeof(buffer)))
+    {
+        decoded += count;
+    }
+    return decoded;
+}
+
+// Two streams in a row on one pooled Opus pipeline: oggdemux adds a new source pad for the second
+// stream, which has to be linked again for any audio to come out.
+void TestOpusPipelineIsReusable()
+{
+    auto first = EncodeOggOpus(440);
+    auto second = EncodeOggOpus(880);
+    Check(!first.empty() && !second.empty(), "Ogg Opus test streams encoded");
+
+    DecoderPipelinePool pool(1);
+    DecoderPipeline* firstPipeline = nullptr;
+    size_t firstDecoded = 0;
+    {
+        auto pipeline = pool.Acquire(SPX_GST_CONTAINER_FORMAT_OGG_OPUS);
+        firstPipeline = pipeline.get();
+        firstDecoded = Decode(*pipeline, first);
+    }
+
+    auto pipeline = pool.Acquire(SPX_GST_CONTAINER_FORMAT_OGG_OPUS);
+    Check(pipeline.get() == firstPipeline && pool.Hits() == 1, "second stream gets the pooled Opus pipeline");
+    auto secondDecoded = Decode(*pipeline, second);
+
+    // A second of 16 kHz, 16 bit mono PCM is 32000 bytes; the encoder's padding may trim a little.
+    Check(firstDecoded > 30000, "first stream decodes");
+    Check(secondDecoded > 30000, "second stream decodes on the reused pipeline");
+}
+
+// A stream oggdemux can't demultiplex posts an error and never reaches the end of the stream. Read
+// has to return instead of waiting forever, and the pipeline must not go back to the pool.
+void TestReadReturnsOnDecoderError()
+{
+    DecoderPipelinePool pool(1);
+    std::vector<uint8_t> garbage(4096, 0x5A);
+    {
+        auto pipeline = pool.Acquire(SPX_GST_CONTAINER_FORMAT_OGG_OPUS);
+        auto decoded = std::async(std::launch::async, [&pipeline, &garbage]() { return Decode(*pipeline, garbage); });
+        auto ready = decoded.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+        Check(ready, "Read returns after a decoder error");
+        if (!ready)
+        {
+            // The reading thread can't be stopped; don't wait for it.
+            std::fflush(stdout);
+            std::_Exit(1);
+        }
+        Check(decoded.get() == 0 && pipeline->Failed(), "the pipeline is marked as failed");
+    }
+
+    auto pipeline = pool.Acquire(SPX_GST_CONTAINER_FORMAT_OGG_OPUS);
+    Check(pool.Hits() == 0 && pool.Misses() == 2, "a failed pipeline is not reused");
+}
+
+} // anonymous namespace
+
+int main()
+{
+    gst_init(nullptr, nullptr);
+    TestOpusPipelineIsReusable();
+    TestReadReturnsOnDecoderError();
+    std::printf("%d failure(s)\n", s_failures);
+    return s_failures == 0 ? 0 : 1;
+}